@@ -0,0 +1,20 @@
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE migrate_src (id int, pad char(600));
+CREATE TABLE migrate_dst (id int PRIMARY KEY);
+INSERT INTO migrate_src SELECT g, 'x' FROM generate_series(1, 3) g;
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'test_decoding');
+
+-- rows written by a migration are tagged, and can be left out
+BEGIN;
+INSERT INTO migrate_dst VALUES (100);
+SELECT pg_migrate_copy(0, 'migrate_src', 'migrate_dst');
+COMMIT;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1');
+SELECT data FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'skip-migration', '1');
+
+SELECT pg_drop_replication_slot('regression_slot');
+DROP TABLE migrate_src, migrate_dst;
@@ -36,6 +36,7 @@ typedef struct
 	bool		skip_empty_xacts;
 	bool		xact_wrote_changes;
 	bool		only_local;
+	bool		skip_migration;
 } TestDecodingData;
 
 static void pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
@@ -58,6 +59,7 @@ static void pg_decode_truncate(LogicalDecodingContext *ctx,
 				   ReorderBufferChange *change);
 static bool pg_decode_filter(LogicalDecodingContext *ctx,
 				 RepOriginId origin_id);
+static bool pg_decode_filter_migration(LogicalDecodingContext *ctx);
 static void pg_decode_message(LogicalDecodingContext *ctx,
 				  ReorderBufferTXN *txn, XLogRecPtr message_lsn,
 				  bool transactional, const char *prefix,
@@ -83,6 +85,7 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->filter_by_origin_cb = pg_decode_filter;
 	cb->shutdown_cb = pg_decode_shutdown;
 	cb->message_cb = pg_decode_message;
+	cb->filter_migration_cb = pg_decode_filter_migration;
 }
 
 
@@ -102,6 +105,7 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 	data->include_timestamp = false;
 	data->skip_empty_xacts = false;
 	data->only_local = false;
+	data->skip_migration = false;
 
 	ctx->output_plugin_private = data;
 
@@ -172,6 +176,17 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
 								strVal(elem->arg), elem->defname)));
 		}
+		else if (strcmp(elem->defname, "skip-migration") == 0)
+		{
+
+			if (elem->arg == NULL)
+				data->skip_migration = true;
+			else if (!parse_bool(strVal(elem->arg), &data->skip_migration))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+								strVal(elem->arg), elem->defname)));
+		}
 		else if (strcmp(elem->defname, "include-rewrites") == 0)
 		{
 
@@ -262,6 +277,14 @@ pg_decode_filter(LogicalDecodingContext *ctx,
 	return false;
 }
 
+static bool
+pg_decode_filter_migration(LogicalDecodingContext *ctx)
+{
+	TestDecodingData *data = ctx->output_plugin_private;
+
+	return data->skip_migration;
+}
+
 /*
  * Print literal `outputstr' already represented as string of type `typid'
  * into stringbuf `s'.
@@ -437,7 +460,10 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	switch (change->action)
 	{
 		case REORDER_BUFFER_CHANGE_INSERT:
-			appendStringInfoString(ctx->out, " INSERT:");
+			if (change->data.tp.is_migration)
+				appendStringInfoString(ctx->out, " INSERT (migration):");
+			else
+				appendStringInfoString(ctx->out, " INSERT:");
 			if (change->data.tp.newtuple == NULL)
 				appendStringInfoString(ctx->out, " (no-tuple-data)");
 			else
@@ -464,7 +490,10 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 									false);
 			break;
 		case REORDER_BUFFER_CHANGE_DELETE:
-			appendStringInfoString(ctx->out, " DELETE:");
+			if (change->data.tp.is_migration)
+				appendStringInfoString(ctx->out, " DELETE (migration):");
+			else
+				appendStringInfoString(ctx->out, " DELETE:");
 
 			/* if there was no PK, we only know that a delete happened */
 			if (change->data.tp.oldtuple == NULL)
@@ -41,10 +41,12 @@
 #include "access/bufmask.h"
 #include "access/heapam.h"
 #include "access/heapam_xlog.h"
+#include "access/heapversion.h"
 #include "access/hio.h"
 #include "access/multixact.h"
 #include "access/parallel.h"
 #include "access/relscan.h"
+#include "access/rewritetrack.h"
 #include "access/sysattr.h"
 #include "access/transam.h"
 #include "access/tuptoaster.h"
@@ -71,6 +73,7 @@
 #include "utils/datum.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/migrate_schema.h"
 #include "utils/relcache.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
@@ -259,7 +262,11 @@ initscan(HeapScanDesc scan, ScanKey key, bool keep_startblock)
 	else
 		allow_strat = allow_sync = false;
 
-	if (allow_strat)
+	if (scan->rs_migrate)
+	{
+		/* heap_setmigratescan chose the strategy, whatever the size */
+	}
+	else if (allow_strat)
 	{
 		/* During a rescan, keep the previous strategy object. */
 		if (scan->rs_strategy == NULL)
@@ -271,6 +278,7 @@ initscan(HeapScanDesc scan, ScanKey key, bool keep_startblock)
 			FreeAccessStrategy(scan->rs_strategy);
 		scan->rs_strategy = NULL;
 	}
+	scan->rs_prefetch_next = InvalidBlockNumber;
 
 	if (scan->rs_parallel != NULL)
 	{
@@ -321,6 +329,75 @@ initscan(HeapScanDesc scan, ScanKey key, bool keep_startblock)
 		pgstat_count_heap_scan(scan->rs_rd);
 }
 
+/*
+ * heap_setmigratescan - mark a heapscan as feeding a migration
+ *
+ * A migration drains a whole table through shared buffers once, so its
+ * reads go through a small ring like VACUUM's, whatever the size of the
+ * table, rather than evicting everyone else's pages.  The ring also takes
+ * the pages a two-way migration dirties.  Blocks the migration still has
+ * tuples to take from are prefetched ahead of the scan.
+ */
+void
+heap_setmigratescan(HeapScanDesc scan)
+{
+	Assert(!scan->rs_inited);	/* else too late to change */
+
+	if (scan->rs_strategy != NULL)
+		FreeAccessStrategy(scan->rs_strategy);
+	scan->rs_strategy = GetAccessStrategy(BAS_VACUUM);
+	scan->rs_migrate = true;
+	scan->rs_prefetch_next = InvalidBlockNumber;
+}
+
+/*
+ * heap_migrate_prefetch - prefetch ahead of a migration scan
+ *
+ * Issue prefetches for the next target_prefetch_pages blocks after page
+ * that the migration has not drained yet, as far as its bitmap tells.
+ * Blocks it has drained are not worth reading ahead: the scan passes over
+ * them unread, or reads them only for the snapshot-conflict checks (see
+ * heap_migrate_skippable).
+ */
+static void
+heap_migrate_prefetch(HeapScanDesc scan, BlockNumber page)
+{
+#ifdef USE_PREFETCH
+	BlockNumber stop;
+
+	if (target_prefetch_pages <= 0 || scan->rs_parallel != NULL)
+		return;
+
+	stop = Min((uint64) page + target_prefetch_pages + 1,
+			   (uint64) scan->rs_nblocks);
+	if (scan->rs_prefetch_next == InvalidBlockNumber ||
+		scan->rs_prefetch_next <= page)
+		scan->rs_prefetch_next = page + 1;
+
+	for (; scan->rs_prefetch_next < stop; scan->rs_prefetch_next++)
+	{
+		if (MigrateBlockHasUnmigrated(scan->rs_rd, scan->rs_prefetch_next))
+			PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM, scan->rs_prefetch_next);
+	}
+#endif							/* USE_PREFETCH */
+}
+
+/*
+ * heap_migrate_skippable - can a migration scan pass over a block unread?
+ *
+ * Every tuple of a block the migration has drained would be skipped anyway,
+ * so under READ COMMITTED the scan passes over the block without reading
+ * it, which keeps batch reruns from rereading the front of the table.
+ * Under REPEATABLE READ and SERIALIZABLE the block is still read, so that
+ * MigrateTuple notices tuples migrated after our snapshot was taken.
+ */
+static bool
+heap_migrate_skippable(HeapScanDesc scan, BlockNumber page)
+{
+	return !IsolationUsesXactSnapshot() &&
+		!MigrateBlockHasUnmigrated(scan->rs_rd, page);
+}
+
 /*
  * heap_setscanlimits - restrict range of a heapscan
  *
@@ -375,6 +452,9 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	CHECK_FOR_INTERRUPTS();
 
+	if (scan->rs_migrate)
+		heap_migrate_prefetch(scan, page);
+
 	/* read page using selected strategy */
 	scan->rs_cbuf = ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
 									   RBM_NORMAL, scan->rs_strategy);
@@ -1005,11 +1085,19 @@ heapgettup_pagemode(HeapScanDesc scan,
 		}
 		else
 		{
-			page++;
-			if (page >= scan->rs_nblocks)
-				page = 0;
-			finished = (page == scan->rs_startblock) ||
-				(scan->rs_numblocks != InvalidBlockNumber ? --scan->rs_numblocks == 0 : false);
+			/*
+			 * A migration scan passes over blocks the migration has drained
+			 * without reading them.
+			 */
+			do
+			{
+				page++;
+				if (page >= scan->rs_nblocks)
+					page = 0;
+				finished = (page == scan->rs_startblock) ||
+					(scan->rs_numblocks != InvalidBlockNumber ? --scan->rs_numblocks == 0 : false);
+			} while (!finished && scan->rs_migrate &&
+					 heap_migrate_skippable(scan, page));
 
 			/*
 			 * Report our new scan position for synchronization purposes. We
@@ -1479,6 +1567,7 @@ heap_beginscan_internal(Relation relation, Snapshot snapshot,
 	scan->rs_bitmapscan = is_bitmapscan;
 	scan->rs_samplescan = is_samplescan;
 	scan->rs_strategy = NULL;	/* set in initscan */
+	scan->rs_migrate = false;
 	scan->rs_allow_strat = allow_strat;
 	scan->rs_allow_sync = allow_sync;
 	scan->rs_temp_snap = temp_snap;
@@ -1506,6 +1595,10 @@ heap_beginscan_internal(Relation relation, Snapshot snapshot,
 	/* we only need to set this up once */
 	scan->rs_ctup.t_tableOid = RelationGetRelid(relation);
 
+	/* tuples of older schema versions are converted as they are returned */
+	scan->rs_versions = RelationGetSchemaVersionInfo(relation);
+	scan->rs_versioncxt = NULL;
+
 	/*
 	 * we do this here instead of in initscan() because heap_rescan also calls
 	 * initscan() and we don't want to allocate memory again
@@ -1593,6 +1686,9 @@ heap_endscan(HeapScanDesc scan)
 	if (scan->rs_temp_snap)
 		UnregisterSnapshot(scan->rs_snapshot);
 
+	if (scan->rs_versioncxt)
+		MemoryContextDelete(scan->rs_versioncxt);
+
 	pfree(scan);
 }
 
@@ -1858,6 +1954,9 @@ heap_getnext(HeapScanDesc scan, ScanDirection direction)
 
 	pgstat_count_heap_getnext(scan->rs_rd);
 
+	if (scan->rs_versions)
+		heap_scan_upgrade_tuple(scan);
+
 	return &(scan->rs_ctup);
 }
 
@@ -2486,6 +2585,9 @@ heap_insert(Relation relation, HeapTuple tup, CommandId cid,
 	 */
 	CheckForSerializableConflictIn(relation, NULL, InvalidBuffer);
 
+	/* the tuple must fit the bitmaps of any migration reading the relation */
+	MigrateCheckNewVersion(relation, buffer);
+
 	/* NO EREPORT(ERROR) from here till changes are logged */
 	START_CRIT_SECTION();
 
@@ -2513,6 +2615,7 @@ heap_insert(Relation relation, HeapTuple tup, CommandId cid,
 	 */
 
 	MarkBufferDirty(buffer);
+	RewriteTrackNoteChange(relation, BufferGetBlockNumber(buffer));
 
 	/* XLOG stuff */
 	if (!(options & HEAP_INSERT_SKIP_WAL) && RelationNeedsWAL(relation))
@@ -2549,6 +2652,8 @@ heap_insert(Relation relation, HeapTuple tup, CommandId cid,
 			xlrec.flags |= XLH_INSERT_ALL_VISIBLE_CLEARED;
 		if (options & HEAP_INSERT_SPECULATIVE)
 			xlrec.flags |= XLH_INSERT_IS_SPECULATIVE;
+		if (migrateflag)
+			xlrec.flags |= XLH_INSERT_IS_MIGRATION;
 		Assert(ItemPointerGetBlockNumber(&heaptup->t_self) == BufferGetBlockNumber(buffer));
 
 		/*
@@ -2596,6 +2701,9 @@ heap_insert(Relation relation, HeapTuple tup, CommandId cid,
 	if (vmbuffer != InvalidBuffer)
 		ReleaseBuffer(vmbuffer);
 
+	/* a tuple inserted into a table being migrated starts unmigrated */
+	MigrateClaimNewVersion(relation, &heaptup->t_self);
+
 	/*
 	 * If tuple is cachable, mark it for invalidation from the caches in case
 	 * we abort.  Note it is OK to do this after releasing the buffer, because
@@ -2671,6 +2779,8 @@ heap_prepare_insert(Relation relation, HeapTuple tup, TransactionId xid,
 	tup->t_data->t_infomask &= ~(HEAP_XACT_MASK);
 	tup->t_data->t_infomask2 &= ~(HEAP2_XACT_MASK);
 	tup->t_data->t_infomask |= HEAP_XMAX_INVALID;
+	HeapTupleHeaderSetSchemaVersion(tup->t_data,
+									RelationGetSchemaVersion(relation));
 	HeapTupleHeaderSetXmin(tup->t_data, xid);
 	if (options & HEAP_INSERT_FROZEN)
 		HeapTupleHeaderSetXminFrozen(tup->t_data);
@@ -2779,12 +2889,16 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 										   &vmbuffer, NULL);
 		page = BufferGetPage(buffer);
 
+		/* the tuples must fit the bitmaps of any migration reading us */
+		MigrateCheckNewVersion(relation, buffer);
+
 		/* NO EREPORT(ERROR) from here till changes are logged */
 		START_CRIT_SECTION();
 
 		/*
 		 * RelationGetBufferForTuple has ensured that the first tuple fits.
-		 * Put that on the page, and then as many other tuples as fit.
+		 * Put that on the page, and then as many other tuples as fit, in
+		 * space and in the migration bitmaps.
 		 */
 		RelationPutHeapTuple(relation, buffer, heaptuples[ndone], false);
 		for (nthispage = 1; ndone + nthispage < ntuples; nthispage++)
@@ -2793,6 +2907,8 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 
 			if (PageGetHeapFreeSpace(page) < MAXALIGN(heaptup->t_len) + saveFreeSpace)
 				break;
+			if (!MigrateNewVersionFits(relation, buffer))
+				break;
 
 			RelationPutHeapTuple(relation, buffer, heaptup, false);
 
@@ -2818,6 +2934,7 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 		 */
 
 		MarkBufferDirty(buffer);
+		RewriteTrackNoteChange(relation, BufferGetBlockNumber(buffer));
 
 		/* XLOG stuff */
 		if (needwal)
@@ -2855,6 +2972,8 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 			tupledata = scratchptr;
 
 			xlrec->flags = all_visible_cleared ? XLH_INSERT_ALL_VISIBLE_CLEARED : 0;
+			if (migrateflag)
+				xlrec->flags |= XLH_INSERT_IS_MIGRATION;
 			xlrec->ntuples = nthispage;
 
 			/*
@@ -2932,6 +3051,9 @@ heap_multi_insert(Relation relation, HeapTuple *tuples, int ntuples,
 		if (vmbuffer != InvalidBuffer)
 			ReleaseBuffer(vmbuffer);
 
+		for (i = ndone; i < ndone + nthispage; i++)
+			MigrateClaimNewVersion(relation, &heaptuples[i]->t_self);
+
 		ndone += nthispage;
 	}
 
@@ -3091,6 +3213,16 @@ heap_delete(Relation relation, ItemPointer tid,
 				(errcode(ERRCODE_INVALID_TRANSACTION_STATE),
 				 errmsg("cannot delete tuples during a parallel operation")));
 
+	/* exclude a concurrent migration of the tuple, if any */
+	MigrateClaimOldVersion(relation, tid);
+
+	/*
+	 * Make sure the relcache has loaded the schema version history, which is
+	 * consulted below to take the old tuple apart; it must not do catalog
+	 * accesses while we hold the buffer lock.
+	 */
+	(void) RelationGetSchemaVersionInfo(relation);
+
 	block = ItemPointerGetBlockNumber(tid);
 	buffer = ReadBuffer(relation, block);
 	page = BufferGetPage(buffer);
@@ -3333,6 +3465,7 @@ l1:
 		HeapTupleHeaderSetMovedPartitions(tp.t_data);
 
 	MarkBufferDirty(buffer);
+	RewriteTrackNoteChange(relation, BufferGetBlockNumber(buffer));
 
 	/*
 	 * XLOG stuff
@@ -3354,6 +3487,8 @@ l1:
 			xlrec.flags |= XLH_DELETE_ALL_VISIBLE_CLEARED;
 		if (changingPart)
 			xlrec.flags |= XLH_DELETE_IS_PARTITION_MOVE;
+		if (migrateflag)
+			xlrec.flags |= XLH_DELETE_IS_MIGRATION;
 		xlrec.infobits_set = compute_infobits(tp.t_data->t_infomask,
 											  tp.t_data->t_infomask2);
 		xlrec.offnum = ItemPointerGetOffsetNumber(&tp.t_self);
@@ -3572,6 +3707,17 @@ heap_update(Relation relation, ItemPointer otid, HeapTuple newtup,
 				(errcode(ERRCODE_INVALID_TRANSACTION_STATE),
 				 errmsg("cannot update tuples during a parallel operation")));
 
+	/* exclude a concurrent migration of the tuple, if any */
+	MigrateClaimOldVersion(relation, otid);
+
+	/*
+	 * The new tuple is always written under the current schema version.  This
+	 * also makes sure the relcache has loaded the version history, which is
+	 * consulted below to take the old tuple apart.
+	 */
+	HeapTupleHeaderSetSchemaVersion(newtup->t_data,
+									RelationGetSchemaVersion(relation));
+
 	/*
 	 * Fetch the list of attributes to be checked for various operations.
 	 *
@@ -4248,6 +4394,9 @@ l2:
 										   bms_overlap(modified_attrs, id_attrs),
 										   &old_key_copied);
 
+	/* the new version must fit the bitmaps of any migration reading us */
+	MigrateCheckNewVersion(relation, newbuf);
+
 	/* NO EREPORT(ERROR) from here till changes are logged */
 	START_CRIT_SECTION();
 
@@ -4315,8 +4464,12 @@ l2:
 	}
 
 	if (newbuf != buffer)
+	{
 		MarkBufferDirty(newbuf);
+		RewriteTrackNoteChange(relation, BufferGetBlockNumber(newbuf));
+	}
 	MarkBufferDirty(buffer);
+	RewriteTrackNoteChange(relation, BufferGetBlockNumber(buffer));
 
 	/* XLOG stuff */
 	if (RelationNeedsWAL(relation))
@@ -4378,6 +4531,9 @@ l2:
 
 	pgstat_count_heap_update(relation, use_hot_update);
 
+	/* the new version starts unmigrated */
+	MigrateClaimNewVersion(relation, &heaptup->t_self);
+
 	/*
 	 * If heaptup is a private copy, release it.  Don't forget to copy t_self
 	 * back to the caller's image, too.
@@ -4575,6 +4731,15 @@ HeapDetermineModifiedColumns(Relation relation, Bitmapset *interesting_cols,
 	int			attnum;
 	Bitmapset  *modified = NULL;
 
+	/*
+	 * If the old tuple predates a lazy ALTER COLUMN TYPE, some of its columns
+	 * are stored as a different type and can't be compared; consider all of
+	 * them modified.
+	 */
+	if (HeapTupleHeaderGetSchemaVersion(oldtup->t_data) !=
+		HeapTupleHeaderGetSchemaVersion(newtup->t_data))
+		return bms_copy(interesting_cols);
+
 	while ((attnum = bms_first_member(interesting_cols)) >= 0)
 	{
 		attnum += FirstLowInvalidHeapAttributeNumber;
@@ -8052,6 +8217,7 @@ ExtractReplicaIdentity(Relation relation, HeapTuple tp, bool key_changed, bool *
 	Relation	idx_rel;
 	char		replident = relation->rd_rel->relreplident;
 	HeapTuple	key_tuple = NULL;
+	SchemaVersionInfo *versions;
 	bool		nulls[MaxHeapAttributeNumber];
 	Datum		values[MaxHeapAttributeNumber];
 	int			natt;
@@ -8064,6 +8230,18 @@ ExtractReplicaIdentity(Relation relation, HeapTuple tp, bool key_changed, bool *
 	if (replident == REPLICA_IDENTITY_NOTHING)
 		return NULL;
 
+	/*
+	 * Decoding interprets the logged tuple with the current row type, so a
+	 * tuple that predates a lazy ALTER COLUMN TYPE must be converted first.
+	 */
+	versions = RelationGetSchemaVersionInfo(relation);
+	if (versions != NULL &&
+		HeapTupleHeaderGetSchemaVersion(tp->t_data) != versions->current)
+	{
+		tp = heap_upgrade_tuple(tp, versions);
+		*copy = true;
+	}
+
 	if (replident == REPLICA_IDENTITY_FULL)
 	{
 		/*
@@ -0,0 +1,467 @@
+/*-------------------------------------------------------------------------
+ *
+ * heapversion.c
+ *	  Heap tuple schema versioning, used by lazy ALTER COLUMN TYPE.
+ *
+ * When ALTER TABLE changes a column's type through an implicit, immutable
+ * cast, it can avoid rewriting the table: it records the old type in
+ * pg_attribute_version under a new schema version and leaves the existing
+ * tuples alone.  Tuples written from then on are stamped with the new
+ * version in their header.  Readers use the information built here to
+ * deform a tuple of an older version according to the row type it was
+ * written with, apply the recorded casts, and form a tuple of the current
+ * row type.  Old-version tuples are thus upgraded when they are next
+ * updated, or by an explicit pg_upgrade_tuple_versions() pass.
+ *
+ * A lazy ADD COLUMN with a volatile default leaves the older rows alone as
+ * well; they are simply shorter than the row type.  This file only keeps
+ * track of which columns those are, since filling them in takes the
+ * executor.
+ *
+ * Only the two spare bits of t_infomask2 are available for the version, so
+ * a relation can go through at most MaxSchemaVersion lazy type changes
+ * before ALTER TABLE falls back to a rewrite, which forgets the history.
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/heap/heapversion.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/heapversion.h"
+#include "access/htup_details.h"
+#include "catalog/catalog.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_attribute_version.h"
+#include "miscadmin.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+/*
+ * BuildSchemaVersionInfo
+ *
+ * Load the schema version history of relid and prepare to convert tuples
+ * of every older version to the given row type, and note the columns whose
+ * default is filled in lazily.  Returns NULL if the relation has no history,
+ * in which case all its tuples are current and complete.
+ *
+ * The result lives in a memory context of its own, which is made a child
+ * of "parent" only once it has been completely built.
+ */
+SchemaVersionInfo *
+BuildSchemaVersionInfo(Oid relid, TupleDesc tupdesc, MemoryContext parent)
+{
+	SchemaVersionInfo *info;
+	MemoryContext cxt;
+	MemoryContext oldcxt;
+	Relation	avrel;
+	ScanKeyData key;
+	SysScanDesc scan;
+	HeapTuple	tuple;
+	List	   *history = NIL;
+	Bitmapset  *lazydefaults = NULL;
+	int			current = 0;
+	int			version;
+
+	avrel = heap_open(AttributeVersionRelationId, AccessShareLock);
+
+	ScanKeyInit(&key,
+				Anum_pg_attribute_version_avrelid,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(relid));
+	scan = systable_beginscan(avrel, AttributeVersionIndexId, true,
+							  NULL, 1, &key);
+
+	/* the index returns the rows in (avversion, avattnum) order */
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		Form_pg_attribute_version avform;
+
+		avform = (Form_pg_attribute_version) GETSTRUCT(tuple);
+
+		/* rows without a type record columns with a lazy default */
+		if (!OidIsValid(avform->avtypid))
+		{
+			lazydefaults = bms_add_member(lazydefaults, avform->avattnum);
+			continue;
+		}
+
+		avform = (Form_pg_attribute_version) palloc(sizeof(FormData_pg_attribute_version));
+		memcpy(avform, GETSTRUCT(tuple), sizeof(FormData_pg_attribute_version));
+		history = lappend(history, avform);
+		current = avform->avversion;
+	}
+
+	systable_endscan(scan);
+	heap_close(avrel, AccessShareLock);
+
+	if (history == NIL && lazydefaults == NULL)
+		return NULL;
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"schema version info",
+								ALLOCSET_SMALL_SIZES);
+	oldcxt = MemoryContextSwitchTo(cxt);
+
+	info = (SchemaVersionInfo *) palloc0(sizeof(SchemaVersionInfo));
+	info->context = cxt;
+	info->current = current;
+	info->tupdesc = CreateTupleDescCopyConstr(tupdesc);
+	info->lazydefaults = bms_copy(lazydefaults);
+
+	if (info->current < 0 || info->current > MaxSchemaVersion)
+		elog(ERROR, "invalid schema version %d for relation %u",
+			 info->current, relid);
+
+	for (version = 0; version < info->current; version++)
+	{
+		SchemaVersion *sv = &info->versions[version];
+		AttrNumber	attnum;
+
+		sv->tupdesc = CreateTupleDescCopyConstr(tupdesc);
+		sv->casts = (SchemaVersionCast *)
+			palloc(list_length(history) * sizeof(SchemaVersionCast));
+		sv->ncasts = 0;
+
+		for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+		{
+			Form_pg_attribute attr = TupleDescAttr(sv->tupdesc, attnum - 1);
+			bool		first = true;
+			ListCell   *lc;
+
+			/*
+			 * Tuples of this version store the column as the old type of the
+			 * first later change to it; each later change then contributes
+			 * one cast step, in version order.
+			 */
+			foreach(lc, history)
+			{
+				Form_pg_attribute_version avform = lfirst(lc);
+				SchemaVersionCast *cast;
+
+				if (avform->avattnum != attnum || avform->avversion <= version)
+					continue;
+
+				if (first)
+				{
+					attr->atttypid = avform->avtypid;
+					attr->atttypmod = avform->avtypmod;
+					attr->attcollation = avform->avcollation;
+					get_typlenbyvalalign(avform->avtypid, &attr->attlen,
+										 &attr->attbyval, &attr->attalign);
+					attr->attstorage = get_typstorage(avform->avtypid);
+					first = false;
+				}
+
+				cast = &sv->casts[sv->ncasts++];
+				cast->attnum = attnum;
+				cast->collation = avform->avcollation;
+				fmgr_info(avform->avcastfunc, &cast->flinfo);
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextSetParent(cxt, parent);
+
+	list_free_deep(history);
+	bms_free(lazydefaults);
+
+	return info;
+}
+
+/*
+ * FreeSchemaVersionInfo
+ */
+void
+FreeSchemaVersionInfo(SchemaVersionInfo *info)
+{
+	MemoryContextDelete(info->context);
+}
+
+/*
+ * RelationGetSchemaVersionInfo
+ *
+ * Returns the relcache's schema version info for the relation, loading it
+ * on first use, or NULL if all of the relation's tuples are current.  Only
+ * plain user tables can have a history, so other relations never consult
+ * the catalog.
+ *
+ * The result is kept across relcache rebuilds as long as the row type and
+ * the relfilenode stay the same, so a scan may hold on to it.
+ */
+SchemaVersionInfo *
+RelationGetSchemaVersionInfo(Relation relation)
+{
+	if (!relation->rd_versionsvalid)
+	{
+		if (relation->rd_rel->relkind == RELKIND_RELATION &&
+			!IsCatalogRelation(relation) &&
+			RelationGetRelid(relation) >= FirstNormalObjectId &&
+			!IsBootstrapProcessingMode())
+			relation->rd_versions =
+				BuildSchemaVersionInfo(RelationGetRelid(relation),
+									   RelationGetDescr(relation),
+									   CacheMemoryContext);
+		relation->rd_versionsvalid = true;
+	}
+
+	return relation->rd_versions;
+}
+
+/*
+ * RelationGetSchemaVersion
+ *
+ * Returns the version to stamp on tuples written to the relation.
+ */
+int
+RelationGetSchemaVersion(Relation relation)
+{
+	SchemaVersionInfo *info = RelationGetSchemaVersionInfo(relation);
+
+	return info ? info->current : 0;
+}
+
+/*
+ * RelationHasLazyDefaults
+ *
+ * Does the relation have columns added with a volatile default that is
+ * filled in only when the older rows are first read?
+ */
+bool
+RelationHasLazyDefaults(Relation relation)
+{
+	SchemaVersionInfo *info = RelationGetSchemaVersionInfo(relation);
+
+	return info != NULL && !bms_is_empty(info->lazydefaults);
+}
+
+/*
+ * RelationIdHasLazyDefaults
+ *
+ * Same as above, for callers that have only the OID of a relation they
+ * already hold a lock on.
+ */
+bool
+RelationIdHasLazyDefaults(Oid relid)
+{
+	Relation	relation;
+	bool		result;
+
+	relation = RelationIdGetRelation(relid);
+	if (!RelationIsValid(relation))
+		return false;
+	result = RelationHasLazyDefaults(relation);
+	RelationClose(relation);
+
+	return result;
+}
+
+/*
+ * RelationGetTupleVersionDescr
+ *
+ * Returns the descriptor that matches the physical layout of a tuple of
+ * the relation, which is the relation's own descriptor unless the tuple
+ * predates a lazy ALTER COLUMN TYPE.
+ */
+TupleDesc
+RelationGetTupleVersionDescr(Relation relation, HeapTupleHeader tup)
+{
+	SchemaVersionInfo *info = RelationGetSchemaVersionInfo(relation);
+	int			version;
+
+	if (info == NULL)
+		return RelationGetDescr(relation);
+
+	version = HeapTupleHeaderGetSchemaVersion(tup);
+	if (version == info->current)
+		return RelationGetDescr(relation);
+	if (version > info->current)
+		elog(ERROR, "tuple has schema version %d, but relation is at version %d",
+			 version, info->current);
+
+	return info->versions[version].tupdesc;
+}
+
+/*
+ * heap_upgrade_tuple
+ *
+ * Convert a tuple written under an older schema version to the current row
+ * type described by info.  The result is palloc'd in the current memory
+ * context, and carries over the header fields of the original, including
+ * its visibility information and item pointers.  A tuple that is already
+ * current is returned as is.
+ */
+HeapTuple
+heap_upgrade_tuple(HeapTuple tuple, SchemaVersionInfo *info)
+{
+	TupleDesc	tupdesc = info->tupdesc;
+	HeapTupleHeader td = tuple->t_data;
+	SchemaVersion *sv;
+	HeapTuple	newtup;
+	Datum	   *values;
+	bool	   *isnull;
+	int			version;
+	int			i;
+
+	version = HeapTupleHeaderGetSchemaVersion(td);
+	if (version == info->current)
+		return tuple;
+	if (version > info->current)
+		elog(ERROR, "tuple has schema version %d, but relation is at version %d",
+			 version, info->current);
+	sv = &info->versions[version];
+
+	values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+	isnull = (bool *) palloc(tupdesc->natts * sizeof(bool));
+
+	heap_deform_tuple(tuple, sv->tupdesc, values, isnull);
+
+	for (i = 0; i < sv->ncasts; i++)
+	{
+		SchemaVersionCast *cast = &sv->casts[i];
+		int			off = cast->attnum - 1;
+
+		if (!isnull[off] && !TupleDescAttr(tupdesc, off)->attisdropped)
+			values[off] = FunctionCall1Coll(&cast->flinfo, cast->collation,
+											values[off]);
+	}
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		if (TupleDescAttr(tupdesc, i)->attisdropped)
+			isnull[i] = true;
+	}
+
+	newtup = heap_form_tuple(tupdesc, values, isnull);
+	heap_copy_tuple_identity(newtup, tuple);
+	HeapTupleHeaderSetSchemaVersion(newtup->t_data, info->current);
+
+	pfree(values);
+	pfree(isnull);
+
+	return newtup;
+}
+
+/*
+ * heap_copy_tuple_identity
+ *
+ * Make a tuple just formed from the values of another one stand in for it:
+ * copy over the visibility information, item pointers and OID.
+ */
+void
+heap_copy_tuple_identity(HeapTuple newtup, HeapTuple tuple)
+{
+	HeapTupleHeader td = tuple->t_data;
+
+	memcpy(&newtup->t_data->t_choice.t_heap, &td->t_choice.t_heap,
+		   sizeof(HeapTupleFields));
+	newtup->t_data->t_ctid = td->t_ctid;
+	newtup->t_data->t_infomask &= ~HEAP_XACT_MASK;
+	newtup->t_data->t_infomask |= td->t_infomask & HEAP_XACT_MASK;
+	newtup->t_data->t_infomask2 &= ~HEAP2_XACT_MASK;
+	newtup->t_data->t_infomask2 |= td->t_infomask2 & HEAP2_XACT_MASK;
+	if ((newtup->t_data->t_infomask & HEAP_HASOID) &&
+		(td->t_infomask & HEAP_HASOID))
+		HeapTupleHeaderSetOid(newtup->t_data, HeapTupleHeaderGetOid(td));
+	newtup->t_self = tuple->t_self;
+	newtup->t_tableOid = tuple->t_tableOid;
+}
+
+/*
+ * heap_tuple_upgrade
+ *
+ * Convenience routine for callers that read a tuple of the relation
+ * directly from its buffer: if the tuple is not current, point it at a
+ * converted copy palloc'd in the current memory context instead.
+ */
+void
+heap_tuple_upgrade(Relation relation, HeapTuple tuple)
+{
+	SchemaVersionInfo *info = RelationGetSchemaVersionInfo(relation);
+	HeapTuple	newtup;
+
+	if (info == NULL ||
+		HeapTupleHeaderGetSchemaVersion(tuple->t_data) == info->current)
+		return;
+
+	newtup = heap_upgrade_tuple(tuple, info);
+	tuple->t_len = newtup->t_len;
+	tuple->t_data = newtup->t_data;
+}
+
+/*
+ * heap_scan_upgrade_tuple
+ *
+ * Upgrade the current tuple of a heap scan, if needed.  The converted copy
+ * is kept in a memory context owned by the scan, and stays valid until the
+ * next tuple is converted.
+ */
+void
+heap_scan_upgrade_tuple(HeapScanDesc scan)
+{
+	SchemaVersionInfo *info = scan->rs_versions;
+	MemoryContext oldcxt;
+	HeapTuple	newtup;
+
+	if (info == NULL ||
+		HeapTupleHeaderGetSchemaVersion(scan->rs_ctup.t_data) == info->current)
+		return;
+
+	if (scan->rs_versioncxt == NULL)
+		scan->rs_versioncxt = AllocSetContextCreate(GetMemoryChunkContext(scan),
+													"heap scan version conversion",
+													ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(scan->rs_versioncxt);
+
+	oldcxt = MemoryContextSwitchTo(scan->rs_versioncxt);
+	newtup = heap_upgrade_tuple(&scan->rs_ctup, info);
+	MemoryContextSwitchTo(oldcxt);
+
+	scan->rs_ctup.t_len = newtup->t_len;
+	scan->rs_ctup.t_data = newtup->t_data;
+}
+
+/*
+ * index_scan_upgrade_tuple
+ *
+ * Same as heap_scan_upgrade_tuple, for the heap tuple fetched by an index
+ * scan.
+ */
+void
+index_scan_upgrade_tuple(IndexScanDesc scan)
+{
+	SchemaVersionInfo *info = scan->xs_versions;
+	MemoryContext oldcxt;
+	HeapTuple	newtup;
+
+	if (info == NULL ||
+		HeapTupleHeaderGetSchemaVersion(scan->xs_ctup.t_data) == info->current)
+		return;
+
+	if (scan->xs_versioncxt == NULL)
+		scan->xs_versioncxt = AllocSetContextCreate(GetMemoryChunkContext(scan),
+													"index scan version conversion",
+													ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(scan->xs_versioncxt);
+
+	oldcxt = MemoryContextSwitchTo(scan->xs_versioncxt);
+	newtup = heap_upgrade_tuple(&scan->xs_ctup, info);
+	MemoryContextSwitchTo(oldcxt);
+
+	scan->xs_ctup.t_len = newtup->t_len;
+	scan->xs_ctup.t_data = newtup->t_data;
+}
@@ -0,0 +1,272 @@
+/*-------------------------------------------------------------------------
+ *
+ * rewritetrack.c
+ *	  Tracking of heap blocks changed during an online table rewrite.
+ *
+ * An online table rewrite (see pg_rewrite_table_online in
+ * commands/cluster.c) copies a table into a new heap while other sessions
+ * keep writing to it, and has to find out afterwards which parts of the old
+ * heap it must look at again.  For that it registers the table here.  Every
+ * insert, update and delete of a heap tuple reports the block it changed,
+ * and for a registered table we set that block's bit in a shared bitmap.
+ *
+ * The report is made right after the buffer is marked dirty, while the
+ * change is still being made under an exclusive lock on the buffer, so it
+ * has to be cheap and cannot fail.  When no rewrite is in progress it costs
+ * a single read of a shared counter.  The rewriter clears a block's bit
+ * before it reads the block under a share lock, so each change is either
+ * seen by that read or sets the bit again afterwards.
+ *
+ * The bitmap of a slot has room for online_rewrite_tracked_blocks blocks.
+ * Blocks past that share the bit of the block whose number they equal
+ * modulo the capacity, and the rewriter revisits all the blocks of a set
+ * bit.
+ *
+ * INTERFACE ROUTINES
+ *		RewriteTrackStart		- start tracking changes to a relation
+ *		RewriteTrackStop		- stop tracking and release the slot
+ *		RewriteTrackTestAndClear - test and clear the bit of a block
+ *		RewriteTrackSetDirty	- set the bit of a block
+ *		RewriteTrackNoteChange	- report a change to a heap block
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/heap/rewritetrack.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/rewritetrack.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/rel.h"
+
+
+/* GUC variable */
+int			online_rewrite_tracked_blocks = 1048576;
+
+/*
+ * One tracked relation.  dbid and relid are set while the slot is claimed
+ * but not yet counted in nactive, and are read without the lock.
+ */
+struct RewriteTrackSlot
+{
+	bool		inuse;			/* protected by RewriteTrackCtl->mutex */
+	Oid			dbid;
+	Oid			relid;
+	pg_atomic_uint32 dirty[FLEXIBLE_ARRAY_MEMBER];
+};
+
+typedef struct RewriteTrackCtlData
+{
+	slock_t		mutex;			/* protects slot allocation */
+	pg_atomic_uint32 nactive;	/* number of slots tracking a relation */
+	uint32		nwords;			/* bitmap words per slot */
+	char		slots[FLEXIBLE_ARRAY_MEMBER];	/* MAX_ONLINE_REWRITES slots */
+} RewriteTrackCtlData;
+
+#define RewriteTrackWords() \
+	((uint32) ((online_rewrite_tracked_blocks + 31) / 32))
+#define SizeOfRewriteTrackSlot(nwords) \
+	MAXALIGN(offsetof(RewriteTrackSlot, dirty) + \
+			 (nwords) * sizeof(pg_atomic_uint32))
+#define GetRewriteTrackSlot(i) \
+	((RewriteTrackSlot *) (RewriteTrackCtl->slots + \
+						   (i) * SizeOfRewriteTrackSlot(RewriteTrackCtl->nwords)))
+
+static RewriteTrackCtlData *RewriteTrackCtl = NULL;
+
+
+/*
+ * RewriteTrackShmemSize --- report amount of shared memory space needed
+ */
+Size
+RewriteTrackShmemSize(void)
+{
+	Size		size;
+
+	size = mul_size(SizeOfRewriteTrackSlot(RewriteTrackWords()),
+					MAX_ONLINE_REWRITES);
+	size = add_size(size, MAXALIGN(offsetof(RewriteTrackCtlData, slots)));
+
+	return size;
+}
+
+/*
+ * RewriteTrackShmemInit --- initialize this module's shared memory
+ */
+void
+RewriteTrackShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	RewriteTrackCtl = (RewriteTrackCtlData *)
+		ShmemInitStruct("Online Rewrite Tracking", RewriteTrackShmemSize(),
+						&found);
+
+	if (!IsUnderPostmaster)
+	{
+		Assert(!found);
+
+		SpinLockInit(&RewriteTrackCtl->mutex);
+		pg_atomic_init_u32(&RewriteTrackCtl->nactive, 0);
+		RewriteTrackCtl->nwords = RewriteTrackWords();
+
+		for (i = 0; i < MAX_ONLINE_REWRITES; i++)
+		{
+			RewriteTrackSlot *slot = GetRewriteTrackSlot(i);
+			uint32		w;
+
+			slot->inuse = false;
+			slot->dbid = InvalidOid;
+			slot->relid = InvalidOid;
+			for (w = 0; w < RewriteTrackCtl->nwords; w++)
+				pg_atomic_init_u32(&slot->dirty[w], 0);
+		}
+	}
+	else
+		Assert(found);
+}
+
+/*
+ * RewriteTrackCapacity --- number of blocks that have a bit of their own
+ */
+BlockNumber
+RewriteTrackCapacity(void)
+{
+	return (BlockNumber) RewriteTrackCtl->nwords * 32;
+}
+
+/*
+ * RewriteTrackStart --- start tracking changes to a relation
+ *
+ * The caller must hold a lock that keeps anyone else from rewriting the
+ * relation.  Changes are tracked from the moment this returns.
+ */
+RewriteTrackSlot *
+RewriteTrackStart(Relation rel)
+{
+	RewriteTrackSlot *slot = NULL;
+	int			i;
+	uint32		w;
+
+	SpinLockAcquire(&RewriteTrackCtl->mutex);
+	for (i = 0; i < MAX_ONLINE_REWRITES; i++)
+	{
+		RewriteTrackSlot *s = GetRewriteTrackSlot(i);
+
+		if (!s->inuse)
+		{
+			s->inuse = true;
+			slot = s;
+			break;
+		}
+	}
+	SpinLockRelease(&RewriteTrackCtl->mutex);
+
+	if (slot == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("too many online table rewrites in progress"),
+				 errdetail("At most %d tables can be rewritten online at the same time.",
+						   MAX_ONLINE_REWRITES)));
+
+	/*
+	 * A backend that saw this slot's previous relation may still set a bit
+	 * or two after we clear the bitmap.  That only makes us look at some
+	 * block again.
+	 */
+	for (w = 0; w < RewriteTrackCtl->nwords; w++)
+		pg_atomic_write_u32(&slot->dirty[w], 0);
+	slot->dbid = MyDatabaseId;
+	slot->relid = RelationGetRelid(rel);
+
+	/* fetch-and-add is a full barrier, so the fields above are visible */
+	pg_atomic_fetch_add_u32(&RewriteTrackCtl->nactive, 1);
+
+	return slot;
+}
+
+/*
+ * RewriteTrackStop --- stop tracking and release the slot
+ */
+void
+RewriteTrackStop(RewriteTrackSlot *slot)
+{
+	pg_atomic_fetch_sub_u32(&RewriteTrackCtl->nactive, 1);
+
+	SpinLockAcquire(&RewriteTrackCtl->mutex);
+	slot->relid = InvalidOid;
+	slot->dbid = InvalidOid;
+	slot->inuse = false;
+	SpinLockRelease(&RewriteTrackCtl->mutex);
+}
+
+/*
+ * RewriteTrackTestAndClear --- test and clear the bit of a block
+ *
+ * Returns true if the block, or another block sharing its bit, has been
+ * changed since the bit was last cleared.
+ */
+bool
+RewriteTrackTestAndClear(RewriteTrackSlot *slot, BlockNumber blkno)
+{
+	BlockNumber bitno = blkno % RewriteTrackCapacity();
+	pg_atomic_uint32 *word = &slot->dirty[bitno / 32];
+	uint32		mask = ((uint32) 1) << (bitno % 32);
+
+	if ((pg_atomic_read_u32(word) & mask) == 0)
+		return false;
+	return (pg_atomic_fetch_and_u32(word, ~mask) & mask) != 0;
+}
+
+/*
+ * RewriteTrackSetDirty --- set the bit of a block
+ */
+void
+RewriteTrackSetDirty(RewriteTrackSlot *slot, BlockNumber blkno)
+{
+	BlockNumber bitno = blkno % RewriteTrackCapacity();
+
+	pg_atomic_fetch_or_u32(&slot->dirty[bitno / 32],
+						   ((uint32) 1) << (bitno % 32));
+}
+
+/*
+ * RewriteTrackNoteChange --- report a change to a heap block
+ *
+ * Called by the heap access routines right after marking the changed buffer
+ * dirty, inside the critical section.  The exclusive buffer lock the caller
+ * holds orders this against the rewriter's reads of the block.
+ */
+void
+RewriteTrackNoteChange(Relation rel, BlockNumber blkno)
+{
+	Oid			relid = RelationGetRelid(rel);
+	int			i;
+
+	if (pg_atomic_read_u32(&RewriteTrackCtl->nactive) == 0)
+		return;
+
+	for (i = 0; i < MAX_ONLINE_REWRITES; i++)
+	{
+		RewriteTrackSlot *slot = GetRewriteTrackSlot(i);
+
+		if (slot->relid == relid && slot->dbid == MyDatabaseId)
+		{
+			BlockNumber bitno = blkno % RewriteTrackCapacity();
+			pg_atomic_uint32 *word = &slot->dirty[bitno / 32];
+			uint32		mask = ((uint32) 1) << (bitno % 32);
+
+			if ((pg_atomic_read_u32(word) & mask) == 0)
+				pg_atomic_fetch_or_u32(word, mask);
+		}
+	}
+}
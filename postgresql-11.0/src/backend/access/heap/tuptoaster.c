@@ -32,6 +32,7 @@
 
 #include "access/genam.h"
 #include "access/heapam.h"
+#include "access/heapversion.h"
 #include "access/tuptoaster.h"
 #include "access/xact.h"
 #include "catalog/catalog.h"
@@ -486,8 +487,11 @@ toast_delete(Relation rel, HeapTuple oldtup, bool is_speculative)
 	 * O(N^2) if there are many varlena columns, so it seems better to err on
 	 * the side of linear cost.  (We won't even be here unless there's at
 	 * least one varlena column, by the way.)
+	 *
+	 * The tuple might have been written under an older schema version, in
+	 * which case it must be taken apart according to its own layout.
 	 */
-	tupleDesc = rel->rd_att;
+	tupleDesc = RelationGetTupleVersionDescr(rel, oldtup->t_data);
 	numAttrs = tupleDesc->natts;
 
 	Assert(numAttrs <= MaxHeapAttributeNumber);
@@ -536,6 +540,7 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 {
 	HeapTuple	result_tuple;
 	TupleDesc	tupleDesc;
+	TupleDesc	oldTupleDesc;
 	int			numAttrs;
 	int			i;
 
@@ -580,8 +585,19 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 
 	Assert(numAttrs <= MaxHeapAttributeNumber);
 	heap_deform_tuple(newtup, tupleDesc, toast_values, toast_isnull);
+
+	/*
+	 * The old tuple might have been written under an older schema version,
+	 * in which case some of its columns have a different type.
+	 */
 	if (oldtup != NULL)
-		heap_deform_tuple(oldtup, tupleDesc, toast_oldvalues, toast_oldisnull);
+	{
+		oldTupleDesc = RelationGetTupleVersionDescr(rel, oldtup->t_data);
+		heap_deform_tuple(oldtup, oldTupleDesc, toast_oldvalues,
+						  toast_oldisnull);
+	}
+	else
+		oldTupleDesc = NULL;
 
 	/* ----------
 	 * Then collect information about the values given
@@ -618,10 +634,12 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 			 * If the old value is stored on disk, check if it has changed so
 			 * we have to delete it later.
 			 */
-			if (att->attlen == -1 && !toast_oldisnull[i] &&
+			if (TupleDescAttr(oldTupleDesc, i)->attlen == -1 &&
+				!toast_oldisnull[i] &&
 				VARATT_IS_EXTERNAL_ONDISK(old_value))
 			{
-				if (toast_isnull[i] || !VARATT_IS_EXTERNAL_ONDISK(new_value) ||
+				if (toast_isnull[i] || att->attlen != -1 ||
+					!VARATT_IS_EXTERNAL_ONDISK(new_value) ||
 					memcmp((char *) old_value, (char *) new_value,
 						   VARSIZE_EXTERNAL(old_value)) != 0)
 				{
@@ -127,6 +127,15 @@ RelationGetIndexScan(Relation indexRelation, int nkeys, int norderbys)
 	scan->xs_cbuf = InvalidBuffer;
 	scan->xs_continue_hot = false;
 
+	scan->xs_migrate_max = 0;	/* may be set later */
+	scan->xs_migrate_ntids = 0;
+	scan->xs_migrate_next = 0;
+	scan->xs_migrate_tids = NULL;
+	scan->xs_migrate_recheck = NULL;
+
+	scan->xs_versions = NULL;	/* may be set later */
+	scan->xs_versioncxt = NULL;
+
 	return scan;
 }
 
@@ -17,6 +17,7 @@
  *		index_beginscan_bitmap - start a scan of an index with amgetbitmap
  *		index_rescan	- restart a scan of an index
  *		index_endscan	- end a scan
+ *		index_setmigratescan - read ahead for a migration
  *		index_insert	- insert an index tuple into a relation
  *		index_markpos	- mark a scan position
  *		index_restrpos	- restore a scan position
@@ -70,6 +71,7 @@
 #include "postgres.h"
 
 #include "access/amapi.h"
+#include "access/heapversion.h"
 #include "access/relscan.h"
 #include "access/transam.h"
 #include "access/xlog.h"
@@ -78,6 +80,8 @@
 #include "storage/bufmgr.h"
 #include "storage/lmgr.h"
 #include "storage/predicate.h"
+#include "utils/memutils.h"
+#include "utils/migrate_schema.h"
 #include "utils/snapmgr.h"
 #include "utils/tqual.h"
 
@@ -233,6 +237,7 @@ index_beginscan(Relation heapRelation,
 	 */
 	scan->heapRelation = heapRelation;
 	scan->xs_snapshot = snapshot;
+	scan->xs_versions = RelationGetSchemaVersionInfo(heapRelation);
 
 	return scan;
 }
@@ -325,6 +330,7 @@ index_rescan(IndexScanDesc scan,
 	}
 
 	scan->xs_continue_hot = false;
+	scan->xs_migrate_ntids = scan->xs_migrate_next = 0;
 
 	scan->kill_prior_tuple = false; /* for safety */
 
@@ -358,10 +364,51 @@ index_endscan(IndexScanDesc scan)
 	if (scan->xs_temp_snap)
 		UnregisterSnapshot(scan->xs_snapshot);
 
+	if (scan->xs_versioncxt)
+		MemoryContextDelete(scan->xs_versioncxt);
+
+	if (scan->xs_migrate_tids)
+	{
+		pfree(scan->xs_migrate_tids);
+		pfree(scan->xs_migrate_recheck);
+	}
+
 	/* Release the scan data structure itself */
 	IndexScanEnd(scan);
 }
 
+/* ----------------
+ *		index_setmigratescan - mark an index scan as feeding a migration
+ *
+ * A lazy migration driven by an index scan, as for a point query on the
+ * old table, visits heap pages in index order, one synchronous read at a
+ * time.  Marked scans instead read the next target_prefetch_pages TIDs from
+ * the index ahead of index_getnext and prefetch the heap blocks among them
+ * that the migration has not drained yet.
+ *
+ * The caller must not change scan direction, mark or restore the position,
+ * or use ordering operators on the scan, since the index AM's position runs
+ * ahead of the tuple returned.  For the same reason, dead index entries
+ * are not killed while reading ahead.
+ * ----------------
+ */
+void
+index_setmigratescan(IndexScanDesc scan)
+{
+	Assert(scan->heapRelation != NULL);
+
+	if (target_prefetch_pages <= 0 || scan->numberOfOrderBys > 0 ||
+		scan->xs_migrate_max > 0)
+		return;
+
+	scan->xs_migrate_max = target_prefetch_pages;
+	scan->xs_migrate_tids = (ItemPointerData *)
+		palloc(scan->xs_migrate_max * sizeof(ItemPointerData));
+	scan->xs_migrate_recheck = (bool *)
+		palloc(scan->xs_migrate_max * sizeof(bool));
+	scan->xs_migrate_ntids = scan->xs_migrate_next = 0;
+}
+
 /* ----------------
  *		index_markpos  - mark a scan position
  * ----------------
@@ -400,6 +447,7 @@ index_restrpos(IndexScanDesc scan)
 	CHECK_SCAN_PROCEDURE(amrestrpos);
 
 	scan->xs_continue_hot = false;
+	scan->xs_migrate_ntids = scan->xs_migrate_next = 0;
 
 	scan->kill_prior_tuple = false; /* for safety */
 
@@ -511,6 +559,7 @@ index_beginscan_parallel(Relation heaprel, Relation indexrel, int nkeys,
 	 */
 	scan->heapRelation = heaprel;
 	scan->xs_snapshot = snapshot;
+	scan->xs_versions = RelationGetSchemaVersionInfo(heaprel);
 
 	return scan;
 }
@@ -621,6 +670,8 @@ index_fetch_heap(IndexScanDesc scan)
 		 */
 		scan->xs_continue_hot = !IsMVCCSnapshot(scan->xs_snapshot);
 		pgstat_count_heap_fetch(scan->indexRelation);
+		if (scan->xs_versions)
+			index_scan_upgrade_tuple(scan);
 		return &scan->xs_ctup;
 	}
 
@@ -640,6 +691,50 @@ index_fetch_heap(IndexScanDesc scan)
 	return NULL;
 }
 
+/*
+ * index_migrate_next_tid - index_getnext_tid for a scan reading ahead
+ *
+ * Returns the next queued TID, first refilling the queue from the index and
+ * prefetching the heap blocks a migration still has tuples to take from.
+ */
+static ItemPointer
+index_migrate_next_tid(IndexScanDesc scan, ScanDirection direction)
+{
+	if (scan->xs_migrate_next >= scan->xs_migrate_ntids)
+	{
+		BlockNumber lastblock = InvalidBlockNumber;
+		ItemPointer tid;
+
+		/* the AM's current entry isn't the one we fetched last */
+		scan->kill_prior_tuple = false;
+
+		scan->xs_migrate_ntids = scan->xs_migrate_next = 0;
+		while (scan->xs_migrate_ntids < scan->xs_migrate_max &&
+			   (tid = index_getnext_tid(scan, direction)) != NULL)
+		{
+			BlockNumber block = ItemPointerGetBlockNumber(tid);
+
+			scan->xs_migrate_tids[scan->xs_migrate_ntids] = *tid;
+			scan->xs_migrate_recheck[scan->xs_migrate_ntids] = scan->xs_recheck;
+			scan->xs_migrate_ntids++;
+
+			if (block != lastblock &&
+				MigrateBlockHasUnmigrated(scan->heapRelation, block))
+				PrefetchBuffer(scan->heapRelation, MAIN_FORKNUM, block);
+			lastblock = block;
+		}
+
+		if (scan->xs_migrate_ntids == 0)
+			return NULL;
+	}
+
+	scan->xs_ctup.t_self = scan->xs_migrate_tids[scan->xs_migrate_next];
+	scan->xs_recheck = scan->xs_migrate_recheck[scan->xs_migrate_next];
+	scan->xs_migrate_next++;
+
+	return &scan->xs_ctup.t_self;
+}
+
 /* ----------------
  *		index_getnext - get the next heap tuple from a scan
  *
@@ -676,7 +771,10 @@ index_getnext(IndexScanDesc scan, ScanDirection direction)
 		else
 		{
 			/* Time to fetch the next TID from the index */
-			tid = index_getnext_tid(scan, direction);
+			if (scan->xs_migrate_max > 0)
+				tid = index_migrate_next_tid(scan, direction);
+			else
+				tid = index_getnext_tid(scan, direction);
 
 			/* If we're out of index entries, we're done */
 			if (tid == NULL)
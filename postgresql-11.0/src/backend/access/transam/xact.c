@@ -59,6 +59,7 @@
 #include "utils/guc.h"
 #include "utils/inval.h"
 #include "utils/memutils.h"
+#include "utils/migrate_schema.h"
 #include "utils/relmapper.h"
 #include "utils/snapmgr.h"
 #include "utils/timeout.h"
@@ -2093,6 +2094,13 @@ CommitTransaction(void)
 	 */
 	ProcArrayEndTransaction(MyProc, latestXid);
 
+	/*
+	 * Publish the tuples we migrated.  Like ProcArrayEndTransaction, this
+	 * must happen before we release our transaction lock, which is what
+	 * backends waiting for those tuples sleep on.
+	 */
+	AtEOXact_MigrateSchema(true);
+
 	/*
 	 * This is all post-commit cleanup.  Note that if an error is raised here,
 	 * it's too late to abort the transaction.  This should be just
@@ -2353,6 +2361,7 @@ PrepareTransaction(void)
 	AtPrepare_Notify();
 	AtPrepare_Locks();
 	AtPrepare_PredicateLocks();
+	AtPrepare_MigrateSchema();
 	AtPrepare_PgStat();
 	AtPrepare_MultiXact();
 	AtPrepare_RelationMap();
@@ -2605,6 +2614,9 @@ AbortTransaction(void)
 	 */
 	ProcArrayEndTransaction(MyProc, latestXid);
 
+	/* Release tuples we claimed for migration, before our locks go away */
+	AtEOXact_MigrateSchema(false);
+
 	/*
 	 * Post-abort cleanup.  See notes in CommitTransaction() concerning
 	 * ordering.  We can skip all of it if the transaction failed before
@@ -4670,6 +4682,7 @@ CommitSubTransaction(void)
 					  s->parent->subTransactionId);
 	AtEOSubXact_HashTables(true, s->nestingLevel);
 	AtEOSubXact_PgStat(true, s->nestingLevel);
+	AtEOSubXact_MigrateSchema(true, s->nestingLevel);
 	AtSubCommit_Snapshot(s->nestingLevel);
 	AtEOSubXact_ApplyLauncher(true, s->nestingLevel);
 
@@ -4824,6 +4837,7 @@ AbortSubTransaction(void)
 						  s->parent->subTransactionId);
 		AtEOSubXact_HashTables(false, s->nestingLevel);
 		AtEOSubXact_PgStat(false, s->nestingLevel);
+		AtEOSubXact_MigrateSchema(false, s->nestingLevel);
 		AtSubAbort_Snapshot(s->nestingLevel);
 		AtEOSubXact_ApplyLauncher(false, s->nestingLevel);
 	}
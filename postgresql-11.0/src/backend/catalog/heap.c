@@ -43,6 +43,7 @@
 #include "catalog/objectaccess.h"
 #include "catalog/partition.h"
 #include "catalog/pg_attrdef.h"
+#include "catalog/pg_attribute_version.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_constraint.h"
 #include "catalog/pg_foreign_table.h"
@@ -1923,6 +1924,11 @@ heap_drop_with_catalog(Oid relid)
 	 */
 	RemoveStatistics(relid, 0);
 
+	/*
+	 * delete schema version history left by lazy ALTER COLUMN TYPE
+	 */
+	RemoveAttributeVersions(relid);
+
 	/*
 	 * delete attribute tuples
 	 */
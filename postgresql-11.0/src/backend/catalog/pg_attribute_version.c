@@ -0,0 +1,176 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_attribute_version.c
+ *	  routines to support manipulation of the pg_attribute_version relation
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/catalog/pg_attribute_version.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/dependency.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_attribute_version.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_proc.h"
+#include "utils/fmgroids.h"
+#include "utils/inval.h"
+#include "utils/rel.h"
+
+
+/*
+ * GetRelationSchemaVersion
+ *
+ * Returns the current schema version of the given relation, that is the
+ * version stamped on newly written heap tuples.  Relations that never went
+ * through a lazy ALTER COLUMN TYPE are at version 0.
+ */
+int16
+GetRelationSchemaVersion(Oid relid)
+{
+	int16		result = 0;
+	Relation	avrel;
+	ScanKeyData key;
+	SysScanDesc scan;
+	HeapTuple	tuple;
+
+	avrel = heap_open(AttributeVersionRelationId, AccessShareLock);
+
+	ScanKeyInit(&key,
+				Anum_pg_attribute_version_avrelid,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(relid));
+	scan = systable_beginscan(avrel, AttributeVersionIndexId, true,
+							  NULL, 1, &key);
+
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		Form_pg_attribute_version avform;
+
+		avform = (Form_pg_attribute_version) GETSTRUCT(tuple);
+		result = Max(result, avform->avversion);
+	}
+
+	systable_endscan(scan);
+	heap_close(avrel, AccessShareLock);
+
+	return result;
+}
+
+/*
+ * StoreAttributeVersion
+ *
+ * Record that column attnum of relid stored values of type typid in all
+ * tuples written before the relation reached the given schema version.
+ * If typid is InvalidOid, record instead that the column was added with a
+ * default to be filled in lazily.
+ *
+ * The cast function is needed to read those tuples for as long as any of
+ * them survive, so the relation is made to depend on it.  The old type
+ * itself is protected by the function's dependency on its argument type.
+ * A lazy default is protected by its pg_attrdef entry, which can't change
+ * while the column has one.  The relcache entry is invalidated so that
+ * readers pick up the new version.
+ */
+void
+StoreAttributeVersion(Oid relid, int16 version, AttrNumber attnum,
+					  Oid typid, int32 typmod, Oid collation,
+					  Oid castfunc)
+{
+	Datum		values[Natts_pg_attribute_version];
+	bool		nulls[Natts_pg_attribute_version];
+	HeapTuple	tuple;
+	Relation	avrel;
+	ObjectAddress myself,
+				referenced;
+
+	avrel = heap_open(AttributeVersionRelationId, RowExclusiveLock);
+
+	values[Anum_pg_attribute_version_avrelid - 1] = ObjectIdGetDatum(relid);
+	values[Anum_pg_attribute_version_avversion - 1] = Int16GetDatum(version);
+	values[Anum_pg_attribute_version_avattnum - 1] = Int16GetDatum(attnum);
+	values[Anum_pg_attribute_version_avtypid - 1] = ObjectIdGetDatum(typid);
+	values[Anum_pg_attribute_version_avtypmod - 1] = Int32GetDatum(typmod);
+	values[Anum_pg_attribute_version_avcollation - 1] = ObjectIdGetDatum(collation);
+	values[Anum_pg_attribute_version_avcastfunc - 1] = ObjectIdGetDatum(castfunc);
+
+	memset(nulls, 0, sizeof(nulls));
+
+	tuple = heap_form_tuple(RelationGetDescr(avrel), values, nulls);
+
+	CatalogTupleInsert(avrel, tuple);
+
+	heap_freetuple(tuple);
+
+	heap_close(avrel, RowExclusiveLock);
+
+	if (OidIsValid(castfunc))
+	{
+		myself.classId = RelationRelationId;
+		myself.objectId = relid;
+		myself.objectSubId = 0;
+		referenced.classId = ProcedureRelationId;
+		referenced.objectId = castfunc;
+		referenced.objectSubId = 0;
+		recordDependencyOn(&myself, &referenced, DEPENDENCY_NORMAL);
+	}
+
+	CacheInvalidateRelcacheByRelid(relid);
+}
+
+/*
+ * RemoveAttributeVersions
+ *
+ * Delete all pg_attribute_version rows of the given relation, together with
+ * the cast function dependencies they carried.  This is done when the
+ * relation is dropped, and when it has been rewritten so that every tuple
+ * is stored in the current row type.
+ */
+void
+RemoveAttributeVersions(Oid relid)
+{
+	Relation	avrel;
+	ScanKeyData key;
+	SysScanDesc scan;
+	HeapTuple	tuple;
+	bool		found = false;
+
+	avrel = heap_open(AttributeVersionRelationId, RowExclusiveLock);
+
+	ScanKeyInit(&key,
+				Anum_pg_attribute_version_avrelid,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(relid));
+	scan = systable_beginscan(avrel, AttributeVersionIndexId, true,
+							  NULL, 1, &key);
+
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		CatalogTupleDelete(avrel, &tuple->t_self);
+		found = true;
+	}
+
+	systable_endscan(scan);
+	heap_close(avrel, RowExclusiveLock);
+
+	/*
+	 * A relation has no other relation-level dependencies on functions, so
+	 * it's safe to remove them wholesale.
+	 */
+	if (found)
+	{
+		deleteDependencyRecordsForClass(RelationRelationId, relid,
+										ProcedureRelationId,
+										DEPENDENCY_NORMAL);
+		CacheInvalidateRelcacheByRelid(relid);
+	}
+}
@@ -1119,6 +1119,21 @@ LANGUAGE INTERNAL
 STRICT IMMUTABLE PARALLEL SAFE
 AS 'jsonb_insert';
 
+CREATE OR REPLACE FUNCTION
+  pg_rewrite_table_online(rel regclass, tablespace name DEFAULT NULL,
+                          chunk_pages integer DEFAULT 128)
+RETURNS void
+LANGUAGE INTERNAL
+VOLATILE PARALLEL UNSAFE
+AS 'pg_rewrite_table_online';
+
+CREATE OR REPLACE FUNCTION
+  pg_migrate_finalize(bitmap integer, drop_source boolean DEFAULT false)
+RETURNS boolean
+LANGUAGE INTERNAL
+STRICT VOLATILE PARALLEL UNSAFE
+AS 'pg_migrate_finalize';
+
 --
 -- The default permissions for functions mean that anyone can execute them.
 -- A number of functions shouldn't be executable by just anyone, but rather
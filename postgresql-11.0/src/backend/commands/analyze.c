@@ -16,6 +16,7 @@
 
 #include <math.h>
 
+#include "access/heapversion.h"
 #include "access/multixact.h"
 #include "access/sysattr.h"
 #include "access/transam.h"
@@ -94,6 +95,7 @@ static VacAttrStats *examine_attribute(Relation onerel, int attnum,
 static int acquire_sample_rows(Relation onerel, int elevel,
 					HeapTuple *rows, int targrows,
 					double *totalrows, double *totaldeadrows);
+static HeapTuple copy_sample_tuple(Relation onerel, HeapTuple tuple);
 static int	compare_rows(const void *a, const void *b);
 static int acquire_inherited_sample_rows(Relation onerel, int elevel,
 							  HeapTuple *rows, int targrows,
@@ -1055,6 +1057,12 @@ acquire_sample_rows(Relation onerel, int elevel,
 
 	Assert(targrows > 0);
 
+	/*
+	 * Load the schema version history now, since copy_sample_tuple consults
+	 * it while we hold a buffer lock.
+	 */
+	(void) RelationGetSchemaVersionInfo(onerel);
+
 	totalblocks = RelationGetNumberOfBlocks(onerel);
 
 	/* Need a cutoff xmin for HeapTupleSatisfiesVacuum */
@@ -1201,7 +1209,7 @@ acquire_sample_rows(Relation onerel, int elevel,
 				 * the relation we're done.
 				 */
 				if (numrows < targrows)
-					rows[numrows++] = heap_copytuple(&targtuple);
+					rows[numrows++] = copy_sample_tuple(onerel, &targtuple);
 				else
 				{
 					/*
@@ -1223,7 +1231,7 @@ acquire_sample_rows(Relation onerel, int elevel,
 
 						Assert(k >= 0 && k < targrows);
 						heap_freetuple(rows[k]);
-						rows[k] = heap_copytuple(&targtuple);
+						rows[k] = copy_sample_tuple(onerel, &targtuple);
 					}
 
 					rowstoskip -= 1;
@@ -1281,6 +1289,22 @@ acquire_sample_rows(Relation onerel, int elevel,
 	return numrows;
 }
 
+/*
+ * Copy a sampled tuple, converting it to the current row type if it was
+ * written under an older schema version.
+ */
+static HeapTuple
+copy_sample_tuple(Relation onerel, HeapTuple tuple)
+{
+	SchemaVersionInfo *versions = RelationGetSchemaVersionInfo(onerel);
+
+	if (versions != NULL &&
+		HeapTupleHeaderGetSchemaVersion(tuple->t_data) != versions->current)
+		return heap_upgrade_tuple(tuple, versions);
+
+	return heap_copytuple(tuple);
+}
+
 /*
  * qsort comparator for sorting rows[] array
  */
@@ -18,9 +18,11 @@
 #include "postgres.h"
 
 #include "access/amapi.h"
+#include "access/heapversion.h"
 #include "access/multixact.h"
 #include "access/relscan.h"
 #include "access/rewriteheap.h"
+#include "access/rewritetrack.h"
 #include "access/transam.h"
 #include "access/tuptoaster.h"
 #include "access/xact.h"
@@ -32,18 +34,25 @@
 #include "catalog/index.h"
 #include "catalog/namespace.h"
 #include "catalog/objectaccess.h"
+#include "catalog/pg_attribute_version.h"
+#include "catalog/pg_tablespace.h"
 #include "catalog/toasting.h"
 #include "commands/cluster.h"
 #include "commands/tablecmds.h"
+#include "commands/tablespace.h"
 #include "commands/vacuum.h"
+#include "executor/executor.h"
 #include "miscadmin.h"
 #include "optimizer/planner.h"
 #include "storage/bufmgr.h"
+#include "storage/ipc.h"
 #include "storage/lmgr.h"
 #include "storage/predicate.h"
 #include "storage/smgr.h"
 #include "utils/acl.h"
+#include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/hsearch.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
@@ -66,16 +75,76 @@ typedef struct
 	Oid			indexOid;
 } RelToCluster;
 
+/*
+ * pg_rewrite_table_online remembers, for each block of the old heap, which
+ * of its tuples it has copied and where the copies are.  A tuple is known by
+ * its line pointer and raw xmin, which together never identify two different
+ * tuple versions.
+ */
+typedef struct OnlineRewriteItem
+{
+	OffsetNumber offnum;		/* line pointer in the old heap block */
+	TransactionId xmin;			/* raw xmin of the tuple */
+	ItemPointerData newtid;		/* its copy in the new heap */
+} OnlineRewriteItem;
+
+typedef struct OnlineRewriteBlock
+{
+	BlockNumber blkno;			/* hash key --- must be first */
+	int			nitems;
+	OnlineRewriteItem *items;	/* in line pointer order */
+} OnlineRewriteBlock;
+
+typedef struct OnlineRewriteState
+{
+	Relation	OldHeap;
+	Relation	NewHeap;
+	RewriteTrackSlot *slot;		/* tracks changes to OldHeap */
+	HTAB	   *blocks;			/* OnlineRewriteBlock entries */
+	MemoryContext mapcxt;		/* holds the items arrays */
+	MemoryContext blockcxt;		/* reset for each block */
+	double		ntuples;		/* tuples copied and not deleted since */
+	BufferAccessStrategy bstrategy;
+	BulkInsertState bistate;
+	EState	   *estate;
+	LazyDefaultState *ldstate;
+	CommandId	cid;			/* for changes to NewHeap in this pass */
+	Datum	   *values;
+	bool	   *isnull;
+	/* indexes of NewHeap, once built */
+	int			nindexes;
+	Oid		   *oldindexes;
+	Relation   *newindexes;
+	IndexInfo **indexinfos;
+	TupleTableSlot *islot;
+} OnlineRewriteState;
+
 
 static void rebuild_relation(Relation OldHeap, Oid indexOid, bool verbose);
 static void copy_heap_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex,
 			   bool verbose, bool *pSwapToastByContent,
 			   TransactionId *pFreezeXid, MultiXactId *pCutoffMulti);
 static List *get_tables_to_cluster(MemoryContext cluster_context);
+static void drop_transient_heap(Oid OIDOldHeap, Oid OIDNewHeap,
+					bool is_system_catalog, bool swap_toast_by_content,
+					Oid *mapped_tables);
 static void reform_and_rewrite_tuple(HeapTuple tuple,
 						 TupleDesc oldTupDesc, TupleDesc newTupDesc,
 						 Datum *values, bool *isnull,
 						 bool newRelHasOids, RewriteState rwstate);
+static void online_rewrite_cleanup(int code, Datum arg);
+static bool online_rewrite_sync_block(OnlineRewriteState *state,
+						  BlockNumber blkno, Snapshot snapshot);
+static bool online_rewrite_tuple_in_flux(HeapTupleHeader tuple,
+							 Snapshot snapshot);
+static void online_rewrite_copy_tuple(OnlineRewriteState *state,
+						  HeapTuple tuple, ItemPointer newtid);
+static BlockNumber online_rewrite_pass(OnlineRewriteState *state,
+					BlockNumber *nbusy);
+static void online_rewrite_build_indexes(OnlineRewriteState *state);
+static void finish_online_heap_swap(Oid OIDOldHeap, Oid OIDNewHeap,
+						int nindexes, Oid *oldindexes, Oid *newindexes,
+						TransactionId frozenXid, MultiXactId cutoffMulti);
 
 
 /*---------------------------------------------------------------------------
@@ -777,6 +846,8 @@ copy_heap_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex, bool verbose,
 	BlockNumber num_pages;
 	int			elevel = verbose ? INFO : DEBUG2;
 	PGRUsage	ru0;
+	EState	   *estate;
+	LazyDefaultState *ldstate;
 
 	pg_rusage_init(&ru0);
 
@@ -915,6 +986,13 @@ copy_heap_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex, bool verbose,
 	else
 		tuplesort = NULL;
 
+	/*
+	 * The new heap won't remember which columns had lazy defaults, so fill
+	 * those in as the rows are copied.
+	 */
+	estate = CreateExecutorState();
+	ldstate = ExecInitLazyDefaults(OldHeap, oldTupDesc, estate, false);
+
 	/*
 	 * Prepare to scan the OldHeap.  To ensure we see recently-dead tuples
 	 * that still need to be copied, we scan with SnapshotAny and use
@@ -1052,6 +1130,12 @@ copy_heap_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex, bool verbose,
 		}
 
 		num_tuples += 1;
+		if (ldstate)
+		{
+			ResetPerTupleExprContext(estate);
+			tuple = ExecFillLazyDefaults(ldstate, tuple,
+										 GetPerTupleExprContext(estate));
+		}
 		if (tuplesort != NULL)
 			tuplesort_putheaptuple(tuplesort, tuple);
 		else
@@ -1066,6 +1150,8 @@ copy_heap_data(Oid OIDNewHeap, Oid OIDOldHeap, Oid OIDOldIndex, bool verbose,
 	if (heapScan != NULL)
 		heap_endscan(heapScan);
 
+	FreeExecutorState(estate);
+
 	/*
 	 * In scan-and-sort mode, complete the sort, then read out all live tuples
 	 * from the tuplestore and write them to the new relation.
@@ -1521,10 +1607,8 @@ finish_heap_swap(Oid OIDOldHeap, Oid OIDNewHeap,
 				 MultiXactId cutoffMulti,
 				 char newrelpersistence)
 {
-	ObjectAddress object;
 	Oid			mapped_tables[4];
 	int			reindex_flags;
-	int			i;
 
 	/* Zero out possible results from swapped_relation_files */
 	memset(mapped_tables, 0, sizeof(mapped_tables));
@@ -1545,6 +1629,18 @@ finish_heap_swap(Oid OIDOldHeap, Oid OIDNewHeap,
 	if (is_system_catalog)
 		CacheInvalidateCatalog(OIDOldHeap);
 
+	/*
+	 * Every tuple of the new heap has been formed in the current row type, so
+	 * any schema version history left by lazy ALTER COLUMN TYPE no longer
+	 * applies, and lazy ADD COLUMN defaults have all been filled in.  Forget
+	 * it before the indexes are rebuilt from the new heap.
+	 */
+	if (!is_system_catalog)
+	{
+		RemoveAttributeVersions(OIDOldHeap);
+		CommandCounterIncrement();
+	}
+
 	/*
 	 * Rebuild each index on the relation (but not the toast table, which is
 	 * all-new at this point).  It is important to do this before the DROP
@@ -1608,6 +1704,21 @@ finish_heap_swap(Oid OIDOldHeap, Oid OIDNewHeap,
 		heap_close(relRelation, RowExclusiveLock);
 	}
 
+	drop_transient_heap(OIDOldHeap, OIDNewHeap, is_system_catalog,
+						swap_toast_by_content, mapped_tables);
+}
+
+/*
+ * Drop the transient table after its files have been swapped with those of
+ * the old heap, and tidy up what the swap left behind.
+ */
+static void
+drop_transient_heap(Oid OIDOldHeap, Oid OIDNewHeap, bool is_system_catalog,
+					bool swap_toast_by_content, Oid *mapped_tables)
+{
+	ObjectAddress object;
+	int			i;
+
 	/* Destroy new heap with old filenode */
 	object.classId = RelationRelationId;
 	object.objectId = OIDNewHeap;
@@ -1785,3 +1896,730 @@ reform_and_rewrite_tuple(HeapTuple tuple,
 
 	heap_freetuple(copiedTuple);
 }
+
+
+/*
+ * Online table rewrite
+ *
+ * pg_rewrite_table_online rewrites a table into new storage, optionally in
+ * another tablespace, while other sessions go on reading and writing it.
+ * Only ShareUpdateExclusiveLock is held while the data is copied; the
+ * exclusive lock is taken just to copy the last few changes and swap the
+ * files, as the ordinary rewrite does at its end.
+ *
+ * The copy is made block by block.  Each block of the old heap is read
+ * under a share lock and compared with what we copied from it before: a
+ * visible tuple that we have not copied yet is inserted into the new heap,
+ * and the copy of a tuple that is no longer visible is deleted from it.
+ * Meanwhile rewritetrack.c records which blocks others change, and we go
+ * over those again until few are left.  A block holding a tuple whose
+ * inserting or deleting transaction was still running is marked to be gone
+ * over again as well, since the outcome changes its contents without
+ * touching the page.
+ *
+ * The indexes of the new heap are built once the bulk of the table has been
+ * copied, and are maintained from then on.  At the end their files are
+ * swapped with those of the existing indexes, so unlike CLUSTER we do not
+ * rebuild them under the exclusive lock.
+ *
+ * Like CLUSTER, this is not MVCC-safe: a snapshot taken before we commit
+ * sees the table as empty afterwards.
+ */
+
+/* number of passes over changed blocks before we take the exclusive lock */
+#define ONLINE_REWRITE_MAX_PASSES		16
+
+/* default number of blocks copied per snapshot */
+#define ONLINE_REWRITE_CHUNK_PAGES		128
+
+/*
+ * pg_rewrite_table_online(rel regclass, tablespace name, chunk_pages int4)
+ */
+Datum
+pg_rewrite_table_online(PG_FUNCTION_ARGS)
+{
+	Oid			relid;
+	Oid			tableSpace;
+	int32		chunk_pages;
+	Relation	OldHeap;
+	Oid			OIDNewHeap;
+	Oid		   *newindexes = NULL;
+	OnlineRewriteState state;
+	HASHCTL		hash_ctl;
+	Relation	relRelation;
+	HeapTuple	reltup;
+	Form_pg_class relform;
+	BlockNumber num_pages;
+	int			i;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_VOID();
+	relid = PG_GETARG_OID(0);
+	chunk_pages = PG_ARGISNULL(2) ? ONLINE_REWRITE_CHUNK_PAGES : PG_GETARG_INT32(2);
+	if (chunk_pages <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("chunk size must be positive")));
+
+	OldHeap = heap_open(relid, ShareUpdateExclusiveLock);
+
+	if (OldHeap->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(OldHeap))));
+
+	if (!pg_class_ownercheck(relid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER,
+					   get_relkind_objtype(OldHeap->rd_rel->relkind),
+					   RelationGetRelationName(OldHeap));
+
+	if (IsSystemRelation(OldHeap) || RelationIsUsedAsCatalogTable(OldHeap))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot rewrite catalog table \"%s\" online",
+						RelationGetRelationName(OldHeap))));
+
+	if (RELATION_IS_OTHER_TEMP(OldHeap))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot rewrite temporary tables of other sessions")));
+
+	/* Same checks as ALTER TABLE SET TABLESPACE */
+	if (PG_ARGISNULL(1))
+		tableSpace = OldHeap->rd_rel->reltablespace;
+	else
+	{
+		const char *tablespacename = NameStr(*PG_GETARG_NAME(1));
+
+		tableSpace = get_tablespace_oid(tablespacename, false);
+		if (tableSpace == GLOBALTABLESPACE_OID)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("only shared relations can be placed in pg_global tablespace")));
+		if (tableSpace != MyDatabaseTableSpace)
+		{
+			AclResult	aclresult;
+
+			aclresult = pg_tablespace_aclcheck(tableSpace, GetUserId(),
+											   ACL_CREATE);
+			if (aclresult != ACLCHECK_OK)
+				aclcheck_error(aclresult, OBJECT_TABLESPACE, tablespacename);
+		}
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.OldHeap = OldHeap;
+
+	/* From here on every change to the table is noted */
+	state.slot = RewriteTrackStart(OldHeap);
+
+	PG_ENSURE_ERROR_CLEANUP(online_rewrite_cleanup,
+							PointerGetDatum(state.slot));
+	{
+		BlockNumber blkno;
+		BlockNumber nblocks;
+		BlockNumber ndirty;
+		BlockNumber nbusy;
+		int			natts;
+		int			pass;
+
+		OIDNewHeap = make_new_heap(relid, tableSpace,
+								   OldHeap->rd_rel->relpersistence,
+								   ShareUpdateExclusiveLock);
+		state.NewHeap = heap_open(OIDNewHeap, AccessExclusiveLock);
+
+		memset(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = sizeof(BlockNumber);
+		hash_ctl.entrysize = sizeof(OnlineRewriteBlock);
+		hash_ctl.hcxt = CurrentMemoryContext;
+		state.blocks = hash_create("online rewrite block map", 1024, &hash_ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+		state.mapcxt = AllocSetContextCreate(CurrentMemoryContext,
+											 "online rewrite tuple map",
+											 ALLOCSET_DEFAULT_SIZES);
+		state.blockcxt = AllocSetContextCreate(CurrentMemoryContext,
+											   "online rewrite block",
+											   ALLOCSET_DEFAULT_SIZES);
+		state.bstrategy = GetAccessStrategy(BAS_BULKREAD);
+		state.bistate = GetBulkInsertState();
+		natts = RelationGetDescr(OldHeap)->natts;
+		state.values = (Datum *) palloc(natts * sizeof(Datum));
+		state.isnull = (bool *) palloc(natts * sizeof(bool));
+
+		/*
+		 * The new heap won't remember which columns had lazy defaults, so
+		 * fill those in as the rows are copied, as CLUSTER does.
+		 */
+		state.estate = CreateExecutorState();
+		state.ldstate = ExecInitLazyDefaults(OldHeap, RelationGetDescr(OldHeap),
+											 state.estate, false);
+
+		/*
+		 * Copy the table in chunks, each under a snapshot of its own.  The
+		 * table may grow meanwhile; copy what it has grown by, too.
+		 */
+		blkno = 0;
+		while (blkno < (nblocks = RelationGetNumberOfBlocks(OldHeap)))
+		{
+			BlockNumber endblk = blkno + Min(nblocks - blkno,
+											 (BlockNumber) chunk_pages);
+			Snapshot	snapshot;
+
+			CommandCounterIncrement();
+			state.cid = GetCurrentCommandId(true);
+			snapshot = RegisterSnapshot(GetLatestSnapshot());
+
+			for (; blkno < endblk; blkno++)
+			{
+				CHECK_FOR_INTERRUPTS();
+
+				/*
+				 * A block past the tracking capacity shares its bit with one
+				 * we have already copied; leave the bit for the next pass.
+				 */
+				if (blkno < RewriteTrackCapacity())
+					(void) RewriteTrackTestAndClear(state.slot, blkno);
+				(void) online_rewrite_sync_block(&state, blkno, snapshot);
+			}
+
+			UnregisterSnapshot(snapshot);
+		}
+
+		online_rewrite_build_indexes(&state);
+
+		/* Go over the changed blocks until they are few enough */
+		for (pass = 0; pass < ONLINE_REWRITE_MAX_PASSES; pass++)
+		{
+			ndirty = online_rewrite_pass(&state, &nbusy);
+			elog(DEBUG1, "online rewrite of \"%s\": pass %d went over %u blocks",
+				 RelationGetRelationName(OldHeap), pass + 1, ndirty);
+			if (ndirty <= (BlockNumber) chunk_pages)
+				break;
+		}
+
+		/*
+		 * Now shut out everyone else and go over what is left.  Anyone who
+		 * changed the table has committed or aborted by the time we get the
+		 * lock, so no block can be in flux anymore.
+		 */
+		LockRelationOid(relid, AccessExclusiveLock);
+		CheckTableNotInUse(OldHeap, "pg_rewrite_table_online()");
+
+		(void) online_rewrite_pass(&state, &nbusy);
+		if (nbusy > 0)
+			elog(ERROR, "%u blocks of relation \"%s\" are still changing",
+				 nbusy, RelationGetRelationName(OldHeap));
+
+		/*
+		 * Transfer any SIREAD locks on the old heap to the relation as a
+		 * whole, as CLUSTER does.
+		 */
+		TransferPredicateLocksToHeapRelation(OldHeap);
+
+		num_pages = RelationGetNumberOfBlocks(state.NewHeap);
+
+		newindexes = (Oid *) palloc(Max(state.nindexes, 1) * sizeof(Oid));
+		for (i = 0; i < state.nindexes; i++)
+		{
+			newindexes[i] = RelationGetRelid(state.newindexes[i]);
+			index_close(state.newindexes[i], NoLock);
+		}
+		if (state.islot)
+			ExecDropSingleTupleTableSlot(state.islot);
+		ExecEndLazyDefaults(state.ldstate);
+		FreeExecutorState(state.estate);
+		FreeBulkInsertState(state.bistate);
+		FreeAccessStrategy(state.bstrategy);
+		hash_destroy(state.blocks);
+		MemoryContextDelete(state.mapcxt);
+		MemoryContextDelete(state.blockcxt);
+		heap_close(state.NewHeap, NoLock);
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(online_rewrite_cleanup,
+								PointerGetDatum(state.slot));
+
+	RewriteTrackStop(state.slot);
+	heap_close(OldHeap, NoLock);
+
+	/* Update pg_class to reflect the correct values of pages and tuples. */
+	relRelation = heap_open(RelationRelationId, RowExclusiveLock);
+
+	reltup = SearchSysCacheCopy1(RELOID, ObjectIdGetDatum(OIDNewHeap));
+	if (!HeapTupleIsValid(reltup))
+		elog(ERROR, "cache lookup failed for relation %u", OIDNewHeap);
+	relform = (Form_pg_class) GETSTRUCT(reltup);
+
+	relform->relpages = num_pages;
+	relform->reltuples = state.ntuples;
+
+	CatalogTupleUpdate(relRelation, &reltup->t_self, reltup);
+
+	heap_freetuple(reltup);
+	heap_close(relRelation, RowExclusiveLock);
+
+	CommandCounterIncrement();
+
+	finish_online_heap_swap(relid, OIDNewHeap,
+							state.nindexes, state.oldindexes, newindexes,
+							RecentXmin, ReadNextMultiXactId());
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Stop tracking changes if the rewrite fails.
+ */
+static void
+online_rewrite_cleanup(int code, Datum arg)
+{
+	RewriteTrackStop((RewriteTrackSlot *) DatumGetPointer(arg));
+}
+
+/*
+ * Bring the copy of one block of the old heap up to date with what the
+ * snapshot sees in it.  Returns true if the block holds a tuple whose fate
+ * isn't known to the snapshot yet, in which case the block has been marked
+ * to be gone over again.
+ */
+static bool
+online_rewrite_sync_block(OnlineRewriteState *state, BlockNumber blkno,
+						  Snapshot snapshot)
+{
+	OnlineRewriteBlock *entry;
+	OnlineRewriteItem *olditems = NULL;
+	int			nolditems = 0;
+	bool	   *kept;
+	OnlineRewriteItem *items;
+	int			nitems = 0;
+	HeapTuple  *copies;
+	int			ncopies = 0;
+	Buffer		buf;
+	Page		page;
+	OffsetNumber offnum;
+	OffsetNumber maxoff;
+	bool		busy = false;
+	MemoryContext oldcxt;
+	int			i;
+	int			j;
+
+	MemoryContextReset(state->blockcxt);
+	oldcxt = MemoryContextSwitchTo(state->blockcxt);
+
+	entry = (OnlineRewriteBlock *) hash_search(state->blocks, &blkno,
+											   HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		olditems = entry->items;
+		nolditems = entry->nitems;
+	}
+	kept = (bool *) palloc0(Max(nolditems, 1) * sizeof(bool));
+
+	buf = ReadBufferExtended(state->OldHeap, MAIN_FORKNUM, blkno,
+							 RBM_NORMAL, state->bstrategy);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+
+	page = BufferGetPage(buf);
+	maxoff = PageIsNew(page) ? InvalidOffsetNumber :
+		PageGetMaxOffsetNumber(page);
+
+	items = (OnlineRewriteItem *)
+		palloc(Max(maxoff, 1) * sizeof(OnlineRewriteItem));
+	copies = (HeapTuple *) palloc(Max(maxoff, 1) * sizeof(HeapTuple));
+
+	j = 0;
+	for (offnum = FirstOffsetNumber;
+		 offnum <= maxoff;
+		 offnum = OffsetNumberNext(offnum))
+	{
+		ItemId		lp = PageGetItemId(page, offnum);
+		HeapTupleData tuple;
+		TransactionId xmin;
+
+		if (!ItemIdIsNormal(lp))
+			continue;
+
+		tuple.t_data = (HeapTupleHeader) PageGetItem(page, lp);
+		tuple.t_len = ItemIdGetLength(lp);
+		tuple.t_tableOid = RelationGetRelid(state->OldHeap);
+		ItemPointerSet(&tuple.t_self, blkno, offnum);
+
+		if (online_rewrite_tuple_in_flux(tuple.t_data, snapshot))
+			busy = true;
+
+		if (!HeapTupleSatisfiesVisibility(&tuple, snapshot, buf))
+			continue;
+
+		/* Keep the copy we made before, if it is of this very tuple */
+		xmin = HeapTupleHeaderGetRawXmin(tuple.t_data);
+		while (j < nolditems && olditems[j].offnum < offnum)
+			j++;
+		if (j < nolditems && olditems[j].offnum == offnum &&
+			olditems[j].xmin == xmin)
+		{
+			kept[j] = true;
+			items[nitems++] = olditems[j];
+			continue;
+		}
+
+		items[nitems].offnum = offnum;
+		items[nitems].xmin = xmin;
+		ItemPointerSetInvalid(&items[nitems].newtid);
+		nitems++;
+		copies[ncopies++] = heap_copytuple(&tuple);
+	}
+
+	UnlockReleaseBuffer(buf);
+
+	/* Delete the copies of tuples that have gone away ... */
+	for (i = 0; i < nolditems; i++)
+	{
+		if (!kept[i])
+			simple_heap_delete(state->NewHeap, &olditems[i].newtid);
+	}
+
+	/* ... and copy the tuples that are new */
+	j = 0;
+	for (i = 0; i < nitems; i++)
+	{
+		if (!ItemPointerIsValid(&items[i].newtid))
+			online_rewrite_copy_tuple(state, copies[j++], &items[i].newtid);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	state->ntuples += nitems - nolditems;
+
+	if (entry != NULL)
+	{
+		pfree(entry->items);
+		if (nitems == 0)
+			hash_search(state->blocks, &blkno, HASH_REMOVE, NULL);
+	}
+	if (nitems > 0)
+	{
+		if (entry == NULL)
+			entry = (OnlineRewriteBlock *) hash_search(state->blocks, &blkno,
+													   HASH_ENTER, NULL);
+		entry->nitems = nitems;
+		entry->items = (OnlineRewriteItem *)
+			MemoryContextAlloc(state->mapcxt,
+							   nitems * sizeof(OnlineRewriteItem));
+		memcpy(entry->items, items, nitems * sizeof(OnlineRewriteItem));
+	}
+
+	if (busy)
+		RewriteTrackSetDirty(state->slot, blkno);
+
+	return busy;
+}
+
+/*
+ * Has a transaction the snapshot doesn't see as finished inserted or
+ * deleted this tuple?  Our own transaction doesn't count, since we see all
+ * its changes.
+ */
+static bool
+online_rewrite_tuple_in_flux(HeapTupleHeader tuple, Snapshot snapshot)
+{
+	TransactionId xid;
+
+	if (!HeapTupleHeaderXminInvalid(tuple) && !HeapTupleHeaderXminFrozen(tuple))
+	{
+		xid = HeapTupleHeaderGetRawXmin(tuple);
+		if (XidInMVCCSnapshot(xid, snapshot) &&
+			!TransactionIdIsCurrentTransactionId(xid))
+			return true;
+	}
+
+	if (!(tuple->t_infomask & HEAP_XMAX_INVALID) &&
+		!HEAP_XMAX_IS_LOCKED_ONLY(tuple->t_infomask))
+	{
+		xid = HeapTupleHeaderGetUpdateXid(tuple);
+		if (TransactionIdIsValid(xid) &&
+			XidInMVCCSnapshot(xid, snapshot) &&
+			!TransactionIdIsCurrentTransactionId(xid))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Insert a copy of a tuple of the old heap into the new heap, formed in the
+ * current row type, and into the indexes of the new heap if they have been
+ * built.
+ */
+static void
+online_rewrite_copy_tuple(OnlineRewriteState *state, HeapTuple tuple,
+						  ItemPointer newtid)
+{
+	ExprContext *econtext = GetPerTupleExprContext(state->estate);
+	TupleDesc	oldTupDesc = RelationGetDescr(state->OldHeap);
+	TupleDesc	newTupDesc = RelationGetDescr(state->NewHeap);
+	HeapTuple	copiedTuple;
+	MemoryContext oldcxt;
+	int			i;
+
+	ResetPerTupleExprContext(state->estate);
+	oldcxt = MemoryContextSwitchTo(GetPerTupleMemoryContext(state->estate));
+
+	heap_tuple_upgrade(state->OldHeap, tuple);
+	if (state->ldstate)
+		tuple = ExecFillLazyDefaults(state->ldstate, tuple, econtext);
+
+	heap_deform_tuple(tuple, oldTupDesc, state->values, state->isnull);
+
+	/* Be sure to null out any dropped columns */
+	for (i = 0; i < newTupDesc->natts; i++)
+	{
+		if (TupleDescAttr(newTupDesc, i)->attisdropped)
+			state->isnull[i] = true;
+	}
+
+	copiedTuple = heap_form_tuple(newTupDesc, state->values, state->isnull);
+
+	/* Preserve OID, if any */
+	if (state->NewHeap->rd_rel->relhasoids)
+		HeapTupleSetOid(copiedTuple, HeapTupleGetOid(tuple));
+
+	heap_insert(state->NewHeap, copiedTuple, state->cid, 0, state->bistate);
+	*newtid = copiedTuple->t_self;
+
+	if (state->nindexes > 0)
+	{
+		Datum		values[INDEX_MAX_KEYS];
+		bool		isnull[INDEX_MAX_KEYS];
+
+		ExecStoreTuple(copiedTuple, state->islot, InvalidBuffer, false);
+		econtext->ecxt_scantuple = state->islot;
+
+		for (i = 0; i < state->nindexes; i++)
+		{
+			IndexInfo  *indexInfo = state->indexinfos[i];
+
+			if (indexInfo->ii_Predicate != NIL &&
+				!ExecQual(indexInfo->ii_PredicateState, econtext))
+				continue;
+
+			FormIndexDatum(indexInfo, state->islot, state->estate,
+						   values, isnull);
+
+			/*
+			 * The new heap may hold two live versions of a row for a while;
+			 * see online_rewrite_build_indexes.
+			 */
+			index_insert(state->newindexes[i], values, isnull,
+						 &copiedTuple->t_self, state->NewHeap,
+						 UNIQUE_CHECK_NO, indexInfo);
+		}
+
+		ExecClearTuple(state->islot);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Go over the blocks that have changed since we last looked at them, under
+ * a fresh snapshot.  Returns the number of blocks gone over, and sets
+ * *nbusy to the number of those that will have to be gone over again.
+ */
+static BlockNumber
+online_rewrite_pass(OnlineRewriteState *state, BlockNumber *nbusy)
+{
+	BlockNumber nblocks = RelationGetNumberOfBlocks(state->OldHeap);
+	BlockNumber capacity = RewriteTrackCapacity();
+	BlockNumber *dirty;
+	BlockNumber ndirty = 0;
+	BlockNumber maxdirty = 1024;
+	BlockNumber bitno;
+	BlockNumber i;
+	Snapshot	snapshot;
+
+	*nbusy = 0;
+
+	/*
+	 * Collect the changed blocks first.  Since we clear their bits now,
+	 * before reading any of them, a change made from here on sets the bit
+	 * again.
+	 */
+	dirty = (BlockNumber *) palloc(maxdirty * sizeof(BlockNumber));
+	for (bitno = 0; bitno < Min(nblocks, capacity); bitno++)
+	{
+		BlockNumber blkno;
+
+		if (!RewriteTrackTestAndClear(state->slot, bitno))
+			continue;
+
+		/* the bit stands for every block equal to it modulo capacity */
+		for (blkno = bitno;; blkno += capacity)
+		{
+			if (ndirty >= maxdirty)
+			{
+				maxdirty *= 2;
+				dirty = (BlockNumber *) repalloc(dirty,
+												 maxdirty * sizeof(BlockNumber));
+			}
+			dirty[ndirty++] = blkno;
+			if (nblocks - blkno <= capacity)
+				break;
+		}
+	}
+
+	if (ndirty > 0)
+	{
+		CommandCounterIncrement();
+		state->cid = GetCurrentCommandId(true);
+		snapshot = RegisterSnapshot(GetLatestSnapshot());
+
+		for (i = 0; i < ndirty; i++)
+		{
+			CHECK_FOR_INTERRUPTS();
+			if (online_rewrite_sync_block(state, dirty[i], snapshot))
+				(*nbusy)++;
+		}
+
+		UnregisterSnapshot(snapshot);
+	}
+
+	pfree(dirty);
+
+	return ndirty;
+}
+
+/*
+ * Build the indexes of the new heap, one for each index of the old heap.
+ *
+ * Until the end of the rewrite, the copies in the new heap may come from
+ * different snapshots.  A row that was moved by an update can thus be in
+ * the new heap twice for a while, so the indexes are built without checking
+ * uniqueness or exclusion constraints.  That makes no difference to the
+ * index files, and once the copy is complete the constraints hold in it as
+ * they do in the old heap.  The swap leaves the old indexes' catalog entries
+ * alone, so the constraints stay in force afterwards.
+ */
+static void
+online_rewrite_build_indexes(OnlineRewriteState *state)
+{
+	List	   *indexoids = RelationGetIndexList(state->OldHeap);
+	ListCell   *lc;
+	int			n = 0;
+
+	state->nindexes = list_length(indexoids);
+	if (state->nindexes == 0)
+		return;
+
+	state->oldindexes = (Oid *) palloc(state->nindexes * sizeof(Oid));
+	state->newindexes = (Relation *) palloc(state->nindexes * sizeof(Relation));
+	state->indexinfos = (IndexInfo **) palloc(state->nindexes * sizeof(IndexInfo *));
+
+	foreach(lc, indexoids)
+	{
+		Oid			oldindexoid = lfirst_oid(lc);
+		Relation	oldindex;
+		IndexInfo  *indexInfo;
+		HeapTuple	tuple;
+		HeapTuple	classtup;
+		Datum		indclassDatum;
+		oidvector  *indclass;
+		Datum		reloptions;
+		bool		isnull;
+		List	   *colnames = NIL;
+		char		newname[NAMEDATALEN];
+		Oid			newindexoid;
+		int			i;
+
+		oldindex = index_open(oldindexoid, AccessShareLock);
+
+		indexInfo = BuildIndexInfo(oldindex);
+		indexInfo->ii_Unique = false;
+		indexInfo->ii_ExclusionOps = NULL;
+		indexInfo->ii_ExclusionProcs = NULL;
+		indexInfo->ii_ExclusionStrats = NULL;
+
+		for (i = 0; i < indexInfo->ii_NumIndexAttrs; i++)
+		{
+			Form_pg_attribute attr = TupleDescAttr(RelationGetDescr(oldindex), i);
+
+			colnames = lappend(colnames, pstrdup(NameStr(attr->attname)));
+		}
+
+		tuple = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(oldindexoid));
+		if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "cache lookup failed for index %u", oldindexoid);
+		indclassDatum = SysCacheGetAttr(INDEXRELID, tuple,
+										Anum_pg_index_indclass, &isnull);
+		Assert(!isnull);
+		indclass = (oidvector *) DatumGetPointer(indclassDatum);
+
+		classtup = SearchSysCache1(RELOID, ObjectIdGetDatum(oldindexoid));
+		if (!HeapTupleIsValid(classtup))
+			elog(ERROR, "cache lookup failed for relation %u", oldindexoid);
+		reloptions = SysCacheGetAttr(RELOID, classtup,
+									 Anum_pg_class_reloptions, &isnull);
+		if (isnull)
+			reloptions = (Datum) 0;
+
+		snprintf(newname, sizeof(newname), "pg_temp_%u", oldindexoid);
+
+		newindexoid = index_create(state->NewHeap, newname,
+								   InvalidOid, InvalidOid, InvalidOid,
+								   InvalidOid, indexInfo, colnames,
+								   oldindex->rd_rel->relam,
+								   oldindex->rd_rel->reltablespace,
+								   oldindex->rd_indcollation,
+								   indclass->values,
+								   oldindex->rd_indoption,
+								   reloptions,
+								   0, 0, true, true, NULL);
+
+		ReleaseSysCache(classtup);
+		ReleaseSysCache(tuple);
+		index_close(oldindex, NoLock);
+
+		state->oldindexes[n] = oldindexoid;
+		state->newindexes[n] = index_open(newindexoid, AccessExclusiveLock);
+		state->indexinfos[n] = BuildIndexInfo(state->newindexes[n]);
+		if (state->indexinfos[n]->ii_Predicate != NIL)
+			state->indexinfos[n]->ii_PredicateState =
+				ExecPrepareQual(state->indexinfos[n]->ii_Predicate,
+								state->estate);
+		n++;
+	}
+
+	state->islot = MakeSingleTupleTableSlot(RelationGetDescr(state->NewHeap));
+
+	list_free(indexoids);
+
+	CommandCounterIncrement();
+}
+
+/*
+ * Swap the files of the old heap and its indexes with those built by
+ * pg_rewrite_table_online, and drop the transient table.
+ */
+static void
+finish_online_heap_swap(Oid OIDOldHeap, Oid OIDNewHeap,
+						int nindexes, Oid *oldindexes, Oid *newindexes,
+						TransactionId frozenXid, MultiXactId cutoffMulti)
+{
+	Oid			mapped_tables[4];
+	int			i;
+
+	memset(mapped_tables, 0, sizeof(mapped_tables));
+
+	swap_relation_files(OIDOldHeap, OIDNewHeap, false, false, true,
+						frozenXid, cutoffMulti, mapped_tables);
+
+	for (i = 0; i < nindexes; i++)
+		swap_relation_files(oldindexes[i], newindexes[i], false, false, true,
+							InvalidTransactionId, InvalidMultiXactId,
+							mapped_tables);
+
+	/* As in finish_heap_swap, the schema version history is obsolete now */
+	RemoveAttributeVersions(OIDOldHeap);
+	CommandCounterIncrement();
+
+	drop_transient_heap(OIDOldHeap, OIDNewHeap, false, false, mapped_tables);
+}
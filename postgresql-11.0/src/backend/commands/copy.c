@@ -2047,17 +2047,33 @@ CopyTo(CopyState cstate)
 		bool	   *nulls;
 		HeapScanDesc scandesc;
 		HeapTuple	tuple;
+		EState	   *estate;
+		LazyDefaultState *ldstate;
 
 		values = (Datum *) palloc(num_phys_attrs * sizeof(Datum));
 		nulls = (bool *) palloc(num_phys_attrs * sizeof(bool));
 
 		scandesc = heap_beginscan(cstate->rel, GetActiveSnapshot(), 0, NULL);
 
+		/* Fill in lazy column defaults, and store them, as a query would */
+		estate = CreateExecutorState();
+		estate->es_snapshot = GetActiveSnapshot();
+		ldstate = ExecInitLazyDefaults(cstate->rel, tupDesc, estate,
+									   ExecLazyDefaultsCanStore(cstate->rel,
+																estate));
+
 		processed = 0;
 		while ((tuple = heap_getnext(scandesc, ForwardScanDirection)) != NULL)
 		{
 			CHECK_FOR_INTERRUPTS();
 
+			if (ldstate)
+			{
+				ResetPerTupleExprContext(estate);
+				tuple = ExecFillLazyDefaults(ldstate, tuple,
+											 GetPerTupleExprContext(estate));
+			}
+
 			/* Deconstruct the tuple ... faster than repeated heap_getattr */
 			heap_deform_tuple(tuple, tupDesc, values, nulls);
 
@@ -2068,6 +2084,9 @@ CopyTo(CopyState cstate)
 
 		heap_endscan(scandesc);
 
+		ExecEndLazyDefaults(ldstate);
+		FreeExecutorState(estate);
+
 		pfree(values);
 		pfree(nulls);
 	}
@@ -33,6 +33,7 @@
 #include "utils/builtins.h"
 #include "utils/json.h"
 #include "utils/lsyscache.h"
+#include "utils/migrate_schema.h"
 #include "utils/rel.h"
 #include "utils/ruleutils.h"
 #include "utils/snapmgr.h"
@@ -81,6 +82,8 @@ static void show_upper_qual(List *qual, const char *qlabel,
 				ExplainState *es);
 static void show_sort_keys(SortState *sortstate, List *ancestors,
 			   ExplainState *es);
+static void show_incremental_sort_keys(IncrementalSortState *incrsortstate,
+						   List *ancestors, ExplainState *es);
 static void show_merge_append_keys(MergeAppendState *mstate, List *ancestors,
 					   ExplainState *es);
 static void show_agg_keys(AggState *astate, List *ancestors,
@@ -102,7 +105,10 @@ static void show_sortorder_options(StringInfo buf, Node *sortexpr,
 static void show_tablesample(TableSampleClause *tsc, PlanState *planstate,
 				 List *ancestors, ExplainState *es);
 static void show_sort_info(SortState *sortstate, ExplainState *es);
+static void show_incremental_sort_info(IncrementalSortState *incrsortstate,
+						   ExplainState *es);
 static void show_hash_info(HashState *hashstate, ExplainState *es);
+static void show_hashagg_info(AggState *aggstate, ExplainState *es);
 static void show_tidbitmap_info(BitmapHeapScanState *planstate,
 					ExplainState *es);
 static void show_instrumentation_count(const char *qlabel, int which,
@@ -111,6 +117,7 @@ static void show_foreignscan_info(ForeignScanState *fsstate, ExplainState *es);
 static void show_eval_params(Bitmapset *bms_params, ExplainState *es);
 static const char *explain_get_index_name(Oid indexId);
 static void show_buffer_usage(ExplainState *es, const BufferUsage *usage);
+static void show_migrate_usage(ExplainState *es, const MigrateUsage *usage);
 static void ExplainIndexScanDetails(Oid indexid, ScanDirection indexorderdir,
 						ExplainState *es);
 static void ExplainScanTarget(Scan *plan, ExplainState *es);
@@ -164,6 +171,8 @@ ExplainQuery(ParseState *pstate, ExplainStmt *stmt, const char *queryString,
 			es->costs = defGetBoolean(opt);
 		else if (strcmp(opt->defname, "buffers") == 0)
 			es->buffers = defGetBoolean(opt);
+		else if (strcmp(opt->defname, "migration") == 0)
+			es->migration = defGetBoolean(opt);
 		else if (strcmp(opt->defname, "timing") == 0)
 		{
 			timing_set = true;
@@ -206,6 +215,11 @@ ExplainQuery(ParseState *pstate, ExplainStmt *stmt, const char *queryString,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("EXPLAIN option BUFFERS requires ANALYZE")));
 
+	if (es->migration && !es->analyze)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("EXPLAIN option MIGRATION requires ANALYZE")));
+
 	/* if the timing was not set explicitly, set default value */
 	es->timing = (timing_set) ? es->timing : es->analyze;
 
@@ -468,6 +482,8 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 	QueryDesc  *queryDesc;
 	instr_time	starttime;
 	double		totaltime = 0;
+	instr_time	waitstart;
+	double		waittime = 0;
 	int			eflags;
 	int			instrument_option = 0;
 
@@ -480,6 +496,8 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 
 	if (es->buffers)
 		instrument_option |= INSTRUMENT_BUFFERS;
+	if (es->migration)
+		instrument_option |= INSTRUMENT_MIGRATION;
 
 	/*
 	 * We always collect timing for the entire statement, even when node-level
@@ -539,6 +557,19 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 
 		/* We can't run ExecutorEnd 'till we're done printing the stats... */
 		totaltime += elapsed_time(&starttime);
+
+		/*
+		 * A migration statement waits for the tuples other migrations were
+		 * moving once it is done (see post_query_tasks).  Do that here, so
+		 * that the time it takes can be reported; the wait afterwards then
+		 * finds nothing left to wait for.
+		 */
+		if (es->migration && migrateflag)
+		{
+			INSTR_TIME_SET_CURRENT(waitstart);
+			MigrateWaitForInProgress();
+			waittime = elapsed_time(&waitstart);
+		}
 	}
 
 	ExplainOpenGroup("Query", NULL, true, es);
@@ -594,6 +625,11 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 		ExplainPropertyFloat("Execution Time", "ms", 1000.0 * totaltime, 3,
 							 es);
 
+	/* the wait is not part of the execution time */
+	if (es->summary && es->migration)
+		ExplainPropertyFloat("Migration Wait Time", "ms", 1000.0 * waittime,
+							 3, es);
+
 	ExplainCloseGroup("Query", NULL, true, es);
 }
 
@@ -1140,6 +1176,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Sort:
 			pname = sname = "Sort";
 			break;
+		case T_IncrementalSort:
+			pname = sname = "Incremental Sort";
+			break;
 		case T_Group:
 			pname = sname = "Group";
 			break;
@@ -1754,6 +1793,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			show_hashagg_info(castNode(AggState, planstate), es);
 			break;
 		case T_Group:
 			show_group_keys(castNode(GroupState, planstate), ancestors, es);
@@ -1766,6 +1806,12 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			show_sort_keys(castNode(SortState, planstate), ancestors, es);
 			show_sort_info(castNode(SortState, planstate), es);
 			break;
+		case T_IncrementalSort:
+			show_incremental_sort_keys(castNode(IncrementalSortState, planstate),
+									   ancestors, es);
+			show_incremental_sort_info(castNode(IncrementalSortState, planstate),
+									   es);
+			break;
 		case T_MergeAppend:
 			show_merge_append_keys(castNode(MergeAppendState, planstate),
 								   ancestors, es);
@@ -1793,6 +1839,10 @@ ExplainNode(PlanState *planstate, List *ancestors,
 	if (es->buffers && planstate->instrument)
 		show_buffer_usage(es, &planstate->instrument->bufusage);
 
+	/* Show migration usage */
+	if (es->migration && planstate->instrument)
+		show_migrate_usage(es, &planstate->instrument->migrateusage);
+
 	/* Show worker detail */
 	if (es->analyze && es->verbose && planstate->worker_instrument)
 	{
@@ -1829,6 +1879,8 @@ ExplainNode(PlanState *planstate, List *ancestors,
 				es->indent++;
 				if (es->buffers)
 					show_buffer_usage(es, &instrument->bufusage);
+				if (es->migration)
+					show_migrate_usage(es, &instrument->migrateusage);
 				es->indent--;
 			}
 			else
@@ -1853,6 +1905,8 @@ ExplainNode(PlanState *planstate, List *ancestors,
 
 				if (es->buffers)
 					show_buffer_usage(es, &instrument->bufusage);
+				if (es->migration)
+					show_migrate_usage(es, &instrument->migrateusage);
 
 				ExplainCloseGroup("Worker", NULL, true, es);
 			}
@@ -2106,6 +2160,28 @@ show_sort_keys(SortState *sortstate, List *ancestors, ExplainState *es)
 						 ancestors, es);
 }
 
+/*
+ * Show the sort keys for an IncrementalSort node, and which of them the
+ * input is already sorted by.
+ */
+static void
+show_incremental_sort_keys(IncrementalSortState *incrsortstate,
+						   List *ancestors, ExplainState *es)
+{
+	IncrementalSort *plan = (IncrementalSort *) incrsortstate->ss.ps.plan;
+
+	show_sort_group_keys((PlanState *) incrsortstate, "Sort Key",
+						 plan->sort.numCols, plan->sort.sortColIdx,
+						 plan->sort.sortOperators, plan->sort.collations,
+						 plan->sort.nullsFirst,
+						 ancestors, es);
+	show_sort_group_keys((PlanState *) incrsortstate, "Presorted Key",
+						 plan->nPresortedCols, plan->sort.sortColIdx,
+						 plan->sort.sortOperators, plan->sort.collations,
+						 plan->sort.nullsFirst,
+						 ancestors, es);
+}
+
 /*
  * Likewise, for a MergeAppend node.
  */
@@ -2535,6 +2611,91 @@ show_sort_info(SortState *sortstate, ExplainState *es)
 	}
 }
 
+/*
+ * If it's EXPLAIN ANALYZE, show how many batches an incremental sort sorted,
+ * and the method and space of the largest of them.
+ *
+ * Only the leader's figures are available in a parallel query.
+ */
+static void
+show_incremental_sort_info(IncrementalSortState *incrsortstate,
+						   ExplainState *es)
+{
+	TuplesortInstrumentation stats = incrsortstate->peak_stats;
+	const char *sortMethod;
+	const char *spaceType;
+
+	if (!es->analyze || incrsortstate->nbatches == 0)
+		return;
+
+	/* the batch still being returned hasn't been counted yet */
+	if (incrsortstate->tuplesortstate != NULL)
+	{
+		TuplesortInstrumentation cur;
+
+		tuplesort_get_stats((Tuplesortstate *) incrsortstate->tuplesortstate,
+							&cur);
+		if (stats.sortMethod == SORT_TYPE_STILL_IN_PROGRESS ||
+			cur.spaceUsed > stats.spaceUsed)
+			stats = cur;
+	}
+
+	sortMethod = tuplesort_method_name(stats.sortMethod);
+	spaceType = tuplesort_space_type_name(stats.spaceType);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Sort Method: %s  Batches: " INT64_FORMAT "  Peak %s: %ldkB\n",
+						 sortMethod, incrsortstate->nbatches,
+						 spaceType, stats.spaceUsed);
+	}
+	else
+	{
+		ExplainPropertyText("Sort Method", sortMethod, es);
+		ExplainPropertyInteger("Sort Batches", NULL,
+							   incrsortstate->nbatches, es);
+		ExplainPropertyInteger("Peak Sort Space Used", "kB",
+							   stats.spaceUsed, es);
+		ExplainPropertyText("Sort Space Type", spaceType, es);
+	}
+}
+
+/*
+ * Show the memory and disk used by hashed aggregation, and how many passes
+ * over spilled input it made.
+ *
+ * Only the leader's figures are available in a parallel query.
+ */
+static void
+show_hashagg_info(AggState *aggstate, ExplainState *es)
+{
+	long		memPeakKb = (aggstate->hash_mem_peak + 1023) / 1024;
+
+	if (!es->analyze || aggstate->hash_batches_used == 0)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyInteger("HashAgg Batches", NULL,
+							   aggstate->hash_batches_used, es);
+		ExplainPropertyInteger("Peak Memory Usage", "kB", memPeakKb, es);
+		ExplainPropertyInteger("Disk Usage", "kB",
+							   aggstate->hash_disk_used, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Batches: %d  Memory Usage: %ldkB",
+						 aggstate->hash_batches_used, memPeakKb);
+		if (aggstate->hash_disk_used > 0)
+			appendStringInfo(es->str, "  Disk Usage: %ldkB",
+							 aggstate->hash_disk_used);
+		appendStringInfoChar(es->str, '\n');
+	}
+}
+
 /*
  * Show information on hash buckets/batches.
  */
@@ -2891,6 +3052,52 @@ show_buffer_usage(ExplainState *es, const BufferUsage *usage)
 	}
 }
 
+/*
+ * Show the work a node did for a lazy migration: the tuples it looked up in
+ * a migration bitmap, those it claimed, those it found claimed by another
+ * migration, and the time it waited for bitmap partition locks.
+ */
+static void
+show_migrate_usage(ExplainState *es, const MigrateUsage *usage)
+{
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		/* Show only positive counter values. */
+		if (usage->tuples_checked > 0)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str, "Migration: checked=%ld",
+							 usage->tuples_checked);
+			if (usage->tuples_claimed > 0)
+				appendStringInfo(es->str, " claimed=%ld",
+								 usage->tuples_claimed);
+			if (usage->tuples_in_progress > 0)
+				appendStringInfo(es->str, " in-progress=%ld",
+								 usage->tuples_in_progress);
+			appendStringInfoChar(es->str, '\n');
+		}
+
+		if (!INSTR_TIME_IS_ZERO(usage->lock_wait_time))
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str, "Migration Timings: lock wait=%0.3f\n",
+							 INSTR_TIME_GET_MILLISEC(usage->lock_wait_time));
+		}
+	}
+	else
+	{
+		ExplainPropertyInteger("Migration Checked Tuples", NULL,
+							   usage->tuples_checked, es);
+		ExplainPropertyInteger("Migration Claimed Tuples", NULL,
+							   usage->tuples_claimed, es);
+		ExplainPropertyInteger("Migration In-Progress Tuples", NULL,
+							   usage->tuples_in_progress, es);
+		ExplainPropertyFloat("Migration Lock Wait Time", "ms",
+							 INSTR_TIME_GET_MILLISEC(usage->lock_wait_time),
+							 3, es);
+	}
+}
+
 /*
  * Add some additional details about an IndexScan or IndexOnlyScan
  */
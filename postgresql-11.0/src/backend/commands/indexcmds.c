@@ -16,6 +16,7 @@
 #include "postgres.h"
 
 #include "access/amapi.h"
+#include "access/heapversion.h"
 #include "access/htup_details.h"
 #include "access/reloptions.h"
 #include "access/sysattr.h"
@@ -663,6 +664,38 @@ DefineIndex(Oid relationId,
 					  accessMethodName, accessMethodId,
 					  amcanorder, stmt->isconstraint);
 
+	/*
+	 * The index build reads the heap directly, and would take rows that are
+	 * short of a column with a lazily filled-in default as null there.
+	 */
+	if (RelationHasLazyDefaults(rel))
+	{
+		SchemaVersionInfo *versions = RelationGetSchemaVersionInfo(rel);
+		Bitmapset  *indexattrs = NULL;
+		int			attnum;
+
+		for (i = 0; i < indexInfo->ii_NumIndexAttrs; i++)
+			indexattrs = bms_add_member(indexattrs,
+										indexInfo->ii_IndexAttrNumbers[i] -
+										FirstLowInvalidHeapAttributeNumber);
+		pull_varattnos((Node *) indexInfo->ii_Expressions, 1, &indexattrs);
+		pull_varattnos((Node *) indexInfo->ii_Predicate, 1, &indexattrs);
+
+		attnum = -1;
+		while ((attnum = bms_next_member(versions->lazydefaults, attnum)) >= 0)
+		{
+			if (bms_is_member(attnum - FirstLowInvalidHeapAttributeNumber,
+							  indexattrs) ||
+				bms_is_member(InvalidAttrNumber - FirstLowInvalidHeapAttributeNumber,
+							  indexattrs))
+				ereport(ERROR,
+						(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						 errmsg("cannot index column \"%s\" while its default is filled in lazily",
+								get_attname(relationId, attnum, false)),
+						 errhint("Rewrite the table first, for example with VACUUM FULL.")));
+		}
+	}
+
 	/*
 	 * Extra checks when creating a PRIMARY KEY index.
 	 */
@@ -17,6 +17,7 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/heapam_xlog.h"
+#include "access/heapversion.h"
 #include "access/multixact.h"
 #include "access/reloptions.h"
 #include "access/relscan.h"
@@ -33,6 +34,7 @@
 #include "catalog/objectaccess.h"
 #include "catalog/partition.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_attribute_version.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_constraint.h"
 #include "catalog/pg_depend.h"
@@ -40,6 +42,7 @@
 #include "catalog/pg_inherits.h"
 #include "catalog/pg_namespace.h"
 #include "catalog/pg_opclass.h"
+#include "catalog/pg_proc.h"
 #include "catalog/pg_tablespace.h"
 #include "catalog/pg_trigger.h"
 #include "catalog/pg_type.h"
@@ -102,6 +105,10 @@
 #include "utils/typcache.h"
 
 
+/* GUC variables */
+bool		lazy_alter_column_type = false;
+bool		lazy_add_column = false;
+
 /*
  * ON COMMIT action list
  */
@@ -202,6 +209,8 @@ typedef struct NewColumnValue
 	AttrNumber	attnum;			/* which column */
 	Expr	   *expr;			/* expression to compute */
 	ExprState  *exprstate;		/* execution state */
+	Oid			lazycast;		/* cast to apply lazily, if any */
+	bool		lazydefault;	/* fill in the default lazily? */
 } NewColumnValue;
 
 /*
@@ -347,6 +356,8 @@ static void ATExecCmd(List **wqueue, AlteredTableInfo *tab, Relation rel,
 		  AlterTableCmd *cmd, LOCKMODE lockmode);
 static void ATRewriteTables(AlterTableStmt *parsetree,
 				List **wqueue, LOCKMODE lockmode);
+static bool ColumnHasLazyDefault(Relation rel, AttrNumber attnum);
+static void ATStoreLazyDefaults(AlteredTableInfo *tab);
 static void ATRewriteTable(AlteredTableInfo *tab, Oid OIDNewHeap, LOCKMODE lockmode);
 static AlteredTableInfo *ATGetQueueEntry(List **wqueue, Relation rel);
 static void ATSimplePermissions(Relation rel, int allowed_targets);
@@ -363,6 +374,7 @@ static ObjectAddress ATExecAddColumn(List **wqueue, AlteredTableInfo *tab,
 				Relation rel, ColumnDef *colDef, bool isOid,
 				bool recurse, bool recursing,
 				bool if_not_exists, LOCKMODE lockmode);
+static bool ATColumnDefaultCanBeLazy(Relation rel, ColumnDef *colDef);
 static bool check_for_column_name_collision(Relation rel, const char *colname,
 								bool if_not_exists);
 static void add_column_datatype_dependency(Oid relid, int32 attnum, Oid typid);
@@ -421,6 +433,9 @@ static void ATPrepAlterColumnType(List **wqueue,
 					  bool recurse, bool recursing,
 					  AlterTableCmd *cmd, LOCKMODE lockmode);
 static bool ATColumnChangeRequiresRewrite(Node *expr, AttrNumber varattno);
+static Oid ATColumnChangeLazyCast(Relation rel, Form_pg_attribute attTup,
+					   Node *expr);
+static void ATApplyLazyColumnTypes(AlteredTableInfo *tab, Relation rel);
 static ObjectAddress ATExecAlterColumnType(AlteredTableInfo *tab, Relation rel,
 					  AlterTableCmd *cmd, LOCKMODE lockmode);
 static ObjectAddress ATExecAlterColumnGenericOptions(Relation rel, const char *colName,
@@ -3979,6 +3994,13 @@ ATRewriteCatalogs(List **wqueue, LOCKMODE lockmode)
 			 */
 			rel = relation_open(tab->relid, NoLock);
 
+			/*
+			 * Before changing any column type, see whether the table can skip
+			 * the rewrite.
+			 */
+			if (pass == AT_PASS_ALTER_TYPE)
+				ATApplyLazyColumnTypes(tab, rel);
+
 			foreach(lcmd, subcmds)
 				ATExecCmd(wqueue, tab, rel,
 						  castNode(AlterTableCmd, lfirst(lcmd)),
@@ -4346,6 +4368,13 @@ ATRewriteTables(AlterTableStmt *parsetree, List **wqueue, LOCKMODE lockmode)
 			heap_close(rel, NoLock);
 		}
 
+		/*
+		 * Columns whose default is to be filled in lazily need no rewrite,
+		 * unless there is going to be one anyway.
+		 */
+		if (tab->rewrite == 0 && tab->newvals != NIL)
+			ATStoreLazyDefaults(tab);
+
 		/*
 		 * We only need to rewrite the table if at least one column needs to
 		 * be recomputed, we are adding/removing the OID column, or we are
@@ -4534,6 +4563,64 @@ ATRewriteTables(AlterTableStmt *parsetree, List **wqueue, LOCKMODE lockmode)
 	}
 }
 
+/*
+ * Does the column still have rows that its default is to be filled in for?
+ */
+static bool
+ColumnHasLazyDefault(Relation rel, AttrNumber attnum)
+{
+	SchemaVersionInfo *info = RelationGetSchemaVersionInfo(rel);
+
+	return info != NULL && bms_is_member(attnum, info->lazydefaults);
+}
+
+/*
+ * ATStoreLazyDefaults: record the new columns whose default is filled lazily
+ *
+ * Those columns are left out of the existing rows, which get their values
+ * when they are first read.  If the rows need to be checked against new
+ * constraints, or have more than one schema version, it is simpler to
+ * rewrite the table after all.
+ */
+static void
+ATStoreLazyDefaults(AlteredTableInfo *tab)
+{
+	int16		version = 0;
+	bool		stored = false;
+	ListCell   *l;
+
+	foreach(l, tab->newvals)
+	{
+		NewColumnValue *ex = lfirst(l);
+
+		if (!ex->lazydefault)
+			continue;
+
+		if (!stored)
+		{
+			version = GetRelationSchemaVersion(tab->relid);
+			if (version > 0 || tab->constraints != NIL || tab->new_notnull ||
+				tab->partition_constraint != NULL)
+			{
+				tab->rewrite |= AT_REWRITE_DEFAULT_VAL;
+				return;
+			}
+		}
+
+		StoreAttributeVersion(tab->relid, version, ex->attnum,
+							  InvalidOid, -1, InvalidOid, InvalidOid);
+		stored = true;
+	}
+
+	if (stored)
+	{
+		ereport(DEBUG1,
+				(errmsg("filling in new column defaults of table \"%s\" lazily",
+						get_rel_name(tab->relid))));
+		CommandCounterIncrement();
+	}
+}
+
 /*
  * ATRewriteTable: scan or rewrite one table
  *
@@ -4555,6 +4642,7 @@ ATRewriteTable(AlteredTableInfo *tab, Oid OIDNewHeap, LOCKMODE lockmode)
 	BulkInsertState bistate;
 	int			hi_options;
 	ExprState  *partqualstate = NULL;
+	LazyDefaultState *ldstate = NULL;
 
 	/*
 	 * Open the relation(s).  We have surely already locked the existing
@@ -4721,6 +4809,26 @@ ATRewriteTable(AlteredTableInfo *tab, Oid OIDNewHeap, LOCKMODE lockmode)
 		snapshot = RegisterSnapshot(GetLatestSnapshot());
 		scan = heap_beginscan(oldrel, snapshot, 0, NULL);
 
+		/*
+		 * The old tuples are deformed below using the row type from before
+		 * this command, so tuples of older schema versions must be converted
+		 * to that rather than to the relation's new row type.
+		 */
+		if (tab->rewrite > 0)
+			scan->rs_versions = BuildSchemaVersionInfo(tab->relid, oldTupDesc,
+													   CurrentMemoryContext);
+
+		/*
+		 * Rows short of a column whose default is filled in lazily must get
+		 * it before they are copied or checked.  When only checking, store
+		 * the values too, so that the rows stay as they were checked; a
+		 * rewrite forgets about lazy defaults anyway.
+		 */
+		estate->es_snapshot = snapshot;
+		ldstate = ExecInitLazyDefaults(oldrel,
+									   newrel ? oldTupDesc : newTupDesc,
+									   estate, newrel == NULL);
+
 		/*
 		 * Switch to per-tuple memory context and reset it for each tuple
 		 * produced, so we don't leak memory.
@@ -4729,6 +4837,9 @@ ATRewriteTable(AlteredTableInfo *tab, Oid OIDNewHeap, LOCKMODE lockmode)
 
 		while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
 		{
+			if (ldstate)
+				tuple = ExecFillLazyDefaults(ldstate, tuple, econtext);
+
 			if (tab->rewrite > 0)
 			{
 				Oid			tupOid = InvalidOid;
@@ -4840,11 +4951,14 @@ ATRewriteTable(AlteredTableInfo *tab, Oid OIDNewHeap, LOCKMODE lockmode)
 		}
 
 		MemoryContextSwitchTo(oldCxt);
+		if (tab->rewrite > 0 && scan->rs_versions)
+			FreeSchemaVersionInfo(scan->rs_versions);
 		heap_endscan(scan);
 		UnregisterSnapshot(snapshot);
 
 		ExecDropSingleTupleTableSlot(oldslot);
 		ExecDropSingleTupleTableSlot(newslot);
+		ExecEndLazyDefaults(ldstate);
 	}
 
 	FreeExecutorState(estate);
@@ -5336,6 +5450,29 @@ ATPrepAddColumn(List **wqueue, Relation rel, bool recurse, bool recursing,
 		cmd->subtype = AT_AddColumnRecurse;
 }
 
+/*
+ * A new column whose default is volatile, and so can't be stored as the
+ * column's missing value, can still be added without a rewrite if the
+ * default is filled in as the existing rows are read (see
+ * executor/execLazyDefault.c).  That only works for plain tables whose rows
+ * all have the same schema version, and only as long as nothing needs to
+ * check the values as they are added; ATRewriteTables makes the final call.
+ */
+static bool
+ATColumnDefaultCanBeLazy(Relation rel, ColumnDef *colDef)
+{
+	if (!lazy_add_column ||
+		rel->rd_rel->relkind != RELKIND_RELATION ||
+		IsCatalogRelation(rel) ||
+		RelationIsUsedAsCatalogTable(rel))
+		return false;
+
+	if (colDef->identity || colDef->is_not_null)
+		return false;
+
+	return RelationGetSchemaVersion(rel) == 0;
+}
+
 /*
  * Add a column to a table; this handles the AT_AddOids cases as well.  The
  * return value is the address of the new column in the parent relation.
@@ -5359,6 +5496,7 @@ ATExecAddColumn(List **wqueue, AlteredTableInfo *tab, Relation rel,
 	Oid			collOid;
 	Form_pg_type tform;
 	Expr	   *defval;
+	bool		lazydefault = false;
 	List	   *children;
 	ListCell   *child;
 	AclResult	aclresult;
@@ -5569,10 +5707,15 @@ ATExecAddColumn(List **wqueue, AlteredTableInfo *tab, Relation rel,
 
 		/*
 		 * Did the request for a missing value work? If not we'll have to do a
-		 * rewrite
+		 * rewrite, unless the default can be filled in as rows are read.
 		 */
 		if (!rawEnt->missingMode)
-			tab->rewrite |= AT_REWRITE_DEFAULT_VAL;
+		{
+			if (ATColumnDefaultCanBeLazy(rel, colDef))
+				lazydefault = true;
+			else
+				tab->rewrite |= AT_REWRITE_DEFAULT_VAL;
+		}
 	}
 
 	/*
@@ -5654,6 +5797,7 @@ ATExecAddColumn(List **wqueue, AlteredTableInfo *tab, Relation rel,
 			newval = (NewColumnValue *) palloc0(sizeof(NewColumnValue));
 			newval->attnum = attribute.attnum;
 			newval->expr = expression_planner(defval);
+			newval->lazydefault = lazydefault;
 
 			tab->newvals = lappend(tab->newvals, newval);
 		}
@@ -6126,6 +6270,14 @@ ATExecColumnDefault(Relation rel, const char *colName,
 						colName, RelationGetRelationName(rel)),
 				 newDefault ? 0 : errhint("Use ALTER TABLE ... ALTER COLUMN ... DROP IDENTITY instead.")));
 
+	/* The default is still needed to fill in the rows added before it */
+	if (ColumnHasLazyDefault(rel, attnum))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("cannot change default of column \"%s\" of relation \"%s\" while it is filled in lazily",
+						colName, RelationGetRelationName(rel)),
+				 errhint("Rewrite the table first, for example with VACUUM FULL.")));
+
 	/*
 	 * Remove any old default for the column.  We use RESTRICT here for
 	 * safety, but at present we do not expect anything to depend on the
@@ -8454,6 +8606,7 @@ validateCheckConstraint(Relation rel, HeapTuple constrtup)
 	Form_pg_constraint constrForm;
 	bool		isnull;
 	Snapshot	snapshot;
+	LazyDefaultState *ldstate;
 
 	/*
 	 * VALIDATE CONSTRAINT is a no-op for foreign tables and partitioned
@@ -8489,6 +8642,11 @@ validateCheckConstraint(Relation rel, HeapTuple constrtup)
 	snapshot = RegisterSnapshot(GetLatestSnapshot());
 	scan = heap_beginscan(rel, snapshot, 0, NULL);
 
+	/* rows must be checked with the lazy column defaults they will keep */
+	estate->es_snapshot = snapshot;
+	ldstate = ExecInitLazyDefaults(rel, tupdesc, estate,
+								   ExecLazyDefaultsCanStore(rel, estate));
+
 	/*
 	 * Switch to per-tuple memory context and reset it for each tuple
 	 * produced, so we don't leak memory.
@@ -8497,6 +8655,9 @@ validateCheckConstraint(Relation rel, HeapTuple constrtup)
 
 	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
 	{
+		if (ldstate)
+			tuple = ExecFillLazyDefaults(ldstate, tuple, econtext);
+
 		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
 
 		if (!ExecCheck(exprstate, econtext))
@@ -8513,6 +8674,7 @@ validateCheckConstraint(Relation rel, HeapTuple constrtup)
 	heap_endscan(scan);
 	UnregisterSnapshot(snapshot);
 	ExecDropSingleTupleTableSlot(slot);
+	ExecEndLazyDefaults(ldstate);
 	FreeExecutorState(estate);
 }
 
@@ -9098,6 +9260,14 @@ ATPrepAlterColumnType(List **wqueue,
 				 errmsg("cannot alter inherited column \"%s\"",
 						colName)));
 
+	/* Nor columns whose default has yet to be filled in */
+	if (ColumnHasLazyDefault(rel, attnum))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("cannot alter type of column \"%s\" while its default is filled in lazily",
+						colName),
+				 errhint("Rewrite the table first, for example with VACUUM FULL.")));
+
 	/* Don't alter columns used in the partition key */
 	if (has_partition_attrs(rel,
 							bms_make_singleton(attnum - FirstLowInvalidHeapAttributeNumber),
@@ -9192,7 +9362,12 @@ ATPrepAlterColumnType(List **wqueue,
 
 		tab->newvals = lappend(tab->newvals, newval);
 		if (ATColumnChangeRequiresRewrite(transform, attnum))
+		{
 			tab->rewrite |= AT_REWRITE_COLUMN_REWRITE;
+			if (def->cooked_default == NULL)
+				newval->lazycast = ATColumnChangeLazyCast(rel, attTup,
+														  transform);
+		}
 	}
 	else if (transform)
 		ereport(ERROR,
@@ -9322,6 +9497,125 @@ ATColumnChangeRequiresRewrite(Node *expr, AttrNumber varattno)
 	}
 }
 
+/*
+ * When a column type change does require a rewrite, it can nevertheless be
+ * applied lazily if the new value is merely the old one passed through an
+ * implicit cast function that is immutable: old tuples can then be converted
+ * whenever they are read (see access/heap/heapversion.c).  Implicit casts are
+ * expected not to fail, so a read can't run into an error that ALTER TABLE
+ * would have reported.  Returns the cast function, or InvalidOid if the
+ * change has to be made by rewriting the table.
+ */
+static Oid
+ATColumnChangeLazyCast(Relation rel, Form_pg_attribute attTup, Node *expr)
+{
+	FuncExpr   *fexpr;
+	Var		   *var;
+	Oid			castfunc;
+
+	if (!lazy_alter_column_type ||
+		rel->rd_rel->relkind != RELKIND_RELATION ||
+		IsCatalogRelation(rel) ||
+		RelationIsUsedAsCatalogTable(rel) ||
+		attTup->atthasmissing)
+		return InvalidOid;
+
+	if (!IsA(expr, FuncExpr))
+		return InvalidOid;
+	fexpr = (FuncExpr *) expr;
+	if (fexpr->funcretset || list_length(fexpr->args) != 1)
+		return InvalidOid;
+
+	var = (Var *) linitial(fexpr->args);
+	if (!IsA(var, Var) || var->varattno != attTup->attnum)
+		return InvalidOid;
+
+	if (find_coercion_pathway(fexpr->funcresulttype, attTup->atttypid,
+							  COERCION_IMPLICIT,
+							  &castfunc) != COERCION_PATH_FUNC ||
+		castfunc != fexpr->funcid ||
+		func_volatile(castfunc) != PROVOLATILE_IMMUTABLE)
+		return InvalidOid;
+
+	return castfunc;
+}
+
+/*
+ * ATApplyLazyColumnTypes: skip the rewrite for lazy column type changes
+ *
+ * If the only reason to rewrite the table is column type changes that can
+ * all be applied lazily, record the current column types under a new schema
+ * version instead and cancel the rewrite; tuples written so far will be
+ * converted when they are read.  This runs before the ALTER TYPE pass, while
+ * pg_attribute still shows the old types.  Since any subcommand of a later
+ * pass might want a rewrite after all, we only try when there are none.
+ */
+static void
+ATApplyLazyColumnTypes(AlteredTableInfo *tab, Relation rel)
+{
+	int			version;
+	int			pass;
+	ListCell   *l;
+
+	if (tab->rewrite != AT_REWRITE_COLUMN_REWRITE ||
+		tab->relkind != RELKIND_RELATION)
+		return;
+
+	/* rows short of a lazily added column have to be filled in first */
+	if (RelationHasLazyDefaults(rel))
+		return;
+
+	for (pass = 0; pass < AT_NUM_PASSES; pass++)
+	{
+		if (pass != AT_PASS_ALTER_TYPE && tab->subcmds[pass] != NIL)
+			return;
+	}
+
+	foreach(l, tab->newvals)
+	{
+		NewColumnValue *ex = lfirst(l);
+
+		if (!OidIsValid(ex->lazycast) &&
+			ATColumnChangeRequiresRewrite((Node *) ex->expr, ex->attnum))
+			return;
+	}
+
+	version = GetRelationSchemaVersion(tab->relid) + 1;
+	if (version > MaxSchemaVersion)
+	{
+		ereport(DEBUG1,
+				(errmsg("too many schema versions to change column types of table \"%s\" lazily",
+						RelationGetRelationName(rel))));
+		return;
+	}
+
+	/*
+	 * A rewrite would have checked this; the table's row type must not be
+	 * stored anywhere else.
+	 */
+	find_composite_type_dependencies(rel->rd_rel->reltype, rel, NULL);
+
+	foreach(l, tab->newvals)
+	{
+		NewColumnValue *ex = lfirst(l);
+		Form_pg_attribute attr = TupleDescAttr(tab->oldDesc, ex->attnum - 1);
+
+		if (OidIsValid(ex->lazycast))
+			StoreAttributeVersion(tab->relid, version, ex->attnum,
+								  attr->atttypid, attr->atttypmod,
+								  attr->attcollation, ex->lazycast);
+	}
+
+	ereport(DEBUG1,
+			(errmsg("changing column types of table \"%s\" lazily",
+					RelationGetRelationName(rel))));
+
+	tab->newvals = NIL;
+	tab->rewrite = 0;
+
+	CommandCounterIncrement();
+}
+
 /*
  * ALTER COLUMN .. SET DATA TYPE
  *
@@ -15102,3 +15396,146 @@ update_relispartition(Relation classRel, Oid relationId, bool newval)
 	if (opened)
 		heap_close(classRel, RowExclusiveLock);
 }
+
+/*
+ * pg_upgrade_tuple_versions
+ *
+ * Convert tuples that a lazy ALTER COLUMN TYPE left in an older schema
+ * version, by updating them in place, so that readers need not do it over
+ * and over.  At most max_tuples tuples are converted per call (all of them,
+ * if max_tuples is zero or less), so that a large table can be processed in
+ * a series of short transactions.  Returns the number of tuples converted.
+ * Rows that lack a column added by a lazy ADD COLUMN get its default filled
+ * in the same way, and count as converted.
+ *
+ * Tuples that are concurrently updated or deleted are skipped; the newer
+ * version is current anyway.  No triggers are fired, and no constraints are
+ * checked, since the row's value does not change as far as readers can tell.
+ */
+Datum
+pg_upgrade_tuple_versions(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		max_tuples = PG_GETARG_INT32(1);
+	Relation	rel;
+	AclResult	aclresult;
+	SchemaVersionInfo *versions;
+	EState	   *estate;
+	ResultRelInfo *resultRelInfo;
+	TupleTableSlot *slot;
+	Snapshot	snapshot;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	MemoryContext oldcxt;
+	LazyDefaultState *ldstate;
+	int64		nconverted = 0;
+
+	rel = heap_open(relid, RowExclusiveLock);
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(rel))));
+
+	aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_UPDATE);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, get_relkind_objtype(rel->rd_rel->relkind),
+					   RelationGetRelationName(rel));
+
+	versions = RelationGetSchemaVersionInfo(rel);
+	if (versions == NULL)
+	{
+		heap_close(rel, NoLock);
+		PG_RETURN_INT64(0);
+	}
+
+	estate = CreateExecutorState();
+	resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
+	estate->es_result_relations = resultRelInfo;
+	estate->es_num_result_relations = 1;
+	estate->es_result_relation_info = resultRelInfo;
+	ExecOpenIndices(resultRelInfo, false);
+	slot = ExecInitExtraTupleSlot(estate, RelationGetDescr(rel));
+
+	/*
+	 * Scan the raw tuples.  Our updates use the snapshot's command ID, so
+	 * the scan won't come across the new tuple versions.
+	 */
+	snapshot = RegisterSnapshot(GetLatestSnapshot());
+	scan = heap_beginscan(rel, snapshot, 0, NULL);
+	scan->rs_versions = NULL;
+
+	estate->es_snapshot = snapshot;
+	ldstate = ExecInitLazyDefaults(rel, RelationGetDescr(rel), estate, true);
+
+	oldcxt = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+
+	while ((max_tuples <= 0 || nconverted < max_tuples) &&
+		   (tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		HeapTuple	newtup;
+		HTSU_Result result;
+		HeapUpdateFailureData hufd;
+		LockTupleMode lockmode;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ldstate &&
+			HeapTupleHeaderGetNatts(tuple->t_data) < RelationGetNumberOfAttributes(rel))
+		{
+			ResetPerTupleExprContext(estate);
+			if (ExecFillLazyDefaults(ldstate, tuple,
+									 GetPerTupleExprContext(estate)) != tuple)
+				nconverted++;
+			continue;
+		}
+
+		if (HeapTupleHeaderGetSchemaVersion(tuple->t_data) == versions->current)
+			continue;
+
+		ResetPerTupleExprContext(estate);
+		newtup = heap_upgrade_tuple(tuple, versions);
+
+		result = heap_update(rel, &tuple->t_self, newtup,
+							 GetCurrentCommandId(true), InvalidSnapshot,
+							 true /* wait for commit */ ,
+							 &hufd, &lockmode);
+		switch (result)
+		{
+			case HeapTupleMayBeUpdated:
+				break;
+
+			case HeapTupleUpdated:
+				/* concurrently updated or deleted, so leave it be */
+				continue;
+
+			default:
+				elog(ERROR, "unrecognized heap_update status: %u", result);
+				break;
+		}
+
+		if (resultRelInfo->ri_NumIndices > 0 && !HeapTupleIsHeapOnly(newtup))
+		{
+			ExecStoreTuple(newtup, slot, InvalidBuffer, false);
+			list_free(ExecInsertIndexTuples(slot, &(newtup->t_self),
+											estate, false, NULL, NIL));
+		}
+
+		nconverted++;
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	heap_endscan(scan);
+	UnregisterSnapshot(snapshot);
+
+	ExecEndLazyDefaults(ldstate);
+	ExecCloseIndices(resultRelInfo);
+	ExecResetTupleTable(estate->es_tupleTable, false);
+	FreeExecutorState(estate);
+
+	heap_close(rel, NoLock);
+
+	PG_RETURN_INT64(nconverted);
+}
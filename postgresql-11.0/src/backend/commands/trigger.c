@@ -15,6 +15,7 @@
 
 #include "access/genam.h"
 #include "access/heapam.h"
+#include "access/heapversion.h"
 #include "access/sysattr.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
@@ -3396,6 +3397,9 @@ ltrmark:;
 		LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
 	}
 
+	/* Convert a tuple written under an older schema version */
+	heap_tuple_upgrade(relation, &tuple);
+
 	if (HeapTupleHeaderGetNatts(tuple.t_data) < relation->rd_att->natts)
 		result = heap_expand_tuple(&tuple, relation->rd_att);
 	else
@@ -4214,6 +4218,7 @@ AfterTriggerExecute(AfterTriggerEvent event,
 	HeapTuple	rettuple;
 	Buffer		buffer1 = InvalidBuffer;
 	Buffer		buffer2 = InvalidBuffer;
+	MemoryContext oldContext;
 	int			tgindx;
 
 	/*
@@ -4287,6 +4292,9 @@ AfterTriggerExecute(AfterTriggerEvent event,
 				ItemPointerCopy(&(event->ate_ctid1), &(tuple1.t_self));
 				if (!heap_fetch(rel, SnapshotAny, &tuple1, &buffer1, false, NULL))
 					elog(ERROR, "failed to fetch tuple1 for AFTER trigger");
+				oldContext = MemoryContextSwitchTo(per_tuple_context);
+				heap_tuple_upgrade(rel, &tuple1);
+				MemoryContextSwitchTo(oldContext);
 				LocTriggerData.tg_trigtuple = &tuple1;
 				LocTriggerData.tg_trigtuplebuf = buffer1;
 			}
@@ -4304,6 +4312,9 @@ AfterTriggerExecute(AfterTriggerEvent event,
 				ItemPointerCopy(&(event->ate_ctid2), &(tuple2.t_self));
 				if (!heap_fetch(rel, SnapshotAny, &tuple2, &buffer2, false, NULL))
 					elog(ERROR, "failed to fetch tuple2 for AFTER trigger");
+				oldContext = MemoryContextSwitchTo(per_tuple_context);
+				heap_tuple_upgrade(rel, &tuple2);
+				MemoryContextSwitchTo(oldContext);
 				LocTriggerData.tg_newtuple = &tuple2;
 				LocTriggerData.tg_newtuplebuf = buffer2;
 			}
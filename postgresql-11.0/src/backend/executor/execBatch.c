@@ -0,0 +1,128 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.c
+ *	  support for passing tuples between plan nodes a batch at a time
+ *
+ * ExecProcNode returns one tuple per call, so a node reading a large input
+ * pays for a chain of calls through its child, and through the child's
+ * scan machinery, for every tuple.  When executor_batch_size is set, nodes
+ * that can produce tuples in batches (SeqScan and Result) install an
+ * ExecProcNodeBatch method, which fills an array of up to that many
+ * qualifying, projected tuples in one call.  Nodes that consume a whole
+ * input (Agg and Hash) fetch from such a child with ExecBatchNext instead of
+ * ExecProcNode.
+ *
+ * A producer keeps a slot per tuple of the batch, so the tuples of a batch
+ * remain valid together until its consumer asks for the next one.  Any
+ * other node is still called a tuple at a time.
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execBatch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "miscadmin.h"
+
+
+/* GUC parameter: maximum number of tuples in a batch, or 0 to disable */
+int			executor_batch_size = 0;
+
+
+/* ----------------------------------------------------------------
+ *		ExecProcNodeBatch
+ *
+ *		Execute the given node to return up to maxslots tuples, and return
+ *		how many it stored in slots.  Zero means it has no more.  The node
+ *		must have an ExecProcNodeBatch method.
+ * ----------------------------------------------------------------
+ */
+int
+ExecProcNodeBatch(PlanState *node, TupleTableSlot **slots, int maxslots)
+{
+	int			ntuples;
+
+	Assert(node->ExecProcNodeBatch != NULL);
+
+	check_stack_depth();
+
+	if (node->chgParam != NULL) /* something changed? */
+		ExecReScan(node);		/* let ReScan handle this */
+
+	if (node->instrument)
+		InstrStartNode(node->instrument);
+
+	ntuples = node->ExecProcNodeBatch(node, slots, maxslots);
+
+	if (node->instrument)
+		InstrStopNode(node->instrument, ntuples);
+
+	return ntuples;
+}
+
+/*
+ * ExecInitBatchSlots -- make the slots a producer returns its batches in
+ */
+TupleTableSlot **
+ExecInitBatchSlots(EState *estate, TupleDesc tupdesc, int nslots)
+{
+	TupleTableSlot **slots;
+	int			i;
+
+	slots = (TupleTableSlot **) palloc(nslots * sizeof(TupleTableSlot *));
+	for (i = 0; i < nslots; i++)
+		slots[i] = ExecInitExtraTupleSlot(estate, tupdesc);
+
+	return slots;
+}
+
+/*
+ * ExecInitTupleBatch -- set up to read outerPlan a batch at a time
+ *
+ * Returns NULL if batches are disabled or outerPlan can't produce them, in
+ * which case the caller reads it with ExecProcNode.
+ */
+TupleBatch *
+ExecInitTupleBatch(PlanState *outerPlan)
+{
+	TupleBatch *batch;
+
+	if (executor_batch_size <= 0 || outerPlan == NULL ||
+		outerPlan->ExecProcNodeBatch == NULL)
+		return NULL;
+
+	batch = (TupleBatch *) palloc(sizeof(TupleBatch));
+	batch->maxtuples = executor_batch_size;
+	batch->ntuples = 0;
+	batch->next = 0;
+	batch->tuples = (TupleTableSlot **)
+		palloc(batch->maxtuples * sizeof(TupleTableSlot *));
+
+	return batch;
+}
+
+/*
+ * ExecProjectInto -- project like ExecProject, into the given slot
+ *
+ * A producer projects each tuple of a batch into a slot of its own.  The
+ * projection's expression finds its result slot when it runs, whether
+ * interpreted or compiled, so it can be pointed at each slot in turn.  The
+ * slot must have the descriptor of the projection's own result slot.
+ */
+TupleTableSlot *
+ExecProjectInto(ProjectionInfo *projInfo, TupleTableSlot *slot)
+{
+	TupleTableSlot *resultslot = projInfo->pi_state.resultslot;
+
+	projInfo->pi_state.resultslot = slot;
+	slot = ExecProject(projInfo);
+	projInfo->pi_state.resultslot = resultslot;
+
+	return slot;
+}
@@ -37,6 +37,11 @@
  * ExecReadyInterpretedExpr will choose to implement certain simple
  * opcode patterns using special fast-path routines (ExecJust*).
  *
+ * ExecQualBatch evaluates a scan qual over a batch of tuples at once, for
+ * scan nodes returning batches (see execBatch.c).  The commonest qual, a
+ * strict comparison of a column with a constant, runs as a loop over the
+ * batch that calls the comparison function directly.
+ *
  * Complex or uncommon instructions are not implemented in-line in
  * ExecInterpExpr(), rather we call out to a helper function appearing later
  * in this file.  For one reason, there'd not be a noticeable performance
@@ -158,6 +163,9 @@ static Datum ExecJustAssignInnerVar(ExprState *state, ExprContext *econtext, boo
 static Datum ExecJustAssignOuterVar(ExprState *state, ExprContext *econtext, bool *isnull);
 static Datum ExecJustAssignScanVar(ExprState *state, ExprContext *econtext, bool *isnull);
 static Datum ExecJustApplyFuncToCase(ExprState *state, ExprContext *econtext, bool *isnull);
+static void ExecQualBatchPrepare(ExprState *state, ExprContext *econtext);
+static int ExecQualBatchVarConst(ExprState *state, ExprContext *econtext,
+					  TupleTableSlot **slots, int nslots, int *sel);
 
 
 /*
@@ -2091,6 +2099,149 @@ ExecJustApplyFuncToCase(ExprState *state, ExprContext *econtext, bool *isnull)
 	return d;
 }
 
+/*
+ * ExecQualBatch
+ *
+ * Evaluate a qual prepared with ExecInitQual for each of a batch of scan
+ * tuples.  Stores the positions of the tuples satisfying it in sel, in
+ * order, and returns how many there are.
+ *
+ * The batch is deformed as far as the qual needs before it's tested, and
+ * per-tuple memory isn't reset between tuples, as a batch's projections
+ * must outlive each other anyway.
+ */
+int
+ExecQualBatch(ExprState *state, ExprContext *econtext,
+			  TupleTableSlot **slots, int nslots, int *sel)
+{
+	int			npassed = 0;
+	int			i;
+
+	/* short-circuit (here and in ExecInitQual) for empty restriction list */
+	if (state == NULL)
+	{
+		for (i = 0; i < nslots; i++)
+			sel[i] = i;
+		return nslots;
+	}
+
+	/* verify that expression was compiled using ExecInitQual */
+	Assert(state->flags & EEO_FLAG_IS_QUAL);
+
+	if (nslots == 0)
+		return 0;
+
+	if (!(state->flags & EEO_FLAG_BATCH_CHECKED))
+	{
+		econtext->ecxt_scantuple = slots[0];
+		ExecQualBatchPrepare(state, econtext);
+	}
+
+	/* deform the whole batch first, as EEOP_SCAN_FETCHSOME would */
+	if (ExecEvalStepOp(state, &state->steps[0]) == EEOP_SCAN_FETCHSOME)
+	{
+		int			last_var = state->steps[0].d.fetch.last_var;
+
+		for (i = 0; i < nslots; i++)
+			slot_getsomeattrs(slots[i], last_var);
+	}
+
+	if (state->flags & EEO_FLAG_BATCH_VAR_CONST)
+		return ExecQualBatchVarConst(state, econtext, slots, nslots, sel);
+
+	for (i = 0; i < nslots; i++)
+	{
+		econtext->ecxt_scantuple = slots[i];
+		if (ExecQual(state, econtext))
+			sel[npassed++] = i;
+	}
+
+	return npassed;
+}
+
+/*
+ * Check, the first time a qual is evaluated over a batch, that it's still
+ * valid, and whether it can run as a loop over the batch: it must be a
+ * single strict function of a scan column and a constant, in either order.
+ */
+static void
+ExecQualBatchPrepare(ExprState *state, ExprContext *econtext)
+{
+	CheckExprStillValid(state, econtext);
+
+	state->flags |= EEO_FLAG_BATCH_CHECKED;
+
+	if (state->steps_len == 6 &&
+		ExecEvalStepOp(state, &state->steps[0]) == EEOP_SCAN_FETCHSOME &&
+		ExecEvalStepOp(state, &state->steps[3]) == EEOP_FUNCEXPR_STRICT &&
+		state->steps[3].d.func.nargs == 2 &&
+		ExecEvalStepOp(state, &state->steps[4]) == EEOP_QUAL)
+	{
+		ExprEvalOp	step1 = ExecEvalStepOp(state, &state->steps[1]);
+		ExprEvalOp	step2 = ExecEvalStepOp(state, &state->steps[2]);
+
+		if ((step1 == EEOP_SCAN_VAR && step2 == EEOP_CONST) ||
+			(step1 == EEOP_CONST && step2 == EEOP_SCAN_VAR))
+			state->flags |= EEO_FLAG_BATCH_VAR_CONST;
+	}
+}
+
+/*
+ * Evaluate a qual comparing a scan column with a constant over a deformed
+ * batch.  The steps store the column's and the constant's values straight
+ * into the function's arguments, so the loop does the same.
+ */
+static int
+ExecQualBatchVarConst(ExprState *state, ExprContext *econtext,
+					  TupleTableSlot **slots, int nslots, int *sel)
+{
+	ExprEvalStep *varop = &state->steps[1];
+	ExprEvalStep *constop = &state->steps[2];
+	ExprEvalStep *funcop = &state->steps[3];
+	FunctionCallInfo fcinfo = funcop->d.func.fcinfo_data;
+	MemoryContext oldcontext;
+	int			attnum;
+	int			npassed = 0;
+	int			i;
+
+	if (ExecEvalStepOp(state, varop) == EEOP_CONST)
+	{
+		varop = &state->steps[2];
+		constop = &state->steps[1];
+	}
+	attnum = varop->d.var.attnum;
+
+	/* strict function, so a null constant fails every tuple */
+	if (constop->d.constval.isnull)
+		return 0;
+	*constop->resvalue = constop->d.constval.value;
+	*constop->resnull = false;
+
+	oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < nslots; i++)
+	{
+		TupleTableSlot *slot = slots[i];
+		Datum		d;
+
+		if (slot->tts_isnull[attnum])
+			continue;
+
+		*varop->resvalue = slot->tts_values[attnum];
+		*varop->resnull = false;
+
+		econtext->ecxt_scantuple = slot;
+		fcinfo->isnull = false;
+		d = funcop->d.func.fn_addr(fcinfo);
+		if (!fcinfo->isnull && DatumGetBool(d))
+			sel[npassed++] = i;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return npassed;
+}
+
 #if defined(EEO_USE_COMPUTED_GOTO)
 /*
  * Comparator used when building address->opcode lookup table for
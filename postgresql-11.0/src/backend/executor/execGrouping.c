@@ -312,6 +312,34 @@ FindTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 	return entry;
 }
 
+/*
+ * Compute the hash value the given tuple would have in the hashtable,
+ * without looking it up.  The tuple must be the same type as the hashtable
+ * entries.
+ *
+ * This lets a caller that can't add the tuple to the table, such as hash
+ * aggregation once it has used up its memory, partition it consistently with
+ * LookupTupleHashEntry.
+ */
+uint32
+TupleHashTableHashSlot(TupleHashTable hashtable, TupleTableSlot *slot)
+{
+	MemoryContext oldContext;
+	uint32		hash;
+
+	/* Need to run the hash functions in short-lived context */
+	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
+
+	hashtable->inputslot = slot;
+	hashtable->in_hash_funcs = hashtable->tab_hash_funcs;
+
+	hash = TupleHashTableHash(hashtable->hashtab, NULL);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return hash;
+}
+
 /*
  * Compute the hash value for a tuple
  *
@@ -0,0 +1,472 @@
+/*-------------------------------------------------------------------------
+ *
+ * execLazyDefault.c
+ *	  routines for filling in lazily materialized column defaults
+ *
+ * ADD COLUMN with a volatile default, such as clock_timestamp() or
+ * gen_random_uuid(), would have to rewrite the whole table, since each row
+ * gets a value of its own.  When lazy_add_column is on, ALTER TABLE instead
+ * only records the column in pg_attribute_version, and the rows that
+ * existed at the time remain one column short.  The routines here compute
+ * the default for such a row when it is read.
+ *
+ * For that value to be the one every reader sees, the first reader stores
+ * it, by updating the row in place of the ALTER TABLE that didn't.  The
+ * update claims the row exactly once: a concurrent reader of the same row
+ * blocks on it until the first one finishes, and then either finds the
+ * value committed in the newer row version or, if the first one aborted,
+ * stores a value of its own.  A reader whose snapshot predates the update
+ * still reads the old, short row version, but takes the stored value all
+ * the same.  Such readers take RowExclusiveLock on the table, to keep out
+ * CREATE INDEX and the like; a scan only does once it comes across a short
+ * row.
+ *
+ * Some readers can't store the value, and only fill it into the row they
+ * return, so that it may differ from the one stored later: readers on a hot
+ * standby or in a read-only transaction, readers of a table that their own
+ * query updates, deletes from or locks rows of, as those would make the
+ * query's own write fail (an UPDATE stores the value it read), and readers
+ * of a migration source, whose tuples a migration moves exactly once
+ * instead.  Any rewrite of the table (ALTER TABLE, CLUSTER, VACUUM FULL or
+ * an online rewrite) stores a value for every short row, and so does
+ * pg_upgrade_tuple_versions().
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execLazyDefault.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/heapversion.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "executor/executor.h"
+#include "rewrite/rewriteHandler.h"
+#include "storage/bufmgr.h"
+#include "storage/lmgr.h"
+#include "utils/datum.h"
+#include "utils/migrate_schema.h"
+#include "utils/rel.h"
+#include "utils/tqual.h"
+
+
+static bool LazyDefaultsRelationIsTarget(EState *estate, Oid relid);
+static void LazyDefaultsStore(LazyDefaultState *ldstate, HeapTuple tuple,
+				  Datum *values, bool *isnull);
+static void LazyDefaultsFetchStored(LazyDefaultState *ldstate,
+						HeapUpdateFailureData *hufd, int natts,
+						Datum *values, bool *isnull);
+static void ShutdownScanLazyDefaults(Datum arg);
+
+
+/*
+ * ExecInitLazyDefaults
+ *
+ * Prepare to fill in the lazy column defaults of rows of rel, formed as
+ * tupdesc, which is normally the relation's own row type.  Returns NULL if
+ * the relation has no such columns.  If writeback is true, the filled-in
+ * values are also stored, which requires the rows to have been read with
+ * estate's snapshot; see ExecLazyDefaultsCanStore.
+ */
+LazyDefaultState *
+ExecInitLazyDefaults(Relation rel, TupleDesc tupdesc, EState *estate,
+					 bool writeback)
+{
+	SchemaVersionInfo *info = RelationGetSchemaVersionInfo(rel);
+	LazyDefaultState *ldstate;
+	MemoryContext oldcxt;
+	int			attnum;
+	int			n;
+
+	if (info == NULL || bms_is_empty(info->lazydefaults))
+		return NULL;
+
+	if (writeback && RecoveryInProgress())
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot fill in column defaults of table \"%s\" during recovery",
+						RelationGetRelationName(rel)),
+				 errhint("Run pg_upgrade_tuple_versions() on the table on the primary server.")));
+	if (writeback && IsInParallelMode())
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TRANSACTION_STATE),
+				 errmsg("cannot fill in column defaults of table \"%s\" during a parallel operation",
+						RelationGetRelationName(rel))));
+
+	oldcxt = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	ldstate = (LazyDefaultState *) palloc0(sizeof(LazyDefaultState));
+	ldstate->ld_relation = rel;
+	ldstate->ld_tupdesc = tupdesc;
+
+	n = bms_num_members(info->lazydefaults);
+	ldstate->ld_attnums = (AttrNumber *) palloc(n * sizeof(AttrNumber));
+	ldstate->ld_defaults = (ExprState **) palloc(n * sizeof(ExprState *));
+
+	n = 0;
+	attnum = -1;
+	while ((attnum = bms_next_member(info->lazydefaults, attnum)) >= 0)
+	{
+		Node	   *expr = NULL;
+
+		if (attnum > tupdesc->natts)
+			elog(ERROR, "invalid lazy default column %d of relation \"%s\"",
+				 attnum, RelationGetRelationName(rel));
+
+		/* a dropped column reads as NULL anyway */
+		if (!TupleDescAttr(RelationGetDescr(rel), attnum - 1)->attisdropped)
+			expr = build_column_default(rel, attnum);
+
+		ldstate->ld_attnums[n] = attnum;
+		ldstate->ld_defaults[n] = expr ? ExecPrepareExpr((Expr *) expr, estate) : NULL;
+		n++;
+	}
+	ldstate->ld_ncolumns = n;
+
+	if (writeback)
+	{
+		EState	   *wstate;
+		ResultRelInfo *resultRelInfo;
+
+		/*
+		 * We are going to write to a relation that we might only have been
+		 * reading so far, and must keep out anyone who assumes otherwise,
+		 * such as CREATE INDEX.
+		 */
+		LockRelationOid(RelationGetRelid(rel), RowExclusiveLock);
+
+		wstate = CreateExecutorState();
+		resultRelInfo = makeNode(ResultRelInfo);
+		InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
+		wstate->es_result_relations = resultRelInfo;
+		wstate->es_num_result_relations = 1;
+		wstate->es_result_relation_info = resultRelInfo;
+		ExecOpenIndices(resultRelInfo, false);
+
+		ldstate->ld_writeback = true;
+		ldstate->ld_snapshot = estate->es_snapshot;
+		ldstate->ld_estate = wstate;
+		ldstate->ld_resultRelInfo = resultRelInfo;
+		ldstate->ld_slot = ExecInitExtraTupleSlot(wstate, RelationGetDescr(rel));
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return ldstate;
+}
+
+/*
+ * ExecLazyDefaultsCanStore
+ *
+ * Can a reader of rel that is part of the query run by estate store the
+ * lazy column defaults it fills in?  See the comments at the top of the
+ * file for those that can't.
+ */
+bool
+ExecLazyDefaultsCanStore(Relation rel, EState *estate)
+{
+	if (RecoveryInProgress() || XactReadOnly || IsInParallelMode())
+		return false;
+
+	if (MigrateRelationIsSource(RelationGetRelid(rel)))
+		return false;
+
+	return !LazyDefaultsRelationIsTarget(estate, RelationGetRelid(rel));
+}
+
+/*
+ * LazyDefaultsRelationIsTarget
+ *
+ * Is the relation updated, deleted from or row-locked by the query?
+ */
+static bool
+LazyDefaultsRelationIsTarget(EState *estate, Oid relid)
+{
+	ListCell   *lc;
+	int			i;
+
+	for (i = 0; i < estate->es_num_result_relations; i++)
+	{
+		if (RelationGetRelid(estate->es_result_relations[i].ri_RelationDesc) == relid)
+			return true;
+	}
+
+	foreach(lc, estate->es_rowMarks)
+	{
+		ExecRowMark *erm = (ExecRowMark *) lfirst(lc);
+
+		if (erm->relid == relid)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * ExecFillLazyDefaults
+ *
+ * If the given row of the relation lacks any of the columns with a lazy
+ * default, return a copy of it with those filled in, palloc'd in the
+ * per-tuple memory of econtext; otherwise return the row as is.  The copy
+ * carries over the header fields and item pointer of the original.
+ */
+HeapTuple
+ExecFillLazyDefaults(LazyDefaultState *ldstate, HeapTuple tuple,
+					 ExprContext *econtext)
+{
+	TupleDesc	tupdesc = ldstate->ld_tupdesc;
+	int			natts = HeapTupleHeaderGetNatts(tuple->t_data);
+	MemoryContext oldcxt;
+	Datum	   *values;
+	bool	   *isnull;
+	HeapTuple	newtup;
+	int			i;
+
+	if (ldstate->ld_ncolumns == 0 ||
+		natts >= ldstate->ld_attnums[ldstate->ld_ncolumns - 1])
+		return tuple;
+
+	oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+	isnull = (bool *) palloc(tupdesc->natts * sizeof(bool));
+	heap_deform_tuple(tuple, tupdesc, values, isnull);
+
+	for (i = 0; i < ldstate->ld_ncolumns; i++)
+	{
+		int			off = ldstate->ld_attnums[i] - 1;
+
+		if (off < natts)
+			continue;
+
+		if (ldstate->ld_defaults[i])
+			values[off] = ExecEvalExpr(ldstate->ld_defaults[i], econtext,
+									   &isnull[off]);
+		else
+		{
+			values[off] = (Datum) 0;
+			isnull[off] = true;
+		}
+	}
+
+	/*
+	 * Store the values unless we might not be able to.  A cursor that was
+	 * opened before later commands of our own transaction reads rows that
+	 * those commands might have changed since.
+	 */
+	if (ldstate->ld_writeback &&
+		ldstate->ld_snapshot->curcid == GetCurrentCommandId(false))
+		LazyDefaultsStore(ldstate, tuple, values, isnull);
+
+	newtup = heap_form_tuple(tupdesc, values, isnull);
+	heap_copy_tuple_identity(newtup, tuple);
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return newtup;
+}
+
+/*
+ * LazyDefaultsStore
+ *
+ * Update the row to contain the values just computed for it.  If somebody
+ * else got to do that first, replace our values with theirs.
+ */
+static void
+LazyDefaultsStore(LazyDefaultState *ldstate, HeapTuple tuple,
+				  Datum *values, bool *isnull)
+{
+	Relation	rel = ldstate->ld_relation;
+	HeapTuple	newtup;
+	HTSU_Result result;
+	HeapUpdateFailureData hufd;
+	LockTupleMode lockmode;
+
+	newtup = heap_form_tuple(ldstate->ld_tupdesc, values, isnull);
+
+	result = heap_update(rel, &tuple->t_self, newtup,
+						 GetCurrentCommandId(true), InvalidSnapshot,
+						 true /* wait for commit */ ,
+						 &hufd, &lockmode);
+	switch (result)
+	{
+		case HeapTupleMayBeUpdated:
+			if (ldstate->ld_resultRelInfo->ri_NumIndices > 0 &&
+				!HeapTupleIsHeapOnly(newtup))
+			{
+				EState	   *wstate = ldstate->ld_estate;
+
+				ExecStoreTuple(newtup, ldstate->ld_slot, InvalidBuffer, false);
+				list_free(ExecInsertIndexTuples(ldstate->ld_slot,
+												&(newtup->t_self),
+												wstate, false, NULL, NIL));
+				ExecClearTuple(ldstate->ld_slot);
+				ResetPerTupleExprContext(wstate);
+			}
+			break;
+
+		case HeapTupleSelfUpdated:
+		case HeapTupleUpdated:
+
+			/*
+			 * The row was updated by another scan of this query or by a
+			 * concurrent transaction, which must have stored values for it.
+			 * If it was deleted instead, ours are as good as any.
+			 */
+			if (!ItemPointerEquals(&hufd.ctid, &tuple->t_self))
+				LazyDefaultsFetchStored(ldstate, &hufd,
+										HeapTupleHeaderGetNatts(tuple->t_data),
+										values, isnull);
+			break;
+
+		default:
+			elog(ERROR, "unrecognized heap_update status: %u", result);
+			break;
+	}
+
+	heap_freetuple(newtup);
+}
+
+/*
+ * LazyDefaultsFetchStored
+ *
+ * Copy the lazy column values that the row version following a short row
+ * stores into values/isnull.
+ */
+static void
+LazyDefaultsFetchStored(LazyDefaultState *ldstate,
+						HeapUpdateFailureData *hufd, int natts,
+						Datum *values, bool *isnull)
+{
+	HeapTupleData tuple;
+	Buffer		buffer;
+	int			i;
+
+	tuple.t_self = hufd->ctid;
+	if (!heap_fetch(ldstate->ld_relation, SnapshotAny, &tuple, &buffer,
+					false, NULL))
+		return;
+
+	/* make sure the slot wasn't reused for an unrelated row meanwhile */
+	if (TransactionIdEquals(HeapTupleHeaderGetXmin(tuple.t_data),
+							hufd->xmax))
+	{
+		for (i = 0; i < ldstate->ld_ncolumns; i++)
+		{
+			AttrNumber	attnum = ldstate->ld_attnums[i];
+			Form_pg_attribute attr = TupleDescAttr(ldstate->ld_tupdesc,
+												   attnum - 1);
+
+			if (attnum <= natts)
+				continue;
+
+			values[attnum - 1] = heap_getattr(&tuple, attnum,
+											  ldstate->ld_tupdesc,
+											  &isnull[attnum - 1]);
+			if (!isnull[attnum - 1])
+				values[attnum - 1] = datumCopy(values[attnum - 1],
+											   attr->attbyval, attr->attlen);
+		}
+	}
+
+	ReleaseBuffer(buffer);
+}
+
+/*
+ * ExecEndLazyDefaults
+ */
+void
+ExecEndLazyDefaults(LazyDefaultState *ldstate)
+{
+	if (ldstate == NULL || ldstate->ld_estate == NULL)
+		return;
+
+	ExecCloseIndices(ldstate->ld_resultRelInfo);
+	ExecResetTupleTable(ldstate->ld_estate->es_tupleTable, false);
+	FreeExecutorState(ldstate->ld_estate);
+	ldstate->ld_estate = NULL;
+}
+
+/*
+ * ExecScanFillLazyDefaults
+ *
+ * Fill in the lazy column defaults of the row in a scan node's slot.  This
+ * is called by ExecScan for rows with fewer columns than the relation.  The
+ * values are stored in the table as well, unless the scan can't do that.
+ */
+void
+ExecScanFillLazyDefaults(ScanState *node, TupleTableSlot *slot)
+{
+	HeapTuple	tuple;
+
+	if (node->ss_LazyDefaults == NULL)
+	{
+		Relation	rel = node->ss_currentRelation;
+		EState	   *estate = node->ps.state;
+
+		if (!RelationHasLazyDefaults(rel))
+			return;
+
+		node->ss_LazyDefaults =
+			ExecInitLazyDefaults(rel, RelationGetDescr(rel), estate,
+								 ExecLazyDefaultsCanStore(rel, estate));
+		RegisterExprContextCallback(node->ps.ps_ExprContext,
+									ShutdownScanLazyDefaults,
+									PointerGetDatum(node));
+	}
+
+	tuple = ExecFillLazyDefaults(node->ss_LazyDefaults, slot->tts_tuple,
+								 node->ps.ps_ExprContext);
+	if (tuple != slot->tts_tuple)
+		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+}
+
+/*
+ * ShutdownScanLazyDefaults
+ *
+ * Release a scan node's lazy default state when its expression context is
+ * shut down, either at the end of the query or on rescan.
+ */
+static void
+ShutdownScanLazyDefaults(Datum arg)
+{
+	ScanState  *node = (ScanState *) DatumGetPointer(arg);
+
+	ExecEndLazyDefaults(node->ss_LazyDefaults);
+	node->ss_LazyDefaults = NULL;
+}
+
+/*
+ * ExecResultRelFillLazyDefaults
+ *
+ * Fill in the lazy column defaults of a row that is about to be updated by
+ * way of the given result relation, which will store the values.  The copy
+ * is made in the per-tuple memory of estate.
+ */
+HeapTuple
+ExecResultRelFillLazyDefaults(ResultRelInfo *resultRelInfo, HeapTuple tuple,
+							  EState *estate)
+{
+	Relation	rel = resultRelInfo->ri_RelationDesc;
+
+	if (HeapTupleHeaderGetNatts(tuple->t_data) >= RelationGetNumberOfAttributes(rel))
+		return tuple;
+
+	if (resultRelInfo->ri_LazyDefaults == NULL)
+	{
+		if (!RelationHasLazyDefaults(rel))
+			return tuple;
+		resultRelInfo->ri_LazyDefaults =
+			ExecInitLazyDefaults(rel, RelationGetDescr(rel), estate, false);
+	}
+
+	return ExecFillLazyDefaults(resultRelInfo->ri_LazyDefaults, tuple,
+								GetPerTupleExprContext(estate));
+}
@@ -37,6 +37,7 @@
  */
 #include "postgres.h"
 
+#include "access/heapversion.h"
 #include "access/htup_details.h"
 #include "access/sysattr.h"
 #include "access/transam.h"
@@ -2761,6 +2762,7 @@ EvalPlanQualFetch(EState *estate, Relation relation, int lockmode,
 			/*
 			 * We got tuple - now copy it for use by recheck query.
 			 */
+			heap_tuple_upgrade(relation, &tuple);
 			copyTuple = heap_copytuple(&tuple);
 			ReleaseBuffer(buffer);
 			break;
@@ -2997,6 +2999,7 @@ EvalPlanQualFetchRowMarks(EPQState *epqstate)
 					elog(ERROR, "failed to fetch tuple for EvalPlanQual recheck");
 
 				/* successful, copy tuple */
+				heap_tuple_upgrade(erm->relation, &tuple);
 				copyTuple = heap_copytuple(&tuple);
 				ReleaseBuffer(buffer);
 			}
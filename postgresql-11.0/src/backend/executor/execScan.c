@@ -18,60 +18,124 @@
  */
 #include "postgres.h"
 
+#include "access/htup_details.h"
+#include "access/xact.h"
 #include "executor/executor.h"
 #include "miscadmin.h"
+#include "pg_trace.h"
 #include "utils/memutils.h"
+#include "utils/rel.h"
 #include "utils/migrate_schema.h"
 
+/*
+ * Take a bitmap partition lock for a claim.  The wait, if any, is counted
+ * in pgMigrateUsage for EXPLAIN (ANALYZE, MIGRATION); an uncontended lock
+ * isn't timed, so the clock is read only when we are about to sleep anyway.
+ */
+static inline void
+MigrateBitmapLockAcquire(LWLock *bitmapLock)
+{
+	instr_time	start;
+	instr_time	end;
+
+	if (LWLockConditionalAcquire(bitmapLock, LW_EXCLUSIVE))
+		return;
+
+	INSTR_TIME_SET_CURRENT(start);
+	LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_ACCUM_DIFF(pgMigrateUsage.lock_wait_time, end, start);
+}
+
+/*
+ * MigrateTuple -- claim a scanned tuple for the running migration
+ *
+ * Returns true if the tuple is ours to migrate.  Tuples already migrated are
+ * skipped, and tuples claimed by someone else are remembered so that
+ * post-query processing can wait for them.  Our own claims are published
+ * when the transaction commits (see AtEOXact_MigrateSchema).  Each relation
+ * the migration reads, such as each leaf of a partitioned source, has a
+ * bitmap of its own.
+ */
 bool MigrateTuple(TupleTableSlot *slot)
 {
-	if (slot->tts_tuple == NULL | slot->tts_tuple->t_len == 0)
+	LWLock *bitmapLock;
+	TransactionId xid;
+	uint64 *bitmap;
+	int bitmapno;
+	uint32 eid;
+
+	if (slot->tts_tuple == NULL || slot->tts_tuple->t_len == 0)
 	{
 		return true;
 	}
 
-	LWLock *bitmapLock;
-	ItemPointerData lctid = slot->tts_tuple->t_self;
-	uint32 blockId	= (uint32) ItemPointerGetBlockNumber (&lctid);
-	uint32 offset 	= (uint32) ItemPointerGetOffsetNumber(&lctid);
+	bitmapno = MigrateScanBitmap(slot->tts_tuple->t_tableOid);
+	if (bitmapno < 0)
+		return false;
+
+	/* leave the rest for the next batch; see exec_execute_message */
+	if (migratebatchfull || MigrateBatchIsFull())
+		return false;
+
+	eid = MigrateTupleEid(&slot->tts_tuple->t_self);
 
-	uint32 pagesize = NUMTUPLESPERPAGE;
-	uint32 idx = blockId * pagesize + offset;
-	uint32 eid = idx - 1;
+	/* everything has been migrated; see pg_migrate_finalize */
+	if (MigrateBitmapFinished(bitmapno))
+	{
+		if (eid != InvalidMigrateEid)
+			MigrateCheckSnapshotConflict(bitmapno, eid);
+		return false;
+	}
 
-	uint32 wordid 		= getwordid(eid);
-	uint32 lockbitid 	= getlockbitid(eid);
-	uint32 migratebitid = getmigratebitid(eid);
+	if (eid == InvalidMigrateEid)
+		elog(ERROR, "tuple (%u,%u) is outside the migration bitmap",
+			 ItemPointerGetBlockNumber(&slot->tts_tuple->t_self),
+			 ItemPointerGetOffsetNumber(&slot->tts_tuple->t_self));
 
-	// printf("blockId: %d, pageSize: %d, offset: %d\n", blockId, pagesize, offset);
-	// printf("eid: %d, wordid: %d, lockbitid: %d, migratebitid: %d\n", eid, wordid, lockbitid, migratebitid);
+	bitmap		 = GlobalBitmap + bitmapno * BITMAPSIZE;
+	pgMigrateUsage.tuples_checked++;
+	TRACE_POSTGRESQL_MIGRATE_CLAIM_START(bitmapno, eid);
 
-	if (!getkthbit(PartialBitmap[wordid], migratebitid))
+	if (!getmigratebit(bitmap, eid))
 	{
-		if (getkthbit(PartialBitmap[wordid], lockbitid))
+		if (getlockbit(bitmap, eid))
 		{
-			InProgLocalList1 = pg_lappend_int(InProgLocalList1, eid);
+			InProgLocalList1 = pg_lappend_int(InProgLocalList1,
+											  MigrateInProgEntry(bitmapno, eid));
+			pgMigrateUsage.tuples_in_progress++;
+			TRACE_POSTGRESQL_MIGRATE_CLAIM_COLLISION(bitmapno, eid);
 			return false;
 		}
 
-		bitmapLock = MigrateBitmapPartitionLock(eid, BitmapNum);
-		LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+		/* waiters sleep on our xid, so make sure we have one */
+		xid = GetTopTransactionId();
+
+		bitmapLock = MigrateBitmapPartitionLock(eid, bitmapno);
+		MigrateBitmapLockAcquire(bitmapLock);
 
-		if (!getkthbit(PartialBitmap[wordid], migratebitid))
+		if (!getmigratebit(bitmap, eid))
 		{
-			if (!getkthbit(PartialBitmap[wordid], lockbitid))
+			if (!getlockbit(bitmap, eid))
 			{
-				PartialBitmap[wordid] |= ((uint64)1 << lockbitid);
+				MigrateRegisterClaim(bitmapno, eid, xid);
+				setlockbit(bitmap, eid);
 				LWLockRelease(bitmapLock);
 
-				InProgLocalList0 = pg_lappend_int(InProgLocalList0, eid);
+				if (MigrateBitmapMoves(bitmapno))
+					MigrateRemoveSourceTuple(slot->tts_tuple);
+				pgMigrateUsage.tuples_claimed++;
+				TRACE_POSTGRESQL_MIGRATE_CLAIM_SUCCESS(bitmapno, eid);
 				return true;
 			}
 			else
 			{
 				LWLockRelease(bitmapLock);
 
-				InProgLocalList1 = pg_lappend_int(InProgLocalList1, eid);	
+				InProgLocalList1 = pg_lappend_int(InProgLocalList1,
+												  MigrateInProgEntry(bitmapno, eid));
+				pgMigrateUsage.tuples_in_progress++;
+				TRACE_POSTGRESQL_MIGRATE_CLAIM_COLLISION(bitmapno, eid);
 				return false;
 			}
 		}
@@ -80,9 +144,25 @@ bool MigrateTuple(TupleTableSlot *slot)
 			LWLockRelease(bitmapLock);
 		}
 	}
+
+	MigrateCheckSnapshotConflict(bitmapno, eid);
 	return false;
 }
 
+/*
+ * Rows that predate a column added with a lazily computed default are short
+ * of it; fill it in before anything looks at the row.
+ */
+static inline void
+ExecScanCheckLazyDefaults(ScanState *node, TupleTableSlot *slot)
+{
+	if (!TupIsNull(slot) && slot->tts_tuple != NULL &&
+		node->ss_currentRelation != NULL &&
+		HeapTupleHeaderGetNatts(slot->tts_tuple->t_data) <
+		RelationGetNumberOfAttributes(node->ss_currentRelation))
+		ExecScanFillLazyDefaults(node, slot);
+}
+
 /*
  * ExecScanFetch -- check interrupts & fetch next potential tuple
  *
@@ -192,6 +272,22 @@ ExecScan(ScanState *node,
 	projInfo = node->ps.ps_ProjInfo;
 	econtext = node->ps.ps_ExprContext;
 
+	/*
+	 * A migration has nothing left to take from a relation, such as one leaf
+	 * of a partitioned source, once its bitmap is finished, nor from any
+	 * relation once its batch is full.
+	 */
+	if (migrateflag &&
+		(migratebatchfull ||
+		 (node->ss_currentRelation != NULL &&
+		  MigrateScanFinished(RelationGetRelid(node->ss_currentRelation)))))
+	{
+		if (projInfo)
+			return ExecClearTuple(projInfo->pi_state.resultslot);
+		else
+			return ExecClearTuple(node->ss_ScanTupleSlot);
+	}
+
 	/* interrupt checks are in ExecScanFetch */
 
 	/*
@@ -204,6 +300,7 @@ ExecScan(ScanState *node,
 
 		ResetExprContext(econtext);
 		slot = ExecScanFetch(node, accessMtd, recheckMtd);
+		ExecScanCheckLazyDefaults(node, slot);
 
 
 		if (migrateflag)
@@ -213,6 +310,10 @@ ExecScan(ScanState *node,
 				++tuplemigratecount;
 				return slot;
 			}
+
+			/* the batch just filled up; the rest is scanned by the next one */
+			if (migratebatchfull)
+				return ExecClearTuple(node->ss_ScanTupleSlot);
 		}
 		else
 		{
@@ -235,6 +336,7 @@ ExecScan(ScanState *node,
 		TupleTableSlot *slot;
 
 		slot = ExecScanFetch(node, accessMtd, recheckMtd);
+		ExecScanCheckLazyDefaults(node, slot);
 
 		/*
 		 * if the slot returned by the accessMtd contains NULL, then it means
@@ -275,6 +377,18 @@ ExecScan(ScanState *node,
 					else
 						return slot;
 				}
+
+				/*
+				 * Stop as soon as the batch is full, rather than reading the
+				 * rest of the relation only to skip every tuple.
+				 */
+				if (migratebatchfull)
+				{
+					if (projInfo)
+						return ExecClearTuple(projInfo->pi_state.resultslot);
+					else
+						return ExecClearTuple(slot);
+				}
 			}
 			else
 			{
@@ -308,6 +422,155 @@ ExecScan(ScanState *node,
 	}
 }
 
+/*
+ * ExecInitScanBatch
+ *		Set up a scan node to return batches of tuples, if they are
+ *		enabled.  Returns true if it did.
+ *
+ * Call after the node's projection info has been set up.
+ */
+bool
+ExecInitScanBatch(ScanState *node)
+{
+	EState	   *estate = node->ps.state;
+
+	if (executor_batch_size <= 0)
+		return false;
+
+	node->ss_BatchSize = executor_batch_size;
+	node->ss_BatchScanSlots =
+		ExecInitBatchSlots(estate, node->ss_ScanTupleSlot->tts_tupleDescriptor,
+						   node->ss_BatchSize);
+	node->ss_BatchTuples = (HeapTupleData *)
+		palloc(node->ss_BatchSize * sizeof(HeapTupleData));
+	node->ss_BatchSel = (int *) palloc(node->ss_BatchSize * sizeof(int));
+	if (node->ps.ps_ProjInfo)
+		node->ss_BatchResultSlots =
+			ExecInitBatchSlots(estate,
+							   node->ps.ps_ResultTupleSlot->tts_tupleDescriptor,
+							   node->ss_BatchSize);
+	node->ss_BatchDone = false;
+
+	return true;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecScanBatch
+ *
+ *		Like ExecScan, but returns up to maxslots qualifying tuples at once
+ *		for ExecProcNodeBatch.  batchAccessMtd stores the next tuple of the
+ *		relation in the slot it is given, so each tuple of the batch keeps
+ *		a scan slot, and a result slot if we project, of its own.  An access
+ *		method that returns tuples in storage it reuses, as heap_getnext
+ *		does, copies the tuple header into the HeapTupleData it is given
+ *		along with the slot, which is just as private to that tuple.
+ *
+ *		The scan tuples of a batch are fetched first, then tested against
+ *		the qual together by ExecQualBatch, and those that pass projected.
+ *		A batch whose tuples all fail is replaced by the next one, so only
+ *		the end of the scan returns no tuples.
+ *
+ *		Per-tuple memory is reset once per batch rather than per tuple,
+ *		since the projections of a batch must outlive each other.
+ *		EvalPlanQual rechecks and lazy migrations are left to ExecScan,
+ *		and return one tuple per batch.
+ * ----------------------------------------------------------------
+ */
+int
+ExecScanBatch(ScanState *node,
+			  ExecScanAccessMtd accessMtd,
+			  ExecScanRecheckMtd recheckMtd,
+			  ExecScanBatchAccessMtd batchAccessMtd,
+			  TupleTableSlot **slots, int maxslots)
+{
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	ExprState  *qual = node->ps.qual;
+	ProjectionInfo *projInfo = node->ps.ps_ProjInfo;
+	int			ntuples = 0;
+
+	if (node->ss_BatchDone)
+		return 0;
+
+	if (migrateflag || node->ps.state->es_epqTuple != NULL)
+	{
+		TupleTableSlot *slot = ExecScan(node, accessMtd, recheckMtd);
+
+		if (TupIsNull(slot))
+		{
+			node->ss_BatchDone = true;
+			return 0;
+		}
+		slots[0] = slot;
+		return 1;
+	}
+
+	maxslots = Min(maxslots, node->ss_BatchSize);
+
+	while (ntuples == 0 && !node->ss_BatchDone)
+	{
+		int			nscanned = 0;
+		int			npassed;
+		int			i;
+
+		ResetExprContext(econtext);
+
+		while (nscanned < maxslots)
+		{
+			TupleTableSlot *slot;
+
+			CHECK_FOR_INTERRUPTS();
+
+			slot = (*batchAccessMtd) (node, node->ss_BatchScanSlots[nscanned],
+									  &node->ss_BatchTuples[nscanned]);
+			if (TupIsNull(slot))
+			{
+				node->ss_BatchDone = true;
+				break;
+			}
+			ExecScanCheckLazyDefaults(node, slot);
+			nscanned++;
+		}
+
+		npassed = ExecQualBatch(qual, econtext, node->ss_BatchScanSlots,
+								nscanned, node->ss_BatchSel);
+		InstrCountFiltered1(node, nscanned - npassed);
+
+		for (i = 0; i < npassed; i++)
+		{
+			TupleTableSlot *slot;
+
+			slot = node->ss_BatchScanSlots[node->ss_BatchSel[i]];
+
+			if (projInfo)
+			{
+				econtext->ecxt_scantuple = slot;
+				slot = ExecProjectInto(projInfo,
+									   node->ss_BatchResultSlots[ntuples]);
+			}
+			slots[ntuples++] = slot;
+		}
+	}
+
+	return ntuples;
+}
+
+/*
+ * ExecEndScanBatch
+ *		Clear the batch slots of a scan node, if any.
+ */
+void
+ExecEndScanBatch(ScanState *node)
+{
+	int			i;
+
+	for (i = 0; i < node->ss_BatchSize; i++)
+	{
+		ExecClearTuple(node->ss_BatchScanSlots[i]);
+		if (node->ss_BatchResultSlots)
+			ExecClearTuple(node->ss_BatchResultSlots[i]);
+	}
+}
+
 /*
  * ExecAssignScanProjectionInfo
  *		Set up projection info for a scan node, if necessary.
@@ -358,6 +621,7 @@ ExecScanReScan(ScanState *node)
 	 * can tell that this plan node is not positioned on a tuple.
 	 */
 	ExecClearTuple(node->ss_ScanTupleSlot);
+	node->ss_BatchDone = false;
 
 	/* Rescan EvalPlanQual tuple if we're inside an EvalPlanQual recheck */
 	if (estate->es_epqScanDone != NULL)
@@ -19,10 +19,14 @@
 
 BufferUsage pgBufferUsage;
 static BufferUsage save_pgBufferUsage;
+MigrateUsage pgMigrateUsage;
 
 static void BufferUsageAdd(BufferUsage *dst, const BufferUsage *add);
 static void BufferUsageAccumDiff(BufferUsage *dst,
 					 const BufferUsage *add, const BufferUsage *sub);
+static void MigrateUsageAdd(MigrateUsage *dst, const MigrateUsage *add);
+static void MigrateUsageAccumDiff(MigrateUsage *dst,
+					  const MigrateUsage *add, const MigrateUsage *sub);
 
 
 /* Allocate new instrumentation structure(s) */
@@ -33,16 +37,19 @@ InstrAlloc(int n, int instrument_options)
 
 	/* initialize all fields to zeroes, then modify as needed */
 	instr = palloc0(n * sizeof(Instrumentation));
-	if (instrument_options & (INSTRUMENT_BUFFERS | INSTRUMENT_TIMER))
+	if (instrument_options & (INSTRUMENT_BUFFERS | INSTRUMENT_TIMER |
+							  INSTRUMENT_MIGRATION))
 	{
 		bool		need_buffers = (instrument_options & INSTRUMENT_BUFFERS) != 0;
 		bool		need_timer = (instrument_options & INSTRUMENT_TIMER) != 0;
+		bool		need_migration = (instrument_options & INSTRUMENT_MIGRATION) != 0;
 		int			i;
 
 		for (i = 0; i < n; i++)
 		{
 			instr[i].need_bufusage = need_buffers;
 			instr[i].need_timer = need_timer;
+			instr[i].need_migrateusage = need_migration;
 		}
 	}
 
@@ -56,6 +63,7 @@ InstrInit(Instrumentation *instr, int instrument_options)
 	memset(instr, 0, sizeof(Instrumentation));
 	instr->need_bufusage = (instrument_options & INSTRUMENT_BUFFERS) != 0;
 	instr->need_timer = (instrument_options & INSTRUMENT_TIMER) != 0;
+	instr->need_migrateusage = (instrument_options & INSTRUMENT_MIGRATION) != 0;
 }
 
 /* Entry to a plan node */
@@ -73,6 +81,10 @@ InstrStartNode(Instrumentation *instr)
 	/* save buffer usage totals at node entry, if needed */
 	if (instr->need_bufusage)
 		instr->bufusage_start = pgBufferUsage;
+
+	/* likewise for migration usage */
+	if (instr->need_migrateusage)
+		instr->migrateusage_start = pgMigrateUsage;
 }
 
 /* Exit from a plan node */
@@ -101,6 +113,10 @@ InstrStopNode(Instrumentation *instr, double nTuples)
 		BufferUsageAccumDiff(&instr->bufusage,
 							 &pgBufferUsage, &instr->bufusage_start);
 
+	if (instr->need_migrateusage)
+		MigrateUsageAccumDiff(&instr->migrateusage,
+							  &pgMigrateUsage, &instr->migrateusage_start);
+
 	/* Is this the first tuple of this cycle? */
 	if (!instr->running)
 	{
@@ -164,6 +180,9 @@ InstrAggNode(Instrumentation *dst, Instrumentation *add)
 	/* Add delta of buffer usage since entry to node's totals */
 	if (dst->need_bufusage)
 		BufferUsageAdd(&dst->bufusage, &add->bufusage);
+
+	if (dst->need_migrateusage)
+		MigrateUsageAdd(&dst->migrateusage, &add->migrateusage);
 }
 
 /* note current values during parallel executor startup */
@@ -227,3 +246,26 @@ BufferUsageAccumDiff(BufferUsage *dst,
 	INSTR_TIME_ACCUM_DIFF(dst->blk_write_time,
 						  add->blk_write_time, sub->blk_write_time);
 }
+
+/* dst += add */
+static void
+MigrateUsageAdd(MigrateUsage *dst, const MigrateUsage *add)
+{
+	dst->tuples_checked += add->tuples_checked;
+	dst->tuples_claimed += add->tuples_claimed;
+	dst->tuples_in_progress += add->tuples_in_progress;
+	INSTR_TIME_ADD(dst->lock_wait_time, add->lock_wait_time);
+}
+
+/* dst += add - sub */
+static void
+MigrateUsageAccumDiff(MigrateUsage *dst,
+					  const MigrateUsage *add,
+					  const MigrateUsage *sub)
+{
+	dst->tuples_checked += add->tuples_checked - sub->tuples_checked;
+	dst->tuples_claimed += add->tuples_claimed - sub->tuples_claimed;
+	dst->tuples_in_progress += add->tuples_in_progress - sub->tuples_in_progress;
+	INSTR_TIME_ACCUM_DIFF(dst->lock_wait_time,
+						  add->lock_wait_time, sub->lock_wait_time);
+}
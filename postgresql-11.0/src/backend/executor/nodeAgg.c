@@ -194,6 +194,39 @@
  *	  transition values.  hashcontext is the single context created to support
  *	  all hash tables.
  *
+ *	  Spilling hashed aggregation to disk:
+ *
+ *	  The planner only chooses hashed aggregation when it expects the hash
+ *	  table to fit in work_mem, but the number of groups can be badly
+ *	  underestimated.  So that such a query doesn't exhaust memory, AGG_HASHED
+ *	  with a single grouping set checks the memory of hashcontext each time it
+ *	  creates a group.  Once that exceeds work_mem it stops creating groups:
+ *	  input tuples of groups already in the table are still aggregated, while
+ *	  the others are written to a set of logical tapes, partitioned by bits of
+ *	  their hash value.  When the groups in memory have been returned, the
+ *	  hash table is emptied and each partition is aggregated in the same way,
+ *	  spilling again (by the next bits of the hash) if it still doesn't fit.
+ *	  A tuple is thereby read and written at most once per level of
+ *	  partitioning, and every group is still finalized exactly once.  When
+ *	  the hash bits run out, a partition is aggregated in memory regardless,
+ *	  as must any table in AGG_MIXED or with several hashed grouping sets.
+ *
+ *	  Parallel hashed aggregation:
+ *
+ *	  A parallel-aware AGG_HASHED node (Parallel HashAggregate) runs in every
+ *	  participant of a parallel query, each aggregating its share of a
+ *	  partial input into a local hash table.  The participants merge their
+ *	  local tables into one hash table in dynamic shared memory, combining
+ *	  the transition states of groups found in both with the aggregates'
+ *	  combine functions; a local table is merged and emptied whenever it
+ *	  exceeds work_mem, and once more at the end of the input.  When all have
+ *	  merged, the participants claim the partitions of the shared table one
+ *	  at a time, and finalize and return the groups they hold.  Unlike a
+ *	  Finalize Aggregate above a Gather, this leaves no final step to be run
+ *	  by the leader alone.  Grouping columns and transition states are stored
+ *	  in the shared table as bare Datums, so the planner only chooses this
+ *	  when they are all passed by value.
+ *
  *    Transition / Combine function invocation:
  *
  *    For performance reasons transition functions, including combine
@@ -230,8 +263,10 @@
 #include "optimizer/tlist.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "pgstat.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/hashutils.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
@@ -239,6 +274,14 @@
 #include "utils/datum.h"
 
 
+/*
+ * Limits on the number of partitions a pass of hashed aggregation spills
+ * into.  Each partition being written costs a BLCKSZ buffer.
+ */
+#define HASHAGG_MIN_PARTITIONS 4
+#define HASHAGG_MAX_PARTITIONS 256
+
+
 static void select_current_set(AggState *aggstate, int setno, bool is_hash);
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
@@ -274,10 +317,32 @@ static Bitmapset *find_unaggregated_cols(AggState *aggstate);
 static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
 static void build_hash_table(AggState *aggstate);
 static TupleHashEntryData *lookup_hash_entry(AggState *aggstate);
-static void lookup_hash_entries(AggState *aggstate);
+static bool lookup_hash_entries(AggState *aggstate);
+static void hash_agg_check_limits(AggState *aggstate);
+static int	hash_agg_partition_bits(void);
+static void hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *hashslot,
+					 TupleTableSlot *inputslot);
+static void hash_agg_finish_spill(AggState *aggstate);
+static TupleTableSlot *hash_agg_batch_read(AggState *aggstate,
+					HashAggBatch batch);
+static void hash_agg_finish_batch(AggState *aggstate);
+static bool hash_agg_next_batch(AggState *aggstate);
+static void hash_agg_reset_spill_state(AggState *aggstate);
+static void agg_setup_shared_table(AggState *aggstate);
+static void agg_shared_table_params(AggState *aggstate,
+						dshash_parameters *params);
+static int agg_shared_compare(const void *a, const void *b, size_t size,
+				   void *arg);
+static dshash_hash agg_shared_hash(const void *key, size_t size, void *arg);
+static void agg_merge_into_shared(AggState *aggstate);
+static void agg_combine_groups(AggState *aggstate, AggStatePerGroup shared,
+				   AggStatePerGroup local);
+static TupleTableSlot *ExecParallelAgg(PlanState *pstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
+static void agg_fill_shared_hash_table(AggState *aggstate);
+static TupleTableSlot *agg_retrieve_shared_hash_table(AggState *aggstate);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
 						  AggState *aggstate, EState *estate,
@@ -402,6 +467,8 @@ fetch_input_tuple(AggState *aggstate)
 			return NULL;
 		slot = aggstate->sort_slot;
 	}
+	else if (aggstate->batch)
+		slot = ExecBatchNext(outerPlanState(aggstate), aggstate->batch);
 	else
 		slot = ExecProcNode(outerPlanState(aggstate));
 
@@ -1274,16 +1341,21 @@ build_hash_table(AggState *aggstate)
 	for (i = 0; i < aggstate->num_hashes; ++i)
 	{
 		AggStatePerHash perhash = &aggstate->perhash[i];
+		long		nbuckets = perhash->aggnode->numGroups;
 
 		Assert(perhash->aggnode->numGroups > 0);
 
+		/* a spilled partition can't have more groups than tuples */
+		if (aggstate->hash_batch)
+			nbuckets = Min(nbuckets, aggstate->hash_batch->ntuples);
+
 		perhash->hashtable = BuildTupleHashTable(&aggstate->ss.ps,
 												 perhash->hashslot->tts_tupleDescriptor,
 												 perhash->numCols,
 												 perhash->hashGrpColIdxHash,
 												 perhash->eqfuncoids,
 												 perhash->hashfunctions,
-												 perhash->aggnode->numGroups,
+												 nbuckets,
 												 additionalsize,
 												 aggstate->hashcontext->ecxt_per_tuple_memory,
 												 tmpmem,
@@ -1439,6 +1511,9 @@ hash_agg_entry_size(int numAggs)
  * set (which the caller must have selected - note that initialize_aggregate
  * depends on this).
  *
+ * If the table is full (hash_spill_mode) and holds no entry for the tuple's
+ * group, the tuple is spilled to disk instead, and NULL is returned.
+ *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static TupleHashEntryData *
@@ -1448,7 +1523,7 @@ lookup_hash_entry(AggState *aggstate)
 	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
 	TupleTableSlot *hashslot = perhash->hashslot;
 	TupleHashEntryData *entry;
-	bool		isnew;
+	bool		isnew = false;
 	int			i;
 
 	/* transfer just the needed columns into hashslot */
@@ -1465,7 +1540,17 @@ lookup_hash_entry(AggState *aggstate)
 	ExecStoreVirtualTuple(hashslot);
 
 	/* find or create the hashtable entry using the filtered tuple */
-	entry = LookupTupleHashEntry(perhash->hashtable, hashslot, &isnew);
+	if (aggstate->hash_spill_mode)
+	{
+		entry = LookupTupleHashEntry(perhash->hashtable, hashslot, NULL);
+		if (entry == NULL)
+		{
+			hash_agg_spill_tuple(aggstate, hashslot, inputslot);
+			return NULL;
+		}
+	}
+	else
+		entry = LookupTupleHashEntry(perhash->hashtable, hashslot, &isnew);
 
 	if (isnew)
 	{
@@ -1488,6 +1573,8 @@ lookup_hash_entry(AggState *aggstate)
 
 			initialize_aggregate(aggstate, pertrans, pergroupstate);
 		}
+
+		hash_agg_check_limits(aggstate);
 	}
 
 	return entry;
@@ -1497,9 +1584,13 @@ lookup_hash_entry(AggState *aggstate)
  * Look up hash entries for the current tuple in all hashed grouping sets,
  * returning an array of pergroup pointers suitable for advance_aggregates.
  *
+ * Returns false if the tuple was spilled to disk instead, in which case it
+ * must not be aggregated now.  That happens only when hash_can_spill, so
+ * there is just one grouping set.
+ *
  * Be aware that lookup_hash_entry can reset the tmpcontext.
  */
-static void
+static bool
 lookup_hash_entries(AggState *aggstate)
 {
 	int			numHashes = aggstate->num_hashes;
@@ -1508,9 +1599,519 @@ lookup_hash_entries(AggState *aggstate)
 
 	for (setno = 0; setno < numHashes; setno++)
 	{
+		TupleHashEntryData *entry;
+
 		select_current_set(aggstate, setno, true);
-		pergroup[setno] = lookup_hash_entry(aggstate)->additional;
+		entry = lookup_hash_entry(aggstate);
+		if (entry == NULL)
+		{
+			Assert(numHashes == 1);
+			return false;
+		}
+		pergroup[setno] = entry->additional;
 	}
+
+	return true;
+}
+
+/*
+ * Check the memory used by the hash tables after a new group was added, and
+ * switch to spilling new groups to disk if it exceeds work_mem.
+ *
+ * Spilling needs more bits of the hash value to partition by than earlier
+ * passes have used; a pass that has none left keeps growing the table.  A
+ * Parallel HashAggregate instead merges its table into the shared one, once
+ * the current tuple has been aggregated.
+ */
+static void
+hash_agg_check_limits(AggState *aggstate)
+{
+	Size		mem_used;
+
+	mem_used = MemoryContextMemAllocated(aggstate->hashcontext->ecxt_per_tuple_memory,
+										 true);
+	if (mem_used > aggstate->hash_mem_peak)
+		aggstate->hash_mem_peak = mem_used;
+
+	if (aggstate->hash_can_spill &&
+		mem_used > work_mem * 1024L &&
+		aggstate->hash_used_bits + hash_agg_partition_bits() <= 32)
+		aggstate->hash_spill_mode = true;
+
+	if (aggstate->shared_table && mem_used > work_mem * 1024L)
+		aggstate->shared_merge_pending = true;
+}
+
+/*
+ * Choose how many partitions to spill into, as log2 of their number.
+ *
+ * Each partition being written has a buffer, so use as many as a quarter of
+ * work_mem allows, within HASHAGG_MIN_PARTITIONS..HASHAGG_MAX_PARTITIONS.
+ */
+static int
+hash_agg_partition_bits(void)
+{
+	long		npartitions;
+	int			bits = 0;
+
+	npartitions = (work_mem * 1024L / 4) / BLCKSZ;
+	npartitions = Max(npartitions, HASHAGG_MIN_PARTITIONS);
+	npartitions = Min(npartitions, HASHAGG_MAX_PARTITIONS);
+
+	while ((2L << bits) <= npartitions)
+		bits++;
+
+	return bits;
+}
+
+/*
+ * Write the input tuple in inputslot, whose grouping columns are in
+ * hashslot, to the partition its hash value selects.
+ *
+ * The partition is chosen by the highest hash bits not yet used by earlier
+ * passes; the hash table buckets use the lowest ones, so the groups of a
+ * partition still spread over the whole table when it is read back.
+ */
+static void
+hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *hashslot,
+					 TupleTableSlot *inputslot)
+{
+	HashAggSpill spill = aggstate->hash_spill;
+	MinimalTuple tuple;
+	uint32		hash;
+	int			partition;
+
+	if (spill == NULL)
+	{
+		MemoryContext oldcontext;
+
+		oldcontext = MemoryContextSwitchTo(aggstate->ss.ps.state->es_query_cxt);
+
+		spill = (HashAggSpill) palloc(sizeof(HashAggSpillData));
+		spill->partition_bits = hash_agg_partition_bits();
+		spill->npartitions = 1 << spill->partition_bits;
+		spill->used_bits = aggstate->hash_used_bits;
+		spill->ntuples = (int64 *) palloc0(spill->npartitions * sizeof(int64));
+		spill->nunread = 0;
+		spill->tapeset = LogicalTapeSetCreate(spill->npartitions, NULL, NULL,
+											  -1);
+
+		aggstate->hash_spill = spill;
+		aggstate->hash_spills = lappend(aggstate->hash_spills, spill);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	Assert(spill->used_bits + spill->partition_bits <= 32);
+
+	hash = TupleHashTableHashSlot(aggstate->perhash[0].hashtable, hashslot);
+	partition = (hash << spill->used_bits) >> (32 - spill->partition_bits);
+
+	tuple = ExecFetchSlotMinimalTuple(inputslot);
+	LogicalTapeWrite(spill->tapeset, partition, (void *) tuple, tuple->t_len);
+	spill->ntuples[partition]++;
+}
+
+/*
+ * At the end of a pass that spilled, queue each partition it wrote to as a
+ * batch to aggregate later.
+ *
+ * The new batches go in front of older ones, so a partition that spills
+ * again is finished before other partitions are started, and fewer spill
+ * files are kept at once.
+ */
+static void
+hash_agg_finish_spill(AggState *aggstate)
+{
+	HashAggSpill spill = aggstate->hash_spill;
+	MemoryContext oldcontext;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(aggstate->ss.ps.state->es_query_cxt);
+
+	for (i = spill->npartitions - 1; i >= 0; i--)
+	{
+		HashAggBatch batch;
+
+		if (spill->ntuples[i] == 0)
+			continue;
+
+		batch = (HashAggBatch) palloc(sizeof(HashAggBatchData));
+		batch->spill = spill;
+		batch->tapenum = i;
+		batch->used_bits = spill->used_bits + spill->partition_bits;
+		batch->ntuples = spill->ntuples[i];
+
+		aggstate->hash_batches = lcons(batch, aggstate->hash_batches);
+		spill->nunread++;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	aggstate->hash_disk_used += LogicalTapeSetBlocks(spill->tapeset) *
+		(BLCKSZ / 1024);
+
+	if (spill->nunread == 0)
+	{
+		LogicalTapeSetClose(spill->tapeset);
+		spill->tapeset = NULL;
+	}
+
+	aggstate->hash_spill = NULL;
+}
+
+/*
+ * Read the next tuple of a spilled partition, or return NULL at its end.
+ */
+static TupleTableSlot *
+hash_agg_batch_read(AggState *aggstate, HashAggBatch batch)
+{
+	LogicalTapeSet *tapeset = batch->spill->tapeset;
+	MinimalTuple tuple;
+	uint32		t_len;
+	size_t		nread;
+
+	CHECK_FOR_INTERRUPTS();
+
+	nread = LogicalTapeRead(tapeset, batch->tapenum, &t_len, sizeof(t_len));
+	if (nread == 0)
+		return NULL;
+	if (nread != sizeof(t_len))
+		elog(ERROR, "unexpected end of data");
+
+	tuple = (MinimalTuple) palloc(t_len);
+	tuple->t_len = t_len;
+	nread = LogicalTapeRead(tapeset, batch->tapenum,
+							(char *) tuple + sizeof(uint32),
+							t_len - sizeof(uint32));
+	if (nread != t_len - sizeof(uint32))
+		elog(ERROR, "unexpected end of data");
+
+	return ExecStoreMinimalTuple(tuple, aggstate->hash_spill_slot, true);
+}
+
+/*
+ * Release the partition the current pass has read, closing its spill's
+ * tapes once all of its partitions have been read.
+ */
+static void
+hash_agg_finish_batch(AggState *aggstate)
+{
+	HashAggBatch batch = aggstate->hash_batch;
+	HashAggSpill spill = batch->spill;
+
+	ExecClearTuple(aggstate->hash_spill_slot);
+
+	if (--spill->nunread == 0)
+	{
+		LogicalTapeSetClose(spill->tapeset);
+		spill->tapeset = NULL;
+	}
+
+	pfree(batch);
+	aggstate->hash_batch = NULL;
+}
+
+/*
+ * Once the groups in the hash table have all been returned, empty it and
+ * aggregate the next spilled partition into it.
+ *
+ * Returns false if no partitions remain.
+ */
+static bool
+hash_agg_next_batch(AggState *aggstate)
+{
+	HashAggBatch batch;
+
+	if (aggstate->hash_batches == NIL)
+		return false;
+
+	batch = (HashAggBatch) linitial(aggstate->hash_batches);
+	aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+
+	/*
+	 * Every group in the table has been finalized, so run any shutdown
+	 * callbacks the aggregates registered before freeing their states.
+	 */
+	ReScanExprContext(aggstate->hashcontext);
+	aggstate->hash_batch = batch;
+	build_hash_table(aggstate);
+	aggstate->table_filled = false;
+
+	aggstate->hash_used_bits = batch->used_bits;
+	aggstate->hash_spill_mode = false;
+	LogicalTapeRewindForRead(batch->spill->tapeset, batch->tapenum, BLCKSZ);
+
+	agg_fill_hash_table(aggstate);
+
+	return true;
+}
+
+/*
+ * Discard any spilled partitions and close their files, so that the next
+ * scan starts from the outer plan again.
+ */
+static void
+hash_agg_reset_spill_state(AggState *aggstate)
+{
+	ListCell   *lc;
+
+	foreach(lc, aggstate->hash_spills)
+	{
+		HashAggSpill spill = (HashAggSpill) lfirst(lc);
+
+		if (spill->tapeset)
+			LogicalTapeSetClose(spill->tapeset);
+		pfree(spill->ntuples);
+	}
+	list_free_deep(aggstate->hash_spills);
+	aggstate->hash_spills = NIL;
+
+	list_free_deep(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+
+	if (aggstate->hash_batch)
+	{
+		pfree(aggstate->hash_batch);
+		aggstate->hash_batch = NULL;
+	}
+	if (aggstate->hash_spill_slot)
+		ExecClearTuple(aggstate->hash_spill_slot);
+
+	aggstate->hash_spill = NULL;
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_used_bits = 0;
+}
+
+/*
+ * Prepare a Parallel HashAggregate to work with the shared hash table, once
+ * it is known that there is one.
+ */
+static void
+agg_setup_shared_table(AggState *aggstate)
+{
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	TupleDesc	hashDesc = perhash->hashslot->tts_tupleDescriptor;
+	int			i;
+
+	Assert(aggstate->aggstrategy == AGG_HASHED && aggstate->num_hashes == 1);
+
+	/* The planner should have made sure the columns can be stored */
+	for (i = 0; i < perhash->numhashGrpCols; i++)
+	{
+		if (!TupleDescAttr(hashDesc, i)->attbyval)
+			elog(ERROR, "Parallel HashAggregate cannot store a pass-by-reference column");
+	}
+
+	aggstate->shared_eqfunctions =
+		(FmgrInfo *) palloc(perhash->numCols * sizeof(FmgrInfo));
+	for (i = 0; i < perhash->numCols; i++)
+		fmgr_info(perhash->eqfuncoids[i], &aggstate->shared_eqfunctions[i]);
+
+	/* A key holds the values, then the null flags, of all the columns */
+	aggstate->shared_key_size =
+		MAXALIGN(perhash->numhashGrpCols * (sizeof(Datum) + sizeof(bool)));
+	aggstate->shared_scan = (dshash_seq_status *)
+		palloc(sizeof(dshash_seq_status));
+	aggstate->shared_scan_active = false;
+	aggstate->shared_merge_pending = false;
+
+	/* Groups beyond work_mem are merged into the shared table instead */
+	aggstate->hash_can_spill = false;
+
+	ExecSetExecProcNode(&aggstate->ss.ps, ExecParallelAgg);
+}
+
+/*
+ * Fill in the parameters to create or attach to the shared hash table.
+ *
+ * An entry is a key followed by the transition states of the group.
+ */
+static void
+agg_shared_table_params(AggState *aggstate, dshash_parameters *params)
+{
+	params->key_size = aggstate->shared_key_size;
+	params->entry_size = aggstate->shared_key_size +
+		aggstate->numtrans * sizeof(AggStatePerGroupData);
+	params->compare_function = agg_shared_compare;
+	params->hash_function = agg_shared_hash;
+	params->tranche_id = LWTRANCHE_PARALLEL_HASH_AGG;
+}
+
+/*
+ * dshash compare function for keys of the shared hash table: like the local
+ * tables, it compares the grouping columns only, and null equals null.
+ */
+static int
+agg_shared_compare(const void *a, const void *b, size_t size, void *arg)
+{
+	AggState   *aggstate = (AggState *) arg;
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	const Datum *values_a = (const Datum *) a;
+	const Datum *values_b = (const Datum *) b;
+	const bool *isnull_a = (const bool *) (values_a + perhash->numhashGrpCols);
+	const bool *isnull_b = (const bool *) (values_b + perhash->numhashGrpCols);
+	int			i;
+
+	for (i = 0; i < perhash->numCols; i++)
+	{
+		if (isnull_a[i] != isnull_b[i])
+			return 1;
+		if (isnull_a[i])
+			continue;
+		if (!DatumGetBool(FunctionCall2(&aggstate->shared_eqfunctions[i],
+										values_a[i], values_b[i])))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * dshash hash function for keys of the shared hash table, combining the
+ * grouping columns' hash values as TupleHashTableHash does.
+ */
+static dshash_hash
+agg_shared_hash(const void *key, size_t size, void *arg)
+{
+	AggState   *aggstate = (AggState *) arg;
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	const Datum *values = (const Datum *) key;
+	const bool *isnull = (const bool *) (values + perhash->numhashGrpCols);
+	uint32		hashkey = 0;
+	int			i;
+
+	for (i = 0; i < perhash->numCols; i++)
+	{
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		/* treat nulls as having hash key 0 */
+		if (!isnull[i])
+		{
+			uint32		hkey;
+
+			hkey = DatumGetUInt32(FunctionCall1(&perhash->hashfunctions[i],
+												values[i]));
+			hashkey ^= hkey;
+		}
+	}
+
+	/* the shared table picks partitions and buckets by the high bits */
+	return murmurhash32(hashkey);
+}
+
+/*
+ * Merge the groups of the local hash table into the shared one, and start
+ * over with an empty local table.
+ */
+static void
+agg_merge_into_shared(AggState *aggstate)
+{
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	TupleTableSlot *hashslot = perhash->hashslot;
+	Size		key_size = aggstate->shared_key_size;
+	Datum	   *values;
+	bool	   *isnull;
+	TupleHashEntryData *entry;
+
+	values = (Datum *) palloc0(key_size);
+	isnull = (bool *) (values + perhash->numhashGrpCols);
+
+	ResetTupleHashIterator(perhash->hashtable, &perhash->hashiter);
+	while ((entry = ScanTupleHashTable(perhash->hashtable,
+									   &perhash->hashiter)) != NULL)
+	{
+		AggStatePerGroup local = (AggStatePerGroup) entry->additional;
+		AggStatePerGroup shared;
+		char	   *sharedentry;
+		bool		found;
+
+		CHECK_FOR_INTERRUPTS();
+
+		ExecStoreMinimalTuple(entry->firstTuple, hashslot, false);
+		slot_getallattrs(hashslot);
+		memcpy(values, hashslot->tts_values,
+			   perhash->numhashGrpCols * sizeof(Datum));
+		memcpy(isnull, hashslot->tts_isnull,
+			   perhash->numhashGrpCols * sizeof(bool));
+
+		sharedentry = dshash_find_or_insert(aggstate->shared_table, values,
+											&found);
+		shared = (AggStatePerGroup) (sharedentry + key_size);
+		if (found)
+			agg_combine_groups(aggstate, shared, local);
+		else
+			memcpy(shared, local,
+				   aggstate->numtrans * sizeof(AggStatePerGroupData));
+		dshash_release_lock(aggstate->shared_table, sharedentry);
+	}
+	ExecClearTuple(hashslot);
+	pfree(values);
+
+	/* Empty the local table, running any shutdown callbacks */
+	ReScanExprContext(aggstate->hashcontext);
+	build_hash_table(aggstate);
+	aggstate->shared_merge_pending = false;
+}
+
+/*
+ * Combine the transition states of a local group into those of the same
+ * group in the shared hash table.
+ *
+ * The states are all passed by value, so the result of a combine function
+ * can be stored in the shared entry as it is.
+ */
+static void
+agg_combine_groups(AggState *aggstate, AggStatePerGroup shared,
+				   AggStatePerGroup local)
+{
+	MemoryContext oldContext;
+	int			transno;
+
+	oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+	for (transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		FunctionCallInfo fcinfo = &pertrans->combinefn_fcinfo;
+		AggStatePerGroup sharedstate = &shared[transno];
+		AggStatePerGroup localstate = &local[transno];
+		Datum		newVal;
+
+		if (pertrans->combinefn.fn_strict)
+		{
+			/* A null state has nothing to add */
+			if (localstate->transValueIsNull)
+				continue;
+
+			/* The first non-null state is taken as it is */
+			if (sharedstate->transValueIsNull)
+			{
+				*sharedstate = *localstate;
+				continue;
+			}
+		}
+
+		/* We run the combine functions in per-input-tuple memory context */
+		aggstate->curpertrans = pertrans;
+
+		fcinfo->arg[0] = sharedstate->transValue;
+		fcinfo->argnull[0] = sharedstate->transValueIsNull;
+		fcinfo->arg[1] = localstate->transValue;
+		fcinfo->argnull[1] = localstate->transValueIsNull;
+		fcinfo->isnull = false; /* just in case combinefn doesn't set it */
+
+		newVal = FunctionCallInvoke(fcinfo);
+
+		aggstate->curpertrans = NULL;
+
+		sharedstate->transValue = newVal;
+		sharedstate->transValueIsNull = fcinfo->isnull;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	ResetExprContext(aggstate->tmpcontext);
 }
 
 /*
@@ -1559,6 +2160,27 @@ ExecAgg(PlanState *pstate)
 	return NULL;
 }
 
+/*
+ * ExecParallelAgg -
+ *
+ *	  ExecAgg for a Parallel HashAggregate with a shared hash table.
+ */
+static TupleTableSlot *
+ExecParallelAgg(PlanState *pstate)
+{
+	AggState   *node = castNode(AggState, pstate);
+
+	CHECK_FOR_INTERRUPTS();
+
+	if (node->agg_done)
+		return NULL;
+
+	if (!node->table_filled)
+		agg_fill_shared_hash_table(node);
+
+	return agg_retrieve_shared_hash_table(node);
+}
+
 /*
  * ExecAgg for non-hashed case
  */
@@ -1903,6 +2525,8 @@ agg_retrieve_direct(AggState *aggstate)
 
 /*
  * ExecAgg for hashed case: read input and build hash table
+ *
+ * The input is the outer plan, or a spilled partition if hash_batch is set.
  */
 static void
 agg_fill_hash_table(AggState *aggstate)
@@ -1916,18 +2540,22 @@ agg_fill_hash_table(AggState *aggstate)
 	 */
 	for (;;)
 	{
-		outerslot = fetch_input_tuple(aggstate);
+		if (aggstate->hash_batch)
+			outerslot = hash_agg_batch_read(aggstate, aggstate->hash_batch);
+		else
+			outerslot = fetch_input_tuple(aggstate);
 		if (TupIsNull(outerslot))
 			break;
 
 		/* set up for lookup_hash_entries and advance_aggregates */
 		tmpcontext->ecxt_outertuple = outerslot;
 
-		/* Find or build hashtable entries */
-		lookup_hash_entries(aggstate);
-
-		/* Advance the aggregates (or combine functions) */
-		advance_aggregates(aggstate);
+		/*
+		 * Find or build hashtable entries, and advance the aggregates (or
+		 * combine functions) unless the tuple was spilled instead
+		 */
+		if (lookup_hash_entries(aggstate))
+			advance_aggregates(aggstate);
 
 		/*
 		 * Reset per-input-tuple context after each tuple, but note that the
@@ -1936,6 +2564,12 @@ agg_fill_hash_table(AggState *aggstate)
 		ResetExprContext(aggstate->tmpcontext);
 	}
 
+	if (aggstate->hash_spill)
+		hash_agg_finish_spill(aggstate);
+	if (aggstate->hash_batch)
+		hash_agg_finish_batch(aggstate);
+	aggstate->hash_batches_used++;
+
 	aggstate->table_filled = true;
 	/* Initialize to walk the first hash table */
 	select_current_set(aggstate, 0, true);
@@ -2005,6 +2639,16 @@ agg_retrieve_hash_table(AggState *aggstate)
 
 				continue;
 			}
+			else if (hash_agg_next_batch(aggstate))
+			{
+				/*
+				 * The table has been refilled from a spilled partition, so
+				 * restart the loop to return its groups.
+				 */
+				perhash = &aggstate->perhash[aggstate->current_set];
+
+				continue;
+			}
 			else
 			{
 				/* No more hashtables, so done */
@@ -2065,6 +2709,145 @@ agg_retrieve_hash_table(AggState *aggstate)
 	return NULL;
 }
 
+/*
+ * ExecParallelAgg: aggregate this participant's input, and merge the groups
+ * into the shared hash table
+ *
+ * Returns when every participant has merged its groups.  A participant that
+ * arrives after that has nothing to add, even if its input isn't exhausted.
+ */
+static void
+agg_fill_shared_hash_table(AggState *aggstate)
+{
+	ParallelAggState *pstate = aggstate->parallel_state;
+	Barrier    *build_barrier = &pstate->build_barrier;
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+	TupleTableSlot *outerslot;
+
+	if (BarrierAttach(build_barrier) == PAGG_BUILD_MERGING)
+	{
+		for (;;)
+		{
+			outerslot = fetch_input_tuple(aggstate);
+			if (TupIsNull(outerslot))
+				break;
+
+			/* set up for lookup_hash_entries and advance_aggregates */
+			tmpcontext->ecxt_outertuple = outerslot;
+
+			/* nothing is spilled, since hash_can_spill is off */
+			if (lookup_hash_entries(aggstate))
+				advance_aggregates(aggstate);
+
+			ResetExprContext(aggstate->tmpcontext);
+
+			if (aggstate->shared_merge_pending)
+				agg_merge_into_shared(aggstate);
+		}
+
+		agg_merge_into_shared(aggstate);
+		aggstate->hash_batches_used++;
+
+		BarrierArriveAndWait(build_barrier, WAIT_EVENT_HASHAGG_MERGING);
+	}
+	Assert(BarrierPhase(build_barrier) == PAGG_BUILD_DONE);
+	BarrierDetach(build_barrier);
+
+	aggstate->table_filled = true;
+	aggstate->shared_scan_active = false;
+	select_current_set(aggstate, 0, true);
+}
+
+/*
+ * ExecParallelAgg: retrieve groups from the shared hash table
+ *
+ * Participants claim its partitions one at a time, so that each group is
+ * returned by exactly one of them.
+ */
+static TupleTableSlot *
+agg_retrieve_shared_hash_table(AggState *aggstate)
+{
+	ParallelAggState *pstate = aggstate->parallel_state;
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	ExprContext *econtext = aggstate->ss.ps.ps_ExprContext;
+	TupleTableSlot *firstSlot = aggstate->ss.ss_ScanTupleSlot;
+	TupleTableSlot *result;
+
+	while (!aggstate->agg_done)
+	{
+		char	   *entry = NULL;
+		Datum	   *values;
+		bool	   *isnull;
+		AggStatePerGroup pergroup;
+		int			i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (aggstate->shared_scan_active)
+			entry = dshash_seq_next(aggstate->shared_scan);
+		if (entry == NULL)
+		{
+			uint32		partition;
+
+			/* Claim the next partition not yet returned, if any */
+			partition = pg_atomic_fetch_add_u32(&pstate->next_partition, 1);
+			if (partition >= DSHASH_NUM_PARTITIONS)
+			{
+				aggstate->shared_scan_active = false;
+				aggstate->agg_done = true;
+				return NULL;
+			}
+
+			dshash_seq_init(aggstate->shared_scan, aggstate->shared_table,
+							(int) partition);
+			aggstate->shared_scan_active = true;
+			continue;
+		}
+
+		/*
+		 * Clear the per-output-tuple context for each group, as in
+		 * agg_retrieve_hash_table
+		 */
+		ResetExprContext(econtext);
+
+		/* Transform the entry's key into a tuple with the right columns */
+		values = (Datum *) entry;
+		isnull = (bool *) (values + perhash->numhashGrpCols);
+
+		ExecClearTuple(firstSlot);
+		memset(firstSlot->tts_isnull, true,
+			   firstSlot->tts_tupleDescriptor->natts * sizeof(bool));
+
+		for (i = 0; i < perhash->numhashGrpCols; i++)
+		{
+			int			varNumber = perhash->hashGrpColIdxInput[i] - 1;
+
+			firstSlot->tts_values[varNumber] = values[i];
+			firstSlot->tts_isnull[varNumber] = isnull[i];
+		}
+		ExecStoreVirtualTuple(firstSlot);
+
+		pergroup = (AggStatePerGroup) (entry + aggstate->shared_key_size);
+
+		/*
+		 * Use the representative input tuple for any references to
+		 * non-aggregated input columns in the qual and tlist.
+		 */
+		econtext->ecxt_outertuple = firstSlot;
+
+		prepare_projection_slot(aggstate, firstSlot, 0);
+
+		finalize_aggregates(aggstate, aggstate->peragg, pergroup);
+
+		result = project_aggregates(aggstate);
+		if (result)
+			return result;
+	}
+
+	/* No more groups */
+	return NULL;
+}
+
 /* -----------------
  * ExecInitAgg
  *
@@ -2209,6 +2992,9 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	outerPlan = outerPlan(node);
 	outerPlanState(aggstate) = ExecInitNode(outerPlan, estate, eflags);
 
+	/* read it in batches, if it returns them; see fetch_input_tuple */
+	aggstate->batch = ExecInitTupleBatch(outerPlanState(aggstate));
+
 	/*
 	 * initialize source tuple type.
 	 */
@@ -2446,6 +3232,18 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		find_hash_columns(aggstate);
 		build_hash_table(aggstate);
 		aggstate->table_filled = false;
+
+		/*
+		 * Only a lone hashed grouping set can leave a group out of the table,
+		 * since a tuple that AGG_MIXED or another hashed set aggregates now
+		 * couldn't be read again later; see "Spilling" above.
+		 */
+		if (aggstate->aggstrategy == AGG_HASHED && numHashes == 1)
+		{
+			aggstate->hash_can_spill = true;
+			aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate,
+															   scanDesc);
+		}
 	}
 
 	/*
@@ -2686,6 +3484,16 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 								   get_func_name(deserialfn_oid));
 				InvokeFunctionExecuteHook(deserialfn_oid);
 			}
+			if (node->plan.parallel_aware &&
+				OidIsValid(aggform->aggcombinefn))
+			{
+				aclresult = pg_proc_aclcheck(aggform->aggcombinefn, aggOwner,
+											 ACL_EXECUTE);
+				if (aclresult != ACLCHECK_OK)
+					aclcheck_error(aclresult, OBJECT_FUNCTION,
+								   get_func_name(aggform->aggcombinefn));
+				InvokeFunctionExecuteHook(aggform->aggcombinefn);
+			}
 		}
 
 		/*
@@ -2775,6 +3583,25 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 									  initValue, initValueIsNull,
 									  inputTypes, numArguments);
 			peragg->transno = transno;
+
+			/*
+			 * A Parallel HashAggregate also merges states into the shared
+			 * hash table, which stores them as bare Datums.  The planner
+			 * should have made sure that it can.
+			 */
+			if (node->plan.parallel_aware)
+			{
+				if (!OidIsValid(aggform->aggcombinefn) ||
+					!pertrans->transtypeByVal)
+					elog(ERROR, "aggregate %u cannot be used by Parallel HashAggregate",
+						 aggref->aggfnoid);
+				fmgr_info(aggform->aggcombinefn, &pertrans->combinefn);
+				InitFunctionCallInfoData(pertrans->combinefn_fcinfo,
+										 &pertrans->combinefn,
+										 2,
+										 pertrans->aggCollation,
+										 (void *) aggstate, NULL);
+			}
 		}
 		ReleaseSysCache(aggTuple);
 	}
@@ -3330,6 +4157,9 @@ ExecEndAgg(AggState *node)
 		}
 	}
 
+	/* Close any files holding spilled tuples */
+	hash_agg_reset_spill_state(node);
+
 	/* And ensure any agg shutdown callbacks have been called */
 	for (setno = 0; setno < numGroupingSets; setno++)
 		ReScanExprContext(node->aggcontexts[setno]);
@@ -3362,6 +4192,9 @@ ExecReScanAgg(AggState *node)
 
 	node->agg_done = false;
 
+	if (node->batch)
+		ExecResetTupleBatch(node->batch);
+
 	if (node->aggstrategy == AGG_HASHED)
 	{
 		/*
@@ -3377,10 +4210,15 @@ ExecReScanAgg(AggState *node)
 		 * If we do have the hash table, and the subplan does not have any
 		 * parameter changes, and none of our own parameter changes affect
 		 * input expressions of the aggregated functions, then we can just
-		 * rescan the existing hash table; no need to build it again.
+		 * rescan the existing hash table; no need to build it again.  That
+		 * isn't so if some groups were spilled, as the table then holds only
+		 * the last partition's, nor with a shared table, which is replaced
+		 * by ExecAggReInitializeDSM.
 		 */
 		if (outerPlan->chgParam == NULL &&
-			!bms_overlap(node->ss.ps.chgParam, aggnode->aggParams))
+			!bms_overlap(node->ss.ps.chgParam, aggnode->aggParams) &&
+			node->hash_spills == NIL &&
+			node->shared_table == NULL)
 		{
 			ResetTupleHashIterator(node->perhash[0].hashtable,
 								   &node->perhash[0].hashiter);
@@ -3436,10 +4274,13 @@ ExecReScanAgg(AggState *node)
 	 */
 	if (node->aggstrategy == AGG_HASHED || node->aggstrategy == AGG_MIXED)
 	{
+		hash_agg_reset_spill_state(node);
 		ReScanExprContext(node->hashcontext);
 		/* Rebuild an empty hash table */
 		build_hash_table(node);
 		node->table_filled = false;
+		node->shared_scan_active = false;
+		node->shared_merge_pending = false;
 		/* iterator will be reset when the table is filled */
 	}
 
@@ -3465,6 +4306,107 @@ ExecReScanAgg(AggState *node)
 		ExecReScan(outerPlan);
 }
 
+/* ----------------------------------------------------------------
+ *						Parallel Query Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecAggEstimate
+ *
+ *		Estimate space required to coordinate a Parallel HashAggregate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggEstimate(AggState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(ParallelAggState));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggInitializeDSM
+ *
+ *		Create the shared hash table, and the state coordinating its use.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggInitializeDSM(AggState *node, ParallelContext *pcxt)
+{
+	ParallelAggState *pstate;
+	dshash_parameters params;
+
+	/*
+	 * Without a real DSM segment there is no DSA area for the shared table,
+	 * and no workers either, so just aggregate as usual.
+	 */
+	if (pcxt->seg == NULL)
+		return;
+
+	agg_setup_shared_table(node);
+
+	pstate = shm_toc_allocate(pcxt->toc, sizeof(ParallelAggState));
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, pstate);
+
+	agg_shared_table_params(node, &params);
+	node->shared_table = dshash_create(node->ss.ps.state->es_query_dsa,
+									   &params, node);
+	pstate->hashtable_handle = dshash_get_hash_table_handle(node->shared_table);
+	BarrierInit(&pstate->build_barrier, 0);
+	pg_atomic_init_u32(&pstate->next_partition, 0);
+
+	node->parallel_state = pstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggReInitializeDSM
+ *
+ *		Replace the shared hash table with an empty one before a rescan.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggReInitializeDSM(AggState *node, ParallelContext *pcxt)
+{
+	ParallelAggState *pstate = node->parallel_state;
+	dshash_parameters params;
+
+	if (pstate == NULL)
+		return;
+
+	/* The workers of the previous scan are gone, so nobody else uses it */
+	dshash_destroy(node->shared_table);
+
+	agg_shared_table_params(node, &params);
+	node->shared_table = dshash_create(node->ss.ps.state->es_query_dsa,
+									   &params, node);
+	pstate->hashtable_handle = dshash_get_hash_table_handle(node->shared_table);
+	BarrierInit(&pstate->build_barrier, 0);
+	pg_atomic_write_u32(&pstate->next_partition, 0);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggInitializeWorker
+ *
+ *		Attach to the shared hash table.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggInitializeWorker(AggState *node, ParallelWorkerContext *pwcxt)
+{
+	ParallelAggState *pstate;
+	dshash_parameters params;
+
+	pstate = shm_toc_lookup(pwcxt->toc, node->ss.ps.plan->plan_node_id, false);
+
+	agg_setup_shared_table(node);
+
+	agg_shared_table_params(node, &params);
+	node->shared_table = dshash_attach(node->ss.ps.state->es_query_dsa,
+									   &params, pstate->hashtable_handle,
+									   node);
+	node->parallel_state = pstate;
+}
+
 
 /***********************************************************************
  * API exposed to aggregate functions
@@ -37,6 +37,7 @@
 
 #include <math.h>
 
+#include "access/heapversion.h"
 #include "access/relscan.h"
 #include "access/transam.h"
 #include "access/visibilitymap.h"
@@ -336,6 +337,10 @@ BitmapHeapNext(BitmapHeapScanState *node)
 
 			pgstat_count_heap_fetch(scan->rs_rd);
 
+			/* Convert a tuple written under an older schema version */
+			if (scan->rs_versions)
+				heap_scan_upgrade_tuple(scan);
+
 			/*
 			 * Set up the result slot to point to this tuple.  Note that the
 			 * slot acquires a pin on the buffer.
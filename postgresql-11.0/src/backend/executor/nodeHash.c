@@ -161,7 +161,10 @@ MultiExecPrivateHash(HashState *node)
 	 */
 	for (;;)
 	{
-		slot = ExecProcNode(outerNode);
+		if (node->batch)
+			slot = ExecBatchNext(outerNode, node->batch);
+		else
+			slot = ExecProcNode(outerNode);
 		if (TupIsNull(slot))
 			break;
 		/* We have to compute the hash value */
@@ -391,6 +394,9 @@ ExecInitHash(Hash *node, EState *estate, int eflags)
 	hashstate->ps.qual =
 		ExecInitQual(node->plan.qual, (PlanState *) hashstate);
 
+	/* read the outer plan in batches, if it returns them */
+	hashstate->batch = ExecInitTupleBatch(outerPlanState(hashstate));
+
 	return hashstate;
 }
 
@@ -2168,6 +2174,9 @@ ExecHashTableResetMatchFlags(HashJoinTable hashtable)
 void
 ExecReScanHash(HashState *node)
 {
+	if (node->batch)
+		ExecResetTupleBatch(node->batch);
+
 	/*
 	 * if chgParam of subnode is not null then plan will be re-scanned by
 	 * first ExecProcNode.
@@ -0,0 +1,414 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeIncrementalSort.c
+ *	  Routines to handle sorting of relations that are already sorted on a
+ *	  prefix of the sort keys.
+ *
+ * When the input arrives sorted on the leading nPresortedCols sort keys,
+ * only tuples that agree on all of those keys have to be sorted among
+ * themselves.  Rather than reading the whole input before returning the
+ * first tuple, as a Sort node must, we read it in batches that each end
+ * where those keys change, sort one batch at a time on all the keys, and
+ * return it before reading on.  A LIMIT above us thus stops the input after
+ * the groups it needs, and each sort is small enough to stay in memory.
+ *
+ * Sorting every group separately would pay tuplesort's startup cost per
+ * group, which hurts when groups are small, so a batch collects at least
+ * MIN_BATCH_SIZE tuples (fewer if the bound allows) before we look for the
+ * end of a group.  The first tuple found not to belong to the batch is kept
+ * in group_pivot to begin the next one.
+ *
+ * Neither backward scans nor mark/restore are supported.
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeIncrementalSort.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/execdebug.h"
+#include "executor/nodeIncrementalSort.h"
+#include "miscadmin.h"
+#include "utils/lsyscache.h"
+#include "utils/tuplesort.h"
+
+
+/* fewest tuples worth starting a tuplesort for, if the groups allow */
+#define MIN_BATCH_SIZE	32
+
+
+/*
+ * Does the tuple in slot have the same presorted keys as the group pivot?
+ */
+static bool
+isCurrentGroup(IncrementalSortState *node, TupleTableSlot *slot)
+{
+	IncrementalSort *plannode = (IncrementalSort *) node->ss.ps.plan;
+	TupleTableSlot *pivot = node->group_pivot;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	MemoryContext oldContext;
+	bool		result = true;
+	int			i;
+
+	/* equality functions may leak, so run them in the per-tuple context */
+	ResetExprContext(econtext);
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	/*
+	 * The input is sorted on these keys, so a tuple that differs at all most
+	 * likely differs in the last of them: compare from the last key back.
+	 */
+	for (i = node->nPresortedCols - 1; i >= 0; i--)
+	{
+		AttrNumber	attno = plannode->sort.sortColIdx[i];
+		Datum		datum1,
+					datum2;
+		bool		isnull1,
+					isnull2;
+
+		datum1 = slot_getattr(pivot, attno, &isnull1);
+		datum2 = slot_getattr(slot, attno, &isnull2);
+
+		if (isnull1 || isnull2)
+		{
+			/* nulls sort together, so they form a group of their own */
+			if (isnull1 == isnull2)
+				continue;
+			result = false;
+			break;
+		}
+
+		if (!DatumGetBool(FunctionCall2Coll(&node->presorted_eqfuncs[i],
+											plannode->sort.collations[i],
+											datum1, datum2)))
+		{
+			result = false;
+			break;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return result;
+}
+
+/*
+ * Remember the stats of a batch's sort before it is ended, if it is the
+ * largest so far.
+ */
+static void
+recordBatchStats(IncrementalSortState *node)
+{
+	TuplesortInstrumentation stats;
+
+	tuplesort_get_stats((Tuplesortstate *) node->tuplesortstate, &stats);
+	if (node->peak_stats.sortMethod == SORT_TYPE_STILL_IN_PROGRESS ||
+		stats.spaceUsed > node->peak_stats.spaceUsed)
+		node->peak_stats = stats;
+}
+
+/*
+ * Read the next batch of input and sort it.
+ *
+ * The batch takes any pending pivot tuple, then tuples up to the minimum
+ * batch size, and then the rest of the group the last of those belongs to.
+ */
+static void
+sortNextBatch(IncrementalSortState *node)
+{
+	IncrementalSort *plannode = (IncrementalSort *) node->ss.ps.plan;
+	PlanState  *outerNode = outerPlanState(node);
+	Tuplesortstate *tuplesortstate;
+	int64		minTuples = MIN_BATCH_SIZE;
+	int64		ntuples = 0;
+
+	Assert(node->tuplesortstate == NULL);
+
+	tuplesortstate = tuplesort_begin_heap(ExecGetResultType(outerNode),
+										  plannode->sort.numCols,
+										  plannode->sort.sortColIdx,
+										  plannode->sort.sortOperators,
+										  plannode->sort.collations,
+										  plannode->sort.nullsFirst,
+										  work_mem,
+										  NULL, false);
+	node->tuplesortstate = (void *) tuplesortstate;
+
+	if (node->bounded)
+	{
+		int64		remaining = node->bound - node->tuples_returned;
+
+		/*
+		 * Only the first "remaining" tuples of this batch can be needed; a
+		 * bounded sort keeps just those, and we needn't gather more than
+		 * that before ending the batch at a group boundary.
+		 */
+		tuplesort_set_bound(tuplesortstate, remaining);
+		minTuples = Min(minTuples, remaining);
+	}
+
+	if (node->pivot_pending)
+	{
+		tuplesort_puttupleslot(tuplesortstate, node->group_pivot);
+		node->pivot_pending = false;
+		ntuples++;
+	}
+
+	while (!node->outerNodeDone)
+	{
+		TupleTableSlot *slot = ExecProcNode(outerNode);
+
+		if (TupIsNull(slot))
+		{
+			node->outerNodeDone = true;
+			break;
+		}
+
+		if (ntuples >= minTuples && !isCurrentGroup(node, slot))
+		{
+			/* this tuple begins the next batch */
+			ExecCopySlot(node->group_pivot, slot);
+			node->pivot_pending = true;
+			break;
+		}
+
+		tuplesort_puttupleslot(tuplesortstate, slot);
+
+		/* the batch may end once the group of its last required tuple does */
+		if (++ntuples == minTuples)
+			ExecCopySlot(node->group_pivot, slot);
+	}
+
+	tuplesort_performsort(tuplesortstate);
+	node->nbatches++;
+
+	SO1_printf("ExecIncrementalSort: sorted a batch of " INT64_FORMAT
+			   " tuples\n", ntuples);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIncrementalSort
+ *
+ *		Returns the next tuple of the current sorted batch, sorting the
+ *		next batch of input when it runs out.
+ *
+ *		Conditions:
+ *		  -- the outer child returns tuples sorted on the presorted keys.
+ *
+ *		Initial States:
+ *		  -- the outer child is prepared to return the first tuple.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecIncrementalSort(PlanState *pstate)
+{
+	IncrementalSortState *node = castNode(IncrementalSortState, pstate);
+	EState	   *estate = node->ss.ps.state;
+	TupleTableSlot *slot = node->ss.ps.ps_ResultTupleSlot;
+
+	CHECK_FOR_INTERRUPTS();
+
+	/* we only support forward scans */
+	Assert(ScanDirectionIsForward(estate->es_direction));
+
+	for (;;)
+	{
+		if (node->tuplesortstate != NULL)
+		{
+			/*
+			 * Note that we only rely on slot tuple remaining valid until the
+			 * next fetch from the tuplesort.
+			 */
+			if (tuplesort_gettupleslot((Tuplesortstate *) node->tuplesortstate,
+									   true, false, slot, NULL))
+			{
+				node->tuples_returned++;
+				return slot;
+			}
+
+			/* this batch is used up */
+			recordBatchStats(node);
+			tuplesort_end((Tuplesortstate *) node->tuplesortstate);
+			node->tuplesortstate = NULL;
+		}
+
+		if ((node->outerNodeDone && !node->pivot_pending) ||
+			(node->bounded && node->tuples_returned >= node->bound))
+			return ExecClearTuple(slot);
+
+		sortNextBatch(node);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitIncrementalSort
+ *
+ *		Creates the run-time state information for the incremental sort
+ *		node produced by the planner and initializes its outer subtree.
+ * ----------------------------------------------------------------
+ */
+IncrementalSortState *
+ExecInitIncrementalSort(IncrementalSort *node, EState *estate, int eflags)
+{
+	IncrementalSortState *incrsortstate;
+	int			i;
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "initializing incremental sort node");
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	incrsortstate = makeNode(IncrementalSortState);
+	incrsortstate->ss.ps.plan = (Plan *) node;
+	incrsortstate->ss.ps.state = estate;
+	incrsortstate->ss.ps.ExecProcNode = ExecIncrementalSort;
+
+	incrsortstate->bounded = false;
+	incrsortstate->tuples_returned = 0;
+	incrsortstate->outerNodeDone = false;
+	incrsortstate->pivot_pending = false;
+	incrsortstate->tuplesortstate = NULL;
+	incrsortstate->nbatches = 0;
+	incrsortstate->peak_stats.sortMethod = SORT_TYPE_STILL_IN_PROGRESS;
+	incrsortstate->peak_stats.spaceUsed = 0;
+
+	/*
+	 * Look up the equality functions that tell whether two tuples agree on
+	 * the presorted keys.
+	 */
+	incrsortstate->nPresortedCols = node->nPresortedCols;
+	incrsortstate->presorted_eqfuncs = (FmgrInfo *)
+		palloc(node->nPresortedCols * sizeof(FmgrInfo));
+	for (i = 0; i < node->nPresortedCols; i++)
+	{
+		Oid			sortop = node->sort.sortOperators[i];
+		Oid			eqop;
+
+		eqop = get_equality_op_for_ordering_op(sortop, NULL);
+		if (!OidIsValid(eqop))
+			elog(ERROR, "missing equality operator for ordering operator %u",
+				 sortop);
+		fmgr_info(get_opcode(eqop), &incrsortstate->presorted_eqfuncs[i]);
+	}
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * The ExprContext is only used for its per-tuple memory, in which the
+	 * presorted keys are compared.
+	 */
+	ExecAssignExprContext(estate, &incrsortstate->ss.ps);
+
+	/*
+	 * initialize child nodes
+	 *
+	 * We shield the child node from the need to support REWIND, BACKWARD, or
+	 * MARK/RESTORE.
+	 */
+	eflags &= ~(EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK);
+
+	outerPlanState(incrsortstate) = ExecInitNode(outerPlan(node), estate,
+												 eflags);
+
+	/*
+	 * Initialize scan slot and type.
+	 */
+	ExecCreateScanSlotFromOuterPlan(estate, &incrsortstate->ss);
+
+	/*
+	 * Initialize return slot and type. No need to initialize projection info
+	 * because this node doesn't do projections.
+	 */
+	ExecInitResultTupleSlotTL(estate, &incrsortstate->ss.ps);
+	incrsortstate->ss.ps.ps_ProjInfo = NULL;
+
+	/* a slot to hold the group pivot */
+	incrsortstate->group_pivot =
+		ExecInitExtraTupleSlot(estate,
+							   ExecGetResultType(outerPlanState(incrsortstate)));
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "incremental sort node initialized");
+
+	return incrsortstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndIncrementalSort(node)
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndIncrementalSort(IncrementalSortState *node)
+{
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "shutting down incremental sort node");
+
+	/*
+	 * clean out the tuple table
+	 */
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	/* must drop pointer to sort result tuple */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->group_pivot);
+
+	/*
+	 * Release tuplesort resources
+	 */
+	if (node->tuplesortstate != NULL)
+		tuplesort_end((Tuplesortstate *) node->tuplesortstate);
+	node->tuplesortstate = NULL;
+
+	/*
+	 * Free the exprcontext
+	 */
+	ExecFreeExprContext(&node->ss.ps);
+
+	/*
+	 * shut down the subplan
+	 */
+	ExecEndNode(outerPlanState(node));
+
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "incremental sort node shutdown");
+}
+
+void
+ExecReScanIncrementalSort(IncrementalSortState *node)
+{
+	PlanState  *outerPlan = outerPlanState(node);
+
+	/* must drop pointer to sort result tuple */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->group_pivot);
+
+	/*
+	 * Only the current batch is kept, so there is nothing to rewind: forget
+	 * it and read the input again.
+	 */
+	if (node->tuplesortstate != NULL)
+	{
+		recordBatchStats(node);
+		tuplesort_end((Tuplesortstate *) node->tuplesortstate);
+		node->tuplesortstate = NULL;
+	}
+	node->tuples_returned = 0;
+	node->outerNodeDone = false;
+	node->pivot_pending = false;
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (outerPlan->chgParam == NULL)
+		ExecReScan(outerPlan);
+}
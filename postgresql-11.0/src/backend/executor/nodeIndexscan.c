@@ -42,6 +42,7 @@
 #include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/migrate_schema.h"
 #include "utils/rel.h"
 
 /*
@@ -115,6 +116,8 @@ IndexNext(IndexScanState *node)
 								   estate->es_snapshot,
 								   node->iss_NumScanKeys,
 								   node->iss_NumOrderByKeys);
+		if (migrateflag && node->iss_MigrateReadAhead)
+			index_setmigratescan(scandesc);
 
 		node->iss_ScanDesc = scandesc;
 
@@ -1004,6 +1007,13 @@ ExecInitIndexScan(IndexScan *node, EState *estate, int eflags)
 	indexstate->iss_RuntimeKeys = NULL;
 	indexstate->iss_NumRuntimeKeys = 0;
 
+	/*
+	 * Reading ahead for a migration moves the index AM's position past the
+	 * tuple returned, so it's only done if the position never matters.
+	 */
+	indexstate->iss_MigrateReadAhead =
+		(eflags & (EXEC_FLAG_MARK | EXEC_FLAG_BACKWARD)) == 0;
+
 	/*
 	 * build the index scan keys from the index qualification
 	 */
@@ -21,6 +21,7 @@
 
 #include "postgres.h"
 
+#include "access/heapversion.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "executor/executor.h"
@@ -320,6 +321,7 @@ lnext:
 				elog(ERROR, "failed to fetch tuple for EvalPlanQual recheck");
 
 			/* successful, copy and store tuple */
+			heap_tuple_upgrade(erm->relation, &tuple);
 			EvalPlanQualSetTuple(&node->lr_epqstate, erm->rti,
 								 heap_copytuple(&tuple));
 			ReleaseBuffer(buffer);
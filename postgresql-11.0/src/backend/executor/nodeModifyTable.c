@@ -37,6 +37,7 @@
 
 #include "postgres.h"
 
+#include "access/heapversion.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "commands/trigger.h"
@@ -863,6 +864,7 @@ ldelete:;
 		TupleTableSlot *rslot;
 		HeapTupleData deltuple;
 		Buffer		delbuffer;
+		MemoryContext oldcxt;
 
 		if (resultRelInfo->ri_FdwRoutine)
 		{
@@ -884,6 +886,9 @@ ldelete:;
 				if (!heap_fetch(resultRelationDesc, SnapshotAny,
 								&deltuple, &delbuffer, false, NULL))
 					elog(ERROR, "failed to fetch deleted tuple for DELETE RETURNING");
+				oldcxt = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+				heap_tuple_upgrade(resultRelationDesc, &deltuple);
+				MemoryContextSwitchTo(oldcxt);
 			}
 
 			if (slot->tts_tupleDescriptor != RelationGetDescr(resultRelationDesc))
@@ -1368,6 +1373,7 @@ ExecOnConflictUpdate(ModifyTableState *mtstate,
 	LockTupleMode lockmode;
 	HTSU_Result test;
 	Buffer		buffer;
+	MemoryContext oldcxt;
 
 	/* Determine lock mode to use */
 	lockmode = ExecUpdateLockMode(estate, resultRelInfo);
@@ -1477,6 +1483,18 @@ ExecOnConflictUpdate(ModifyTableState *mtstate,
 	 */
 	ExecCheckHeapTupleVisible(estate, &tuple, buffer);
 
+	/* Convert a tuple written under an older schema version */
+	oldcxt = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	heap_tuple_upgrade(relation, &tuple);
+	MemoryContextSwitchTo(oldcxt);
+
+	/*
+	 * Likewise fill in lazy column defaults, so that the update stores them
+	 * rather than nulls.
+	 */
+	if (HeapTupleHeaderGetNatts(tuple.t_data) < RelationGetNumberOfAttributes(relation))
+		tuple = *ExecResultRelFillLazyDefaults(resultRelInfo, &tuple, estate);
+
 	/* Store target's existing tuple in the state's dedicated slot */
 	ExecStoreTuple(&tuple, mtstate->mt_existing, buffer, false);
 
@@ -139,6 +139,67 @@ ExecResult(PlanState *pstate)
 	return NULL;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecResultBatch(node)
+ *
+ *		Projects a batch of tuples of the outer plan, which returns
+ *		batches itself.  The projections may point into the outer
+ *		tuples, so a batch never spans two batches of the outer plan.
+ * ----------------------------------------------------------------
+ */
+static int
+ExecResultBatch(PlanState *pstate, TupleTableSlot **slots, int maxslots)
+{
+	ResultState *node = castNode(ResultState, pstate);
+	TupleBatch *batch = node->rs_batch;
+	ExprContext *econtext;
+	int			ntuples = 0;
+
+	CHECK_FOR_INTERRUPTS();
+
+	econtext = node->ps.ps_ExprContext;
+
+	/*
+	 * check constant qualifications like (2 > 1), if not already done
+	 */
+	if (node->rs_checkqual)
+	{
+		bool		qualResult = ExecQual(node->resconstantqual, econtext);
+
+		node->rs_checkqual = false;
+		if (!qualResult)
+		{
+			node->rs_done = true;
+			return 0;
+		}
+	}
+
+	if (node->rs_done)
+		return 0;
+
+	if (batch->next >= batch->ntuples)
+	{
+		batch->ntuples = ExecProcNodeBatch(outerPlanState(node),
+										   batch->tuples, batch->maxtuples);
+		batch->next = 0;
+		if (batch->ntuples == 0)
+			return 0;
+	}
+
+	/* the projections of a batch must outlive each other */
+	ResetExprContext(econtext);
+
+	while (ntuples < maxslots && batch->next < batch->ntuples)
+	{
+		econtext->ecxt_outertuple = batch->tuples[batch->next++];
+		slots[ntuples] = ExecProjectInto(node->ps.ps_ProjInfo,
+										 node->rs_BatchSlots[ntuples]);
+		ntuples++;
+	}
+
+	return ntuples;
+}
+
 /* ----------------------------------------------------------------
  *		ExecResultMarkPos
  * ----------------------------------------------------------------
@@ -228,6 +289,19 @@ ExecInitResult(Result *node, EState *estate, int eflags)
 	resstate->resconstantqual =
 		ExecInitQual((List *) node->resconstantqual, (PlanState *) resstate);
 
+	/*
+	 * Return batches if the outer plan does.
+	 */
+	resstate->rs_batch = ExecInitTupleBatch(outerPlanState(resstate));
+	if (resstate->rs_batch)
+	{
+		resstate->rs_BatchSlots =
+			ExecInitBatchSlots(estate,
+							   resstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor,
+							   resstate->rs_batch->maxtuples);
+		resstate->ps.ExecProcNodeBatch = ExecResultBatch;
+	}
+
 	return resstate;
 }
 
@@ -261,6 +335,8 @@ ExecReScanResult(ResultState *node)
 {
 	node->rs_done = false;
 	node->rs_checkqual = (node->resconstantqual == NULL) ? false : true;
+	if (node->rs_batch)
+		ExecResetTupleBatch(node->rs_batch);
 
 	/*
 	 * If chgParam of subnode is not null then plan will be re-scanned by
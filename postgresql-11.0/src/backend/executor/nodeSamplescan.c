@@ -15,6 +15,7 @@
 #include "postgres.h"
 
 #include "access/hash.h"
+#include "access/heapversion.h"
 #include "access/relscan.h"
 #include "access/tsmapi.h"
 #include "executor/executor.h"
@@ -525,6 +526,10 @@ tablesample_getnext(SampleScanState *scanstate)
 	/* Count successfully-fetched tuples as heap fetches */
 	pgstat_count_heap_getnext(scan->rs_rd);
 
+	/* Convert a tuple written under an older schema version */
+	if (scan->rs_versions)
+		heap_scan_upgrade_tuple(scan);
+
 	return &(scan->rs_ctup);
 }
 
@@ -15,6 +15,7 @@
 /*
  * INTERFACE ROUTINES
  *		ExecSeqScan				sequentially scans a relation.
+ *		ExecSeqScanBatch		sequentially scans a batch of tuples.
  *		ExecSeqNext				retrieve next tuple in sequential order.
  *		ExecInitSeqScan			creates and initializes a seqscan node.
  *		ExecEndSeqScan			releases any storage allocated.
@@ -27,12 +28,17 @@
  */
 #include "postgres.h"
 
+#include "access/htup_details.h"
 #include "access/relscan.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
+#include "storage/bufmgr.h"
+#include "utils/migrate_schema.h"
 #include "utils/rel.h"
 
 static TupleTableSlot *SeqNext(SeqScanState *node);
+static TupleTableSlot *SeqNextInto(SeqScanState *node, TupleTableSlot *slot,
+			HeapTuple tupdata);
 
 /* ----------------------------------------------------------------
  *						Scan Support
@@ -47,12 +53,31 @@ static TupleTableSlot *SeqNext(SeqScanState *node);
  */
 static TupleTableSlot *
 SeqNext(SeqScanState *node)
+{
+	return SeqNextInto(node, node->ss.ss_ScanTupleSlot, NULL);
+}
+
+/* ----------------------------------------------------------------
+ *		SeqNextInto
+ *
+ *		Fetch the next tuple into the given slot.  This is a workhorse
+ *		for ExecSeqScanBatch, which keeps a slot per tuple of a batch.
+ *
+ *		heap_getnext returns the same HeapTupleData for every tuple, so
+ *		when tupdata isn't NULL the tuple's header is copied there, and
+ *		the slot keeps pointing at this tuple after the next fetch.  A
+ *		tuple converted from an older schema version doesn't live on the
+ *		page but in the scan's conversion context, which is reset by the
+ *		next conversion, so such a tuple is copied into the slot instead.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+SeqNextInto(SeqScanState *node, TupleTableSlot *slot, HeapTuple tupdata)
 {
 	HeapTuple	tuple;
 	HeapScanDesc scandesc;
 	EState	   *estate;
 	ScanDirection direction;
-	TupleTableSlot *slot;
 
 	/*
 	 * get information from the estate and scan state
@@ -60,7 +85,6 @@ SeqNext(SeqScanState *node)
 	scandesc = node->ss.ss_currentScanDesc;
 	estate = node->ss.ps.state;
 	direction = estate->es_direction;
-	slot = node->ss.ss_ScanTupleSlot;
 
 	if (scandesc == NULL)
 	{
@@ -71,6 +95,8 @@ SeqNext(SeqScanState *node)
 		scandesc = heap_beginscan(node->ss.ss_currentRelation,
 								  estate->es_snapshot,
 								  0, NULL);
+		if (migrateflag)
+			heap_setmigratescan(scandesc);
 		node->ss.ss_currentScanDesc = scandesc;
 	}
 
@@ -87,6 +113,25 @@ SeqNext(SeqScanState *node)
 	 * that ExecStoreTuple will increment the refcount of the buffer; the
 	 * refcount will not be dropped until the tuple table slot is cleared.
 	 */
+	if (tuple && tupdata)
+	{
+		Page		page = BufferGetPage(scandesc->rs_cbuf);
+
+		if (scandesc->rs_versions != NULL &&
+			((char *) tuple->t_data < (char *) page ||
+			 (char *) tuple->t_data >= (char *) page + BLCKSZ))
+		{
+			MemoryContext oldcxt = MemoryContextSwitchTo(slot->tts_mcxt);
+
+			tuple = heap_copytuple(tuple);
+			MemoryContextSwitchTo(oldcxt);
+			return ExecStoreTuple(tuple, slot, InvalidBuffer, true);
+		}
+
+		*tupdata = *tuple;
+		tuple = tupdata;
+	}
+
 	if (tuple)
 		ExecStoreTuple(tuple,	/* tuple to store */
 					   slot,	/* slot to store in */
@@ -131,6 +176,25 @@ ExecSeqScan(PlanState *pstate)
 					(ExecScanRecheckMtd) SeqRecheck);
 }
 
+/* ----------------------------------------------------------------
+ *		ExecSeqScanBatch(node)
+ *
+ *		Scans the relation sequentially and returns the next batch of
+ *		qualifying tuples.
+ * ----------------------------------------------------------------
+ */
+static int
+ExecSeqScanBatch(PlanState *pstate, TupleTableSlot **slots, int maxslots)
+{
+	SeqScanState *node = castNode(SeqScanState, pstate);
+
+	return ExecScanBatch(&node->ss,
+						 (ExecScanAccessMtd) SeqNext,
+						 (ExecScanRecheckMtd) SeqRecheck,
+						 (ExecScanBatchAccessMtd) SeqNextInto,
+						 slots, maxslots);
+}
+
 
 /* ----------------------------------------------------------------
  *		ExecInitSeqScan
@@ -190,6 +254,9 @@ ExecInitSeqScan(SeqScan *node, EState *estate, int eflags)
 	scanstate->ss.ps.qual =
 		ExecInitQual(node->plan.qual, (PlanState *) scanstate);
 
+	if (ExecInitScanBatch(&scanstate->ss))
+		scanstate->ss.ps.ExecProcNodeBatch = ExecSeqScanBatch;
+
 	return scanstate;
 }
 
@@ -221,6 +288,7 @@ ExecEndSeqScan(SeqScanState *node)
 	 */
 	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
 	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	ExecEndScanBatch(&node->ss);
 
 	/*
 	 * close heap scan
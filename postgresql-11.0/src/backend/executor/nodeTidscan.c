@@ -22,6 +22,7 @@
  */
 #include "postgres.h"
 
+#include "access/heapversion.h"
 #include "access/sysattr.h"
 #include "catalog/pg_type.h"
 #include "executor/execdebug.h"
@@ -376,6 +377,16 @@ TidNext(TidScanState *node)
 
 		if (heap_fetch(heapRelation, snapshot, tuple, &buffer, false, NULL))
 		{
+			MemoryContext oldcxt;
+
+			/*
+			 * Convert a tuple written under an older schema version.  The
+			 * copy only needs to live until the next call.
+			 */
+			oldcxt = MemoryContextSwitchTo(node->ss.ps.ps_ExprContext->ecxt_per_tuple_memory);
+			heap_tuple_upgrade(heapRelation, tuple);
+			MemoryContextSwitchTo(oldcxt);
+
 			/*
 			 * store the scanned tuple in the scan tuple slot of the scan
 			 * state.  Eventually we will only do this and not return a tuple.
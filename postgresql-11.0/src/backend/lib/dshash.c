@@ -17,8 +17,11 @@
  * is only expected to happen a small number of times until a stable size is
  * found, since growth is geometric.
  *
- * Future versions may support iterators and incremental resizing; for now
- * the implementation is minimalist.
+ * A table that is no longer being modified can be scanned one partition at a
+ * time with dshash_seq_init and dshash_seq_next, which take no locks, so that
+ * several backends can read disjoint partitions in parallel.  Future versions
+ * may support iterators over a table in use, and incremental resizing; for
+ * now the implementation is minimalist.
  *
  * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -52,15 +55,6 @@ struct dshash_table_item
 	/* The user's entry object follows here.  See ENTRY_FROM_ITEM(item). */
 };
 
-/*
- * The number of partitions for locking purposes.  This is set to match
- * NUM_BUFFER_PARTITIONS for now, on the basis that whatever's good enough for
- * the buffer pool must be good enough for any other purpose.  This could
- * become a runtime parameter in future.
- */
-#define DSHASH_NUM_PARTITIONS_LOG2 7
-#define DSHASH_NUM_PARTITIONS (1 << DSHASH_NUM_PARTITIONS_LOG2)
-
 /* A magic value used to identify our hash tables. */
 #define DSHASH_MAGIC 0x75ff6a20
 
@@ -574,6 +568,58 @@ dshash_release_lock(dshash_table *hash_table, void *entry)
 	LWLockRelease(PARTITION_LOCK(hash_table, partition_index));
 }
 
+/*
+ * Begin a scan of the entries in one lock partition of a hash table.
+ *
+ * The caller must be certain that no backend will insert or delete entries
+ * while the scan is in progress, for example because every backend that
+ * modifies the table has since waited on a barrier.  No partition lock is
+ * held between calls, so entries may be read and written in place.
+ */
+void
+dshash_seq_init(dshash_seq_status *status, dshash_table *hash_table,
+				int partition)
+{
+	Assert(hash_table->control->magic == DSHASH_MAGIC);
+	Assert(!hash_table->find_locked);
+	Assert(partition >= 0 && partition < DSHASH_NUM_PARTITIONS);
+
+	/* A lock is needed only to read the current bucket array safely. */
+	LWLockAcquire(PARTITION_LOCK(hash_table, partition), LW_SHARED);
+	ensure_valid_bucket_pointers(hash_table);
+	LWLockRelease(PARTITION_LOCK(hash_table, partition));
+
+	status->hash_table = hash_table;
+	status->curbucket = BUCKET_INDEX_FOR_PARTITION(partition,
+												   hash_table->size_log2);
+	status->endbucket = BUCKET_INDEX_FOR_PARTITION(partition + 1,
+												   hash_table->size_log2);
+	status->nextitem = InvalidDsaPointer;
+}
+
+/*
+ * Return the next entry of a scan begun by dshash_seq_init, or NULL when the
+ * partition has no more.
+ */
+void *
+dshash_seq_next(dshash_seq_status *status)
+{
+	dshash_table *hash_table = status->hash_table;
+	dshash_table_item *item;
+
+	while (!DsaPointerIsValid(status->nextitem))
+	{
+		if (status->curbucket >= status->endbucket)
+			return NULL;
+		status->nextitem = hash_table->buckets[status->curbucket++];
+	}
+
+	item = dsa_get_address(hash_table->area, status->nextitem);
+	status->nextitem = item->next;
+
+	return ENTRY_FROM_ITEM(item);
+}
+
 /*
  * A compare function that forwards to memcmp.
  */
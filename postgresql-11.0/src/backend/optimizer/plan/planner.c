@@ -217,6 +217,16 @@ static RelOptInfo *create_partial_grouping_paths(PlannerInfo *root,
 							  GroupPathExtraData *extra,
 							  bool force_rel_creation);
 static void gather_grouping_paths(PlannerInfo *root, RelOptInfo *rel);
+static bool can_parallel_hashagg(PlannerInfo *root, RelOptInfo *grouped_rel,
+					 const AggClauseCosts *agg_costs,
+					 GroupPathExtraData *extra);
+static void add_parallel_hashagg_path(PlannerInfo *root,
+						  RelOptInfo *input_rel,
+						  RelOptInfo *grouped_rel,
+						  const AggClauseCosts *agg_costs,
+						  grouping_sets_data *gd,
+						  double dNumGroups,
+						  GroupPathExtraData *extra);
 static bool can_partial_agg(PlannerInfo *root,
 				const AggClauseCosts *agg_costs);
 static void apply_scanjoin_target_to_paths(PlannerInfo *root,
@@ -4830,8 +4840,9 @@ create_distinct_paths(PlannerInfo *root,
  * Build a new upperrel containing Paths for ORDER BY evaluation.
  *
  * All paths in the result must satisfy the ORDER BY ordering.
- * The only new path we need consider is an explicit sort on the
- * cheapest-total existing path.
+ * The only new paths we need consider are an explicit sort on the
+ * cheapest-total existing path, and incremental sorts on paths that are
+ * already sorted on some leading keys of the ordering.
  *
  * input_rel: contains the source-data Paths
  * target: the output tlist the result Paths must emit
@@ -4872,9 +4883,37 @@ create_ordered_paths(PlannerInfo *root,
 	{
 		Path	   *path = (Path *) lfirst(lc);
 		bool		is_sorted;
+		int			presorted_keys;
+
+		is_sorted = pathkeys_count_contained_in(root->sort_pathkeys,
+												path->pathkeys,
+												&presorted_keys);
+
+		/*
+		 * A path sorted on leading keys of the ordering needs only an
+		 * incremental sort to finish it, which returns the first tuples
+		 * without reading all of its input and so suits a LIMIT best.  Try
+		 * it on any such path, not just the cheapest.
+		 */
+		if (!is_sorted && presorted_keys > 0 && enable_incremental_sort)
+		{
+			Path	   *sorted_path;
+
+			sorted_path = (Path *) create_incremental_sort_path(root,
+																ordered_rel,
+																path,
+																root->sort_pathkeys,
+																presorted_keys,
+																limit_tuples);
+
+			/* Add projection step if needed */
+			if (sorted_path->pathtarget != target)
+				sorted_path = apply_projection_to_path(root, ordered_rel,
+													   sorted_path, target);
+
+			add_path(ordered_rel, sorted_path);
+		}
 
-		is_sorted = pathkeys_contained_in(root->sort_pathkeys,
-										  path->pathkeys);
 		if (path == cheapest_input_path || is_sorted)
 		{
 			if (!is_sorted)
@@ -6343,6 +6382,15 @@ add_paths_to_grouping_rel(PlannerInfo *root, RelOptInfo *input_rel,
 										 agg_costs,
 										 dNumGroups));
 			}
+
+			/*
+			 * Also consider a Parallel HashAgg, whose workers build a single
+			 * shared hash table, beneath a Gather.
+			 */
+			if (input_rel->partial_pathlist != NIL &&
+				can_parallel_hashagg(root, grouped_rel, agg_costs, extra))
+				add_parallel_hashagg_path(root, input_rel, grouped_rel,
+										  agg_costs, gd, dNumGroups, extra);
 		}
 
 		/*
@@ -6689,6 +6737,123 @@ create_partial_grouping_paths(PlannerInfo *root,
 	return partially_grouped_rel;
 }
 
+/*
+ * can_parallel_hashagg
+ *
+ * Determines whether a Parallel HashAgg can implement the grouping.  Its
+ * shared hash table stores transition states and the columns of each group as
+ * bare Datums, so all must be passed by value, and states are merged with the
+ * aggregates' combine functions, as in partial aggregation.
+ */
+static bool
+can_parallel_hashagg(PlannerInfo *root, RelOptInfo *grouped_rel,
+					 const AggClauseCosts *agg_costs,
+					 GroupPathExtraData *extra)
+{
+	List	   *groupExprs;
+	List	   *vars = NIL;
+	ListCell   *lc;
+
+	if (!enable_parallel_hashagg || !grouped_rel->consider_parallel ||
+		(extra->flags & GROUPING_CAN_PARTIAL_AGG) == 0 ||
+		IS_OTHER_REL(grouped_rel))
+		return false;
+
+	/* Only pass-by-reference transition types need any transition space */
+	if (agg_costs->transitionSpace > 0)
+		return false;
+
+	groupExprs = get_sortgrouplist_exprs(root->parse->groupClause,
+										 extra->targetList);
+	foreach(lc, groupExprs)
+	{
+		if (!get_typbyval(exprType((Node *) lfirst(lc))))
+			return false;
+	}
+
+	/*
+	 * Any other column the target list or HAVING needs of a group, outside of
+	 * aggregates, is stored in the table too.
+	 */
+	foreach(lc, grouped_rel->reltarget->exprs)
+	{
+		Node	   *expr = (Node *) lfirst(lc);
+
+		if (list_member(groupExprs, expr))
+			continue;
+		vars = list_concat(vars,
+						   pull_var_clause(expr,
+										   PVC_INCLUDE_AGGREGATES |
+										   PVC_RECURSE_WINDOWFUNCS |
+										   PVC_RECURSE_PLACEHOLDERS));
+	}
+	vars = list_concat(vars,
+					   pull_var_clause(extra->havingQual,
+									   PVC_INCLUDE_AGGREGATES |
+									   PVC_RECURSE_WINDOWFUNCS |
+									   PVC_RECURSE_PLACEHOLDERS));
+	foreach(lc, vars)
+	{
+		Node	   *node = (Node *) lfirst(lc);
+
+		if (IsA(node, Var) && !get_typbyval(exprType(node)))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * add_parallel_hashagg_path
+ *
+ * Add a Gather over a Parallel HashAgg of the cheapest partial input path.
+ * Each participant aggregates its share of the input and merges the groups
+ * into the shared hash table, then returns a share of the finished groups.
+ */
+static void
+add_parallel_hashagg_path(PlannerInfo *root, RelOptInfo *input_rel,
+						  RelOptInfo *grouped_rel,
+						  const AggClauseCosts *agg_costs,
+						  grouping_sets_data *gd, double dNumGroups,
+						  GroupPathExtraData *extra)
+{
+	Query	   *parse = root->parse;
+	Path	   *partial_path = (Path *) linitial(input_rel->partial_pathlist);
+	Path	   *path;
+	double		dNumLocalGroups;
+	double		rows = dNumGroups;
+
+	/* The groups a participant finds in its share of the input */
+	dNumLocalGroups = get_number_of_groups(root,
+										   partial_path->rows,
+										   gd,
+										   extra->targetList);
+
+	path = (Path *) create_agg_path(root, grouped_rel,
+									partial_path,
+									grouped_rel->reltarget,
+									AGG_HASHED,
+									AGGSPLIT_SIMPLE,
+									parse->groupClause,
+									(List *) extra->havingQual,
+									agg_costs,
+									dNumLocalGroups);
+	path->parallel_aware = true;
+
+	/*
+	 * Every local group is merged into the shared table, which is then
+	 * divided among the participants.
+	 */
+	path->total_cost += dNumLocalGroups * cpu_tuple_cost;
+	if (input_rel->cheapest_total_path->rows > 0)
+		path->rows = clamp_row_est(dNumGroups * partial_path->rows /
+								   input_rel->cheapest_total_path->rows);
+
+	add_path(grouped_rel, (Path *)
+			 create_gather_path(root, grouped_rel, path,
+								grouped_rel->reltarget, NULL, &rows));
+}
+
 /*
  * Generate Gather and Gather Merge paths for a grouping relation or partial
  * grouping relation.
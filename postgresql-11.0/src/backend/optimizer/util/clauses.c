@@ -19,6 +19,7 @@
 
 #include "postgres.h"
 
+#include "access/heapversion.h"
 #include "access/htup_details.h"
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_class.h"
@@ -1288,6 +1289,7 @@ max_parallel_hazard_walker(Node *node, max_parallel_hazard_context *context)
 	else if (IsA(node, Query))
 	{
 		Query	   *query = (Query *) node;
+		ListCell   *lc;
 
 		/* SELECT FOR UPDATE/SHARE must be treated as unsafe */
 		if (query->rowMarks != NULL)
@@ -1296,6 +1298,23 @@ max_parallel_hazard_walker(Node *node, max_parallel_hazard_context *context)
 			return true;
 		}
 
+		/*
+		 * Reading a table whose lazy column defaults are not all filled in
+		 * evaluates the defaults, which need not be parallel safe (nextval(),
+		 * say), and are not part of the query for the walker to look at.
+		 */
+		foreach(lc, query->rtable)
+		{
+			RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+			if (rte->rtekind == RTE_RELATION &&
+				RelationIdHasLazyDefaults(rte->relid))
+			{
+				context->max_hazard = PROPARALLEL_UNSAFE;
+				return true;
+			}
+		}
+
 		/* Recurse into subselects */
 		return query_tree_walker(query,
 								 max_parallel_hazard_walker,
@@ -3638,12 +3638,24 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_HASH_GROW_BUCKETS_REINSERTING:
 			event_name = "Hash/GrowBuckets/Reinserting";
 			break;
+		case WAIT_EVENT_HASHAGG_MERGING:
+			event_name = "HashAgg/Merging";
+			break;
 		case WAIT_EVENT_LOGICAL_SYNC_DATA:
 			event_name = "LogicalSyncData";
 			break;
 		case WAIT_EVENT_LOGICAL_SYNC_STATE_CHANGE:
 			event_name = "LogicalSyncStateChange";
 			break;
+		case WAIT_EVENT_MIGRATE_IN_PROGRESS:
+			event_name = "MigrateInProgress";
+			break;
+		case WAIT_EVENT_MIGRATE_STATEMENT:
+			event_name = "MigrateStatement";
+			break;
+		case WAIT_EVENT_MIGRATE_WRITE:
+			event_name = "MigrateWrite";
+			break;
 		case WAIT_EVENT_MQ_INTERNAL:
 			event_name = "MessageQueueInternal";
 			break;
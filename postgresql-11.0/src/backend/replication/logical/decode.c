@@ -502,6 +502,20 @@ FilterByOrigin(LogicalDecodingContext *ctx, RepOriginId origin_id)
 	return filter_by_origin_cb_wrapper(ctx, origin_id);
 }
 
+/*
+ * Rows a lazy migration copies into its target were written by the
+ * application once already, so consumers that replicate the source may not
+ * want them again.  is_migration is the record's migration flag.
+ */
+static inline bool
+FilterMigration(LogicalDecodingContext *ctx, bool is_migration)
+{
+	if (!is_migration || ctx->callbacks.filter_migration_cb == NULL)
+		return false;
+
+	return filter_migration_cb_wrapper(ctx);
+}
+
 /*
  * Handle rmgr LOGICALMSG_ID records for DecodeRecordIntoReorderBuffer().
  */
@@ -681,6 +695,10 @@ DecodeInsert(LogicalDecodingContext *ctx, XLogRecordBuffer *buf)
 	if (FilterByOrigin(ctx, XLogRecGetOrigin(r)))
 		return;
 
+	/* nor for migrated rows */
+	if (FilterMigration(ctx, (xlrec->flags & XLH_INSERT_IS_MIGRATION) != 0))
+		return;
+
 	change = ReorderBufferGetChange(ctx->reorder);
 	if (!(xlrec->flags & XLH_INSERT_IS_SPECULATIVE))
 		change->action = REORDER_BUFFER_CHANGE_INSERT;
@@ -689,6 +707,7 @@ DecodeInsert(LogicalDecodingContext *ctx, XLogRecordBuffer *buf)
 	change->origin_id = XLogRecGetOrigin(r);
 
 	memcpy(&change->data.tp.relnode, &target_node, sizeof(RelFileNode));
+	change->data.tp.is_migration = (xlrec->flags & XLH_INSERT_IS_MIGRATION) != 0;
 
 	if (xlrec->flags & XLH_INSERT_CONTAINS_NEW_TUPLE)
 	{
@@ -805,11 +824,16 @@ DecodeDelete(LogicalDecodingContext *ctx, XLogRecordBuffer *buf)
 	if (FilterByOrigin(ctx, XLogRecGetOrigin(r)))
 		return;
 
+	/* nor for the source rows two-way migrations remove */
+	if (FilterMigration(ctx, (xlrec->flags & XLH_DELETE_IS_MIGRATION) != 0))
+		return;
+
 	change = ReorderBufferGetChange(ctx->reorder);
 	change->action = REORDER_BUFFER_CHANGE_DELETE;
 	change->origin_id = XLogRecGetOrigin(r);
 
 	memcpy(&change->data.tp.relnode, &target_node, sizeof(RelFileNode));
+	change->data.tp.is_migration = (xlrec->flags & XLH_DELETE_IS_MIGRATION) != 0;
 
 	/* old primary key stored */
 	if (xlrec->flags & XLH_DELETE_CONTAINS_OLD)
@@ -894,6 +918,10 @@ DecodeMultiInsert(LogicalDecodingContext *ctx, XLogRecordBuffer *buf)
 	if (FilterByOrigin(ctx, XLogRecGetOrigin(r)))
 		return;
 
+	/* nor for migrated rows */
+	if (FilterMigration(ctx, (xlrec->flags & XLH_INSERT_IS_MIGRATION) != 0))
+		return;
+
 	tupledata = XLogRecGetBlockData(r, 0, &tuplelen);
 
 	data = tupledata;
@@ -909,6 +937,8 @@ DecodeMultiInsert(LogicalDecodingContext *ctx, XLogRecordBuffer *buf)
 		change->origin_id = XLogRecGetOrigin(r);
 
 		memcpy(&change->data.tp.relnode, &rnode, sizeof(RelFileNode));
+		change->data.tp.is_migration =
+			(xlrec->flags & XLH_INSERT_IS_MIGRATION) != 0;
 
 		/*
 		 * CONTAINS_NEW_TUPLE will always be set currently as multi_insert
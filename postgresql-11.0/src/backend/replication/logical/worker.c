@@ -753,9 +753,17 @@ apply_handle_update(StringInfo s)
 	 */
 	if (found)
 	{
-		/* Process and store remote tuple in the slot */
+		HeapTuple	localtup;
+
+		/*
+		 * Process and store remote tuple in the slot.  Columns that it
+		 * doesn't change keep their local value, including any lazily
+		 * filled-in default.
+		 */
 		oldctx = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
-		ExecStoreTuple(localslot->tts_tuple, remoteslot, InvalidBuffer, false);
+		localtup = ExecResultRelFillLazyDefaults(estate->es_result_relation_info,
+												 localslot->tts_tuple, estate);
+		ExecStoreTuple(localtup, remoteslot, InvalidBuffer, false);
 		slot_modify_cstrings(remoteslot, rel, newtup.values, newtup.changed);
 		MemoryContextSwitchTo(oldctx);
 
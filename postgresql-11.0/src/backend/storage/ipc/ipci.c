@@ -19,6 +19,7 @@
 #include "access/heapam.h"
 #include "access/multixact.h"
 #include "access/nbtree.h"
+#include "access/rewritetrack.h"
 #include "access/subtrans.h"
 #include "access/twophase.h"
 #include "commands/async.h"
@@ -149,8 +150,10 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, SnapMgrShmemSize());
 		size = add_size(size, BTreeShmemSize());
 		size = add_size(size, SyncScanShmemSize());
+		size = add_size(size, RewriteTrackShmemSize());
 		size = add_size(size, AsyncShmemSize());
 		size = add_size(size, BackendRandomShmemSize());
+		size = add_size(size, MigrateShmemSize());
 
 		/* 
 		 * adding 1024MB of additonal size for accommodating the shared
@@ -276,6 +279,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	SnapMgrInit();
 	BTreeShmemInit();
 	SyncScanShmemInit();
+	RewriteTrackShmemInit();
 	AsyncShmemInit();
 	BackendRandomShmemInit();
 
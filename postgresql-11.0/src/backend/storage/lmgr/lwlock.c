@@ -454,7 +454,8 @@ InitializeLWLocks(void)
 	/* Initialize bitmap LWLocks in main array */
 	lock = MainLWLockArray + NUM_INDIVIDUAL_LWLOCKS +
 		NUM_BUFFER_PARTITIONS + NUM_LOCK_PARTITIONS + NUM_PREDICATELOCK_PARTITIONS;
-	for (id = 0; id < NUM_MIGRATE_BITMAP_LOCKS; id++, lock++)
+	for (id = 0; id < NUM_MIGRATE_BITMAP_LOCKS * NUM_MIGRATE_BITMAP_LOCK_SETS;
+		 id++, lock++)
 		LWLockInitialize(&lock->lock, LWTRANCHE_MIGRATE_BITMAP);
 
 	/* Initialize named tranches. */
@@ -528,6 +529,7 @@ RegisterLWLockTranches(void)
 	LWLockRegisterTranche(LWTRANCHE_TBM, "tbm");
 	LWLockRegisterTranche(LWTRANCHE_PARALLEL_APPEND, "parallel_append");
 	LWLockRegisterTranche(LWTRANCHE_PARALLEL_HASH_JOIN, "parallel_hash_join");
+	LWLockRegisterTranche(LWTRANCHE_PARALLEL_HASH_AGG, "parallel_hash_agg");
 
 	/* Register named tranches. */
 	for (i = 0; i < NamedLWLockTrancheRequests; i++)
@@ -203,7 +203,6 @@
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 #include "utils/tqual.h"
-#include "utils/migrate_schema.h"
 
 /* Uncomment the next line to test the graceful degradation code. */
 /* #define TEST_OLDSERXID */
@@ -467,8 +466,6 @@ static void FlagRWConflict(SERIALIZABLEXACT *reader, SERIALIZABLEXACT *writer);
 static void OnConflict_CheckForSerializationFailure(const SERIALIZABLEXACT *reader,
 										SERIALIZABLEXACT *writer);
 
-static void txn_error_handling();
-
 /*------------------------------------------------------------------------*/
 
 /*
@@ -4471,23 +4468,6 @@ FlagRWConflict(SERIALIZABLEXACT *reader, SERIALIZABLEXACT *writer)
 		SetRWConflict(reader, writer);
 }
 
-static void txn_error_handling()
-{
-	if (migrateflag && InProgLocalList0 != NIL) {
-		ListCell *cell = NULL;
-		foreach(cell, InProgLocalList0)
-		{
-			resetlockbit(PartialBitmap, lfirst_int(cell));
-		}
-		tuplemigratecount = 0;
-		migrateflag = false;
-		pg_list_free(InProgLocalList0, false);
-		pg_list_free(InProgLocalList1, false);
-		InProgLocalList0 = NIL;
-		InProgLocalList1 = NIL;
-	}
-}
-
 /*----------------------------------------------------------------------------
  * We are about to add a RW-edge to the dependency graph - check that we don't
  * introduce a dangerous structure by doing so, and abort one of the
@@ -4642,7 +4622,6 @@ OnConflict_CheckForSerializationFailure(const SERIALIZABLEXACT *reader,
 		 */
 		if (MySerializableXact == writer)
 		{
-			txn_error_handling();
 			LWLockRelease(SerializableXactHashLock);
 			ereport(ERROR,
 					(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
@@ -86,6 +86,9 @@ static LOCALLOCK *lockAwaited = NULL;
 
 static DeadLockState deadlock_state = DS_NOT_YET_CHECKED;
 
+/* If not zero, the wait event to report while sleeping on a lock */
+static uint32 lockWaitEventInfo = 0;
+
 /* Is a deadlock check pending? */
 static volatile sig_atomic_t got_deadlock_timeout;
 
@@ -694,6 +697,8 @@ LockErrorCleanup(void)
 
 	AbortStrongLockAcquire();
 
+	lockWaitEventInfo = 0;
+
 	/* Nothing to do if we weren't waiting for a lock */
 	if (lockAwaited == NULL)
 	{
@@ -1019,6 +1024,22 @@ ProcQueueInit(PROC_QUEUE *queue)
 }
 
 
+/*
+ * ProcSetLockWaitEvent -- report lock waits under another wait event
+ *
+ * Callers that wait on a heavyweight lock for their own purposes, such as
+ * lazy migration waiting out the transaction that claimed a tuple, can set
+ * the wait event shown while they sleep so that the wait can be told apart
+ * from ordinary lock waits.  Pass zero to go back to the default.  An error
+ * resets it (see LockErrorCleanup).
+ */
+void
+ProcSetLockWaitEvent(uint32 wait_event_info)
+{
+	lockWaitEventInfo = wait_event_info;
+}
+
+
 /*
  * ProcSleep -- put a process to sleep on the specified lock
  *
@@ -1264,6 +1285,7 @@ ProcSleep(LOCALLOCK *locallock, LockMethod lockMethodTable)
 		else
 		{
 			WaitLatch(MyLatch, WL_LATCH_SET, 0,
+					  lockWaitEventInfo != 0 ? lockWaitEventInfo :
 					  PG_WAIT_LOCK | locallock->tag.lock.locktag_type);
 			ResetLatch(MyLatch);
 			/* check for deadlocks first, as that's probably log-worthy */
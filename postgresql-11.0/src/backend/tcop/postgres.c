@@ -54,6 +54,7 @@
 #include "pg_trace.h"
 #include "parser/analyze.h"
 #include "parser/parser.h"
+#include "parser/scansup.h"
 #include "pg_getopt.h"
 #include "postmaster/autovacuum.h"
 #include "postmaster/postmaster.h"
@@ -71,6 +72,7 @@
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
 #include "tcop/utility.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/ps_status.h"
@@ -196,6 +198,8 @@ static void log_disconnections(int code, Datum arg);
 static void enable_statement_timeout(void);
 static void disable_statement_timeout(void);
 static void post_query_tasks(void);
+static void exec_migration_batches(const char *stmt_name, ParamListInfo params,
+					   char *completionTag);
 
 
 /* ----------------------------------------------------------------
@@ -884,41 +888,121 @@ pg_plan_queries(List *querytrees, int cursorOptions, ParamListInfo boundParams)
 
 static void post_query_tasks(void)
 {
-	/* perform post query tasks */
+	/*
+	 * Wait for tuples that concurrent migrations had claimed when we ran
+	 * into them.  Our own claims are published when the transaction commits.
+	 */
 	if (migrateflag)
 	{
-		ListCell *cell = NULL;
-		ListCell *prev = NULL;
-		ListCell *next = NULL;
-		foreach(cell, InProgLocalList0)
-		{
-			setmigratebit(PartialBitmap, lfirst_int(cell));
-		}
+		MigrateWaitForInProgress();
+		tuplemigratecount = 0;
+		migrateflag = false;
+	}
+}
 
-		int volatile size = list_length(InProgLocalList1);
-		while (size > 0)
-		{
-				prev = NULL;
-				for (cell = list_head(InProgLocalList1); cell; cell = next)
-				{
-						next = lnext(cell);
-						if (getmigratebit(PartialBitmap, lfirst_int(cell)))
-						{
-								size--;
-								InProgLocalList1 = pg_list_delete_cell(InProgLocalList1, cell, prev);
-						} else {
-								prev = cell;
-						}
-				}
-		}
+/*
+ * Run the rest of a migration statement that stopped after migrate_batch_size
+ * tuples.  A transaction can't commit in the middle of a statement, so we
+ * commit what the statement did so far and run it again in a new transaction,
+ * until a run finishes without filling its batch.  Each run migrates only
+ * the tuples the earlier ones left behind.
+ *
+ * This gives up the atomicity of the statement on purpose: should a later
+ * run fail, the earlier ones stay committed.  That is harmless for a
+ * migration, which only ever moves each tuple once and can simply be issued
+ * again, and it only happens outside a transaction block (see
+ * MigrateBatchIsFull), where the client can't expect to roll the statement
+ * back anyway.
+ *
+ * completionTag holds the tag of the first run, and gets the total count.
+ * The statement keeps its own command tag, and an INSERT the OID field of
+ * the first run's tag.
+ */
+static void
+exec_migration_batches(const char *stmt_name, ParamListInfo params,
+					   char *completionTag)
+{
+	uint8		bitmapno = BitmapNum;
+	uint64		processed;
+	const char *count;
+	const char *commandTag;
+	Oid			lastOid = InvalidOid;
+	CachedPlanSource *psrc;
+
+	count = strrchr(completionTag, ' ');
+	if (count == NULL)
+		return;
+	processed = pg_strtouint64(count + 1, NULL, 10);
+
+	if (stmt_name != NULL)
+		psrc = FetchPreparedStatement(stmt_name, true)->plansource;
+	else
+		psrc = unnamed_stmt_psrc;
+	commandTag = psrc->commandTag;
+	if (strcmp(commandTag, "INSERT") == 0)
+		lastOid = (Oid) strtoul(completionTag + strlen("INSERT "), NULL, 10);
+
+	while (migratebatchfull)
+	{
+		CachedPlan *cplan;
+		Portal		portal;
+		char		batchTag[COMPLETION_TAG_BUFSIZE];
+
+		finish_xact_command();
 
-		pg_list_free(InProgLocalList0, false);
-		pg_list_free(InProgLocalList1, false);
-		InProgLocalList0 = NIL;
+		CHECK_FOR_INTERRUPTS();
+
+		start_xact_command();
+
+		if (stmt_name != NULL)
+			psrc = FetchPreparedStatement(stmt_name, true)->plansource;
+		else
+			psrc = unnamed_stmt_psrc;
+
+		migrateflag = true;
 		InProgLocalList1 = NIL;
-		tuplemigratecount = 0;
-		migrateflag = false;
+		BitmapNum = bitmapno;
+		PartialBitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+
+		portal = CreateNewPortal();
+		portal->visible = false;
+
+		PushActiveSnapshot(GetTransactionSnapshot());
+		cplan = GetCachedPlan(psrc, params, false, NULL);
+		PortalDefineQuery(portal,
+						  NULL,
+						  psrc->query_string,
+						  psrc->commandTag,
+						  cplan->stmt_list,
+						  cplan);
+		PopActiveSnapshot();
+
+		PortalStart(portal, params, 0, InvalidSnapshot);
+
+		batchTag[0] = '\0';
+		(void) PortalRun(portal,
+						 FETCH_ALL,
+						 true,	/* always top level */
+						 true,
+						 None_Receiver,
+						 None_Receiver,
+						 batchTag);
+		PortalDrop(portal, false);
+
+		post_query_tasks();
+		CommandCounterIncrement();
+
+		count = strrchr(batchTag, ' ');
+		if (count != NULL)
+			processed += pg_strtouint64(count + 1, NULL, 10);
 	}
+
+	if (strcmp(commandTag, "INSERT") == 0)
+		snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+				 "INSERT %u " UINT64_FORMAT, lastOid, processed);
+	else
+		snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+				 "%s " UINT64_FORMAT, commandTag, processed);
 }
 
 
@@ -1543,6 +1627,8 @@ exec_bind_message(StringInfo input_message)
 	bool		save_log_statement_stats = log_statement_stats;
 	bool		snapshot_set = false;
 	char		msec_str[32];
+	int			reversebitmap;
+	const char *migrate_text;
 
 	/* Get the fixed part of the message */
 	portal_name = pq_getmsgstring(input_message);
@@ -1571,18 +1657,26 @@ exec_bind_message(StringInfo input_message)
 					 errmsg("unnamed prepared statement does not exist")));
 	}
 
-	if (strncmp(psrc->query_string, " insert into customer_proj1", 27) == 0) {
+	/* clients such as pgbench strip the leading space of a statement */
+	migrate_text = psrc->query_string;
+	while (scanner_isspace(*migrate_text))
+		migrate_text++;
+
+	if (strncmp(migrate_text, "insert into customer_proj1", 26) == 0) {
 		migrateflag = true;
-		InProgLocalList0 = NIL;
 		InProgLocalList1 = NIL;
 		BitmapNum = 0;
 		PartialBitmap = GlobalBitmap;
-	} else if (strncmp(psrc->query_string, " insert into customer_proj2", 27) == 0) {
+	} else if (strncmp(migrate_text, "insert into customer_proj2", 26) == 0) {
 		migrateflag = true;
-		InProgLocalList0 = NIL;
 		InProgLocalList1 = NIL;
 		BitmapNum = 1;
 		PartialBitmap = GlobalBitmap + BITMAPSIZE;
+	} else if ((reversebitmap = MigrateReverseStatement(psrc->query_string)) >= 0) {
+		migrateflag = true;
+		InProgLocalList1 = NIL;
+		BitmapNum = reversebitmap;
+		PartialBitmap = GlobalBitmap + reversebitmap * BITMAPSIZE;
 	}
 
 	/*
@@ -1932,6 +2026,7 @@ exec_execute_message(const char *portal_name, long max_rows)
 	char		completionTag[COMPLETION_TAG_BUFSIZE];
 	const char *sourceText;
 	const char *prepStmtName;
+	const char *migrateStmtName = NULL;
 	ParamListInfo portalParams;
 	bool		save_log_statement_stats = log_statement_stats;
 	bool		is_xact_command;
@@ -1983,6 +2078,19 @@ exec_execute_message(const char *portal_name, long max_rows)
 		 */
 		portalParams = NULL;
 	}
+	else if (migrateflag && migrate_batch_size > 0)
+	{
+		/*
+		 * A migration statement may commit in batches, which destroys the
+		 * portal too.  See exec_migration_batches.
+		 */
+		sourceText = pstrdup(portal->sourceText);
+		if (portal->prepStmtName)
+			prepStmtName = migrateStmtName = pstrdup(portal->prepStmtName);
+		else
+			prepStmtName = "<unnamed>";
+		portalParams = copyParamList(portal->portalParams);
+	}
 	else
 	{
 		sourceText = portal->sourceText;
@@ -2061,6 +2169,10 @@ exec_execute_message(const char *portal_name, long max_rows)
 	/* Check for cancel signal before we start execution */
 	CHECK_FOR_INTERRUPTS();
 
+	/* wait for anyone running the same migration statement */
+	if (migrateflag && !execute_is_fetch)
+		MigrateCoalesceStatement(sourceText, portalParams);
+
 	/*
 	 * Okay to run the portal.
 	 */
@@ -2079,6 +2191,14 @@ exec_execute_message(const char *portal_name, long max_rows)
 
 	post_query_tasks();
 
+	/*
+	 * A migration statement that filled its batch commits here and runs again
+	 * for the rest, so it is not atomic.  Only statements run outside a
+	 * transaction block are split up; see exec_migration_batches.
+	 */
+	if (completed && migratebatchfull && !is_xact_command)
+		exec_migration_batches(migrateStmtName, portalParams, completionTag);
+
 	if (completed)
 	{
 		if (is_xact_command)
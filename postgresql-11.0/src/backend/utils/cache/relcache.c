@@ -31,6 +31,7 @@
 #include <unistd.h>
 
 #include "access/hash.h"
+#include "access/heapversion.h"
 #include "access/htup_details.h"
 #include "access/multixact.h"
 #include "access/nbtree.h"
@@ -2290,6 +2291,8 @@ RelationDestroyRelation(Relation relation, bool remember_tupdesc)
 		pfree(relation->rd_partcheck);
 	if (relation->rd_fdwroutine)
 		pfree(relation->rd_fdwroutine);
+	if (relation->rd_versions)
+		FreeSchemaVersionInfo(relation->rd_versions);
 	pfree(relation);
 }
 
@@ -2441,6 +2444,7 @@ RelationClearRelation(Relation relation, bool rebuild)
 		bool		keep_policies;
 		bool		keep_partkey;
 		bool		keep_partdesc;
+		bool		keep_versions;
 
 		/* Build temporary entry, but don't link it into hashtable */
 		newrel = RelationBuildDesc(save_relid, false);
@@ -2477,6 +2481,14 @@ RelationClearRelation(Relation relation, bool rebuild)
 											relation->rd_partdesc,
 											newrel->rd_partdesc);
 
+		/*
+		 * The schema version history only changes together with the row type
+		 * (lazy ALTER COLUMN TYPE) or the relfilenode (a rewrite that forgets
+		 * it), so it can be kept unless one of those changed.
+		 */
+		keep_versions = keep_tupdesc &&
+			RelFileNodeEquals(relation->rd_node, newrel->rd_node);
+
 		/*
 		 * Perform swapping of the relcache entry contents.  Within this
 		 * process the old entry is momentarily invalid, so there *must* be no
@@ -2541,6 +2553,11 @@ RelationClearRelation(Relation relation, bool rebuild)
 			SWAPFIELD(PartitionDesc, rd_partdesc);
 			SWAPFIELD(MemoryContext, rd_pdcxt);
 		}
+		if (keep_versions)
+		{
+			SWAPFIELD(bool, rd_versionsvalid);
+			SWAPFIELD(struct SchemaVersionInfo *, rd_versions);
+		}
 
 #undef SWAPFIELD
 
@@ -5661,6 +5678,8 @@ load_relcache_init_file(bool shared)
 		rel->rd_exclprocs = NULL;
 		rel->rd_exclstrats = NULL;
 		rel->rd_fdwroutine = NULL;
+		rel->rd_versionsvalid = false;
+		rel->rd_versions = NULL;
 
 		/*
 		 * Reset transient-state fields in the relcache entry
@@ -0,0 +1,363 @@
+/*-------------------------------------------------------------------------
+ *
+ * migrate_copy.c
+ *	  Bulk migration of the rows left in a migration source.
+ *
+ * Migration statements migrate the rows the workload asks for, one tuple at
+ * a time through the executor's INSERT path: every row is a separate
+ * heap_insert, with its index entries made right after.  That suits a
+ * statement migrating a handful of keys, but draining what a busy workload
+ * leaves behind that way is as slow as the INSERT ... SELECT it replaced.
+ *
+ * pg_migrate_copy moves the remaining rows the way COPY FROM loads a file.
+ * It claims the tuples of the source like any migration statement does,
+ * maps each one onto the target by column name, and buffers them until
+ * there are enough for heap_multi_insert, which fills a page per WAL record.
+ * Index entries and AFTER ROW triggers for a batch follow its insertion, as
+ * in CopyFromInsertBatch.  The claims are published at commit like those of
+ * any other migration, so concurrent migration statements and writers see
+ * the rows either as still to migrate or as migrated, never in between.
+ *
+ *
+ * Portions Copyright (c) 2020, UMD Database Group
+ *
+ * src/backend/utils/migrate_copy.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/heapversion.h"
+#include "access/htup_details.h"
+#include "access/tupconvert.h"
+#include "access/xact.h"
+#include "catalog/objectaddress.h"
+#include "catalog/pg_class.h"
+#include "commands/trigger.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "nodes/parsenodes.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/migrate_schema.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+
+
+/* flush the buffered tuples once there are this many, or this many bytes */
+#define MIGRATE_COPY_MAX_TUPLES		1000
+#define MIGRATE_COPY_MAX_BYTES		65535
+
+/*
+ * Insert the buffered tuples into the target, then make their index entries
+ * and run their AFTER ROW INSERT triggers, like CopyFromInsertBatch.
+ */
+static void
+migrate_copy_flush(EState *estate, ResultRelInfo *resultRelInfo,
+				   TupleTableSlot *myslot, BulkInsertState bistate,
+				   CommandId mycid, TransitionCaptureState *transition_capture,
+				   HeapTuple *buffered, int nbuffered)
+{
+	TriggerDesc *trigdesc = resultRelInfo->ri_TrigDesc;
+	MemoryContext oldcontext;
+	int			i;
+
+	/* heap_multi_insert leaks memory, so use the per-tuple context */
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	heap_multi_insert(resultRelInfo->ri_RelationDesc, buffered, nbuffered,
+					  mycid, 0, bistate);
+	MemoryContextSwitchTo(oldcontext);
+
+	if (resultRelInfo->ri_NumIndices > 0)
+	{
+		for (i = 0; i < nbuffered; i++)
+		{
+			List	   *recheckIndexes;
+
+			ExecStoreTuple(buffered[i], myslot, InvalidBuffer, false);
+			recheckIndexes = ExecInsertIndexTuples(myslot,
+												   &(buffered[i]->t_self),
+												   estate, false, NULL, NIL);
+			ExecARInsertTriggers(estate, resultRelInfo, buffered[i],
+								 recheckIndexes, transition_capture);
+			list_free(recheckIndexes);
+		}
+	}
+	else if (trigdesc != NULL &&
+			 (trigdesc->trig_insert_after_row ||
+			  trigdesc->trig_insert_new_table))
+	{
+		for (i = 0; i < nbuffered; i++)
+			ExecARInsertTriggers(estate, resultRelInfo, buffered[i],
+								 NIL, transition_capture);
+	}
+}
+
+/*
+ * Error out unless the current user may do what the bulk migration does to
+ * rel.  Row-level security policies can't be applied to a bulk load, so
+ * they are refused, as COPY FROM does.
+ */
+static void
+migrate_copy_check_rel(Relation rel, AclMode mode)
+{
+	AclResult	aclresult;
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(rel)),
+				 errhint("Only plain tables can be migrated in bulk.")));
+
+	aclresult = pg_class_aclcheck(RelationGetRelid(rel), GetUserId(), mode);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult,
+					   get_relkind_objtype(rel->rd_rel->relkind),
+					   RelationGetRelationName(rel));
+
+	if (check_enable_rls(RelationGetRelid(rel), InvalidOid, false) == RLS_ENABLED)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("bulk migration is not supported for tables with row-level security"),
+				 errhint("Use a migration statement instead.")));
+}
+
+/*
+ * Scan the source and move every tuple we can claim into the target.
+ * Returns the number of tuples migrated.
+ */
+static uint64
+migrate_copy_rows(Relation source, Relation target)
+{
+	TupleDesc	srcdesc = RelationGetDescr(source);
+	TupleConversionMap *map;
+	LazyDefaultState *ldstate = NULL;
+	EState	   *estate;
+	ResultRelInfo *resultRelInfo;
+	RangeTblEntry *rte;
+	TupleTableSlot *srcslot;
+	TupleTableSlot *myslot;
+	TransitionCaptureState *transition_capture;
+	BulkInsertState bistate;
+	CommandId	mycid = GetCurrentCommandId(true);
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	HeapTuple  *buffered;
+	int			nbuffered = 0;
+	Size		bufferedSize = 0;
+	uint64		processed = 0;
+
+	map = convert_tuples_by_name(srcdesc, RelationGetDescr(target),
+								 gettext_noop("could not map the rows of the migration source onto its target"));
+
+	estate = CreateExecutorState();
+
+	rte = makeNode(RangeTblEntry);
+	rte->rtekind = RTE_RELATION;
+	rte->relid = RelationGetRelid(target);
+	rte->relkind = target->rd_rel->relkind;
+	rte->requiredPerms = ACL_INSERT;
+	estate->es_range_table = list_make1(rte);
+
+	resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, target, 1, NULL, 0);
+	CheckValidResultRel(resultRelInfo, CMD_INSERT);
+	ExecOpenIndices(resultRelInfo, false);
+
+	/*
+	 * A BEFORE ROW trigger could look at the target and find the rows still
+	 * waiting in our buffer missing, so, like COPY FROM, we can't buffer
+	 * rows for such a target.  A migration statement handles it instead.
+	 */
+	if (resultRelInfo->ri_TrigDesc != NULL &&
+		(resultRelInfo->ri_TrigDesc->trig_insert_before_row ||
+		 resultRelInfo->ri_TrigDesc->trig_insert_instead_row))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot migrate in bulk into table \"%s\" because it has BEFORE ROW INSERT triggers",
+						RelationGetRelationName(target)),
+				 errhint("Use a migration statement instead.")));
+
+	estate->es_result_relations = resultRelInfo;
+	estate->es_num_result_relations = 1;
+	estate->es_result_relation_info = resultRelInfo;
+
+	srcslot = ExecInitExtraTupleSlot(estate, srcdesc);
+	myslot = ExecInitExtraTupleSlot(estate, RelationGetDescr(target));
+	estate->es_trig_tuple_slot = ExecInitExtraTupleSlot(estate, NULL);
+
+	/* rows that predate a lazily defaulted column are filled in as we go */
+	if (RelationHasLazyDefaults(source))
+		ldstate = ExecInitLazyDefaults(source, srcdesc, estate, false);
+
+	AfterTriggerBeginQuery();
+	transition_capture = MakeTransitionCaptureState(target->trigdesc,
+													RelationGetRelid(target),
+													CMD_INSERT);
+	ExecBSInsertTriggers(estate, resultRelInfo);
+
+	bistate = GetBulkInsertState();
+	buffered = (HeapTuple *) palloc(MIGRATE_COPY_MAX_TUPLES * sizeof(HeapTuple));
+
+	scan = heap_beginscan(source, GetActiveSnapshot(), 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		MemoryContext oldcontext;
+		HeapTuple	newtuple;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* buffered tuples live in the per-tuple context until flushed */
+		if (nbuffered == 0)
+			ResetPerTupleExprContext(estate);
+
+		ExecStoreTuple(tuple, srcslot, scan->rs_cbuf, false);
+		if (!MigrateTuple(srcslot))
+		{
+			if (migratebatchfull)
+				break;
+			continue;
+		}
+		++tuplemigratecount;
+
+		oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+
+		if (ldstate != NULL &&
+			HeapTupleHeaderGetNatts(tuple->t_data) < srcdesc->natts)
+			tuple = ExecFillLazyDefaults(ldstate, tuple,
+										 GetPerTupleExprContext(estate));
+
+		/* heap_multi_insert writes the header, so never hand it the original */
+		if (map != NULL)
+			newtuple = do_convert_tuple(tuple, map);
+		else
+			newtuple = heap_copytuple(tuple);
+		newtuple->t_tableOid = RelationGetRelid(target);
+
+		MemoryContextSwitchTo(oldcontext);
+
+		ExecStoreTuple(newtuple, myslot, InvalidBuffer, false);
+		if (target->rd_att->constr)
+			ExecConstraints(resultRelInfo, myslot, estate);
+		if (resultRelInfo->ri_PartitionCheck)
+			ExecPartitionCheck(resultRelInfo, myslot, estate, true);
+
+		buffered[nbuffered++] = newtuple;
+		bufferedSize += newtuple->t_len;
+		processed++;
+
+		if (nbuffered == MIGRATE_COPY_MAX_TUPLES ||
+			bufferedSize > MIGRATE_COPY_MAX_BYTES)
+		{
+			migrate_copy_flush(estate, resultRelInfo, myslot, bistate, mycid,
+							   transition_capture, buffered, nbuffered);
+			nbuffered = 0;
+			bufferedSize = 0;
+		}
+	}
+
+	if (nbuffered > 0)
+		migrate_copy_flush(estate, resultRelInfo, myslot, bistate, mycid,
+						   transition_capture, buffered, nbuffered);
+
+	FreeBulkInsertState(bistate);
+
+	ExecASInsertTriggers(estate, resultRelInfo, transition_capture);
+	AfterTriggerEndQuery(estate);
+
+	if (ldstate != NULL)
+		ExecEndLazyDefaults(ldstate);
+	ExecResetTupleTable(estate->es_tupleTable, false);
+	heap_endscan(scan);
+
+	ExecCloseIndices(resultRelInfo);
+	ExecCleanUpTriggerState(estate);
+	FreeExecutorState(estate);
+
+	pfree(buffered);
+
+	return processed;
+}
+
+/*
+ * pg_migrate_copy(bitmap int4, source regclass, target regclass) returns int8
+ *
+ * Migrate every row of source that is still to be migrated into target, as
+ * the migration using the given bitmap.  The columns of target are taken
+ * from the columns of source with the same name, which must have the same
+ * type.  Rows other transactions are migrating are waited for, as by any
+ * migration statement.  Outside a transaction block, a call stops once it
+ * has migrated migrate_batch_size rows, and has to be repeated until it
+ * returns zero.  Returns the number of rows migrated.
+ */
+Datum
+pg_migrate_copy(PG_FUNCTION_ARGS)
+{
+	int32		bitmap = PG_GETARG_INT32(0);
+	Oid			sourceid = PG_GETARG_OID(1);
+	Oid			targetid = PG_GETARG_OID(2);
+	Relation	source;
+	Relation	target;
+	uint64		processed = 0;
+
+	if (bitmap < 0 || bitmap >= MIGRATE_FIRST_PARTITION_BITMAP)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("%d is not the bitmap of a migration", bitmap)));
+	if (sourceid == targetid)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("source and target of a migration must differ")));
+	if (migrateflag)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("a migration statement is already running")));
+
+	source = heap_open(sourceid, AccessShareLock);
+	target = heap_open(targetid, RowExclusiveLock);
+
+	migrate_copy_check_rel(source,
+						   MigrateBitmapMoves(bitmap) ?
+						   ACL_SELECT | ACL_DELETE : ACL_SELECT);
+	migrate_copy_check_rel(target, ACL_INSERT);
+
+	/* set up as exec_bind_message does for a migration statement */
+	migrateflag = true;
+	InProgLocalList1 = NIL;
+	BitmapNum = bitmap;
+	PartialBitmap = GlobalBitmap + bitmap * BITMAPSIZE;
+
+	PG_TRY();
+	{
+		if (!MigrateScanFinished(sourceid))
+			processed = migrate_copy_rows(source, target);
+
+		MigrateWaitForInProgress();
+	}
+	PG_CATCH();
+	{
+		/* don't leave a subtransaction that catches this migrating */
+		tuplemigratecount = 0;
+		migrateflag = false;
+		migratebatchfull = false;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/*
+	 * Unlike a migration statement, we are not run again for the next batch
+	 * by exec_execute_message; the caller calls us again instead.
+	 */
+	tuplemigratecount = 0;
+	migrateflag = false;
+	migratebatchfull = false;
+
+	heap_close(target, NoLock);
+	heap_close(source, NoLock);
+
+	PG_RETURN_INT64((int64) processed);
+}
@@ -0,0 +1,268 @@
+/*-------------------------------------------------------------------------
+ *
+ * migrate_index.c
+ *	  Indexes on the target of a lazy migration.
+ *
+ * The target of a lazy migration fills up as queries migrate the rows they
+ * need, and those queries read it right after.  Without indexes every such
+ * read is a sequential scan of a growing table, while building the indexes
+ * once the target is full means a ShareLock held across a scan of the whole
+ * table, which stops the migration until it is done.
+ *
+ * pg_migrate_clone_indexes gives the target, while it is still empty, the
+ * indexes of the source that can be carried over.  Building them costs
+ * nothing, and from then on each migrated row is indexed as it is inserted,
+ * so the indexes always cover exactly the rows migrated so far.  Since
+ * queries migrate the keys they read before reading them, that is all the
+ * planner needs to use the indexes from the first migrated row on.
+ *
+ *
+ * Portions Copyright (c) 2020, UMD Database Group
+ *
+ * src/backend/utils/migrate_index.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/sysattr.h"
+#include "access/xact.h"
+#include "catalog/heap.h"
+#include "catalog/index.h"
+#include "catalog/pg_class.h"
+#include "commands/defrem.h"
+#include "nodes/bitmapset.h"
+#include "nodes/parsenodes.h"
+#include "optimizer/var.h"
+#include "parser/parse_utilcmd.h"
+#include "storage/bufmgr.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+
+/*
+ * Map the columns of source to the columns of target with the same name,
+ * type and collation, or to zero.
+ */
+static AttrNumber *
+migrate_index_attmap(Relation source, Relation target)
+{
+	TupleDesc	srcdesc = RelationGetDescr(source);
+	TupleDesc	tgtdesc = RelationGetDescr(target);
+	AttrNumber *attmap;
+	int			i;
+	int			j;
+
+	attmap = (AttrNumber *) palloc0(srcdesc->natts * sizeof(AttrNumber));
+	for (i = 0; i < srcdesc->natts; i++)
+	{
+		Form_pg_attribute srcatt = TupleDescAttr(srcdesc, i);
+
+		if (srcatt->attisdropped)
+			continue;
+
+		for (j = 0; j < tgtdesc->natts; j++)
+		{
+			Form_pg_attribute tgtatt = TupleDescAttr(tgtdesc, j);
+
+			if (tgtatt->attisdropped ||
+				strcmp(NameStr(srcatt->attname), NameStr(tgtatt->attname)) != 0)
+				continue;
+
+			if (srcatt->atttypid == tgtatt->atttypid &&
+				srcatt->atttypmod == tgtatt->atttypmod &&
+				srcatt->attcollation == tgtatt->attcollation)
+				attmap[i] = tgtatt->attnum;
+			break;
+		}
+	}
+
+	return attmap;
+}
+
+/*
+ * Return the name of a column the index uses that the target lacks, or NULL
+ * if the index can be carried over.
+ */
+static char *
+migrate_index_missing_column(Relation source, IndexInfo *info,
+							 AttrNumber *attmap)
+{
+	Bitmapset  *attrs = NULL;
+	int			i;
+
+	for (i = 0; i < info->ii_NumIndexAttrs; i++)
+	{
+		if (info->ii_IndexAttrNumbers[i] != InvalidAttrNumber)
+			attrs = bms_add_member(attrs, info->ii_IndexAttrNumbers[i] -
+								   FirstLowInvalidHeapAttributeNumber);
+	}
+	pull_varattnos((Node *) info->ii_Expressions, 1, &attrs);
+	pull_varattnos((Node *) info->ii_Predicate, 1, &attrs);
+
+	i = -1;
+	while ((i = bms_next_member(attrs, i)) >= 0)
+	{
+		AttrNumber	attnum = i + FirstLowInvalidHeapAttributeNumber;
+
+		/* a whole-row reference or a system column can't be carried over */
+		if (attnum <= 0)
+			return pstrdup(attnum == 0 ? "*" :
+						   NameStr(SystemAttributeDefinition(attnum,
+															 true)->attname));
+		if (attmap[attnum - 1] == InvalidAttrNumber)
+			return get_attname(RelationGetRelid(source), attnum, false);
+	}
+
+	return NULL;
+}
+
+/*
+ * Does target already have an index equivalent to the one described?
+ */
+static bool
+migrate_index_exists(Relation target, Relation srcidx, IndexInfo *srcinfo,
+					 AttrNumber *attmap, int maplen)
+{
+	List	   *indexes = RelationGetIndexList(target);
+	ListCell   *lc;
+	bool		found = false;
+
+	foreach(lc, indexes)
+	{
+		Relation	tgtidx = index_open(lfirst_oid(lc), AccessShareLock);
+
+		found = CompareIndexInfo(BuildIndexInfo(tgtidx), srcinfo,
+								 tgtidx->rd_indcollation,
+								 srcidx->rd_indcollation,
+								 tgtidx->rd_opfamily,
+								 srcidx->rd_opfamily,
+								 attmap, maplen);
+		index_close(tgtidx, AccessShareLock);
+		if (found)
+			break;
+	}
+	list_free(indexes);
+
+	return found;
+}
+
+/*
+ * Error out unless the target is empty.  Our ShareLock has waited out any
+ * transaction that was inserting into it, so a fresh snapshot sees all rows.
+ */
+static void
+migrate_index_check_empty(Relation target)
+{
+	HeapScanDesc scan;
+	bool		empty;
+
+	if (RelationGetNumberOfBlocks(target) == 0)
+		return;
+
+	scan = heap_beginscan(target, GetLatestSnapshot(), 0, NULL);
+	empty = (heap_getnext(scan, ForwardScanDirection) == NULL);
+	heap_endscan(scan);
+
+	if (!empty)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration target \"%s\" is not empty",
+						RelationGetRelationName(target)),
+				 errdetail("Building indexes on it would block the migration until they are done."),
+				 errhint("Use CREATE INDEX CONCURRENTLY instead.")));
+}
+
+/*
+ * pg_migrate_clone_indexes(source regclass, target regclass) returns int4
+ *
+ * Create on the empty target of a migration the indexes of its source,
+ * including primary key, unique and exclusion constraints.  An index is
+ * carried over if every column it uses is present in the target under the
+ * same name and with the same type and collation, and the target doesn't
+ * have an equivalent one yet; the others are skipped with a notice.
+ * Returns the number of indexes created.
+ */
+Datum
+pg_migrate_clone_indexes(PG_FUNCTION_ARGS)
+{
+	Oid			sourceid = PG_GETARG_OID(0);
+	Oid			targetid = PG_GETARG_OID(1);
+	Relation	source;
+	Relation	target;
+	AttrNumber *attmap;
+	int			maplen;
+	List	   *indexes;
+	ListCell   *lc;
+	int32		created = 0;
+
+	source = heap_open(sourceid, AccessShareLock);
+	target = heap_open(targetid, ShareLock);
+
+	if (source->rd_rel->relkind != RELKIND_RELATION ||
+		target->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("indexes can only be cloned between tables")));
+	if (sourceid == targetid)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("source and target of a migration must differ")));
+
+	migrate_index_check_empty(target);
+
+	attmap = migrate_index_attmap(source, target);
+	maplen = RelationGetDescr(source)->natts;
+
+	indexes = RelationGetIndexList(source);
+	foreach(lc, indexes)
+	{
+		Relation	srcidx = index_open(lfirst_oid(lc), AccessShareLock);
+		IndexInfo  *srcinfo = BuildIndexInfo(srcidx);
+		char	   *missing;
+
+		if (!IndexIsValid(srcidx->rd_index))
+		{
+			index_close(srcidx, AccessShareLock);
+			continue;
+		}
+
+		missing = migrate_index_missing_column(source, srcinfo, attmap);
+		if (missing != NULL)
+			ereport(NOTICE,
+					(errmsg("skipping index \"%s\": column \"%s\" is not in \"%s\"",
+							RelationGetRelationName(srcidx), missing,
+							RelationGetRelationName(target))));
+		else if (!migrate_index_exists(target, srcidx, srcinfo,
+									   attmap, maplen))
+		{
+			IndexStmt  *stmt;
+
+			stmt = generateClonedIndexStmt(NULL, targetid, srcidx,
+										   attmap, maplen, NULL);
+			DefineIndex(targetid, stmt,
+						InvalidOid, /* no predefined OID */
+						InvalidOid, /* no parent index */
+						InvalidOid, /* no parent constraint */
+						true,	/* is_alter_table, to check for a primary key */
+						true,	/* check_rights */
+						false,	/* check_not_in_use */
+						false,	/* skip_build */
+						false); /* quiet */
+			CommandCounterIncrement();
+			created++;
+		}
+
+		index_close(srcidx, AccessShareLock);
+	}
+	list_free(indexes);
+
+	heap_close(target, NoLock);
+	heap_close(source, AccessShareLock);
+
+	PG_RETURN_INT32(created);
+}
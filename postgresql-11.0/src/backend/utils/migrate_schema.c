@@ -13,7 +13,125 @@
 
 
 #include "utils/migrate_schema.h"
+
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/relscan.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/dependency.h"
+#include "catalog/pg_class.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pg_trace.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "storage/bufmgr.h"
+#include "storage/lmgr.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
 #include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/hashutils.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+#include "utils/tqual.h"
+
+
+/*
+ * Shared state besides the bitmaps.  wordSeq[] stamps each bitmap word with
+ * the value publishSeq had when a migrate bit in it was last published, which
+ * is what lets snapshot-based isolation levels detect migrations they can't
+ * see.  newVersions[] counts the tuple versions stored in each bitmap's
+ * source by any path through heapam (see MigrateClaimNewVersion), so that
+ * pg_migrate_finalize can tell whether any appeared while it was looking.
+ * The two-way state is set by pg_migrate_enable_reverse and
+ * pg_migrate_rollback, and indexed by migration rather than bitmap.
+ *
+ * A bitmap is assigned to the relation it covers by the first migration
+ * statement that reads it (see MigrateScanBitmap), and keeps it in
+ * bitmaprelid[] after it is retired.  owner[] is the migration bitmap a
+ * bitmap belongs to: itself for the first NUM_MIGRATIONS * 2, and for the
+ * partition bitmaps the one whose statement took it, or -1 while it is free.
+ */
+typedef struct MigrateSharedData
+{
+	Oid			srcrelid[NUM_MIGRATE_BITMAPS];	/* relation each bitmap covers */
+	bool		finished[NUM_MIGRATE_BITMAPS];	/* migration is complete */
+	pg_atomic_uint32 newVersions[NUM_MIGRATE_BITMAPS];
+	Oid			bitmaprelid[NUM_MIGRATE_BITMAPS];
+	int			owner[NUM_MIGRATE_BITMAPS];
+	slock_t		mutex;			/* protects bitmap assignment */
+	bool		twoWay[NUM_MIGRATIONS];	/* rows are moved, not copied */
+	bool		reversed[NUM_MIGRATIONS];	/* rolled back */
+	char		reversePrefix[NUM_MIGRATIONS][MIGRATE_PREFIX_LEN];
+	pg_atomic_uint32 publishSeq;
+	uint32		wordSeq[FLEXIBLE_ARRAY_MEMBER];
+} MigrateSharedData;
+
+/* an element whose lock bit is set, and the transaction that set it */
+typedef struct MigrateClaimTag
+{
+	uint32		eid;
+	uint32		bitmapno;
+} MigrateClaimTag;
+
+typedef struct MigrateClaimEnt
+{
+	MigrateClaimTag tag;		/* hash key -- must be first */
+	TransactionId owner;		/* top-level xid of the claiming transaction */
+} MigrateClaimEnt;
+
+#define MIGRATE_CLAIM_HASH_SIZE \
+	mul_size(max_migrate_claims_per_xact, MaxBackends)
+
+/*
+ * A migration statement some transaction is running, by its bitmap and a
+ * hash of its text and parameter values.  Two statements with the same tag
+ * are assumed to migrate the same tuples; a hash collision only makes one
+ * wait for the other needlessly.
+ */
+typedef struct MigrateStmtTag
+{
+	uint64		hash;
+	uint32		bitmapno;
+} MigrateStmtTag;
+
+typedef struct MigrateStmtEnt
+{
+	MigrateStmtTag tag;			/* hash key -- must be first */
+	TransactionId owner;		/* top-level xid of the running transaction */
+} MigrateStmtEnt;
+
+#define MIGRATE_STMT_HASH_SIZE	mul_size(MaxBackends, 4)
+
+typedef enum MigrateClaimKind
+{
+	MIGRATE_CLAIM_MIGRATION,	/* migrated by us; publish at commit */
+	MIGRATE_CLAIM_WRITE			/* old version updated or deleted by us */
+} MigrateClaimKind;
+
+/* backend-local record of a claim, released at end of (sub)transaction */
+typedef struct MigrateLocalClaim
+{
+	uint32		eid;
+	uint8		bitmapno;
+	uint8		kind;			/* a MigrateClaimKind */
+	int			nestLevel;		/* subtransaction nesting level of claim */
+} MigrateLocalClaim;
+
+int			max_migrate_claims_per_xact = 4096;
+int			migrate_batch_size = 0;
+int			migrate_bitmap_layout = MIGRATE_LAYOUT_INTERLEAVED;
 
 /* flag to indicate if a query is a part of a migration */
 bool    migrateflag         = false;
@@ -24,6 +142,9 @@ uint64  tuplemigratecount   = 0;
 /* count of the number of tuples migration in progress (per transaction) */
 uint32  count_inprogress    = 0;
 
+/* the running migration statement stopped at migrate_batch_size tuples */
+bool    migratebatchfull    = false;
+
 /* global bitmap for indicating migration status of tuples */
 uint64  *GlobalBitmap       = NULL;
 
@@ -31,97 +152,2001 @@ uint64  *GlobalBitmap       = NULL;
 uint8 BitmapNum = 0;
 uint64 *PartialBitmap = NULL;
 
-List    *InProgLocalList0;
+/* tuples claimed by concurrent migrations that we have to wait for */
 List    *InProgLocalList1;
 
-inline uint32 getwordid(uint32 eid)
+static MigrateSharedData *MigrateShared = NULL;
+static HTAB *MigrateClaimHash = NULL;
+static HTAB *MigrateStmtHash = NULL;
+
+/* the statements we registered in MigrateStmtHash, released at end of xact */
+static MigrateStmtTag *localStmts = NULL;
+static int	numLocalStmts = 0;
+static int	maxLocalStmts = 0;
+
+static MigrateLocalClaim *localClaims = NULL;
+static int	numLocalClaims = 0;
+static int	maxLocalClaims = 0;
+
+/* publishSeq as of our transaction snapshot */
+static uint32 MigrateXactSnapshotSeq = 0;
+static bool MigrateXactSnapshotSeqValid = false;
+
+/*
+ * Bitmaps pg_migrate_finalize found complete, and migrations
+ * pg_migrate_rollback reversed, which take effect at commit.
+ */
+static uint32 pendingFinishMask = 0;
+static uint32 pendingRollbackMask = 0;
+
+/* pg_migrate_reclaim is deleting tuples; see MigrateClaimOldVersion */
+static bool MigrateReclaiming = false;
+static int	pendingNestLevel[NUM_MIGRATE_BITMAPS];
+
+/*
+ * Size of the shared structures backing lazy migration, other than the
+ * bitmaps themselves (those are covered by the padding in ipci.c).
+ */
+Size
+MigrateShmemSize(void)
+{
+	Size		size;
+
+	size = add_size(offsetof(MigrateSharedData, wordSeq),
+					mul_size(NUM_MIGRATE_BITMAPS * BITMAPSIZE, sizeof(uint32)));
+	size = add_size(size, hash_estimate_size(MIGRATE_CLAIM_HASH_SIZE,
+											 sizeof(MigrateClaimEnt)));
+	size = add_size(size, hash_estimate_size(MIGRATE_STMT_HASH_SIZE,
+											 sizeof(MigrateStmtEnt)));
+	return size;
+}
+
+void
+InitGlobalBitmap(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	/* allocate bitmap from shared memory */
+	GlobalBitmap = (uint64 *) ShmemInitStruct("Global Bitmap", (NUM_MIGRATE_BITMAPS * BITMAPSIZE * sizeof(uint64)), &found);
+
+	if (!found)
+	{
+		printf("Shared Global Bitmap created!\n");
+		memset(GlobalBitmap, 0, (NUM_MIGRATE_BITMAPS * BITMAPSIZE * sizeof(uint64)));
+	}
+
+	MigrateShared = (MigrateSharedData *)
+		ShmemInitStruct("Migrate Shared State",
+						offsetof(MigrateSharedData, wordSeq) +
+						NUM_MIGRATE_BITMAPS * BITMAPSIZE * sizeof(uint32),
+						&found);
+
+	if (!found)
+	{
+		int			i;
+
+		for (i = 0; i < NUM_MIGRATE_BITMAPS; i++)
+		{
+			MigrateShared->srcrelid[i] = InvalidOid;
+			MigrateShared->finished[i] = false;
+			pg_atomic_init_u32(&MigrateShared->newVersions[i], 0);
+			MigrateShared->bitmaprelid[i] = InvalidOid;
+			MigrateShared->owner[i] =
+				(i < MIGRATE_FIRST_PARTITION_BITMAP) ? i : -1;
+		}
+		SpinLockInit(&MigrateShared->mutex);
+		for (i = 0; i < NUM_MIGRATIONS; i++)
+		{
+			MigrateShared->twoWay[i] = false;
+			MigrateShared->reversed[i] = false;
+			MigrateShared->reversePrefix[i][0] = '\0';
+		}
+		pg_atomic_init_u32(&MigrateShared->publishSeq, 0);
+		memset(MigrateShared->wordSeq, 0,
+			   NUM_MIGRATE_BITMAPS * BITMAPSIZE * sizeof(uint32));
+	}
+
+	/*
+	 * The claim hash is partitioned the same way as the bitmap locks: by
+	 * bitmap and by group of SIZEOFWORD elements (see MigrateBitmapPartition).
+	 * A partition lock thus covers every element whose bits share a word with
+	 * one it guards, along with their wordSeq stamps and claim entries, and
+	 * the plain read-modify-write of a bitmap word under it is safe.
+	 */
+	StaticAssertStmt(SIZEOFWORD % ELEMCOUNTINWORD == 0,
+					 "a bitmap lock partition must cover whole bitmap words");
+	StaticAssertStmt(NUM_MIGRATE_BITMAPS == NUM_MIGRATE_BITMAP_LOCK_SETS,
+					 "every migrate bitmap needs its own partition locks");
+	StaticAssertStmt(NUMTUPLES <= (1 << MIGRATE_INPROG_EID_BITS) &&
+					 NUM_MIGRATE_BITMAPS <= (1 << (31 - MIGRATE_INPROG_EID_BITS)),
+					 "element ids and bitmaps don't fit in InProgLocalList1");
+	StaticAssertStmt((NUM_MIGRATE_BITMAP_LOCKS * NUM_MIGRATE_BITMAPS &
+					  (NUM_MIGRATE_BITMAP_LOCKS * NUM_MIGRATE_BITMAPS - 1)) == 0,
+					 "migrate claim partitions must be a power of 2");
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(MigrateClaimTag);
+	info.entrysize = sizeof(MigrateClaimEnt);
+	info.num_partitions = NUM_MIGRATE_BITMAP_LOCKS * NUM_MIGRATE_BITMAPS;
+
+	MigrateClaimHash = ShmemInitHash("Migrate Claim Hash",
+									 MIGRATE_CLAIM_HASH_SIZE,
+									 MIGRATE_CLAIM_HASH_SIZE,
+									 &info,
+									 HASH_ELEM | HASH_BLOBS |
+									 HASH_PARTITION | HASH_FIXED_SIZE);
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(MigrateStmtTag);
+	info.entrysize = sizeof(MigrateStmtEnt);
+
+	MigrateStmtHash = ShmemInitHash("Migrate Statement Hash",
+									MIGRATE_STMT_HASH_SIZE,
+									MIGRATE_STMT_HASH_SIZE,
+									&info,
+									HASH_ELEM | HASH_BLOBS | HASH_FIXED_SIZE);
+}
+
+/*
+ * Map a heap TID to its element id in the bitmap, or InvalidMigrateEid if the
+ * TID lies outside the range the bitmap was sized for.
+ */
+uint32
+MigrateTupleEid(ItemPointer tid)
 {
-	return (eid / ELEMCOUNTINWORD);
+	uint32		blockId = (uint32) ItemPointerGetBlockNumber(tid);
+	uint32		offset = (uint32) ItemPointerGetOffsetNumber(tid);
+	uint32		eid;
+
+	if (offset < 1 || offset > NUMTUPLESPERPAGE)
+		return InvalidMigrateEid;
+
+	eid = blockId * NUMTUPLESPERPAGE + offset - 1;
+	if (eid >= NUMTUPLES)
+		return InvalidMigrateEid;
+
+	return eid;
 }
 
-inline uint32 getlockbitid(uint32 eid)
+/*
+ * Compute the claim hash code for an element.  The low bits select the
+ * partition, and have to agree with MigrateBitmapPartitionLock.
+ */
+static uint32
+MigrateClaimHashCode(const MigrateClaimTag *tag)
 {
-	uint32 posinbyte = eid % ELEMCOUNTINWORD;
-	return (posinbyte * 2 + LOCKBITPOS);
+	uint32		nparts = NUM_MIGRATE_BITMAP_LOCKS * NUM_MIGRATE_BITMAPS;
+	uint32		hashcode = get_hash_value(MigrateClaimHash, (const void *) tag);
+
+	return (hashcode & ~(nparts - 1)) |
+		MigrateClaimPartitionIndex(tag->eid, tag->bitmapno);
 }
 
-inline uint32 getmigratebitid(uint32 eid)
+/*
+ * Remember a claim in the backend-local list.  Done before the shared state
+ * is touched, so that running out of memory can't leave a claim behind that
+ * end-of-transaction processing doesn't know about.
+ */
+static void
+MigrateReserveLocalClaim(void)
 {
-	uint32 posinbyte = eid % ELEMCOUNTINWORD;
-	return (posinbyte * 2 + MIGRATEBITPOS);
+	if (numLocalClaims < maxLocalClaims)
+		return;
+
+	if (localClaims == NULL)
+	{
+		maxLocalClaims = 64;
+		localClaims = (MigrateLocalClaim *)
+			MemoryContextAlloc(TopMemoryContext,
+							   maxLocalClaims * sizeof(MigrateLocalClaim));
+	}
+	else
+	{
+		maxLocalClaims *= 2;
+		localClaims = (MigrateLocalClaim *)
+			repalloc(localClaims, maxLocalClaims * sizeof(MigrateLocalClaim));
+	}
 }
 
-inline bool getkthbit(uint64 word, uint32 k)
+/*
+ * Record in the shared claim hash that "owner" holds the lock bit of an
+ * element, so that waiters know whose transaction to sleep on.  Caller must
+ * hold the element's bitmap partition lock exclusively and set the lock bit
+ * afterwards.
+ */
+static void
+MigrateInsertClaim(uint8 bitmapno, uint32 eid, TransactionId owner,
+				   MigrateClaimKind kind)
 {
-	return ((word & ((uint64)1 << k)) != 0);
+	MigrateClaimTag tag;
+	MigrateClaimEnt *ent;
+	MigrateLocalClaim *local;
+	bool		found;
+
+	MigrateReserveLocalClaim();
+
+	tag.eid = eid;
+	tag.bitmapno = bitmapno;
+	ent = (MigrateClaimEnt *)
+		hash_search_with_hash_value(MigrateClaimHash, &tag,
+									MigrateClaimHashCode(&tag),
+									HASH_ENTER_NULL, &found);
+	if (!ent)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of shared memory"),
+				 errhint("You might need to increase max_migrate_claims_per_transaction.")));
+	Assert(!found);
+	ent->owner = owner;
+
+	local = &localClaims[numLocalClaims++];
+	local->eid = eid;
+	local->bitmapno = bitmapno;
+	local->kind = kind;
+	local->nestLevel = GetCurrentTransactionNestLevel();
 }
 
-inline bool getlockbit(uint64 *bitmap, uint32 eid)
+/*
+ * Look up the transaction holding the lock bit of an element.  Caller must
+ * hold the element's bitmap partition lock.
+ */
+static TransactionId
+MigrateClaimOwner(uint8 bitmapno, uint32 eid)
 {
-	uint32 wordid    = getwordid(eid);
-	uint32 lockbitid = getlockbitid(eid);
-	return getkthbit(bitmap[wordid], lockbitid);
+	MigrateClaimTag tag;
+	MigrateClaimEnt *ent;
+
+	tag.eid = eid;
+	tag.bitmapno = bitmapno;
+	ent = (MigrateClaimEnt *)
+		hash_search_with_hash_value(MigrateClaimHash, &tag,
+									MigrateClaimHashCode(&tag),
+									HASH_FIND, NULL);
+	if (!ent)
+		elog(ERROR, "could not find owner of migration claim %u in bitmap %u",
+			 eid, bitmapno);
+
+	return ent->owner;
 }
 
-inline void setlockbit(uint64 *bitmap, uint32 eid)
+/*
+ * Claim an element for migration on behalf of the current transaction.
+ * Called from MigrateTuple with the partition lock held exclusively, right
+ * before the lock bit is set.
+ */
+void
+MigrateRegisterClaim(uint8 bitmapno, uint32 eid, TransactionId owner)
 {
-	uint32 wordid    = getwordid(eid);
-	uint32 lockbitid = getlockbitid(eid);
-	bitmap[wordid]  |= ((uint64)1 << lockbitid);
+	MigrateInsertClaim(bitmapno, eid, owner, MIGRATE_CLAIM_MIGRATION);
 }
 
-inline void resetlockbit(uint64 *bitmap, uint32 eid)
+/*
+ * Release one of our claims, with its partition lock held exclusively.  On
+ * commit, migration claims publish the migrate bit; everything else just
+ * drops the lock bit, so that waiters notice the tuple was not migrated by
+ * us.
+ */
+static void
+MigrateReleaseClaimLocked(MigrateLocalClaim *claim, bool isCommit, uint32 seq)
 {
-	uint32 wordid    = getwordid(eid);
-	uint32 lockbitid = getlockbitid(eid);
-	bitmap[wordid]  &= ~((uint64)1 << lockbitid);
+	uint64	   *bitmap = GlobalBitmap + claim->bitmapno * BITMAPSIZE;
+	uint32		wordid = getwordid(claim->eid);
+	MigrateClaimTag tag;
+
+	tag.eid = claim->eid;
+	tag.bitmapno = claim->bitmapno;
+
+	if (isCommit && claim->kind == MIGRATE_CLAIM_MIGRATION)
+	{
+		/* the stamp must be visible before anyone can see the migrate bit */
+		MigrateShared->wordSeq[claim->bitmapno * BITMAPSIZE + wordid] = seq;
+		pg_write_barrier();
+		setmigratebit(bitmap, claim->eid);
+	}
+	resetlockbit(bitmap, claim->eid);
+
+	(void) hash_search_with_hash_value(MigrateClaimHash, &tag,
+									   MigrateClaimHashCode(&tag),
+									   HASH_REMOVE, NULL);
 }
 
-inline void setmigratebit(uint64 *bitmap, uint32 eid)
+/*
+ * Release one of our claims.
+ */
+static void
+MigrateReleaseClaim(MigrateLocalClaim *claim, bool isCommit, uint32 seq)
 {
-	uint32 wordid       = getwordid(eid);
-	uint32 migratebitid = getmigratebitid(eid);
-	bitmap[wordid]     |= ((uint64)1 << migratebitid);
+	LWLock	   *bitmapLock = MigrateBitmapPartitionLock(claim->eid, claim->bitmapno);
+
+	LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+	MigrateReleaseClaimLocked(claim, isCommit, seq);
+	LWLockRelease(bitmapLock);
 }
 
-inline bool getmigratebit(uint64 *bitmap, uint32 eid)
+/*
+ * qsort comparator putting claims in partition order, and in element order
+ * within a partition so that the bitmap words are written in sequence.
+ */
+static int
+MigrateLocalClaimCmp(const void *a, const void *b)
 {
-	uint32 wordid       = getwordid(eid);
-	uint32 migratebitid = getmigratebitid(eid);
-	return getkthbit(bitmap[wordid], migratebitid);
+	const MigrateLocalClaim *ca = (const MigrateLocalClaim *) a;
+	const MigrateLocalClaim *cb = (const MigrateLocalClaim *) b;
+	uint32		pa = MigrateClaimPartitionIndex(ca->eid, ca->bitmapno);
+	uint32		pb = MigrateClaimPartitionIndex(cb->eid, cb->bitmapno);
+
+	if (pa != pb)
+		return pa < pb ? -1 : 1;
+	if (ca->eid != cb->eid)
+		return ca->eid < cb->eid ? -1 : 1;
+	return 0;
 }
 
-inline bool getinprogbit(uint64 *bitmap, uint32 eid)
+/*
+ * Release all of our claims at end of transaction.  Consecutive elements
+ * fall in different partitions, so a bulk migration taking the partition
+ * lock per claim would take it as many times as it migrated tuples, each
+ * time contending with the migrations still running.  Sorting the claims
+ * by partition instead takes each lock once for all the claims under it.
+ * The list need not stay in nesting order, as it is emptied right after.
+ */
+static void
+MigrateReleaseAllClaims(bool isCommit, uint32 seq)
 {
-	uint32 wordid   = eid / SIZEOFWORD;
-	uint32 bitid    = eid % SIZEOFWORD;
-	return getkthbit(bitmap[wordid], bitid);
+	LWLock	   *heldLock = NULL;
+	int			i;
+
+	if (isCommit)
+		TRACE_POSTGRESQL_MIGRATE_PUBLISH_START(numLocalClaims, seq);
+
+	if (numLocalClaims > 1)
+		qsort(localClaims, numLocalClaims, sizeof(MigrateLocalClaim),
+			  MigrateLocalClaimCmp);
+
+	for (i = 0; i < numLocalClaims; i++)
+	{
+		MigrateLocalClaim *claim = &localClaims[i];
+		LWLock	   *bitmapLock = MigrateBitmapPartitionLock(claim->eid,
+															claim->bitmapno);
+
+		if (bitmapLock != heldLock)
+		{
+			if (heldLock != NULL)
+				LWLockRelease(heldLock);
+			LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+			heldLock = bitmapLock;
+		}
+		MigrateReleaseClaimLocked(claim, isCommit, seq);
+	}
+
+	if (heldLock != NULL)
+		LWLockRelease(heldLock);
+
+	if (isCommit)
+		TRACE_POSTGRESQL_MIGRATE_PUBLISH_DONE(numLocalClaims, seq);
+	numLocalClaims = 0;
 }
 
-inline void setinprogbit(uint64 *bitmap, uint32 eid)
+/*
+ * Under REPEATABLE READ and SERIALIZABLE our snapshot may predate the commit
+ * that migrated an element, in which case its rows in the new table are
+ * invisible to us and skipping it would lose them.  Such a conflict is
+ * reported like any other concurrent update under those isolation levels.
+ * The check is done per bitmap word, so it can give false positives but
+ * never misses a conflict.
+ */
+void
+MigrateCheckSnapshotConflict(uint8 bitmapno, uint32 eid)
 {
-	uint32 wordid   = eid / SIZEOFWORD;
-	uint32 bitid    = eid % SIZEOFWORD;
-	bitmap[wordid] |= ((uint64)1 << bitid);
+	uint32		seq;
+
+	if (!IsolationUsesXactSnapshot() || !MigrateXactSnapshotSeqValid)
+		return;
+
+	pg_read_barrier();
+	seq = MigrateShared->wordSeq[bitmapno * BITMAPSIZE + getwordid(eid)];
+
+	if ((int32) (seq - MigrateXactSnapshotSeq) > 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+				 errmsg("could not serialize access due to concurrent migration")));
 }
 
-inline void resetinprogbit(uint64 *bitmap, uint32 eid)
+/*
+ * Hash the text of a migration statement and the values of its parameters.
+ */
+static uint64
+MigrateStatementHash(const char *query_string, ParamListInfo params)
 {
-	uint32 wordid   = eid / SIZEOFWORD;
-	uint32 bitid    = eid % SIZEOFWORD;
-	bitmap[wordid] &= ~((uint64)1 << bitid);
+	uint64		hash;
+	int			i;
+
+	hash = DatumGetUInt64(hash_any_extended((const unsigned char *) query_string,
+											strlen(query_string), 0));
+	if (params == NULL)
+		return hash;
+
+	for (i = 0; i < params->numParams; i++)
+	{
+		ParamExternData *prm = &params->params[i];
+		int16		typlen;
+		bool		typbyval;
+		uint64		phash;
+
+		if (prm->isnull || !OidIsValid(prm->ptype))
+			phash = 0;
+		else
+		{
+			get_typlenbyval(prm->ptype, &typlen, &typbyval);
+			if (typbyval)
+				phash = DatumGetUInt64(hash_any_extended((const unsigned char *) &prm->value,
+														 sizeof(Datum), i));
+			else
+			{
+				Datum		value = prm->value;
+
+				if (typlen == -1)
+					value = PointerGetDatum(PG_DETOAST_DATUM_PACKED(value));
+				phash = DatumGetUInt64(hash_any_extended((const unsigned char *) DatumGetPointer(value),
+														 datumGetSize(value, false, typlen),
+														 i));
+			}
+		}
+		hash = hash_combine64(hash, phash);
+	}
+
+	return hash;
 }
 
+/*
+ * Coalesce a migration statement with an identical one that another
+ * transaction is running.
+ *
+ * When many sessions need the same rows at once, as at the start of a
+ * migration, they all issue the same migration statement.  Run side by side,
+ * each scans the same pages, and all but one find the tuples claimed and
+ * wait for their owner at the end; if it aborts, they fail with a
+ * serialization error.  Instead, the first to arrive registers the statement
+ * and the others wait for its transaction before they start.  By then the
+ * tuples are migrated and their own run only finds them so, or, if it
+ * aborted, one of them migrates them in its place.
+ *
+ * Statements are matched by text and parameter values only, so statements
+ * whose predicates merely overlap still run side by side.
+ */
 void
-InitGlobalBitmap(void)
+MigrateCoalesceStatement(const char *query_string, ParamListInfo params)
 {
-	bool found;
-	/* allocate bitmap from shared memory */
-	GlobalBitmap = (uint64 *) ShmemInitStruct("Global Bitmap", (2 * BITMAPSIZE * sizeof(uint64)), &found);
+	MigrateStmtTag tag;
+	TransactionId xid;
 
-	if (!found)
+	/* only parameters bound by the client can be told apart */
+	if (params != NULL && params->paramFetch != NULL)
+		return;
+
+	MemSet(&tag, 0, sizeof(tag));
+	tag.hash = MigrateStatementHash(query_string, params);
+	tag.bitmapno = BitmapNum;
+
+	if (numLocalStmts >= maxLocalStmts)
 	{
-		printf("Shared Global Bitmap created!\n");
-		memset(GlobalBitmap, 0, (2 * BITMAPSIZE * sizeof(uint64)));
+		if (localStmts == NULL)
+		{
+			maxLocalStmts = 8;
+			localStmts = (MigrateStmtTag *)
+				MemoryContextAlloc(TopMemoryContext,
+								   maxLocalStmts * sizeof(MigrateStmtTag));
+		}
+		else
+		{
+			maxLocalStmts *= 2;
+			localStmts = (MigrateStmtTag *)
+				repalloc(localStmts, maxLocalStmts * sizeof(MigrateStmtTag));
+		}
+	}
+
+	xid = GetTopTransactionId();
+
+	for (;;)
+	{
+		MigrateStmtEnt *ent;
+		TransactionId owner;
+		bool		found;
+
+		LWLockAcquire(MigrateStatementLock, LW_EXCLUSIVE);
+		ent = (MigrateStmtEnt *) hash_search(MigrateStmtHash, &tag,
+											 HASH_ENTER_NULL, &found);
+
+		/* with the table full, the statement just runs alongside the others */
+		if (ent == NULL)
+		{
+			LWLockRelease(MigrateStatementLock);
+			return;
+		}
+
+		if (!found ||
+			(ent->owner != xid && !TransactionIdIsInProgress(ent->owner)))
+		{
+			/* if found, a backend that died left it behind */
+			localStmts[numLocalStmts++] = tag;
+			ent->owner = xid;
+			LWLockRelease(MigrateStatementLock);
+			return;
+		}
+
+		owner = ent->owner;
+		LWLockRelease(MigrateStatementLock);
+
+		if (owner == xid)
+			return;
+
+		ProcSetLockWaitEvent(WAIT_EVENT_MIGRATE_STATEMENT);
+		XactLockTableWait(owner, NULL, NULL, XLTW_None);
+		ProcSetLockWaitEvent(0);
+	}
+}
+
+/*
+ * Drop the statements we registered, waking up the transactions waiting to
+ * run them.
+ */
+static void
+MigrateReleaseStatements(void)
+{
+	TransactionId xid = GetTopTransactionIdIfAny();
+	int			i;
+
+	if (numLocalStmts == 0)
+		return;
+
+	LWLockAcquire(MigrateStatementLock, LW_EXCLUSIVE);
+	for (i = 0; i < numLocalStmts; i++)
+	{
+		MigrateStmtEnt *ent;
+
+		ent = (MigrateStmtEnt *) hash_search(MigrateStmtHash, &localStmts[i],
+											 HASH_FIND, NULL);
+		if (ent != NULL && ent->owner == xid)
+			(void) hash_search(MigrateStmtHash, &localStmts[i],
+							   HASH_REMOVE, NULL);
+	}
+	LWLockRelease(MigrateStatementLock);
+
+	numLocalStmts = 0;
+}
+
+/*
+ * Sleep on the transaction lock of owner, which holds the claim on element
+ * eid of bitmapno, reporting wait_event_info rather than a lock wait so
+ * that time lost to migration shows up as such.
+ */
+static void
+MigrateWaitForClaim(uint32 bitmapno, uint32 eid, TransactionId owner,
+					Relation rel, ItemPointer tid, XLTW_Oper oper,
+					uint32 wait_event_info)
+{
+	TRACE_POSTGRESQL_MIGRATE_WAIT_START(bitmapno, eid, owner);
+	ProcSetLockWaitEvent(wait_event_info);
+	XactLockTableWait(owner, rel, tid, oper);
+	ProcSetLockWaitEvent(0);
+	TRACE_POSTGRESQL_MIGRATE_WAIT_DONE(bitmapno, eid);
+}
+
+/*
+ * Wait for the elements other transactions had claimed when our migration
+ * query ran into them.  We sleep on the owner's transaction lock, so the
+ * deadlock detector sees these waits, and we return only once every such
+ * element is migrated.  If an owner released its claim without migrating
+ * (it aborted, or the tuple was updated under it), the rows we expected in
+ * the new table aren't there and the transaction has to be retried.
+ */
+void
+MigrateWaitForInProgress(void)
+{
+	ListCell   *cell;
+
+	foreach(cell, InProgLocalList1)
+	{
+		uint32		bitmapno = MigrateInProgBitmap(lfirst_int(cell));
+		uint32		eid = MigrateInProgEid(lfirst_int(cell));
+		uint64	   *bitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+		LWLock	   *bitmapLock = MigrateBitmapPartitionLock(eid, bitmapno);
+
+		for (;;)
+		{
+			bool		migrated;
+			TransactionId owner = InvalidTransactionId;
+
+			LWLockAcquire(bitmapLock, LW_SHARED);
+			migrated = getmigratebit(bitmap, eid);
+			if (!migrated && getlockbit(bitmap, eid))
+				owner = MigrateClaimOwner(bitmapno, eid);
+			LWLockRelease(bitmapLock);
+
+			if (migrated)
+			{
+				MigrateCheckSnapshotConflict(bitmapno, eid);
+				break;
+			}
+
+			if (!TransactionIdIsValid(owner))
+				ereport(ERROR,
+						(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+						 errmsg("could not serialize access due to concurrent update"),
+						 errdetail("A concurrent transaction released a tuple without migrating it."),
+						 errhint("The transaction might succeed if retried.")));
+
+			/* a claim of our own is published when we commit */
+			if (TransactionIdIsCurrentTransactionId(owner))
+				break;
+
+			MigrateWaitForClaim(bitmapno, eid, owner, NULL, NULL, XLTW_None,
+								WAIT_EVENT_MIGRATE_IN_PROGRESS);
+		}
+	}
+
+	pg_list_free(InProgLocalList1, false);
+	InProgLocalList1 = NIL;
+}
+
+/*
+ * Return the bitmap the running migration statement uses for tuples of
+ * relid, assigning one the first time a relation is read: the statement's
+ * own bitmap if it is still free, else one from the partition bitmaps.
+ * Returns -1 if the migration has been rolled back, so nothing is to be
+ * migrated any more.
+ *
+ * Bitmaps are never reassigned, so we remember the last few lookups, which
+ * covers a scan of one partition after another.
+ */
+#define MIGRATE_SCAN_CACHE_SIZE 4
+
+typedef struct MigrateScanCacheEnt
+{
+	Oid			relid;
+	int			parent;
+	int			bitmapno;
+} MigrateScanCacheEnt;
+
+static MigrateScanCacheEnt scanCache[MIGRATE_SCAN_CACHE_SIZE];
+static int	scanCacheNext = 0;
+
+static int
+MigrateScanCacheLookup(Oid relid, int parent)
+{
+	int			b;
+
+	for (b = 0; b < MIGRATE_SCAN_CACHE_SIZE; b++)
+	{
+		if (scanCache[b].relid == relid && scanCache[b].parent == parent &&
+			OidIsValid(relid))
+			return scanCache[b].bitmapno;
+	}
+	return -1;
+}
+
+static void
+MigrateScanCacheRemember(Oid relid, int parent, int bitmapno)
+{
+	scanCache[scanCacheNext].relid = relid;
+	scanCache[scanCacheNext].parent = parent;
+	scanCache[scanCacheNext].bitmapno = bitmapno;
+	scanCacheNext = (scanCacheNext + 1) % MIGRATE_SCAN_CACHE_SIZE;
+}
+
+int
+MigrateScanBitmap(Oid relid)
+{
+	int			parent = BitmapNum;
+	int			bitmapno;
+	int			b;
+
+	if (parent < NUM_MIGRATIONS && MigrateShared->reversed[parent])
+		return -1;
+
+	bitmapno = MigrateScanCacheLookup(relid, parent);
+	if (bitmapno >= 0)
+		return bitmapno;
+
+	SpinLockAcquire(&MigrateShared->mutex);
+	if (!OidIsValid(MigrateShared->bitmaprelid[parent]) ||
+		MigrateShared->bitmaprelid[parent] == relid)
+		bitmapno = parent;
+	for (b = MIGRATE_FIRST_PARTITION_BITMAP;
+		 bitmapno < 0 && b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		if (MigrateShared->owner[b] == parent &&
+			MigrateShared->bitmaprelid[b] == relid)
+			bitmapno = b;
+	}
+	for (b = MIGRATE_FIRST_PARTITION_BITMAP;
+		 bitmapno < 0 && b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		if (MigrateShared->owner[b] < 0)
+		{
+			MigrateShared->owner[b] = parent;
+			bitmapno = b;
+		}
+	}
+	if (bitmapno >= 0 && !OidIsValid(MigrateShared->bitmaprelid[bitmapno]))
+	{
+		MigrateShared->bitmaprelid[bitmapno] = relid;
+		MigrateShared->srcrelid[bitmapno] = relid;
+	}
+	SpinLockRelease(&MigrateShared->mutex);
+
+	if (bitmapno < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("too many relations are being migrated"),
+				 errdetail("Migrations can read at most %d relations besides their first.",
+						   NUM_MIGRATE_PARTITION_BITMAPS)));
+
+	MigrateScanCacheRemember(relid, parent, bitmapno);
+
+	return bitmapno;
+}
+
+/*
+ * Like MigrateScanBitmap, but only look: returns -1 as well if the running
+ * migration statement hasn't been assigned a bitmap for relid yet.  Used by
+ * the checks the scans make ahead of MigrateTuple, which must not assign
+ * bitmaps to relations the statement merely reads.
+ */
+static int
+MigrateFindScanBitmap(Oid relid)
+{
+	int			parent = BitmapNum;
+	int			bitmapno;
+	int			b;
+
+	if (parent < NUM_MIGRATIONS && MigrateShared->reversed[parent])
+		return -1;
+
+	bitmapno = MigrateScanCacheLookup(relid, parent);
+	if (bitmapno >= 0)
+		return bitmapno;
+
+	SpinLockAcquire(&MigrateShared->mutex);
+	if (MigrateShared->bitmaprelid[parent] == relid)
+		bitmapno = parent;
+	for (b = MIGRATE_FIRST_PARTITION_BITMAP;
+		 bitmapno < 0 && b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		if (MigrateShared->owner[b] == parent &&
+			MigrateShared->bitmaprelid[b] == relid)
+			bitmapno = b;
+	}
+	SpinLockRelease(&MigrateShared->mutex);
+
+	if (bitmapno >= 0)
+		MigrateScanCacheRemember(relid, parent, bitmapno);
+
+	return bitmapno;
+}
+
+/*
+ * Has the running migration statement migrated as many tuples as it may in
+ * one transaction?  Only statements run outside a transaction block are
+ * split into batches; exec_execute_message commits each batch and runs the
+ * statement again for the rest.
+ */
+bool
+MigrateBatchIsFull(void)
+{
+	if (migrate_batch_size <= 0 || tuplemigratecount < migrate_batch_size ||
+		IsTransactionBlock())
+		return false;
+
+	migratebatchfull = true;
+	return true;
+}
+
+/*
+ * Has the running migration statement nothing left to migrate from relid?
+ * A relation it hasn't been assigned a bitmap for yet has everything left.
+ */
+bool
+MigrateScanFinished(Oid relid)
+{
+	int			parent = BitmapNum;
+	int			bitmapno;
+
+	if (parent < NUM_MIGRATIONS && MigrateShared->reversed[parent])
+		return true;
+
+	bitmapno = MigrateFindScanBitmap(relid);
+	return bitmapno >= 0 && MigrateShared->finished[bitmapno];
+}
+
+/*
+ * Does a block of rel hold elements the running migration statement has not
+ * migrated yet?  Slots that never held a tuple count too, as does any block
+ * past the end of the bitmap, and every block of a relation the statement
+ * has no bitmap for yet.  The bitmap is read without locks, which is good
+ * enough to decide whether to read the block ahead, or to skip it under
+ * READ COMMITTED (see heap_migrate_skippable).  Nothing is assigned here:
+ * the scans ask before they have handed MigrateTuple a single tuple.
+ */
+bool
+MigrateBlockHasUnmigrated(Relation rel, BlockNumber blkno)
+{
+	int			bitmapno = MigrateFindScanBitmap(RelationGetRelid(rel));
+	uint64	   *bitmap;
+	uint32		first;
+	uint32		eid;
+
+	if (bitmapno < 0)
+		return true;
+	if (MigrateShared->finished[bitmapno])
+		return false;
+	if ((uint64) blkno * NUMTUPLESPERPAGE >= NUMTUPLES)
+		return true;
+
+	bitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+	first = blkno * NUMTUPLESPERPAGE;
+	for (eid = first; eid < first + NUMTUPLESPERPAGE && eid < NUMTUPLES; eid++)
+	{
+		if (!getmigratebit(bitmap, eid))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Return the bitmap covering a relation at or after "start", or -1.  The
+ * same relation may be the source of several migrations.
+ */
+static int
+MigrateSourceBitmap(Oid relid, int start)
+{
+	int			i;
+
+	for (i = start; i < NUM_MIGRATE_BITMAPS; i++)
+	{
+		if (MigrateShared->srcrelid[i] == relid)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Return a bitmap that has been assigned a relation at or after "start", or
+ * -1.  Unlike MigrateSourceBitmap this includes retired bitmaps, whose bits
+ * pg_migrate_reclaim still relies on.
+ */
+static int
+MigrateAssignedBitmap(Oid relid, int start)
+{
+	int			i;
+
+	for (i = start; i < NUM_MIGRATE_BITMAPS; i++)
+	{
+		if (MigrateShared->bitmaprelid[i] == relid)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Called by heap_update and heap_delete before a tuple is updated or
+ * deleted, so every writer is covered, whether it is the executor, COPY,
+ * logical replication apply or a two-way migration removing the source copy
+ * of a tuple it has claimed.
+ *
+ * Writers claim the old version the same way migrations do, so the two
+ * exclude each other: a writer waits for an in-progress migration of the
+ * tuple, and a migration that finds the tuple claimed by a writer waits for
+ * it and then sees the claim released rather than published.  A tuple that
+ * was already migrated lives in the new table now, so writing to its old
+ * version is a serialization failure.  The exception is pg_migrate_reclaim,
+ * which deletes old versions that every migration has migrated, and that
+ * no one else can write to for that reason.
+ */
+void
+MigrateClaimOldVersion(Relation rel, ItemPointer tid)
+{
+	Oid			relid = RelationGetRelid(rel);
+	uint32		eid;
+	int			b;
+
+	if (MigrateShared == NULL || MigrateReclaiming ||
+		MigrateSourceBitmap(relid, 0) < 0)
+		return;
+
+	eid = MigrateTupleEid(tid);
+	if (eid == InvalidMigrateEid)
+		return;
+
+	for (b = MigrateSourceBitmap(relid, 0); b >= 0;
+		 b = MigrateSourceBitmap(relid, b + 1))
+	{
+		uint64	   *bitmap = GlobalBitmap + b * BITMAPSIZE;
+		LWLock	   *bitmapLock = MigrateBitmapPartitionLock(eid, b);
+		TransactionId xid = GetTopTransactionId();
+
+		for (;;)
+		{
+			TransactionId owner;
+
+			LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+
+			if (getmigratebit(bitmap, eid))
+			{
+				LWLockRelease(bitmapLock);
+				ereport(ERROR,
+						(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+						 errmsg("could not serialize access due to concurrent migration"),
+						 errdetail("Tuple (%u,%u) of relation \"%s\" has been migrated to the new schema.",
+								   ItemPointerGetBlockNumber(tid),
+								   ItemPointerGetOffsetNumber(tid),
+								   RelationGetRelationName(rel))));
+			}
+
+			if (!getlockbit(bitmap, eid))
+			{
+				MigrateInsertClaim(b, eid, xid, MIGRATE_CLAIM_WRITE);
+				setlockbit(bitmap, eid);
+				LWLockRelease(bitmapLock);
+				break;
+			}
+
+			owner = MigrateClaimOwner(b, eid);
+			LWLockRelease(bitmapLock);
+
+			if (TransactionIdIsCurrentTransactionId(owner))
+				break;
+
+			MigrateWaitForClaim(b, eid, owner, rel, tid, XLTW_Update,
+								WAIT_EVENT_MIGRATE_WRITE);
+		}
+	}
+}
+
+/*
+ * Can a new tuple version be stored in a page of rel without falling outside
+ * the bitmaps of the migrations reading rel?  The tuple takes a free line
+ * pointer of the page, which may be an unused one further down but is never
+ * past the end of the line pointer array, so we check the slot just past the
+ * end.  Called with the buffer locked, possibly in a critical section.
+ */
+bool
+MigrateNewVersionFits(Relation rel, Buffer buffer)
+{
+	ItemPointerData tid;
+
+	if (MigrateShared == NULL ||
+		MigrateSourceBitmap(RelationGetRelid(rel), 0) < 0)
+		return true;
+
+	ItemPointerSet(&tid, BufferGetBlockNumber(buffer),
+				   OffsetNumberNext(PageGetMaxOffsetNumber(BufferGetPage(buffer))));
+	return MigrateTupleEid(&tid) != InvalidMigrateEid;
+}
+
+/*
+ * Called by heap_insert, heap_multi_insert and heap_update once they have
+ * locked the page a new tuple version goes to, before it is written.  A
+ * tuple the bitmap can't represent could be neither claimed nor migrated,
+ * so rather than store one we fail the statement while that is still
+ * harmless.
+ */
+void
+MigrateCheckNewVersion(Relation rel, Buffer buffer)
+{
+	if (!MigrateNewVersionFits(rel, buffer))
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("page %u of relation \"%s\" is outside the migration bitmap",
+						BufferGetBlockNumber(buffer),
+						RelationGetRelationName(rel)),
+				 errdetail("Migration bitmaps cover %d pages of %d tuples.",
+						   NUMPAGES, NUMTUPLESPERPAGE)));
+}
+
+/*
+ * Called by heap_insert, heap_multi_insert and heap_update after a new tuple
+ * version was stored.  Its slot may have held a since-pruned tuple whose bits
+ * are still set, and the new version must start out unmigrated.  That goes
+ * for retired bitmaps as well, so that pg_migrate_reclaim doesn't take the
+ * new version for a migrated one.
+ *
+ * MigrateCheckNewVersion has made sure the tuple fits the bitmaps of the
+ * migrations under way when it was stored.  If it doesn't, a migration must
+ * have started in between; the tuple is left untracked, and that migration
+ * fails when it reaches it (see MigrateTuple).
+ */
+void
+MigrateClaimNewVersion(Relation rel, ItemPointer tid)
+{
+	Oid			relid = RelationGetRelid(rel);
+	uint32		eid;
+	int			b;
+
+	if (MigrateShared == NULL || MigrateAssignedBitmap(relid, 0) < 0)
+		return;
+
+	eid = MigrateTupleEid(tid);
+	if (eid == InvalidMigrateEid)
+		return;
+
+	for (b = MigrateAssignedBitmap(relid, 0); b >= 0;
+		 b = MigrateAssignedBitmap(relid, b + 1))
+	{
+		uint64	   *bitmap = GlobalBitmap + b * BITMAPSIZE;
+		LWLock	   *bitmapLock = MigrateBitmapPartitionLock(eid, b);
+
+		LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+		resetlockbit(bitmap, eid);
+		resetmigratebit(bitmap, eid);
+		LWLockRelease(bitmapLock);
+
+		pg_atomic_fetch_add_u32(&MigrateShared->newVersions[b], 1);
+	}
+}
+
+/*
+ * Is the relation the source of a running migration, so that writers of its
+ * tuples have to claim them?
+ */
+bool
+MigrateRelationIsSource(Oid relid)
+{
+	return MigrateShared != NULL && MigrateSourceBitmap(relid, 0) >= 0;
+}
+
+/*
+ * Has the tuple at tid been migrated by every migration that has read its
+ * relation, finished or not?  False if no migration has read the relation,
+ * or the tuple lies outside the bitmaps.
+ */
+bool
+MigrateTupleIsMigrated(Relation rel, ItemPointer tid)
+{
+	Oid			relid = RelationGetRelid(rel);
+	uint32		eid;
+	bool		found = false;
+	int			b;
+
+	eid = MigrateTupleEid(tid);
+	if (eid == InvalidMigrateEid)
+		return false;
+
+	for (b = MigrateAssignedBitmap(relid, 0); b >= 0;
+		 b = MigrateAssignedBitmap(relid, b + 1))
+	{
+		uint64	   *bitmap = GlobalBitmap + b * BITMAPSIZE;
+		LWLock	   *bitmapLock = MigrateBitmapPartitionLock(eid, b);
+		bool		migrated;
+
+		LWLockAcquire(bitmapLock, LW_SHARED);
+		migrated = getmigratebit(bitmap, eid);
+		LWLockRelease(bitmapLock);
+
+		if (!migrated)
+			return false;
+		found = true;
+	}
+
+	return found;
+}
+
+/*
+ * The relation a bitmap has been assigned, or InvalidOid.
+ */
+Oid
+MigrateBitmapRelation(uint8 bitmapno)
+{
+	Oid			relid;
+
+	SpinLockAcquire(&MigrateShared->mutex);
+	relid = MigrateShared->bitmaprelid[bitmapno];
+	SpinLockRelease(&MigrateShared->mutex);
+
+	return relid;
+}
+
+/*
+ * How far has publishing got?  A snapshot taken after this returns sees the
+ * migrations of every element MigrateElementMigratedBefore accepts for it.
+ */
+uint32
+MigratePublishSeq(void)
+{
+	return pg_atomic_read_u32(&MigrateShared->publishSeq);
+}
+
+/*
+ * Was an element migrated, and published no later than seq?  Stamps are per
+ * bitmap word, so an element published earlier may be taken for a later one.
+ */
+bool
+MigrateElementMigratedBefore(uint8 bitmapno, uint32 eid, uint32 seq)
+{
+	uint64	   *bitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+	LWLock	   *bitmapLock = MigrateBitmapPartitionLock(eid, bitmapno);
+	bool		migrated;
+	uint32		stamp;
+
+	LWLockAcquire(bitmapLock, LW_SHARED);
+	migrated = getmigratebit(bitmap, eid);
+	stamp = MigrateShared->wordSeq[bitmapno * BITMAPSIZE + getwordid(eid)];
+	LWLockRelease(bitmapLock);
+
+	return migrated && (int32) (stamp - seq) <= 0;
+}
+
+/*
+ * Is the lock bit of an element set?  If so, *owner is set to the
+ * transaction holding it, or InvalidTransactionId if no claim is recorded.
+ */
+bool
+MigrateElementClaimant(uint8 bitmapno, uint32 eid, TransactionId *owner)
+{
+	uint64	   *bitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+	LWLock	   *bitmapLock = MigrateBitmapPartitionLock(eid, bitmapno);
+	bool		locked;
+
+	*owner = InvalidTransactionId;
+
+	LWLockAcquire(bitmapLock, LW_SHARED);
+	locked = getlockbit(bitmap, eid);
+	if (locked)
+	{
+		MigrateClaimTag tag;
+		MigrateClaimEnt *ent;
+
+		tag.eid = eid;
+		tag.bitmapno = bitmapno;
+		ent = (MigrateClaimEnt *)
+			hash_search_with_hash_value(MigrateClaimHash, &tag,
+										MigrateClaimHashCode(&tag),
+										HASH_FIND, NULL);
+		if (ent)
+			*owner = ent->owner;
+	}
+	LWLockRelease(bitmapLock);
+
+	return locked;
+}
+
+/*
+ * pg_migrate_reclaim
+ *		Release the pages of a migration source whose rows have all moved.
+ *
+ * A source still holds every row migrated out of it, costing disk space and
+ * scan time, both while the migrations are under way and after they are
+ * finalized if the source is kept.  For each page on which every live row
+ * has been migrated by every migration that read the table, delete those
+ * rows.  Old snapshots keep seeing them as usual; once no one can, VACUUM
+ * frees the space, marks the page for reuse and truncates empty pages at
+ * the end of the table.  A page with a row that was never migrated, such as
+ * one stored after the migration read the page, or with a row being
+ * inserted or deleted, is left alone, so that the pages freed are wholly
+ * empty.
+ *
+ * This works while the migrations are still running.  A migrate bit is only
+ * set once the migrating transaction has committed, so a snapshot that sees
+ * our deletions also sees the rows in the new table.  A snapshot that
+ * doesn't still sees the old rows, and a migration statement that reads
+ * them with it finds them migrated, as the bits stay set; they only go when
+ * VACUUM has removed the rows and a new tuple takes the slot (see
+ * MigrateClaimNewVersion).  The snapshot-based conflict checks of the
+ * migrations thus see the same bits as before.
+ *
+ * Writers never touch a migrated row, which is a serialization failure for
+ * them, so we delete the rows without claiming them (see
+ * MigrateClaimOldVersion).  The rows are deleted below the executor, so no
+ * triggers fire; the row in the new table carries on for it.  Returns the
+ * number of rows deleted.
+ */
+Datum
+pg_migrate_reclaim(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	Relation	rel;
+	AclResult	aclresult;
+	TransactionId oldestXmin;
+	BufferAccessStrategy bstrategy;
+	BlockNumber nblocks;
+	BlockNumber blkno;
+	ItemPointerData tids[MaxHeapTuplesPerPage];
+	int64		nreclaimed = 0;
+
+	rel = heap_open(relid, RowExclusiveLock);
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(rel))));
+
+	aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_DELETE);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, get_relkind_objtype(rel->rd_rel->relkind),
+					   RelationGetRelationName(rel));
+
+	if (MigrateAssignedBitmap(relid, 0) < 0)
+	{
+		heap_close(rel, NoLock);
+		PG_RETURN_INT64(0);
+	}
+
+	oldestXmin = GetOldestXmin(rel, PROCARRAY_FLAGS_VACUUM);
+	bstrategy = GetAccessStrategy(BAS_BULKREAD);
+	nblocks = RelationGetNumberOfBlocks(rel);
+
+	for (blkno = 0; blkno < nblocks; blkno++)
+	{
+		Buffer		buf;
+		Page		page;
+		OffsetNumber offnum;
+		OffsetNumber maxoff;
+		int			ntids = 0;
+		bool		reclaimable = true;
+		int			i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		buf = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL,
+								 bstrategy);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		maxoff = PageIsNew(page) ? InvalidOffsetNumber :
+			PageGetMaxOffsetNumber(page);
+
+		for (offnum = FirstOffsetNumber;
+			 offnum <= maxoff && reclaimable;
+			 offnum = OffsetNumberNext(offnum))
+		{
+			ItemId		lp = PageGetItemId(page, offnum);
+			HeapTupleData tuple;
+
+			if (!ItemIdIsNormal(lp))
+				continue;
+
+			tuple.t_data = (HeapTupleHeader) PageGetItem(page, lp);
+			tuple.t_len = ItemIdGetLength(lp);
+			tuple.t_tableOid = relid;
+			ItemPointerSet(&tuple.t_self, blkno, offnum);
+
+			switch (HeapTupleSatisfiesVacuum(&tuple, oldestXmin, buf))
+			{
+				case HEAPTUPLE_LIVE:
+					if (MigrateTupleIsMigrated(rel, &tuple.t_self))
+						tids[ntids++] = tuple.t_self;
+					else
+						reclaimable = false;
+					break;
+
+				case HEAPTUPLE_DEAD:
+				case HEAPTUPLE_RECENTLY_DEAD:
+					break;
+
+				default:
+					/* someone is still inserting or deleting it */
+					reclaimable = false;
+					break;
+			}
+		}
+
+		UnlockReleaseBuffer(buf);
+
+		if (!reclaimable)
+			continue;
+
+		for (i = 0; i < ntids; i++)
+		{
+			HeapUpdateFailureData hufd;
+			HTSU_Result result;
+
+			MigrateReclaiming = true;
+			PG_TRY();
+			{
+				result = heap_delete(rel, &tids[i], GetCurrentCommandId(true),
+									 InvalidSnapshot, true, &hufd, false);
+			}
+			PG_CATCH();
+			{
+				MigrateReclaiming = false;
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			MigrateReclaiming = false;
+
+			/* a row deleted since we looked is skipped */
+			if (result == HeapTupleMayBeUpdated)
+				nreclaimed++;
+		}
+	}
+
+	FreeAccessStrategy(bstrategy);
+	heap_close(rel, NoLock);
+
+	PG_RETURN_INT64(nreclaimed);
+}
+
+/*
+ * Is the migration of a bitmap complete?  Once it is, nothing is left for
+ * migration queries to claim, and MigrateTuple need not look at the bitmap.
+ */
+bool
+MigrateBitmapFinished(uint8 bitmapno)
+{
+	return MigrateShared->finished[bitmapno];
+}
+
+/*
+ * Stop using a bitmap.  MigrateTuple checks the finished flag first, so it
+ * must be set before srcrelid is cleared.
+ */
+static void
+MigrateRetireBitmap(int bitmapno)
+{
+	MigrateShared->finished[bitmapno] = true;
+	pg_write_barrier();
+	MigrateShared->srcrelid[bitmapno] = InvalidOid;
+}
+
+/*
+ * Are all the bitmaps of a migration that have been assigned finished?
+ */
+static bool
+MigrateMigrationFinished(int migration)
+{
+	int			b;
+
+	if (!MigrateShared->finished[migration])
+		return false;
+	for (b = MIGRATE_FIRST_PARTITION_BITMAP; b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		if (MigrateShared->owner[b] == migration &&
+			!MigrateShared->finished[b])
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Retire every bitmap of a migration.
+ */
+static void
+MigrateRetireMigration(int migration)
+{
+	int			b;
+
+	for (b = 0; b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		if (MigrateShared->owner[b] == migration &&
+			!MigrateShared->finished[b])
+			MigrateRetireBitmap(b);
+	}
+}
+
+/*
+ * Has every tuple of rel that is or may become visible been migrated by
+ * the bitmap's migration?  Dead and recently dead tuples don't count: no
+ * new snapshot sees them.  A tuple whose insertion is in progress always
+ * counts, and is unmigrated (MigrateClaimNewVersion cleared its bits), as
+ * is any tuple that doesn't fit in the bitmap.
+ */
+static bool
+MigrateSourceIsMigrated(Relation rel, uint8 bitmapno)
+{
+	uint64	   *bitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+	TransactionId OldestXmin;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	bool		complete = true;
+
+	OldestXmin = GetOldestXmin(rel, PROCARRAY_FLAGS_VACUUM);
+	scan = heap_beginscan_strat(rel, SnapshotAny, 0, NULL, true, false);
+
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		HTSV_Result status;
+		uint32		eid;
+		LWLock	   *bitmapLock;
+		bool		migrated;
+
+		CHECK_FOR_INTERRUPTS();
+
+		LockBuffer(scan->rs_cbuf, BUFFER_LOCK_SHARE);
+		status = HeapTupleSatisfiesVacuum(tuple, OldestXmin, scan->rs_cbuf);
+		LockBuffer(scan->rs_cbuf, BUFFER_LOCK_UNLOCK);
+
+		if (status == HEAPTUPLE_DEAD || status == HEAPTUPLE_RECENTLY_DEAD)
+			continue;
+
+		eid = MigrateTupleEid(&tuple->t_self);
+		if (eid == InvalidMigrateEid)
+		{
+			complete = false;
+			break;
+		}
+
+		bitmapLock = MigrateBitmapPartitionLock(eid, bitmapno);
+		LWLockAcquire(bitmapLock, LW_SHARED);
+		migrated = getmigratebit(bitmap, eid);
+		LWLockRelease(bitmapLock);
+
+		if (!migrated)
+		{
+			complete = false;
+			break;
+		}
+	}
+
+	heap_endscan(scan);
+
+	return complete;
+}
+
+/*
+ * pg_migrate_bitmaps
+ *		Show the migration bitmaps that have been assigned a relation.
+ *
+ * parent is the bitmap of the migration statement a partition bitmap
+ * serves, or the bitmap itself.
+ */
+Datum
+pg_migrate_bitmaps(PG_FUNCTION_ARGS)
+{
+#define PG_MIGRATE_BITMAPS_COLS 4
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	Oid			relids[NUM_MIGRATE_BITMAPS];
+	int			owners[NUM_MIGRATE_BITMAPS];
+	bool		finished[NUM_MIGRATE_BITMAPS];
+	int			b;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	SpinLockAcquire(&MigrateShared->mutex);
+	for (b = 0; b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		relids[b] = MigrateShared->bitmaprelid[b];
+		owners[b] = MigrateShared->owner[b];
+		finished[b] = MigrateShared->finished[b];
+	}
+	SpinLockRelease(&MigrateShared->mutex);
+
+	for (b = 0; b < NUM_MIGRATE_BITMAPS; b++)
+	{
+		Datum		values[PG_MIGRATE_BITMAPS_COLS];
+		bool		nulls[PG_MIGRATE_BITMAPS_COLS];
+
+		if (!OidIsValid(relids[b]))
+			continue;
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(b);
+		values[1] = Int32GetDatum(owners[b]);
+		values[2] = ObjectIdGetDatum(relids[b]);
+		values[3] = BoolGetDatum(finished[b]);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * pg_migrate_finalize
+ *		Retire a migration whose every tuple has been migrated.
+ *
+ * Until then, writers to the source claim each tuple they touch in the
+ * bitmap and migration queries probe it for every row they scan.  We scan
+ * the source without blocking anyone and give up on the first tuple still
+ * to migrate.  If there is none, we take ExclusiveLock on the source, which
+ * waits out the writers in progress and keeps new ones away until we
+ * commit, and make sure no tuple version was stored in the meantime.  The
+ * bitmap is retired when we commit: writers to the source stop claiming
+ * tuples, and migration queries against the bitmap find nothing to migrate
+ * without looking at it.  If drop_source is true, the source is dropped as
+ * well.
+ *
+ * Finishing every bitmap of a two-way migration also retires its reverse
+ * bitmap, so it can no longer be rolled back.  After a rollback, the reverse
+ * bitmap can be finalized like any other once every row has moved back.
+ *
+ * The bitmap stays in shared memory, which can't be given back, until the
+ * server restarts.  Returns whether the migration is finished.
+ */
+Datum
+pg_migrate_finalize(PG_FUNCTION_ARGS)
+{
+	int32		bitmapno = PG_GETARG_INT32(0);
+	bool		drop_source = PG_GETARG_BOOL(1);
+	Oid			relid;
+	Relation	rel;
+	uint32		nversions;
+	bool		complete;
+
+	if (bitmapno < 0 || bitmapno >= NUM_MIGRATE_BITMAPS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("migration bitmap %d does not exist", bitmapno)));
+
+	/*
+	 * Only the owner of the relation a bitmap covers may finalize it, whatever
+	 * state it is in.  A bitmap that hasn't been assigned a relation yet, or
+	 * whose relation is gone, has nothing to finalize.
+	 */
+	relid = MigrateBitmapRelation(bitmapno);
+	if (OidIsValid(relid) &&
+		SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relid)) &&
+		!pg_class_ownercheck(relid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE, get_rel_name(relid));
+
+	if (MigrateShared->finished[bitmapno] ||
+		(pendingFinishMask & (1 << bitmapno)) != 0 ||
+		(MigrateShared->owner[bitmapno] >= 0 &&
+		 (pendingRollbackMask & (1 << MigrateShared->owner[bitmapno])) != 0))
+		PG_RETURN_BOOL(true);
+
+	/* a reverse bitmap is only in use once its migration is rolled back */
+	if (MigrateIsReverseBitmap(bitmapno) &&
+		!MigrateShared->reversed[bitmapno - NUM_MIGRATIONS])
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d has not been rolled back",
+						bitmapno - NUM_MIGRATIONS)));
+
+	/* nothing has been migrated yet, so we don't even know the source */
+	relid = MigrateShared->srcrelid[bitmapno];
+	if (!OidIsValid(relid))
+		PG_RETURN_BOOL(false);
+
+	rel = try_relation_open(relid, AccessShareLock);
+	if (rel == NULL)
+		PG_RETURN_BOOL(false);
+
+	nversions = pg_atomic_read_u32(&MigrateShared->newVersions[bitmapno]);
+	pg_memory_barrier();
+
+	complete = MigrateSourceIsMigrated(rel, bitmapno);
+	if (complete)
+	{
+		/*
+		 * A writer that stored a version after we read the counter bumps it
+		 * before it commits, so we see that once we have the lock.
+		 */
+		LockRelationOid(relid, ExclusiveLock);
+		pg_memory_barrier();
+		if (pg_atomic_read_u32(&MigrateShared->newVersions[bitmapno]) !=
+			nversions)
+			complete = false;
+	}
+
+	if (complete && drop_source)
+	{
+		ObjectAddress object;
+		int			b;
+
+		for (b = MigrateSourceBitmap(relid, 0); b >= 0;
+			 b = MigrateSourceBitmap(relid, b + 1))
+		{
+			if (b != bitmapno && (pendingFinishMask & (1 << b)) == 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_OBJECT_IN_USE),
+						 errmsg("cannot drop table \"%s\" because another migration is still reading it",
+								RelationGetRelationName(rel))));
+		}
+
+		heap_close(rel, NoLock);
+		rel = NULL;
+
+		ObjectAddressSet(object, RelationRelationId, relid);
+		performDeletion(&object, DROP_RESTRICT, 0);
+	}
+
+	if (rel != NULL)
+		heap_close(rel, NoLock);
+
+	if (complete)
+	{
+		pendingFinishMask |= 1 << bitmapno;
+		pendingNestLevel[bitmapno] = GetCurrentTransactionNestLevel();
+	}
+
+	PG_RETURN_BOOL(complete);
+}
+
+/*
+ * Does migrating a tuple through this bitmap move it, deleting it from the
+ * source?  That is the case for both directions of a two-way migration, so
+ * that rolling it back never has to reconcile two copies of a row.
+ */
+bool
+MigrateBitmapMoves(uint8 bitmapno)
+{
+	int			owner = MigrateShared->owner[bitmapno];
+
+	if (MigrateIsReverseBitmap(owner))
+		return true;
+	return MigrateShared->twoWay[owner];
+}
+
+/*
+ * Delete the source copy of a tuple we have just claimed for a two-way
+ * migration.  Writers claim a tuple before they touch it, so only a writer
+ * that committed before our claim can have got there first.
+ */
+void
+MigrateRemoveSourceTuple(HeapTuple tuple)
+{
+	Relation	rel;
+	HTSU_Result result;
+	HeapUpdateFailureData hufd;
+
+	rel = heap_open(tuple->t_tableOid, RowExclusiveLock);
+
+	result = heap_delete(rel, &tuple->t_self, GetCurrentCommandId(true),
+						 InvalidSnapshot, true, &hufd, false);
+	switch (result)
+	{
+		case HeapTupleMayBeUpdated:
+			break;
+
+		case HeapTupleUpdated:
+			ereport(ERROR,
+					(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+					 errmsg("could not serialize access due to concurrent update")));
+			break;
+
+		default:
+			elog(ERROR, "unexpected heap_delete status while migrating tuple (%u,%u): %u",
+				 ItemPointerGetBlockNumber(&tuple->t_self),
+				 ItemPointerGetOffsetNumber(&tuple->t_self), result);
+			break;
+	}
+
+	heap_close(rel, NoLock);
+}
+
+/*
+ * If query_string is the reverse statement of a rolled-back migration,
+ * return the migration's reverse bitmap, else -1.
+ */
+int
+MigrateReverseStatement(const char *query_string)
+{
+	int			b;
+
+	for (b = 0; b < NUM_MIGRATIONS; b++)
+	{
+		const char *prefix;
+
+		if (!MigrateShared->reversed[b])
+			continue;
+		pg_read_barrier();
+
+		prefix = MigrateShared->reversePrefix[b];
+		if (strncmp(query_string, prefix, strlen(prefix)) == 0)
+			return MigrateReverseBitmap(b);
+	}
+
+	return -1;
+}
+
+/*
+ * pg_migrate_enable_reverse
+ *		Make a migration two-way, so that it can be rolled back.
+ *
+ * A two-way migration moves rows to the target, deleting them from the
+ * source, and tracks the rows of the target in its reverse bitmap.  Rows
+ * the application writes to the target start out unmigrated there like any
+ * new tuple version, and writers claim them as they do in the source.
+ * reverse_prefix is the start of the text of the statement that maps target
+ * rows back to the old layout, the counterpart of the migration statements
+ * recognized when a statement is bound.  It has to be an INSERT into the
+ * source that reads from the target.  The reverse bitmap has the same shape
+ * as the others, so the target's tuples must fit NUMPAGES and
+ * NUMTUPLESPERPAGE as well.
+ *
+ * This has to be done before anything is migrated, and takes effect at
+ * once, whether or not our transaction commits.
+ */
+Datum
+pg_migrate_enable_reverse(PG_FUNCTION_ARGS)
+{
+	int32		migration = PG_GETARG_INT32(0);
+	Oid			targetid = PG_GETARG_OID(1);
+	char	   *prefix = text_to_cstring(PG_GETARG_TEXT_PP(2));
+	Relation	rel;
+	bool		started;
+
+	if (migration < 0 || migration >= NUM_MIGRATIONS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("migration %d does not exist", migration)));
+
+	if (prefix[0] == '\0' || strlen(prefix) >= MIGRATE_PREFIX_LEN)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("reverse statement prefix must be between 1 and %d bytes long",
+						MIGRATE_PREFIX_LEN - 1)));
+
+	rel = heap_open(targetid, ShareUpdateExclusiveLock);
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(rel))));
+
+	if (!pg_class_ownercheck(targetid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER,
+					   get_relkind_objtype(rel->rd_rel->relkind),
+					   RelationGetRelationName(rel));
+
+	/*
+	 * A migration is assigned its source, under the same lock, before it
+	 * claims anything.
+	 */
+	SpinLockAcquire(&MigrateShared->mutex);
+	started = MigrateShared->twoWay[migration] ||
+		OidIsValid(MigrateShared->bitmaprelid[migration]);
+	if (!started)
+	{
+		int			rev = MigrateReverseBitmap(migration);
+
+		MigrateShared->twoWay[migration] = true;
+		strlcpy(MigrateShared->reversePrefix[migration], prefix,
+				MIGRATE_PREFIX_LEN);
+		MigrateShared->bitmaprelid[rev] = targetid;
+		MigrateShared->srcrelid[rev] = targetid;
+	}
+	SpinLockRelease(&MigrateShared->mutex);
+
+	if (started)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d has already started", migration)));
+
+	heap_close(rel, NoLock);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * pg_migrate_rollback
+ *		Reverse a two-way migration.
+ *
+ * The rows migrated so far live only in the target, and the rest only in
+ * the source, so there is nothing to copy.  We take ExclusiveLock on the
+ * target, which waits out the migrations and writers in progress there, and
+ * at commit retire the forward bitmap and start recognizing the reverse
+ * statement.  From then on the application issues that statement instead
+ * of the migration statements, and the target's rows move back lazily and
+ * exactly once, under the reverse bitmap.
+ */
+Datum
+pg_migrate_rollback(PG_FUNCTION_ARGS)
+{
+	int32		migration = PG_GETARG_INT32(0);
+	Oid			targetid;
+
+	if (migration < 0 || migration >= NUM_MIGRATIONS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("migration %d does not exist", migration)));
+
+	if (!MigrateShared->twoWay[migration])
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d is not two-way", migration),
+				 errhint("Use pg_migrate_enable_reverse() before the migration starts.")));
+
+	/* finishing the migration retires the reverse bitmap */
+	targetid = MigrateShared->srcrelid[MigrateReverseBitmap(migration)];
+	if (!OidIsValid(targetid))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d has already finished", migration)));
+
+	if (!pg_class_ownercheck(targetid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   get_rel_name(targetid));
+
+	LockRelationOid(targetid, ExclusiveLock);
+
+	if (MigrateShared->reversed[migration] ||
+		(pendingRollbackMask & (1 << migration)) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d has already been rolled back", migration)));
+	if (MigrateShared->finished[migration] ||
+		(pendingFinishMask & (1 << migration)) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d has already finished", migration)));
+
+	pendingRollbackMask |= 1 << migration;
+	pendingNestLevel[migration] = GetCurrentTransactionNestLevel();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Remember how far publishing had got when the transaction snapshot was
+ * taken; see MigrateCheckSnapshotConflict.  Called before the snapshot is
+ * computed, so a publish racing with it is counted as concurrent.
+ */
+void
+MigrateNoteXactSnapshot(void)
+{
+	if (MigrateShared == NULL)
+		return;
+
+	MigrateXactSnapshotSeq = pg_atomic_read_u32(&MigrateShared->publishSeq);
+	MigrateXactSnapshotSeqValid = true;
+}
+
+/*
+ * AtPrepare_MigrateSchema
+ *		Claims are tied to our backend, so they can't survive PREPARE.
+ */
+void
+AtPrepare_MigrateSchema(void)
+{
+	/* waiters can run their statements themselves from here on */
+	MigrateReleaseStatements();
+
+	if (numLocalClaims > 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot PREPARE a transaction that has migrated tuples")));
+	if (pendingFinishMask != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot PREPARE a transaction that has finalized a migration")));
+	if (pendingRollbackMask != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot PREPARE a transaction that has rolled back a migration")));
+}
+
+/*
+ * AtEOXact_MigrateSchema
+ *		Publish or release our claims at end of transaction.
+ *
+ * This runs after we've been removed from the ProcArray but before our
+ * transaction lock is released, so waiters that wake up find the final
+ * state, and a snapshot that sees our inserts into the new table also sees
+ * either the migrate bit or our lock bit.  It replaces the old arrangement
+ * where the migrate bits were set at end of statement, before commit, and
+ * only a serialization failure released the lock bits.
+ */
+void
+AtEOXact_MigrateSchema(bool isCommit)
+{
+	uint32		seq = 0;
+	int			i;
+
+	MigrateReleaseStatements();
+
+	if (numLocalClaims > 0)
+	{
+		if (isCommit)
+			seq = pg_atomic_add_fetch_u32(&MigrateShared->publishSeq, 1);
+
+		MigrateReleaseAllClaims(isCommit, seq);
+	}
+
+	/*
+	 * Retire the bitmaps we finalized, and reverse the migrations we rolled
+	 * back.  Writers are still blocked by our locks, and find the new state
+	 * once they get them.
+	 */
+	if ((pendingFinishMask | pendingRollbackMask) != 0)
+	{
+		if (isCommit)
+		{
+			for (i = 0; i < NUM_MIGRATE_BITMAPS; i++)
+			{
+				if ((pendingFinishMask & (1 << i)) != 0)
+					MigrateRetireBitmap(i);
+			}
+
+			for (i = 0; i < NUM_MIGRATIONS; i++)
+			{
+				if ((pendingRollbackMask & (1 << i)) != 0)
+				{
+					MigrateShared->reversed[i] = true;
+					MigrateRetireMigration(i);
+				}
+				else if (MigrateShared->twoWay[i] &&
+						 !MigrateShared->reversed[i] &&
+						 MigrateMigrationFinished(i))
+					MigrateRetireBitmap(MigrateReverseBitmap(i));
+			}
+		}
+		pendingFinishMask = 0;
+		pendingRollbackMask = 0;
+	}
+
+	if (InProgLocalList1 != NIL)
+	{
+		pg_list_free(InProgLocalList1, false);
+		InProgLocalList1 = NIL;
+	}
+	tuplemigratecount = 0;
+	migrateflag = false;
+	migratebatchfull = false;
+	MigrateXactSnapshotSeqValid = false;
+}
+
+/*
+ * AtEOSubXact_MigrateSchema
+ *		Hand our claims to the parent on subcommit, release them on subabort.
+ *
+ * Claims are appended in nesting order, so those made by the ending
+ * subtransaction and its children are always at the end of the list.
+ * Finalizations and rollbacks are handled alike; an aborted one gave up its
+ * locks, so it can't stand.
+ */
+void
+AtEOSubXact_MigrateSchema(bool isCommit, int nestDepth)
+{
+	int			i;
+
+	for (i = 0; i < NUM_MIGRATE_BITMAPS; i++)
+	{
+		if (((pendingFinishMask | pendingRollbackMask) & (1 << i)) == 0 ||
+			pendingNestLevel[i] < nestDepth)
+			continue;
+		if (isCommit)
+			pendingNestLevel[i] = nestDepth - 1;
+		else
+		{
+			pendingFinishMask &= ~(1 << i);
+			pendingRollbackMask &= ~(1 << i);
+		}
+	}
+
+	if (isCommit)
+	{
+		for (i = numLocalClaims - 1;
+			 i >= 0 && localClaims[i].nestLevel >= nestDepth; i--)
+			localClaims[i].nestLevel = nestDepth - 1;
+		return;
+	}
+
+	while (numLocalClaims > 0 &&
+		   localClaims[numLocalClaims - 1].nestLevel >= nestDepth)
+	{
+		MigrateReleaseClaim(&localClaims[numLocalClaims - 1], false, 0);
+		numLocalClaims--;
 	}
 }
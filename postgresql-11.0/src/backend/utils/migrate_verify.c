@@ -0,0 +1,491 @@
+/*-------------------------------------------------------------------------
+ *
+ * migrate_verify.c
+ *	  Verification that a lazy migration moved every row exactly once.
+ *
+ * pg_migrate_verify checks a migration bitmap, its source and the target of
+ * the migration against each other, in the manner of amcheck's
+ * heapallindexed check.  Each table is read by an ordinary query, which the
+ * planner is free to run as a parallel sequential scan, and nothing stronger
+ * than AccessShareLock is taken, so the check can run alongside the
+ * workload.  Rows are matched by the key columns the caller names.
+ *
+ * The keys of the target are summarized in a Bloom filter.  A source row
+ * whose migrate bit is set but whose key the filter lacks is missing from the
+ * target.  The filter has false positives, so a small fraction of missing
+ * rows can go unreported.  A key the filter seems to hold already when it is
+ * added is a candidate duplicate, and if there are any, a second scan of the
+ * target counts the candidates exactly.  Lock bits held by no running
+ * transaction are orphaned: nobody is going to migrate those rows, and
+ * migration queries that run into them wait forever.
+ *
+ *
+ * Portions Copyright (c) 2020, UMD Database Group
+ *
+ * src/backend/utils/migrate_verify.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/transam.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "funcapi.h"
+#include "lib/bloomfilter.h"
+#include "miscadmin.h"
+#include "storage/procarray.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/migrate_schema.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+
+
+#define PG_MIGRATE_VERIFY_COLS 4
+
+typedef enum MigrateVerifyPass
+{
+	VERIFY_TARGET_KEYS,			/* fingerprint the keys of the target */
+	VERIFY_TARGET_DUPLICATES,	/* count the candidate duplicates */
+	VERIFY_SOURCE				/* look for migrated rows the target lacks */
+} MigrateVerifyPass;
+
+/*
+ * A key of the target that may occur more than once.  Keys are entered by
+ * their 64-bit hash, and compared in full when counted.
+ */
+typedef struct MigrateVerifyKey
+{
+	uint64		hash;			/* hash key; must be first */
+	char	   *key;
+	List	   *tids;			/* where the key occurs in the target */
+} MigrateVerifyKey;
+
+/* a lock bit that looked orphaned when we first saw it */
+typedef struct MigrateVerifyLock
+{
+	uint32		eid;
+	TransactionId owner;
+} MigrateVerifyLock;
+
+/*
+ * The queries deliver their rows, a tid and a key, straight to this
+ * receiver, so no result is ever materialized.
+ */
+typedef struct MigrateVerifyState
+{
+	DestReceiver pub;			/* publicly-known function pointers */
+	MigrateVerifyPass pass;
+	uint8		bitmapno;
+	uint32		publishSeq;		/* publishing as of our snapshot */
+	Oid			sourceid;
+	bloom_filter *filter;
+	HTAB	   *candidates;
+	MemoryContext cxt;			/* for what outlives a row */
+	MemoryContext rowcxt;		/* reset after every row */
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+} MigrateVerifyState;
+
+
+/*
+ * Add a problem to the result.
+ */
+static void
+migrate_verify_report(MigrateVerifyState *state, const char *problem,
+					  Oid relid, ItemPointer tid, const char *key)
+{
+	Datum		values[PG_MIGRATE_VERIFY_COLS];
+	bool		nulls[PG_MIGRATE_VERIFY_COLS];
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = CStringGetTextDatum(problem);
+	values[1] = ObjectIdGetDatum(relid);
+	values[2] = PointerGetDatum(tid);
+	if (key != NULL)
+		values[3] = CStringGetTextDatum(key);
+	else
+		nulls[3] = true;
+
+	tuplestore_putvalues(state->tupstore, state->tupdesc, values, nulls);
+}
+
+static bool
+migrate_verify_receive(TupleTableSlot *slot, DestReceiver *self)
+{
+	MigrateVerifyState *state = (MigrateVerifyState *) self;
+	MemoryContext oldcontext;
+	ItemPointer tid;
+	text	   *key;
+	unsigned char *keydata;
+	int			keylen;
+	uint64		hash;
+	MigrateVerifyKey *entry;
+	bool		found;
+
+	slot_getallattrs(slot);
+	if (slot->tts_isnull[0] || slot->tts_isnull[1])
+		return true;
+
+	oldcontext = MemoryContextSwitchTo(state->rowcxt);
+
+	tid = (ItemPointer) DatumGetPointer(slot->tts_values[0]);
+	key = DatumGetTextPP(slot->tts_values[1]);
+	keydata = (unsigned char *) VARDATA_ANY(key);
+	keylen = VARSIZE_ANY_EXHDR(key);
+
+	switch (state->pass)
+	{
+		case VERIFY_TARGET_KEYS:
+			if (bloom_lacks_element(state->filter, keydata, keylen))
+			{
+				bloom_add_element(state->filter, keydata, keylen);
+				break;
+			}
+			hash = DatumGetUInt64(hash_any_extended(keydata, keylen, 0));
+			entry = (MigrateVerifyKey *)
+				hash_search(state->candidates, &hash, HASH_ENTER, &found);
+			if (!found)
+			{
+				entry->key = MemoryContextStrdup(state->cxt,
+												 text_to_cstring(key));
+				entry->tids = NIL;
+			}
+			break;
+
+		case VERIFY_TARGET_DUPLICATES:
+			hash = DatumGetUInt64(hash_any_extended(keydata, keylen, 0));
+			entry = (MigrateVerifyKey *)
+				hash_search(state->candidates, &hash, HASH_FIND, NULL);
+			if (entry != NULL && strlen(entry->key) == keylen &&
+				memcmp(entry->key, keydata, keylen) == 0)
+			{
+				ItemPointer copy;
+
+				MemoryContextSwitchTo(state->cxt);
+				copy = (ItemPointer) palloc(sizeof(ItemPointerData));
+				ItemPointerCopy(tid, copy);
+				entry->tids = lappend(entry->tids, copy);
+			}
+			break;
+
+		case VERIFY_SOURCE:
+			{
+				uint32		eid = MigrateTupleEid(tid);
+
+				if (eid != InvalidMigrateEid &&
+					MigrateElementMigratedBefore(state->bitmapno, eid,
+												 state->publishSeq) &&
+					bloom_lacks_element(state->filter, keydata, keylen))
+					migrate_verify_report(state, "missing", state->sourceid,
+										  tid, text_to_cstring(key));
+			}
+			break;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextReset(state->rowcxt);
+
+	return true;
+}
+
+static void
+migrate_verify_startup(DestReceiver *self, int operation, TupleDesc typeinfo)
+{
+	/* do nothing */
+}
+
+static void
+migrate_verify_shutdown(DestReceiver *self)
+{
+	/* do nothing */
+}
+
+static void
+migrate_verify_destroy(DestReceiver *self)
+{
+	/* the state belongs to pg_migrate_verify */
+}
+
+/*
+ * Plan and run one of our queries, handing its rows to the receiver.
+ */
+static void
+migrate_verify_run(MigrateVerifyState *state, MigrateVerifyPass pass,
+				   const char *sql)
+{
+	RawStmt    *parsetree;
+	List	   *querytrees;
+	PlannedStmt *plan;
+	QueryDesc  *queryDesc;
+
+	state->pass = pass;
+
+	parsetree = linitial_node(RawStmt, pg_parse_query(sql));
+	querytrees = pg_analyze_and_rewrite(parsetree, sql, NULL, 0, NULL);
+	plan = pg_plan_query(linitial_node(Query, querytrees),
+						 CURSOR_OPT_PARALLEL_OK, NULL);
+
+	queryDesc = CreateQueryDesc(plan, sql, GetActiveSnapshot(),
+								InvalidSnapshot, &state->pub, NULL, NULL, 0);
+	ExecutorStart(queryDesc, 0);
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L, true);
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+	FreeQueryDesc(queryDesc);
+}
+
+/*
+ * Schema-qualified and quoted name of a relation, for our queries.
+ */
+static char *
+migrate_verify_relname(Oid relid)
+{
+	char	   *relname = get_rel_name(relid);
+
+	if (relname == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_TABLE),
+				 errmsg("relation with OID %u does not exist", relid)));
+
+	return quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+									  relname);
+}
+
+/*
+ * Collect the lock bits of a bitmap whose owner isn't running.  The owner
+ * may only just have ended and be about to release them, so they are looked
+ * at again once the scans are done.
+ */
+static List *
+migrate_verify_find_locks(uint8 bitmapno)
+{
+	uint64	   *bitmap = GlobalBitmap + bitmapno * BITMAPSIZE;
+	List	   *locks = NIL;
+	uint32		eid;
+
+	for (eid = 0; eid < NUMTUPLES; eid++)
+	{
+		TransactionId owner;
+
+		if ((eid & 32767) == 0)
+			CHECK_FOR_INTERRUPTS();
+
+		if (!getlockbit(bitmap, eid))
+			continue;
+
+		if (MigrateElementClaimant(bitmapno, eid, &owner) &&
+			(!TransactionIdIsValid(owner) ||
+			 !TransactionIdIsInProgress(owner)))
+		{
+			MigrateVerifyLock *lock = palloc(sizeof(MigrateVerifyLock));
+
+			lock->eid = eid;
+			lock->owner = owner;
+			locks = lappend(locks, lock);
+		}
+	}
+
+	return locks;
+}
+
+/*
+ * pg_migrate_verify
+ *		Check that a migration moved every row of its source exactly once.
+ *
+ * bitmap is a migration bitmap as shown by pg_migrate_bitmaps, target the
+ * table its rows are migrated to, and key_columns the columns, present in
+ * both tables, that identify a row.  Returns a row for each problem found:
+ *
+ *	duplicated		a row of the target whose key occurs more than once
+ *	missing			a migrated row of the source whose key the target lacks
+ *	orphaned lock	an element of the source locked by no running transaction
+ *
+ * Both tables are read with one fresh snapshot.  Rows whose migration was
+ * published after it was taken are skipped.  Rows deleted from the target,
+ * or whose key was changed there, after they were migrated are reported as
+ * missing.
+ */
+Datum
+pg_migrate_verify(PG_FUNCTION_ARGS)
+{
+	int32		bitmapno = PG_GETARG_INT32(0);
+	Oid			targetid = PG_GETARG_OID(1);
+	ArrayType  *keycols = PG_GETARG_ARRAYTYPE_P(2);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MigrateVerifyState state;
+	TupleDesc	tupdesc;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	Datum	   *keynames;
+	bool	   *keynulls;
+	int			nkeys;
+	StringInfoData keyexpr;
+	StringInfoData sql;
+	char	   *targetname;
+	char	   *sourcename;
+	Relation	target;
+	int64		ntuples;
+	List	   *locks;
+	ListCell   *lc;
+	HASH_SEQ_STATUS status;
+	MigrateVerifyKey *entry;
+	HASHCTL		ctl;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (bitmapno < 0 || bitmapno >= NUM_MIGRATE_BITMAPS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("migration bitmap %d does not exist", bitmapno)));
+
+	state.sourceid = MigrateBitmapRelation(bitmapno);
+	if (!OidIsValid(state.sourceid))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration bitmap %d has not been assigned a relation",
+						bitmapno)));
+
+	deconstruct_array(keycols, TEXTOID, -1, false, 'i',
+					  &keynames, &keynulls, &nkeys);
+	if (nkeys == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("at least one key column must be given")));
+
+	initStringInfo(&keyexpr);
+	appendStringInfoString(&keyexpr, "ROW(");
+	for (i = 0; i < nkeys; i++)
+	{
+		if (keynulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("key column names must not be null")));
+		if (i > 0)
+			appendStringInfoString(&keyexpr, ", ");
+		appendStringInfoString(&keyexpr,
+							   quote_identifier(TextDatumGetCString(keynames[i])));
+	}
+	appendStringInfoString(&keyexpr, ")::text");
+
+	targetname = migrate_verify_relname(targetid);
+	sourcename = migrate_verify_relname(state.sourceid);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	state.tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = state.tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	state.pub.receiveSlot = migrate_verify_receive;
+	state.pub.rStartup = migrate_verify_startup;
+	state.pub.rShutdown = migrate_verify_shutdown;
+	state.pub.rDestroy = migrate_verify_destroy;
+	state.pub.mydest = DestNone;
+	state.bitmapno = (uint8) bitmapno;
+	state.tupdesc = tupdesc;
+	state.cxt = CurrentMemoryContext;
+	state.rowcxt = AllocSetContextCreate(CurrentMemoryContext,
+										 "migration verify row",
+										 ALLOCSET_DEFAULT_SIZES);
+
+	/* Size Bloom filter based on estimated number of tuples in target */
+	target = heap_open(targetid, AccessShareLock);
+	ntuples = (int64) target->rd_rel->reltuples;
+	heap_close(target, NoLock);
+	state.filter = bloom_create(ntuples, maintenance_work_mem, random());
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint64);
+	ctl.entrysize = sizeof(MigrateVerifyKey);
+	ctl.hcxt = CurrentMemoryContext;
+	state.candidates = hash_create("migration verify candidates", 256, &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	locks = migrate_verify_find_locks(state.bitmapno);
+
+	/*
+	 * Publishing is committed and visible in the procarray before it is
+	 * stamped, so a snapshot taken after we read the stamp sees the rows of
+	 * every element published by then.
+	 */
+	state.publishSeq = MigratePublishSeq();
+	PushActiveSnapshot(GetLatestSnapshot());
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "SELECT ctid, %s FROM %s",
+					 keyexpr.data, targetname);
+	migrate_verify_run(&state, VERIFY_TARGET_KEYS, sql.data);
+
+	if (hash_get_num_entries(state.candidates) > 0)
+		migrate_verify_run(&state, VERIFY_TARGET_DUPLICATES, sql.data);
+
+	resetStringInfo(&sql);
+	appendStringInfo(&sql, "SELECT ctid, %s FROM ONLY %s",
+					 keyexpr.data, sourcename);
+	migrate_verify_run(&state, VERIFY_SOURCE, sql.data);
+
+	PopActiveSnapshot();
+
+	hash_seq_init(&status, state.candidates);
+	while ((entry = (MigrateVerifyKey *) hash_seq_search(&status)) != NULL)
+	{
+		if (list_length(entry->tids) < 2)
+			continue;
+
+		foreach(lc, entry->tids)
+			migrate_verify_report(&state, "duplicated", targetid,
+								  (ItemPointer) lfirst(lc), entry->key);
+	}
+
+	foreach(lc, locks)
+	{
+		MigrateVerifyLock *lock = (MigrateVerifyLock *) lfirst(lc);
+		TransactionId owner;
+		ItemPointerData tid;
+
+		if (!MigrateElementClaimant(state.bitmapno, lock->eid, &owner) ||
+			owner != lock->owner ||
+			(TransactionIdIsValid(owner) && TransactionIdIsInProgress(owner)))
+			continue;
+
+		ItemPointerSet(&tid, lock->eid / NUMTUPLESPERPAGE,
+					   lock->eid % NUMTUPLESPERPAGE + 1);
+		migrate_verify_report(&state, "orphaned lock", state.sourceid,
+							  &tid, NULL);
+	}
+
+	bloom_free(state.filter);
+	hash_destroy(state.candidates);
+	MemoryContextDelete(state.rowcxt);
+
+	tuplestore_donestoring(state.tupstore);
+
+	return (Datum) 0;
+}
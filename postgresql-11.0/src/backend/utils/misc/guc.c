@@ -28,6 +28,7 @@
 
 #include "access/commit_ts.h"
 #include "access/gin.h"
+#include "access/rewritetrack.h"
 #include "access/rmgr.h"
 #include "access/transam.h"
 #include "access/twophase.h"
@@ -37,10 +38,12 @@
 #include "catalog/pg_authid.h"
 #include "commands/async.h"
 #include "commands/prepare.h"
+#include "commands/tablecmds.h"
 #include "commands/user.h"
 #include "commands/vacuum.h"
 #include "commands/variable.h"
 #include "commands/trigger.h"
+#include "executor/executor.h"
 #include "funcapi.h"
 #include "jit/jit.h"
 #include "libpq/auth.h"
@@ -81,6 +84,7 @@
 #include "utils/bytea.h"
 #include "utils/guc_tables.h"
 #include "utils/memutils.h"
+#include "utils/migrate_schema.h"
 #include "utils/pg_locale.h"
 #include "utils/plancache.h"
 #include "utils/portal.h"
@@ -420,6 +424,12 @@ static const struct config_enum_entry password_encryption_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry migrate_bitmap_layout_options[] = {
+	{"interleaved", MIGRATE_LAYOUT_INTERLEAVED, false},
+	{"split", MIGRATE_LAYOUT_SPLIT, false},
+	{NULL, 0, false}
+};
+
 /*
  * Options for enum values stored in other modules
  */
@@ -871,6 +881,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_incremental_sort", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of incremental sort steps."),
+			NULL
+		},
+		&enable_incremental_sort,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_hashagg", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of hashed aggregation plans."),
@@ -961,6 +980,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_parallel_hashagg", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of parallel hashed aggregation plans."),
+			NULL
+		},
+		&enable_parallel_hashagg,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_partition_pruning", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enable plan-time and run-time partition pruning."),
@@ -1485,6 +1513,26 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"lazy_alter_column_type", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Lets ALTER COLUMN TYPE convert existing rows when they are read."),
+			gettext_noop("Type changes through an implicit, immutable cast then "
+						 "do not rewrite the table.")
+		},
+		&lazy_alter_column_type,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"lazy_add_column", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Lets ADD COLUMN fill in a volatile default when existing rows are read."),
+			gettext_noop("Adding a column whose default is, for example, "
+						 "clock_timestamp() then does not rewrite the table.")
+		},
+		&lazy_add_column,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"array_nulls", PGC_USERSET, COMPAT_OPTIONS_PREVIOUS,
 			gettext_noop("Enable input of NULL elements in arrays."),
@@ -1887,6 +1935,15 @@ static struct config_int ConfigureNamesInt[] =
 		8, 1, INT_MAX,
 		NULL, NULL, NULL
 	},
+	{
+		{"executor_batch_size", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the number of tuples plan nodes pass to each other at once, where they can."),
+			gettext_noop("Zero passes tuples one at a time.")
+		},
+		&executor_batch_size,
+		0, 0, 1000,
+		NULL, NULL, NULL
+	},
 	{
 		{"geqo_threshold", PGC_USERSET, QUERY_TUNING_GEQO,
 			gettext_noop("Sets the threshold of FROM items beyond which GEQO is used."),
@@ -2227,6 +2284,18 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"online_rewrite_tracked_blocks", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the table size up to which an online table rewrite tracks each changed block."),
+			gettext_noop("Changes to larger tables are tracked less precisely, "
+						 "which makes the rewrite revisit more blocks."),
+			GUC_UNIT_BLOCKS
+		},
+		&online_rewrite_tracked_blocks,
+		1048576, 1024, INT_MAX / 2,
+		NULL, NULL, NULL
+	},
+
 #ifdef LOCK_DEBUG
 	{
 		{"trace_lock_oidmin", PGC_SUSET, DEVELOPER_OPTIONS,
@@ -2360,6 +2429,30 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_migrate_claims_per_transaction", PGC_POSTMASTER, LOCK_MANAGEMENT,
+			gettext_noop("Sets the maximum number of tuples claimed for migration per transaction."),
+			gettext_noop("The shared migration claim table is sized on the assumption that "
+						 "at most max_migrate_claims_per_transaction * max_connections "
+						 "tuples will be claimed at any one time.")
+		},
+		&max_migrate_claims_per_xact,
+		4096, 10, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"migrate_batch_size", PGC_USERSET, LOCK_MANAGEMENT,
+			gettext_noop("Sets the number of tuples a migration statement migrates per transaction."),
+			gettext_noop("A migration statement run outside a transaction block commits "
+						 "after this many tuples and carries on in a new transaction. "
+						 "Zero disables batching.")
+		},
+		&migrate_batch_size,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"max_pred_locks_per_relation", PGC_SIGHUP, LOCK_MANAGEMENT,
 			gettext_noop("Sets the maximum number of predicate-locked pages and tuples per relation."),
@@ -4151,6 +4244,17 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"migrate_bitmap_layout", PGC_POSTMASTER, LOCK_MANAGEMENT,
+			gettext_noop("Sets how the lock and migrate bits of migration bitmaps are laid out."),
+			gettext_noop("\"split\" keeps the lock bits, which every claim writes, "
+						 "on other cache lines than the migrate bits, which scans read.")
+		},
+		&migrate_bitmap_layout,
+		MIGRATE_LAYOUT_INTERLEAVED, migrate_bitmap_layout_options,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	{
 		{NULL, 0, 0, NULL, NULL}, NULL, 0, NULL, NULL, NULL, NULL
@@ -462,6 +462,46 @@ MemoryContextIsEmpty(MemoryContext context)
 	return context->methods->is_empty(context);
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Return the memory obtained from malloc by a context, and by all its
+ *		descendants if recurse is true.
+ *
+ * This is cheap for AllocSet contexts, which keep a running total, so it is
+ * suitable for checking a memory limit as a context grows.  Other context
+ * types are asked for their statistics, which means walking their blocks.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	if (IsA(context, AllocSetContext))
+		total = AllocSetMemAllocated(context);
+	else
+	{
+		MemoryContextCounters counters;
+
+		memset(&counters, 0, sizeof(counters));
+		context->methods->stats(context, NULL, NULL, &counters);
+		total = counters.totalspace;
+	}
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild;
+			 child != NULL;
+			 child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
 /*
  * MemoryContextStats
  *		Print statistics about the named context and all its descendants.
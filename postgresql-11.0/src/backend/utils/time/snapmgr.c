@@ -62,6 +62,7 @@
 #include "storage/spin.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/migrate_schema.h"
 #include "utils/rel.h"
 #include "utils/resowner_private.h"
 #include "utils/snapmgr.h"
@@ -340,6 +341,9 @@ GetTransactionSnapshot(void)
 		 */
 		if (IsolationUsesXactSnapshot())
 		{
+			/* Let lazy migration tell which migrations this snapshot sees */
+			MigrateNoteXactSnapshot();
+
 			/* First, create the snapshot in CurrentSnapshotData */
 			if (IsolationIsSerializable())
 				CurrentSnapshot = GetSerializableTransactionSnapshot(&CurrentSnapshotData);
@@ -250,6 +250,7 @@ static char *convertRegProcReference(Archive *fout,
 static char *getFormattedOperatorName(Archive *fout, const char *oproid);
 static char *convertTSFunction(Archive *fout, Oid funcOid);
 static Oid	findLastBuiltinOid_V71(Archive *fout);
+static void checkPendingAttributeVersions(Archive *fout);
 static char *getFormattedTypeName(Archive *fout, Oid oid, OidOptions opts);
 static void getBlobs(Archive *fout);
 static void dumpBlob(Archive *fout, BlobInfo *binfo);
@@ -727,6 +728,10 @@ main(int argc, char **argv)
 		exit_horribly(NULL,
 					  "Exported snapshots are not supported by this server version.\n");
 
+	/* binary upgrade keeps table files that only pg_attribute_version explains */
+	if (dopt.binary_upgrade)
+		checkPendingAttributeVersions(fout);
+
 	/*
 	 * Find the last built-in OID, if needed (prior to 8.1)
 	 *
@@ -16724,6 +16729,42 @@ findLastBuiltinOid_V71(Archive *fout)
 	return last_oid;
 }
 
+/*
+ * checkPendingAttributeVersions -
+ *
+ * A lazy ALTER COLUMN TYPE or ADD COLUMN leaves rows in the table files in
+ * an older layout, which pg_attribute_version tells the server how to read.
+ * That catalog is not dumped: a restore writes every row afresh in the
+ * current layout, so it has no use for it.  In binary-upgrade mode, however,
+ * the old table files are carried over as they are, and without their
+ * history they would be misread.  Refuse rather than produce such a dump.
+ */
+static void
+checkPendingAttributeVersions(Archive *fout)
+{
+	PGresult   *res;
+	bool		pending = false;
+
+	if (fout->remoteVersion < 110000)
+		return;
+
+	res = ExecuteSqlQueryForSingleRow(fout,
+									  "SELECT pg_catalog.to_regclass('pg_catalog.pg_attribute_version') IS NOT NULL AS present");
+	if (strcmp(PQgetvalue(res, 0, 0), "t") == 0)
+	{
+		PQclear(res);
+		res = ExecuteSqlQueryForSingleRow(fout,
+										  "SELECT EXISTS (SELECT 1 FROM pg_catalog.pg_attribute_version) AS pending");
+		pending = (strcmp(PQgetvalue(res, 0, 0), "t") == 0);
+	}
+	PQclear(res);
+
+	if (pending)
+		exit_horribly(NULL,
+					  "some tables have lazy schema changes pending, which binary upgrade cannot carry over\n"
+					  "Rewrite them, for example with VACUUM FULL, before upgrading.\n");
+}
+
 /*
  * dumpSequence
  *	  write the declaration (not data) of one user-defined sequence
@@ -0,0 +1,68 @@
+use strict;
+use warnings;
+
+use PostgresNode;
+use TestLib;
+use Test::More tests => 9;
+
+# Dumping a table whose rows a lazy ALTER COLUMN TYPE left in an older
+# layout.  A plain dump reads the rows converted, so it restores like any
+# other; a binary upgrade would carry the old layout over without the
+# history needed to read it, so pg_dump refuses until the table is rewritten.
+
+my $node = get_new_node('main');
+$node->init;
+$node->start;
+
+my $backupdir = $node->backup_dir;
+my $plain     = "$backupdir/plain.sql";
+my $discard   = "$backupdir/discard.sql";
+
+$node->safe_psql(
+	'postgres', q{
+	CREATE TABLE lazy (id int PRIMARY KEY, a int4, b int2);
+	INSERT INTO lazy SELECT g, g * 10, g FROM generate_series(1, 100) g;
+	SET lazy_alter_column_type = on;
+	ALTER TABLE lazy ALTER COLUMN a TYPE int8;
+	ALTER TABLE lazy ALTER COLUMN b TYPE int4;
+	UPDATE lazy SET a = a * 1000000000, b = b * 100000 WHERE id > 90;
+});
+
+my $query = q{SELECT format_type(atttypid, atttypmod) FROM pg_attribute
+	WHERE attrelid = 'lazy'::regclass AND attnum > 0 ORDER BY attnum;
+	SELECT string_agg(id || ':' || a || ':' || b, ',' ORDER BY id) FROM lazy};
+my $expected = $node->safe_psql('postgres', $query);
+
+is( $node->safe_psql(
+		'postgres',
+		q{SELECT count(*) FROM pg_attribute_version
+		  WHERE avrelid = 'lazy'::regclass}),
+	'2',
+	'lazy type changes are pending');
+
+$node->command_ok([ 'pg_dump', '--no-sync', '-f', $plain, 'postgres' ],
+	'pg_dump with lazy type changes pending');
+
+$node->run_log([ 'createdb', 'restored' ]);
+$node->command_ok(
+	[ 'psql', '-X', '-q', '-v', 'ON_ERROR_STOP=1', '-f', $plain, 'restored' ],
+	'restore of the dump');
+
+is($node->safe_psql('restored', $query),
+	$expected, 'restored table matches');
+is( $node->safe_psql('restored',
+		q{SELECT count(*) FROM pg_attribute_version}),
+	'0',
+	'restored table has no lazy type changes pending');
+
+$node->command_checks_all(
+	[ 'pg_dump', '--no-sync', '--binary-upgrade', '-f', $discard, 'postgres' ],
+	1,
+	[qr/^$/],
+	[qr/some tables have lazy schema changes pending/],
+	'pg_dump --binary-upgrade refuses pending lazy type changes');
+
+$node->safe_psql('postgres', 'VACUUM FULL lazy');
+$node->command_ok(
+	[ 'pg_dump', '--no-sync', '--binary-upgrade', '-f', $discard, 'postgres' ],
+	'pg_dump --binary-upgrade once the table is rewritten');
@@ -26,6 +26,7 @@ static void check_for_isn_and_int8_passing_mismatch(ClusterInfo *cluster);
 static void check_for_reg_data_type_usage(ClusterInfo *cluster);
 static void check_for_jsonb_9_4_usage(ClusterInfo *cluster);
 static void check_for_pg_role_prefix(ClusterInfo *cluster);
+static void check_for_pending_attribute_versions(ClusterInfo *cluster);
 static char *get_canonical_locale_name(int category, const char *locale);
 
 
@@ -100,6 +101,10 @@ check_and_dump_old_cluster(bool live_check)
 	check_for_reg_data_type_usage(&old_cluster);
 	check_for_isn_and_int8_passing_mismatch(&old_cluster);
 
+	/* table files in an older layout can't be carried over */
+	if (old_cluster.controldata.cat_ver >= ATTRIBUTE_VERSION_CAT_VER)
+		check_for_pending_attribute_versions(&old_cluster);
+
 	/*
 	 * Pre-PG 10 allowed tables with 'unknown' type columns and non WAL logged
 	 * hash indexes
@@ -1133,3 +1138,83 @@ get_canonical_locale_name(int category, const char *locale)
 
 	return res;
 }
+
+
+/*
+ * check_for_pending_attribute_versions()
+ *
+ *	A lazy ALTER COLUMN TYPE or ADD COLUMN leaves rows in an older layout,
+ *	which pg_attribute_version tells the server how to read.  The table files
+ *	are carried over as they are, but the catalog is not, so such tables have
+ *	to be rewritten first.
+ */
+static void
+check_for_pending_attribute_versions(ClusterInfo *cluster)
+{
+	int			dbnum;
+	FILE	   *script = NULL;
+	bool		found = false;
+	char		output_path[MAXPGPATH];
+
+	prep_status("Checking for pending lazy schema changes");
+
+	snprintf(output_path, sizeof(output_path), "tables_with_attribute_versions.txt");
+
+	for (dbnum = 0; dbnum < cluster->dbarr.ndbs; dbnum++)
+	{
+		PGresult   *res;
+		bool		db_used = false;
+		int			ntups;
+		int			rowno;
+		int			i_nspname,
+					i_relname;
+		DbInfo	   *active_db = &cluster->dbarr.dbs[dbnum];
+		PGconn	   *conn = connectToServer(cluster, active_db->db_name);
+
+		res = executeQueryOrDie(conn,
+								"SELECT n.nspname, c.relname "
+								"FROM	pg_catalog.pg_class c, "
+								"		pg_catalog.pg_namespace n "
+								"WHERE	c.relnamespace = n.oid AND "
+								"		c.oid IN (SELECT avrelid "
+								"				  FROM pg_catalog.pg_attribute_version)");
+
+		ntups = PQntuples(res);
+		i_nspname = PQfnumber(res, "nspname");
+		i_relname = PQfnumber(res, "relname");
+		for (rowno = 0; rowno < ntups; rowno++)
+		{
+			found = true;
+			if (script == NULL && (script = fopen_priv(output_path, "w")) == NULL)
+				pg_fatal("could not open file \"%s\": %s\n",
+						 output_path, strerror(errno));
+			if (!db_used)
+			{
+				fprintf(script, "Database: %s\n", active_db->db_name);
+				db_used = true;
+			}
+			fprintf(script, "  %s.%s\n",
+					PQgetvalue(res, rowno, i_nspname),
+					PQgetvalue(res, rowno, i_relname));
+		}
+
+		PQclear(res);
+
+		PQfinish(conn);
+	}
+
+	if (script)
+		fclose(script);
+
+	if (found)
+	{
+		pg_log(PG_REPORT, "fatal\n");
+		pg_fatal("Your installation contains tables with lazy ALTER COLUMN TYPE or ADD COLUMN\n"
+				 "changes still pending in their files, which cannot be upgraded as they are.\n"
+				 "Rewrite the tables, for example with VACUUM FULL, and restart the upgrade.\n"
+				 "A list of the problem tables is in the file:\n"
+				 "    %s\n\n", output_path);
+	}
+	else
+		check_ok();
+}
@@ -131,6 +131,12 @@ extern char *output_files[];
  */
 #define JSONB_FORMAT_CHANGE_CAT_VER 201409291
 
+/*
+ * pg_attribute_version, which records lazy schema changes still pending in
+ * the table files, was added
+ */
+#define ATTRIBUTE_VERSION_CAT_VER 202610181
+
 
 /*
  * Each relation is represented by a relinfo structure.
@@ -60,6 +60,8 @@
 #include "pgbench.h"
 
 #define ERRCODE_UNDEFINED_TABLE  "42P01"
+#define ERRCODE_T_R_SERIALIZATION_FAILURE  "40001"
+#define ERRCODE_T_R_DEADLOCK_DETECTED  "40P01"
 
 /*
  * Hashing constants
@@ -156,6 +158,18 @@ int64		latency_limit = 0;
 char	   *tablespace = NULL;
 char	   *index_tablespace = NULL;
 
+/*
+ * use the TPC-C (sort of) tables and transaction mix instead of TPC-B?
+ */
+bool		tpcc = false;
+
+/*
+ * Start the schema migration this many seconds into the run, under -T.
+ * Scripts see it through the :migrated variable.  0 means no migration.
+ */
+int			migrate_at = 0;
+int64		migrate_time = 0;	/* when to start it in micro seconds */
+
 /* random seed used when calling srandom() */
 int64		random_seed = -1;
 
@@ -168,6 +182,16 @@ int64		random_seed = -1;
 #define ntellers	10
 #define naccounts	100000
 
+/*
+ * TPC-C sizes.  Each warehouse (scale unit) has TPCC_DISTRICTS districts of
+ * TPCC_CUSTOMERS customers, each of whom starts out with one order.  The last
+ * TPCC_NEW_ORDERS orders of a district are undelivered.
+ */
+#define TPCC_DISTRICTS		10
+#define TPCC_CUSTOMERS		3000
+#define TPCC_NEW_ORDERS		900
+#define TPCC_ITEMS			100000
+
 /*
  * The scale factor at/beyond which 32bit integers are incapable of storing
  * 64bit values.
@@ -250,6 +274,21 @@ typedef struct StatsData
 	SimpleStats lag;
 } StatsData;
 
+/*
+ * Latency histogram, kept for each second of a run with --migrate-at, so
+ * that percentiles can be reported around the start of the migration.
+ * Buckets grow geometrically, LATENCY_HIST_STEPS of them per doubling of the
+ * latency in microseconds, which puts any percentile within 5% of the truth.
+ */
+#define LATENCY_HIST_STEPS		8
+#define LATENCY_HIST_BUCKETS	(LATENCY_HIST_STEPS * 40)
+
+typedef struct LatencyHistogram
+{
+	int64		cnt;			/* number of transactions */
+	int64		buckets[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
 /*
  * Connection state machine states.
  */
@@ -347,6 +386,8 @@ typedef struct
 
 	bool		prepared[MAX_SCRIPTS];	/* whether client prepared the script */
 
+	bool		migrated;		/* value of :migrated, under --migrate-at */
+
 	/* per client collected stats */
 	int64		cnt;			/* client transaction count, for -t */
 	int			ecnt;			/* error count */
@@ -401,6 +442,8 @@ typedef struct
 	instr_time	conn_time;
 	StatsData	stats;
 	int64		latency_late;	/* executed but late transactions */
+	int64		retried;		/* transactions retried, under --migrate-at */
+	LatencyHistogram *timeline; /* per-second latencies, under --migrate-at */
 } TState;
 
 #define INVALID_THREAD		((pthread_t) 0)
@@ -463,6 +506,42 @@ static int64 total_weight = 0;
 
 static int	debug = 0;			/* debug flag */
 
+/*
+ * Pieces of the TPC-C scripts.  Customers are chosen with TPC-C's
+ * NURand(1023, 1, 3000).  Since scripts can't loop, a new order's lines are
+ * generated by the server, from a random base item number, as distinct items
+ * numbered i_base + 6607 * n.  The item number also yields the quantity.
+ */
+#define TPCC_SET_CUSTOMER \
+	"\\set w_id random(1, :scale)\n" \
+	"\\set d_id random(1, " CppAsString2(TPCC_DISTRICTS) ")\n" \
+	"\\set c_id ((random(0, 1023) | random(1, " CppAsString2(TPCC_CUSTOMERS) ")) + 259) % " CppAsString2(TPCC_CUSTOMERS) " + 1\n"
+#define TPCC_CUSTOMER_KEY \
+	"c_w_id = :w_id AND c_d_id = :d_id AND c_id = :c_id"
+#define TPCC_ORDER_ITEMS \
+	"SELECT n, (:i_base + n * 6607) % " CppAsString2(TPCC_ITEMS) " + 1 AS i_id FROM generate_series(1, :ol_cnt) n"
+#define TPCC_DELIVERED_ORDERS \
+	"SELECT o_id FROM oorder WHERE o_w_id = :w_id AND o_d_id = :d_id AND o_c_id = :c_id AND o_carrier_id IS NOT NULL"
+#define TPCC_DELIVERED_AMOUNT \
+	"SELECT coalesce(sum(ol_amount), 0) FROM order_line WHERE ol_w_id = :w_id AND ol_d_id = :d_id AND ol_delivery_d = LOCALTIMESTAMP AND ol_o_id IN (" TPCC_DELIVERED_ORDERS ")"
+
+/*
+ * The schema migration splits customer into customer_proj1, which holds what
+ * rarely changes, and customer_proj2, which holds the balances.  After it has
+ * started, a transaction first migrates the customer it works on to the new
+ * tables it needs, with statements the server recognizes by their text as
+ * migration statements.  Only the first migrates the row; later ones find it
+ * migrated and insert nothing.
+ */
+#define TPCC_CUSTOMER_PROJ1_COLS \
+	"c_w_id, c_d_id, c_id, c_first, c_middle, c_last, c_street_1, c_street_2, c_city, c_state, c_zip, c_phone, c_since, c_credit, c_credit_lim, c_discount"
+#define TPCC_CUSTOMER_PROJ2_COLS \
+	"c_w_id, c_d_id, c_id, c_balance, c_ytd_payment, c_payment_cnt, c_delivery_cnt, c_data"
+#define TPCC_MIGRATE_PROJ1 \
+	"insert into customer_proj1 select " TPCC_CUSTOMER_PROJ1_COLS " from customer where " TPCC_CUSTOMER_KEY ";\n"
+#define TPCC_MIGRATE_PROJ2 \
+	"insert into customer_proj2 select " TPCC_CUSTOMER_PROJ2_COLS " from customer where " TPCC_CUSTOMER_KEY ";\n"
+
 /* Builtin test scripts */
 typedef struct BuiltinScript
 {
@@ -506,6 +585,91 @@ static const BuiltinScript builtin_script[] =
 		"<builtin: select only>",
 		"\\set aid random(1, " CppAsString2(naccounts) " * :scale)\n"
 		"SELECT abalance FROM pgbench_accounts WHERE aid = :aid;\n"
+	},
+	{
+		"tpcc-new-order",
+		"<builtin: TPC-C (sort of) new order>",
+		TPCC_SET_CUSTOMER
+		"\\set ol_cnt random(5, 15)\n"
+		"\\set i_base random(0, " CppAsString2(TPCC_ITEMS) " - 1)\n"
+		"BEGIN;\n"
+		"SELECT w_tax FROM warehouse WHERE w_id = :w_id;\n"
+		"UPDATE district SET d_next_o_id = d_next_o_id + 1 WHERE d_w_id = :w_id AND d_id = :d_id;\n"
+		"\\if :migrated\n"
+		TPCC_MIGRATE_PROJ1
+		"SELECT c_discount, c_last, c_credit FROM customer_proj1 WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\else\n"
+		"SELECT c_discount, c_last, c_credit FROM customer WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\endif\n"
+		"INSERT INTO oorder (o_w_id, o_d_id, o_id, o_c_id, o_ol_cnt, o_all_local, o_entry_d) SELECT d_w_id, d_id, d_next_o_id - 1, :c_id, :ol_cnt, 1, LOCALTIMESTAMP FROM district WHERE d_w_id = :w_id AND d_id = :d_id;\n"
+		"INSERT INTO new_order (no_w_id, no_d_id, no_o_id) SELECT d_w_id, d_id, d_next_o_id - 1 FROM district WHERE d_w_id = :w_id AND d_id = :d_id;\n"
+		"SELECT s_i_id FROM stock WHERE s_w_id = :w_id AND s_i_id IN (" TPCC_ORDER_ITEMS ") ORDER BY s_i_id FOR UPDATE;\n"
+		"UPDATE stock SET s_quantity = CASE WHEN s_quantity >= ol.i_id % 10 + 11 THEN s_quantity - ol.i_id % 10 - 1 ELSE s_quantity - ol.i_id % 10 + 90 END, s_ytd = s_ytd + ol.i_id % 10 + 1, s_order_cnt = s_order_cnt + 1 FROM (" TPCC_ORDER_ITEMS ") ol WHERE s_w_id = :w_id AND s_i_id = ol.i_id;\n"
+		"INSERT INTO order_line (ol_w_id, ol_d_id, ol_o_id, ol_number, ol_i_id, ol_supply_w_id, ol_quantity, ol_amount, ol_dist_info) SELECT d_w_id, d_id, d_next_o_id - 1, ol.n, ol.i_id, d_w_id, ol.i_id % 10 + 1, (ol.i_id % 10 + 1) * i_price, s_dist_info FROM district, (" TPCC_ORDER_ITEMS ") ol, item, stock WHERE d_w_id = :w_id AND d_id = :d_id AND i_id = ol.i_id AND s_w_id = d_w_id AND s_i_id = ol.i_id;\n"
+		"END;\n"
+	},
+	{
+		"tpcc-payment",
+		"<builtin: TPC-C (sort of) payment>",
+		TPCC_SET_CUSTOMER
+		"\\set h_amount random(100, 500000)\n"
+		"BEGIN;\n"
+		"UPDATE warehouse SET w_ytd = w_ytd + :h_amount / 100.0 WHERE w_id = :w_id;\n"
+		"SELECT w_name, w_street_1, w_street_2, w_city, w_state, w_zip FROM warehouse WHERE w_id = :w_id;\n"
+		"UPDATE district SET d_ytd = d_ytd + :h_amount / 100.0 WHERE d_w_id = :w_id AND d_id = :d_id;\n"
+		"SELECT d_name, d_street_1, d_street_2, d_city, d_state, d_zip FROM district WHERE d_w_id = :w_id AND d_id = :d_id;\n"
+		"\\if :migrated\n"
+		TPCC_MIGRATE_PROJ1
+		TPCC_MIGRATE_PROJ2
+		"SELECT c_first, c_middle, c_last, c_street_1, c_street_2, c_city, c_state, c_zip, c_phone, c_credit, c_credit_lim, c_discount, c_since FROM customer_proj1 WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"UPDATE customer_proj2 SET c_balance = c_balance - :h_amount / 100.0, c_ytd_payment = c_ytd_payment + :h_amount / 100.0, c_payment_cnt = c_payment_cnt + 1 WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\else\n"
+		"SELECT c_first, c_middle, c_last, c_street_1, c_street_2, c_city, c_state, c_zip, c_phone, c_credit, c_credit_lim, c_discount, c_since FROM customer WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"UPDATE customer SET c_balance = c_balance - :h_amount / 100.0, c_ytd_payment = c_ytd_payment + :h_amount / 100.0, c_payment_cnt = c_payment_cnt + 1 WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\endif\n"
+		"INSERT INTO history (h_c_id, h_c_d_id, h_c_w_id, h_d_id, h_w_id, h_date, h_amount, h_data) VALUES (:c_id, :d_id, :w_id, :d_id, :w_id, LOCALTIMESTAMP, :h_amount / 100.0, 'payment');\n"
+		"END;\n"
+	},
+	{
+		"tpcc-order-status",
+		"<builtin: TPC-C (sort of) order status>",
+		TPCC_SET_CUSTOMER
+		"BEGIN;\n"
+		"\\if :migrated\n"
+		TPCC_MIGRATE_PROJ1
+		TPCC_MIGRATE_PROJ2
+		"SELECT c_first, c_middle, c_last, c_balance FROM customer_proj1 JOIN customer_proj2 USING (c_w_id, c_d_id, c_id) WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\else\n"
+		"SELECT c_first, c_middle, c_last, c_balance FROM customer WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\endif\n"
+		"SELECT o_id, o_carrier_id, o_entry_d FROM oorder WHERE o_w_id = :w_id AND o_d_id = :d_id AND o_c_id = :c_id ORDER BY o_id DESC LIMIT 1;\n"
+		"SELECT ol_i_id, ol_supply_w_id, ol_quantity, ol_amount, ol_delivery_d FROM order_line WHERE ol_w_id = :w_id AND ol_d_id = :d_id AND ol_o_id = (SELECT max(o_id) FROM oorder WHERE o_w_id = :w_id AND o_d_id = :d_id AND o_c_id = :c_id);\n"
+		"END;\n"
+	},
+	{
+		"tpcc-delivery",
+		"<builtin: TPC-C (sort of) delivery>",
+		TPCC_SET_CUSTOMER
+		"\\set o_carrier_id random(1, 10)\n"
+		"BEGIN;\n"
+		"UPDATE oorder SET o_carrier_id = :o_carrier_id WHERE o_w_id = :w_id AND o_d_id = :d_id AND o_id = (SELECT min(no_o_id) FROM new_order, oorder WHERE no_w_id = :w_id AND no_d_id = :d_id AND o_w_id = no_w_id AND o_d_id = no_d_id AND o_id = no_o_id AND o_c_id = :c_id);\n"
+		"DELETE FROM new_order WHERE no_w_id = :w_id AND no_d_id = :d_id AND no_o_id IN (" TPCC_DELIVERED_ORDERS ");\n"
+		"UPDATE order_line SET ol_delivery_d = LOCALTIMESTAMP WHERE ol_w_id = :w_id AND ol_d_id = :d_id AND ol_delivery_d IS NULL AND ol_o_id IN (" TPCC_DELIVERED_ORDERS ");\n"
+		"\\if :migrated\n"
+		TPCC_MIGRATE_PROJ2
+		"UPDATE customer_proj2 SET c_balance = c_balance + (" TPCC_DELIVERED_AMOUNT "), c_delivery_cnt = c_delivery_cnt + 1 WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\else\n"
+		"UPDATE customer SET c_balance = c_balance + (" TPCC_DELIVERED_AMOUNT "), c_delivery_cnt = c_delivery_cnt + 1 WHERE " TPCC_CUSTOMER_KEY ";\n"
+		"\\endif\n"
+		"END;\n"
+	},
+	{
+		"tpcc-stock-level",
+		"<builtin: TPC-C (sort of) stock level>",
+		"\\set w_id random(1, :scale)\n"
+		"\\set d_id random(1, " CppAsString2(TPCC_DISTRICTS) ")\n"
+		"\\set threshold random(10, 20)\n"
+		"SELECT count(DISTINCT s_i_id) FROM district, order_line, stock WHERE d_w_id = :w_id AND d_id = :d_id AND ol_w_id = :w_id AND ol_d_id = :d_id AND ol_o_id >= d_next_o_id - 20 AND ol_o_id < d_next_o_id AND s_w_id = :w_id AND s_i_id = ol_i_id AND s_quantity < :threshold;\n"
 	}
 };
 
@@ -552,6 +716,7 @@ usage(void)
 		   "  --index-tablespace=TABLESPACE\n"
 		   "                           create indexes in the specified tablespace\n"
 		   "  --tablespace=TABLESPACE  create tables in the specified tablespace\n"
+		   "  --tpcc                   create TPC-C tables instead of TPC-B ones\n"
 		   "  --unlogged-tables        create tables as unlogged tables\n"
 		   "\nOptions to select what to run:\n"
 		   "  -b, --builtin=NAME[@W]   add builtin script NAME weighted at W (default: 1)\n"
@@ -561,6 +726,7 @@ usage(void)
 		   "                           (same as \"-b simple-update\")\n"
 		   "  -S, --select-only        perform SELECT-only transactions\n"
 		   "                           (same as \"-b select-only\")\n"
+		   "  --tpcc                   run the TPC-C transaction mix\n"
 		   "\nBenchmarking options:\n"
 		   "  -c, --client=NUM         number of concurrent database clients (default: 1)\n"
 		   "  -C, --connect            establish new connection for each transaction\n"
@@ -582,6 +748,7 @@ usage(void)
 		   "  --aggregate-interval=NUM aggregate data over NUM seconds\n"
 		   "  --log-prefix=PREFIX      prefix for transaction time log file\n"
 		   "                           (default: \"pgbench_log\")\n"
+		   "  --migrate-at=NUM         start the schema migration after NUM seconds\n"
 		   "  --progress-timestamp     use Unix epoch timestamps for progress\n"
 		   "  --random-seed=SEED       set random seed (\"time\", \"rand\", integer)\n"
 		   "  --sampling-rate=NUM      fraction of transactions to log (e.g., 0.01 for 1%%)\n"
@@ -1062,6 +1229,62 @@ accumStats(StatsData *stats, bool skipped, double lat, double lag)
 	}
 }
 
+/*
+ * Add a latency, in microseconds, to a histogram
+ */
+static void
+addToHistogram(LatencyHistogram *hist, double lat)
+{
+	int			bucket = 0;
+
+	if (lat >= 1.0)
+		bucket = (int) (log2(lat) * LATENCY_HIST_STEPS);
+	if (bucket >= LATENCY_HIST_BUCKETS)
+		bucket = LATENCY_HIST_BUCKETS - 1;
+
+	hist->cnt++;
+	hist->buckets[bucket]++;
+}
+
+/*
+ * Merge two histograms
+ */
+static void
+mergeHistogram(LatencyHistogram *acc, LatencyHistogram *hist)
+{
+	int			i;
+
+	acc->cnt += hist->cnt;
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+		acc->buckets[i] += hist->buckets[i];
+}
+
+/*
+ * Return the given percentile of the latencies in a histogram, in
+ * milliseconds, taking the geometric middle of its bucket
+ */
+static double
+histogramPercentile(LatencyHistogram *hist, double percentile)
+{
+	int64		rank = (int64) ceil(hist->cnt * percentile / 100.0);
+	int64		seen = 0;
+	int			i;
+
+	if (hist->cnt == 0)
+		return 0.0;
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < LATENCY_HIST_BUCKETS - 1; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	return 0.001 * pow(2.0, (i + 0.5) / LATENCY_HIST_STEPS);
+}
+
 /* call PQexec() and exit() on failure */
 static void
 executeStatement(PGconn *con, const char *sql)
@@ -2677,6 +2900,64 @@ evaluateSleep(CState *st, int argc, char **argv, int *usecs)
 	return true;
 }
 
+/*
+ * Set a client's :migrated variable for the transaction it is starting,
+ * under --migrate-at
+ */
+static bool
+setMigratedVariable(CState *st, instr_time *now)
+{
+	bool		migrated;
+
+	if (INSTR_TIME_IS_ZERO(*now))
+		INSTR_TIME_SET_CURRENT(*now);
+	migrated = INSTR_TIME_GET_MICROSEC(*now) >= migrate_time;
+
+	if (migrated == st->migrated)
+		return true;
+	st->migrated = migrated;
+	return putVariableInt(st, "migrate", "migrated", migrated ? 1 : 0);
+}
+
+/*
+ * Roll back a client's transaction that failed with a serialization failure
+ * or a deadlock, and start it over, under --migrate-at.  Such failures are
+ * to be expected around the start of a migration, when a transaction that
+ * started before it wants to change a row another one has since migrated.
+ * The transaction keeps its start time, so its latency includes the failed
+ * attempts.
+ */
+static bool
+retryTransaction(TState *thread, CState *st, instr_time *now)
+{
+	if (PQtransactionStatus(st->con) != PQTRANS_IDLE)
+	{
+		PGresult   *res = PQexec(st->con, "ROLLBACK");
+
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			commandFailed(st, "SQL", PQerrorMessage(st->con));
+			PQclear(res);
+			return false;
+		}
+		PQclear(res);
+	}
+
+	while (conditional_stack_pop(st->cstack))
+		 /* skip */ ;
+
+	thread->retried++;
+
+	/* the migration may have started since */
+	INSTR_TIME_SET_ZERO(*now);
+	if (!setMigratedVariable(st, now))
+		return false;
+
+	st->command = 0;
+	st->state = CSTATE_START_COMMAND;
+	return true;
+}
+
 /*
  * Advance the state machine of a connection, if possible.
  */
@@ -2684,6 +2965,7 @@ static void
 doCustom(TState *thread, CState *st, StatsData *agg)
 {
 	PGresult   *res;
+	char	   *sqlState;
 	Command    *command;
 	instr_time	now;
 	bool		end_tx_processed = false;
@@ -2839,11 +3121,11 @@ doCustom(TState *thread, CState *st, StatsData *agg)
 				}
 
 				/*
-				 * Record transaction start time under logging, progress or
-				 * throttling.
+				 * Record transaction start time under logging, progress,
+				 * throttling or --migrate-at.
 				 */
 				if (use_log || progress || throttle_delay || latency_limit ||
-					per_script_stats)
+					per_script_stats || migrate_at)
 				{
 					if (INSTR_TIME_IS_ZERO(now))
 						INSTR_TIME_SET_CURRENT(now);
@@ -2857,6 +3139,13 @@ doCustom(TState *thread, CState *st, StatsData *agg)
 						st->txn_scheduled = INSTR_TIME_GET_MICROSEC(now);
 				}
 
+				/* Tell the script whether the migration has started */
+				if (migrate_at && !setMigratedVariable(st, &now))
+				{
+					st->state = CSTATE_ABORTED;
+					break;
+				}
+
 				/* Begin with the first command */
 				st->command = 0;
 				st->state = CSTATE_START_COMMAND;
@@ -3191,6 +3480,17 @@ doCustom(TState *thread, CState *st, StatsData *agg)
 						st->state = CSTATE_END_COMMAND;
 						break;
 					default:
+						sqlState = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+						if (migrate_at && sqlState != NULL &&
+							(strcmp(sqlState, ERRCODE_T_R_SERIALIZATION_FAILURE) == 0 ||
+							 strcmp(sqlState, ERRCODE_T_R_DEADLOCK_DETECTED) == 0))
+						{
+							PQclear(res);
+							discard_response(st);
+							if (!retryTransaction(thread, st, &now))
+								st->state = CSTATE_ABORTED;
+							break;
+						}
 						commandFailed(st, "SQL", PQerrorMessage(st->con));
 						PQclear(res);
 						st->state = CSTATE_ABORTED;
@@ -3397,7 +3697,8 @@ processXactStats(TState *thread, CState *st, instr_time *now,
 	double		latency = 0.0,
 				lag = 0.0;
 	bool		thread_details = progress || throttle_delay || latency_limit,
-				detailed = thread_details || use_log || per_script_stats;
+				detailed = (thread_details || use_log || per_script_stats ||
+							migrate_at);
 
 	if (detailed && !skipped)
 	{
@@ -3424,6 +3725,17 @@ processXactStats(TState *thread, CState *st, instr_time *now,
 		thread->stats.cnt++;
 	}
 
+	/* under --migrate-at, keep a latency histogram of every second */
+	if (migrate_at && !skipped)
+	{
+		int64		second;
+
+		second = (INSTR_TIME_GET_MICROSEC(*now) -
+				  INSTR_TIME_GET_MICROSEC(thread->start_time)) / 1000000;
+		second = Max(0, Min(second, duration));
+		addToHistogram(&thread->timeline[second], latency);
+	}
+
 	/* client stat is just counting */
 	st->cnt++;
 
@@ -3770,6 +4082,338 @@ initCreateFKeys(PGconn *con)
 	}
 }
 
+/*
+ * The TPC-C tables, including the two the schema migration splits customer
+ * into.  Their names are the ones BullFrog's migration statements expect.
+ */
+static const char *const tpccTables[] = {
+	"warehouse", "district", "customer", "customer_proj1", "customer_proj2",
+	"history", "new_order", "oorder", "order_line", "item", "stock"
+};
+
+/*
+ * Remove old TPC-C tables, if any exist
+ */
+static void
+initTpccDropTables(PGconn *con)
+{
+	PQExpBufferData sql;
+	int			i;
+
+	fprintf(stderr, "dropping old tables...\n");
+
+	initPQExpBuffer(&sql);
+	appendPQExpBufferStr(&sql, "drop table if exists ");
+	for (i = 0; i < lengthof(tpccTables); i++)
+		appendPQExpBuffer(&sql, "%s%s", i > 0 ? ", " : "", tpccTables[i]);
+	executeStatement(con, sql.data);
+	termPQExpBuffer(&sql);
+}
+
+/*
+ * Create the TPC-C tables
+ */
+static void
+initTpccCreateTables(PGconn *con)
+{
+	/*
+	 * Note: the migration bitmaps of the server have room for at most 15
+	 * tuples per page of customer, so c_data, which TPC-C makes 300 to 500
+	 * characters long, is always generated with 500, which fits 12.
+	 */
+	struct ddlinfo
+	{
+		const char *table;		/* table name */
+		const char *cols;		/* column decls */
+		int			declare_fillfactor;
+	};
+	static const struct ddlinfo DDLs[] = {
+		{
+			"warehouse",
+			"w_id int not null,w_name varchar(10),w_street_1 varchar(20),w_street_2 varchar(20),w_city varchar(20),w_state char(2),w_zip char(9),w_tax numeric(4,4),w_ytd numeric(12,2)",
+			1
+		},
+		{
+			"district",
+			"d_w_id int not null,d_id int not null,d_name varchar(10),d_street_1 varchar(20),d_street_2 varchar(20),d_city varchar(20),d_state char(2),d_zip char(9),d_tax numeric(4,4),d_ytd numeric(12,2),d_next_o_id int",
+			1
+		},
+		{
+			"customer",
+			"c_w_id int not null,c_d_id int not null,c_id int not null,c_first varchar(16),c_middle char(2),c_last varchar(16),c_street_1 varchar(20),c_street_2 varchar(20),c_city varchar(20),c_state char(2),c_zip char(9),c_phone char(16),c_since timestamp,c_credit char(2),c_credit_lim numeric(12,2),c_discount numeric(4,4),c_balance numeric(12,2),c_ytd_payment numeric(12,2),c_payment_cnt int,c_delivery_cnt int,c_data varchar(500)",
+			1
+		},
+		{
+			"customer_proj1",
+			"c_w_id int not null,c_d_id int not null,c_id int not null,c_first varchar(16),c_middle char(2),c_last varchar(16),c_street_1 varchar(20),c_street_2 varchar(20),c_city varchar(20),c_state char(2),c_zip char(9),c_phone char(16),c_since timestamp,c_credit char(2),c_credit_lim numeric(12,2),c_discount numeric(4,4)",
+			0
+		},
+		{
+			"customer_proj2",
+			"c_w_id int not null,c_d_id int not null,c_id int not null,c_balance numeric(12,2),c_ytd_payment numeric(12,2),c_payment_cnt int,c_delivery_cnt int,c_data varchar(500)",
+			1
+		},
+		{
+			"history",
+			"h_c_id int,h_c_d_id int,h_c_w_id int,h_d_id int,h_w_id int,h_date timestamp,h_amount numeric(6,2),h_data varchar(24)",
+			0
+		},
+		{
+			"new_order",
+			"no_w_id int not null,no_d_id int not null,no_o_id int not null",
+			0
+		},
+		{
+			"oorder",
+			"o_w_id int not null,o_d_id int not null,o_id int not null,o_c_id int,o_carrier_id int,o_ol_cnt int,o_all_local int,o_entry_d timestamp",
+			1
+		},
+		{
+			"order_line",
+			"ol_w_id int not null,ol_d_id int not null,ol_o_id int not null,ol_number int not null,ol_i_id int,ol_supply_w_id int,ol_delivery_d timestamp,ol_quantity int,ol_amount numeric(6,2),ol_dist_info char(24)",
+			1
+		},
+		{
+			"item",
+			"i_id int not null,i_im_id int,i_name varchar(24),i_price numeric(5,2),i_data varchar(50)",
+			0
+		},
+		{
+			"stock",
+			"s_w_id int not null,s_i_id int not null,s_quantity int,s_ytd int,s_order_cnt int,s_remote_cnt int,s_dist_info char(24),s_data varchar(50)",
+			1
+		}
+	};
+	PQExpBufferData sql;
+	int			i;
+
+	fprintf(stderr, "creating tables...\n");
+
+	initPQExpBuffer(&sql);
+	for (i = 0; i < lengthof(DDLs); i++)
+	{
+		const struct ddlinfo *ddl = &DDLs[i];
+
+		resetPQExpBuffer(&sql);
+		appendPQExpBuffer(&sql, "create%s table %s(%s)",
+						  unlogged_tables ? " unlogged" : "",
+						  ddl->table, ddl->cols);
+		if (ddl->declare_fillfactor)
+			appendPQExpBuffer(&sql, " with (fillfactor=%d)", fillfactor);
+		if (tablespace != NULL)
+		{
+			char	   *escape_tablespace;
+
+			escape_tablespace = PQescapeIdentifier(con, tablespace,
+												   strlen(tablespace));
+			appendPQExpBuffer(&sql, " tablespace %s", escape_tablespace);
+			PQfreemem(escape_tablespace);
+		}
+
+		executeStatement(con, sql.data);
+	}
+	termPQExpBuffer(&sql);
+}
+
+/*
+ * Fill the TPC-C tables with some data, one warehouse at a time.  The
+ * migration tables start out empty.
+ */
+static void
+initTpccGenerateData(PGconn *con)
+{
+	static const char *const perWarehouse[] = {
+		"insert into warehouse (w_id, w_name, w_street_1, w_street_2, w_city, w_state, w_zip, w_tax, w_ytd) "
+		"select w, 'W' || w, 'street 1', 'street 2', 'city', 'MD', '123411111', round((random() * 0.2)::numeric, 4), 300000 "
+		"from (values (%d)) w(w)",
+
+		"insert into district (d_w_id, d_id, d_name, d_street_1, d_street_2, d_city, d_state, d_zip, d_tax, d_ytd, d_next_o_id) "
+		"select %d, d, 'D' || d, 'street 1', 'street 2', 'city', 'MD', '123411111', round((random() * 0.2)::numeric, 4), 30000, "
+		CppAsString2(TPCC_CUSTOMERS) " + 1 "
+		"from generate_series(1, " CppAsString2(TPCC_DISTRICTS) ") d",
+
+		"insert into customer (c_w_id, c_d_id, c_id, c_first, c_middle, c_last, c_street_1, c_street_2, c_city, c_state, c_zip, c_phone, c_since, c_credit, c_credit_lim, c_discount, c_balance, c_ytd_payment, c_payment_cnt, c_delivery_cnt, c_data) "
+		"select %d, d, c, substr(md5(random()::text), 1, 16), 'OE', 'CUST' || (c - 1) %% 1000, 'street 1', 'street 2', 'city', 'MD', '123411111', lpad(c::text, 16, '0'), LOCALTIMESTAMP, "
+		"case when random() < 0.1 then 'BC' else 'GC' end, 50000, round((random() * 0.5)::numeric, 4), -10, 10, 1, 0, rpad(md5(c::text), 500, md5(d::text)) "
+		"from generate_series(1, " CppAsString2(TPCC_DISTRICTS) ") d, generate_series(1, " CppAsString2(TPCC_CUSTOMERS) ") c",
+
+		"insert into history (h_c_id, h_c_d_id, h_c_w_id, h_d_id, h_w_id, h_date, h_amount, h_data) "
+		"select c, d, w, d, w, LOCALTIMESTAMP, 10, 'initial' "
+		"from (values (%d)) w(w), generate_series(1, " CppAsString2(TPCC_DISTRICTS) ") d, generate_series(1, " CppAsString2(TPCC_CUSTOMERS) ") c",
+
+		/* each customer has one order; 1087 makes that a permutation */
+		"insert into oorder (o_w_id, o_d_id, o_id, o_c_id, o_carrier_id, o_ol_cnt, o_all_local, o_entry_d) "
+		"select %d, d, o, o * 1087 %% " CppAsString2(TPCC_CUSTOMERS) " + 1, "
+		"case when o <= " CppAsString2(TPCC_CUSTOMERS) " - " CppAsString2(TPCC_NEW_ORDERS) " then o %% 10 + 1 end, 5 + o %% 11, 1, LOCALTIMESTAMP "
+		"from generate_series(1, " CppAsString2(TPCC_DISTRICTS) ") d, generate_series(1, " CppAsString2(TPCC_CUSTOMERS) ") o",
+
+		"insert into new_order (no_w_id, no_d_id, no_o_id) "
+		"select %d, d, o "
+		"from generate_series(1, " CppAsString2(TPCC_DISTRICTS) ") d, "
+		"generate_series(" CppAsString2(TPCC_CUSTOMERS) " - " CppAsString2(TPCC_NEW_ORDERS) " + 1, " CppAsString2(TPCC_CUSTOMERS) ") o",
+
+		"insert into order_line (ol_w_id, ol_d_id, ol_o_id, ol_number, ol_i_id, ol_supply_w_id, ol_delivery_d, ol_quantity, ol_amount, ol_dist_info) "
+		"select w, d, o, n, (o * 7919 + n * 6607) %% " CppAsString2(TPCC_ITEMS) " + 1, w, "
+		"case when o <= " CppAsString2(TPCC_CUSTOMERS) " - " CppAsString2(TPCC_NEW_ORDERS) " then LOCALTIMESTAMP end, 5, "
+		"case when o <= " CppAsString2(TPCC_CUSTOMERS) " - " CppAsString2(TPCC_NEW_ORDERS) " then 0 else round((random() * 9999.98 + 0.01)::numeric, 2) end, "
+		"substr(md5(n::text), 1, 24) "
+		"from (values (%d)) w(w), generate_series(1, " CppAsString2(TPCC_DISTRICTS) ") d, "
+		"generate_series(1, " CppAsString2(TPCC_CUSTOMERS) ") o, generate_series(1, 5 + o %% 11) n",
+
+		"insert into stock (s_w_id, s_i_id, s_quantity, s_ytd, s_order_cnt, s_remote_cnt, s_dist_info, s_data) "
+		"select %d, i, 10 + (random() * 90)::int, 0, 0, 0, substr(md5(i::text), 1, 24), md5(random()::text) "
+		"from generate_series(1, " CppAsString2(TPCC_ITEMS) ") i"
+	};
+	PQExpBufferData sql;
+	int			i,
+				w;
+
+	/* used to track elapsed time and estimate of the remaining time */
+	instr_time	start,
+				diff;
+	double		elapsed_sec,
+				remaining_sec;
+	int			log_interval = 1;
+
+	fprintf(stderr, "generating data...\n");
+
+	/*
+	 * we do all of this in one transaction to enable the backend's
+	 * data-loading optimizations
+	 */
+	executeStatement(con, "begin");
+
+	initPQExpBuffer(&sql);
+	appendPQExpBufferStr(&sql, "truncate table ");
+	for (i = 0; i < lengthof(tpccTables); i++)
+		appendPQExpBuffer(&sql, "%s%s", i > 0 ? ", " : "", tpccTables[i]);
+	executeStatement(con, sql.data);
+
+	executeStatement(con,
+					 "insert into item (i_id, i_im_id, i_name, i_price, i_data) "
+					 "select i, i % 10000 + 1, substr(md5(i::text), 1, 24), round((random() * 99 + 1)::numeric, 2), md5(i::text) "
+					 "from generate_series(1, " CppAsString2(TPCC_ITEMS) ") i");
+
+	INSTR_TIME_SET_CURRENT(start);
+
+	for (w = 1; w <= scale; w++)
+	{
+		for (i = 0; i < lengthof(perWarehouse); i++)
+		{
+			resetPQExpBuffer(&sql);
+			appendPQExpBuffer(&sql, perWarehouse[i], w);
+			executeStatement(con, sql.data);
+		}
+
+		INSTR_TIME_SET_CURRENT(diff);
+		INSTR_TIME_SUBTRACT(diff, start);
+
+		elapsed_sec = INSTR_TIME_GET_DOUBLE(diff);
+		remaining_sec = (scale - w) * elapsed_sec / w;
+
+		/* under -q, only once in a while */
+		if (!use_quiet || w == scale ||
+			elapsed_sec >= log_interval * LOG_STEP_SECONDS)
+		{
+			fprintf(stderr, "%d of %d warehouses (%d%%) done (elapsed %.2f s, remaining %.2f s)\n",
+					w, scale, (int) ((int64) w * 100 / scale),
+					elapsed_sec, remaining_sec);
+			log_interval = (int) ceil(elapsed_sec / LOG_STEP_SECONDS);
+		}
+	}
+	termPQExpBuffer(&sql);
+
+	executeStatement(con, "commit");
+}
+
+/*
+ * Invoke vacuum on the TPC-C tables
+ */
+static void
+initTpccVacuum(PGconn *con)
+{
+	char		buffer[256];
+	int			i;
+
+	fprintf(stderr, "vacuuming...\n");
+	for (i = 0; i < lengthof(tpccTables); i++)
+	{
+		snprintf(buffer, sizeof(buffer), "vacuum analyze %s", tpccTables[i]);
+		executeStatement(con, buffer);
+	}
+}
+
+/*
+ * Create primary keys, and the index the order status transaction needs, on
+ * the TPC-C tables
+ */
+static void
+initTpccCreatePKeys(PGconn *con)
+{
+	static const char *const DDLINDEXes[] = {
+		"alter table warehouse add primary key (w_id)",
+		"alter table district add primary key (d_w_id, d_id)",
+		"alter table customer add primary key (c_w_id, c_d_id, c_id)",
+		"alter table customer_proj1 add primary key (c_w_id, c_d_id, c_id)",
+		"alter table customer_proj2 add primary key (c_w_id, c_d_id, c_id)",
+		"alter table new_order add primary key (no_w_id, no_d_id, no_o_id)",
+		"alter table oorder add primary key (o_w_id, o_d_id, o_id)",
+		"alter table order_line add primary key (ol_w_id, ol_d_id, ol_o_id, ol_number)",
+		"alter table item add primary key (i_id)",
+		"alter table stock add primary key (s_w_id, s_i_id)",
+		"create index oorder_customer_idx on oorder (o_w_id, o_d_id, o_c_id, o_id)"
+	};
+	int			i;
+
+	fprintf(stderr, "creating primary keys...\n");
+	for (i = 0; i < lengthof(DDLINDEXes); i++)
+	{
+		char		buffer[256];
+
+		strlcpy(buffer, DDLINDEXes[i], sizeof(buffer));
+
+		if (index_tablespace != NULL)
+		{
+			char	   *escape_tablespace;
+
+			escape_tablespace = PQescapeIdentifier(con, index_tablespace,
+												   strlen(index_tablespace));
+			snprintf(buffer + strlen(buffer), sizeof(buffer) - strlen(buffer),
+					 "%s tablespace %s",
+					 strncmp(buffer, "alter", 5) == 0 ? " using index" : "",
+					 escape_tablespace);
+			PQfreemem(escape_tablespace);
+		}
+
+		executeStatement(con, buffer);
+	}
+}
+
+/*
+ * Create foreign key constraints between the TPC-C tables
+ */
+static void
+initTpccCreateFKeys(PGconn *con)
+{
+	static const char *const DDLKEYs[] = {
+		"alter table district add constraint district_w_id_fkey foreign key (d_w_id) references warehouse",
+		"alter table customer add constraint customer_d_id_fkey foreign key (c_w_id, c_d_id) references district",
+		"alter table history add constraint history_c_id_fkey foreign key (h_c_w_id, h_c_d_id, h_c_id) references customer",
+		"alter table oorder add constraint oorder_c_id_fkey foreign key (o_w_id, o_d_id, o_c_id) references customer",
+		"alter table new_order add constraint new_order_o_id_fkey foreign key (no_w_id, no_d_id, no_o_id) references oorder",
+		"alter table order_line add constraint order_line_o_id_fkey foreign key (ol_w_id, ol_d_id, ol_o_id) references oorder",
+		"alter table stock add constraint stock_w_id_fkey foreign key (s_w_id) references warehouse",
+		"alter table stock add constraint stock_i_id_fkey foreign key (s_i_id) references item"
+	};
+	int			i;
+
+	fprintf(stderr, "creating foreign keys...\n");
+	for (i = 0; i < lengthof(DDLKEYs); i++)
+	{
+		executeStatement(con, DDLKEYs[i]);
+	}
+}
+
 /*
  * Validate an initialization-steps string
  *
@@ -3817,22 +4461,40 @@ runInitSteps(const char *initialize_steps)
 		switch (*step)
 		{
 			case 'd':
-				initDropTables(con);
+				if (tpcc)
+					initTpccDropTables(con);
+				else
+					initDropTables(con);
 				break;
 			case 't':
-				initCreateTables(con);
+				if (tpcc)
+					initTpccCreateTables(con);
+				else
+					initCreateTables(con);
 				break;
 			case 'g':
-				initGenerateData(con);
+				if (tpcc)
+					initTpccGenerateData(con);
+				else
+					initGenerateData(con);
 				break;
 			case 'v':
-				initVacuum(con);
+				if (tpcc)
+					initTpccVacuum(con);
+				else
+					initVacuum(con);
 				break;
 			case 'p':
-				initCreatePKeys(con);
+				if (tpcc)
+					initTpccCreatePKeys(con);
+				else
+					initCreatePKeys(con);
 				break;
 			case 'f':
-				initCreateFKeys(con);
+				if (tpcc)
+					initTpccCreateFKeys(con);
+				else
+					initCreateFKeys(con);
 				break;
 			case ' ':
 				break;			/* ignore */
@@ -4559,6 +5221,67 @@ printSimpleStats(const char *prefix, SimpleStats *ss)
 	}
 }
 
+/* print one line of the migration report */
+static void
+printMigrationLine(const char *label, LatencyHistogram *hist, int seconds)
+{
+	printf("%s %10.1f %9.3f %9.3f %9.3f %9.3f\n",
+		   label, seconds > 0 ? (double) hist->cnt / seconds : 0.0,
+		   histogramPercentile(hist, 50.0),
+		   histogramPercentile(hist, 90.0),
+		   histogramPercentile(hist, 99.0),
+		   histogramPercentile(hist, 100.0));
+}
+
+/*
+ * Report throughput and latency percentiles before and after the start of
+ * the migration, and for every second of the run.  A transaction counts in
+ * the second it ended in.
+ */
+static void
+printMigrationReport(TState *threads)
+{
+	LatencyHistogram *timeline;
+	LatencyHistogram before,
+				after;
+	int64		retried = 0;
+	int			i,
+				sec;
+
+	timeline = (LatencyHistogram *)
+		pg_malloc0(sizeof(LatencyHistogram) * (duration + 1));
+	for (i = 0; i < nthreads; i++)
+	{
+		for (sec = 0; sec <= duration; sec++)
+			mergeHistogram(&timeline[sec], &threads[i].timeline[sec]);
+		retried += threads[i].retried;
+	}
+
+	/* the stragglers past the end count in the last second */
+	mergeHistogram(&timeline[duration - 1], &timeline[duration]);
+
+	memset(&before, 0, sizeof(before));
+	memset(&after, 0, sizeof(after));
+	for (sec = 0; sec < duration; sec++)
+		mergeHistogram(sec < migrate_at ? &before : &after, &timeline[sec]);
+
+	printf("migration started after %d s\n", migrate_at);
+	printf("number of transactions retried: " INT64_FORMAT "\n", retried);
+	printf("                  tps   p50 (ms)  p90 (ms)  p99 (ms)  max (ms)\n");
+	printMigrationLine("before    ", &before, migrate_at);
+	printMigrationLine("after     ", &after, duration - migrate_at);
+	for (sec = 0; sec < duration; sec++)
+	{
+		char		label[32];
+
+		snprintf(label, sizeof(label), "%6d s%s", sec + 1,
+				 sec == migrate_at ? " *" : "  ");
+		printMigrationLine(label, &timeline[sec], 1);
+	}
+
+	pg_free(timeline);
+}
+
 /* print out results */
 static void
 printResults(TState *threads, StatsData *total, instr_time total_time,
@@ -4645,6 +5368,9 @@ printResults(TState *threads, StatsData *total, instr_time total_time,
 	printf("tps = %f (including connections establishing)\n", tps_include);
 	printf("tps = %f (excluding connections establishing)\n", tps_exclude);
 
+	if (migrate_at)
+		printMigrationReport(threads);
+
 	/* Report per-script/command statistics */
 	if (per_script_stats || is_latencies)
 	{
@@ -4793,6 +5519,8 @@ main(int argc, char **argv)
 		{"log-prefix", required_argument, NULL, 7},
 		{"foreign-keys", no_argument, NULL, 8},
 		{"random-seed", required_argument, NULL, 9},
+		{"tpcc", no_argument, NULL, 10},
+		{"migrate-at", required_argument, NULL, 11},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -4808,6 +5536,7 @@ main(int argc, char **argv)
 	bool		benchmarking_option_set = false;
 	bool		initialization_option_set = false;
 	bool		internal_script_used = false;
+	bool		tpcc_script_used = false;
 
 	CState	   *state;			/* status of clients */
 	TState	   *threads;		/* array of thread */
@@ -4998,10 +5727,18 @@ main(int argc, char **argv)
 					listAvailableScripts();
 					exit(0);
 				}
-				weight = parseScriptWeight(optarg, &script);
-				process_builtin(findBuiltin(script), weight);
-				benchmarking_option_set = true;
-				internal_script_used = true;
+				{
+					const BuiltinScript *bi;
+
+					weight = parseScriptWeight(optarg, &script);
+					bi = findBuiltin(script);
+					process_builtin(bi, weight);
+					benchmarking_option_set = true;
+					if (strncmp(bi->name, "tpcc-", 5) == 0)
+						tpcc_script_used = true;
+					else
+						internal_script_used = true;
+				}
 				break;
 			case 'S':
 				process_builtin(findBuiltin("select-only"), 1);
@@ -5148,6 +5885,20 @@ main(int argc, char **argv)
 					exit(1);
 				}
 				break;
+			case 10:			/* tpcc */
+				/* selects the tables under -i, the transaction mix otherwise */
+				tpcc = true;
+				break;
+			case 11:			/* migrate-at */
+				benchmarking_option_set = true;
+				migrate_at = atoi(optarg);
+				if (migrate_at <= 0)
+				{
+					fprintf(stderr, "invalid number of seconds before migration: \"%s\"\n",
+							optarg);
+					exit(1);
+				}
+				break;
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit(1);
@@ -5155,6 +5906,18 @@ main(int argc, char **argv)
 		}
 	}
 
+	/* add the TPC-C mix, weighted as TPC-C requires at least */
+	if (tpcc && !is_init_mode)
+	{
+		process_builtin(findBuiltin("tpcc-new-order"), 45);
+		process_builtin(findBuiltin("tpcc-payment"), 43);
+		process_builtin(findBuiltin("tpcc-order-status"), 4);
+		process_builtin(findBuiltin("tpcc-delivery"), 4);
+		process_builtin(findBuiltin("tpcc-stock-level"), 4);
+		benchmarking_option_set = true;
+		tpcc_script_used = true;
+	}
+
 	/* set default script if none */
 	if (num_scripts == 0 && !is_init_mode)
 	{
@@ -5317,6 +6080,25 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (migrate_at && (duration <= 0 || migrate_at >= duration))
+	{
+		fprintf(stderr, "migration (--migrate-at) must start within the duration of the test (-T)\n");
+		exit(1);
+	}
+
+	/* the server recognizes migration statements only when they are bound */
+	if (migrate_at && querymode == QUERY_SIMPLE)
+	{
+		fprintf(stderr, "migration (--migrate-at) requires the extended or prepared protocol (-M)\n");
+		exit(1);
+	}
+
+	if (internal_script_used && tpcc_script_used)
+	{
+		fprintf(stderr, "TPC-B and TPC-C builtin scripts cannot be used together\n");
+		exit(1);
+	}
+
 	/*
 	 * save main process id in the global variable because process id will be
 	 * changed after fork.
@@ -5417,6 +6199,52 @@ main(int argc, char **argv)
 					scale);
 	}
 
+	if (tpcc_script_used)
+	{
+		/* likewise, the scale of the TPC-C tables is the warehouse count */
+		res = PQexec(con, "select count(*) from warehouse");
+		if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		{
+			char	   *sqlState = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+
+			fprintf(stderr, "%s", PQerrorMessage(con));
+			if (sqlState && strcmp(sqlState, ERRCODE_UNDEFINED_TABLE) == 0)
+			{
+				fprintf(stderr, "Perhaps you need to do initialization (\"pgbench -i --tpcc\") in database \"%s\"\n", PQdb(con));
+			}
+
+			exit(1);
+		}
+		scale = atoi(PQgetvalue(res, 0, 0));
+		PQclear(res);
+
+		if (scale_given)
+			fprintf(stderr,
+					"scale option ignored, using count from warehouse table (%d)\n",
+					scale);
+
+		/*
+		 * Rows migrated by an earlier run stay migrated for as long as the
+		 * server runs, so the migration can only be run once.
+		 */
+		if (migrate_at)
+		{
+			res = PQexec(con, "select 1 from customer_proj1 limit 1");
+			if (PQresultStatus(res) != PGRES_TUPLES_OK)
+			{
+				fprintf(stderr, "%s", PQerrorMessage(con));
+				exit(1);
+			}
+			if (PQntuples(res) > 0)
+			{
+				fprintf(stderr, "customer has already been migrated\n");
+				fprintf(stderr, "Reinitialize with \"pgbench -i --tpcc\" and restart the server to migrate it again.\n");
+				exit(1);
+			}
+			PQclear(res);
+		}
+	}
+
 	/*
 	 * :scale variables normally get -s or database scale, but don't override
 	 * an explicit -D switch
@@ -5462,7 +6290,25 @@ main(int argc, char **argv)
 				exit(1);
 	}
 
-	if (!is_no_vacuum)
+	/*
+	 * :migrated tells whether the migration has started, under --migrate-at;
+	 * until then, or without it, it is 0 unless set with -D.
+	 */
+	if (lookupVariable(&state[0], "migrated") == NULL)
+	{
+		for (i = 0; i < nclients; i++)
+			if (!putVariableInt(&state[i], "startup", "migrated", 0))
+				exit(1);
+	}
+
+	if (!is_no_vacuum && tpcc_script_used)
+	{
+		fprintf(stderr, "starting vacuum...");
+		tryExecuteStatement(con, "vacuum warehouse");
+		tryExecuteStatement(con, "vacuum district");
+		fprintf(stderr, "end.\n");
+	}
+	else if (!is_no_vacuum)
 	{
 		fprintf(stderr, "starting vacuum...");
 		tryExecuteStatement(con, "vacuum pgbench_branches");
@@ -5496,6 +6342,11 @@ main(int argc, char **argv)
 		thread->random_state[2] = random();
 		thread->logfile = NULL; /* filled in later */
 		thread->latency_late = 0;
+		thread->retried = 0;
+		thread->timeline = NULL;
+		if (migrate_at)
+			thread->timeline = (LatencyHistogram *)
+				pg_malloc0(sizeof(LatencyHistogram) * (duration + 1));
 		thread->zipf_cache.nb_cells = 0;
 		thread->zipf_cache.current = 0;
 		thread->zipf_cache.overflowCount = 0;
@@ -5522,10 +6373,13 @@ main(int argc, char **argv)
 
 		INSTR_TIME_SET_CURRENT(thread->start_time);
 
-		/* compute when to stop */
+		/* compute when to stop, and when to start migrating */
 		if (duration > 0)
 			end_time = INSTR_TIME_GET_MICROSEC(thread->start_time) +
 				(int64) 1000000 * duration;
+		if (migrate_at)
+			migrate_time = INSTR_TIME_GET_MICROSEC(thread->start_time) +
+				(int64) 1000000 * migrate_at;
 
 		/* the first thread (i = 0) is executed by main thread */
 		if (i > 0)
@@ -5545,10 +6399,13 @@ main(int argc, char **argv)
 	}
 #else
 	INSTR_TIME_SET_CURRENT(threads[0].start_time);
-	/* compute when to stop */
+	/* compute when to stop, and when to start migrating */
 	if (duration > 0)
 		end_time = INSTR_TIME_GET_MICROSEC(threads[0].start_time) +
 			(int64) 1000000 * duration;
+	if (migrate_at)
+		migrate_time = INSTR_TIME_GET_MICROSEC(threads[0].start_time) +
+			(int64) 1000000 * migrate_at;
 	threads[0].thread = INVALID_THREAD;
 #endif							/* ENABLE_THREAD_SAFETY */
 
@@ -5935,6 +6792,8 @@ threadRun(void *arg)
 						fprintf(stderr, ", " INT64_FORMAT " skipped",
 								cur.skipped - last.skipped);
 				}
+				if (migrate_at && now >= migrate_time)
+					fprintf(stderr, ", migrating");
 				fprintf(stderr, "\n");
 
 				last = cur;
@@ -131,6 +131,22 @@ my @options = (
 	[ 'init vs run', '-i -S',    [qr{cannot be used in initialization}] ],
 	[ 'run vs init', '-S -F 90', [qr{cannot be used in benchmarking}] ],
 	[ 'ambiguous builtin', '-b s', [qr{ambiguous}] ],
+	[
+		'invalid migration start', '--migrate-at=0',
+		[qr{invalid number of seconds before migration}]
+	],
+	[
+		'migration => duration', '-M extended --migrate-at=5 -T 5',
+		[qr{must start within the duration}]
+	],
+	[
+		'migration => extended', '--migrate-at=5 -T 10',
+		[qr{requires the extended or prepared protocol}]
+	],
+	[
+		'TPC-B vs TPC-C', '-b tpcb -b tpcc-payment',
+		[qr{cannot be used together}]
+	],
 	[
 		'--progress-timestamp => --progress', '--progress-timestamp',
 		[qr{allowed only under}]
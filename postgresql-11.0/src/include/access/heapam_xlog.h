@@ -67,6 +67,8 @@
 #define XLH_INSERT_LAST_IN_MULTI				(1<<1)
 #define XLH_INSERT_IS_SPECULATIVE				(1<<2)
 #define XLH_INSERT_CONTAINS_NEW_TUPLE			(1<<3)
+/* written by a lazy migration, see migrate_schema.c */
+#define XLH_INSERT_IS_MIGRATION					(1<<4)
 
 /*
  * xl_heap_update flag values, 8 bits are available.
@@ -94,6 +96,8 @@
 #define XLH_DELETE_CONTAINS_OLD_KEY				(1<<2)
 #define XLH_DELETE_IS_SUPER						(1<<3)
 #define XLH_DELETE_IS_PARTITION_MOVE			(1<<4)
+/* a two-way migration moving the tuple out of its source */
+#define XLH_DELETE_IS_MIGRATION					(1<<5)
 
 /* convenience macro for checking whether any form of old tuple was logged */
 #define XLH_DELETE_CONTAINS_OLD						\
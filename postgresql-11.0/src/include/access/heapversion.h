@@ -0,0 +1,79 @@
+/*-------------------------------------------------------------------------
+ *
+ * heapversion.h
+ *	  POSTGRES heap tuple schema versioning, used by lazy ALTER COLUMN TYPE.
+ *
+ * A lazy ALTER COLUMN TYPE leaves existing tuples in place and instead
+ * advances the relation's schema version, recording the old column type in
+ * pg_attribute_version.  Every heap tuple carries the schema version it was
+ * written under in its header (see HeapTupleHeaderGetSchemaVersion), and
+ * the heap access routines convert tuples of older versions to the current
+ * row type as they are read.
+ *
+ * pg_attribute_version also lists the columns that a lazy ADD COLUMN gave a
+ * volatile default.  Rows that predate such a column get their value from
+ * the executor when they are first read (see executor/execLazyDefault.c).
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/access/heapversion.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef HEAPVERSION_H
+#define HEAPVERSION_H
+
+#include "access/htup.h"
+#include "access/relscan.h"
+#include "access/tupdesc.h"
+#include "fmgr.h"
+#include "nodes/bitmapset.h"
+#include "utils/relcache.h"
+
+/* The version must fit in HEAP_SCHEMA_VERSION_MASK */
+#define MaxSchemaVersion		3
+
+/* One cast step applied to a column of an old-version tuple */
+typedef struct SchemaVersionCast
+{
+	AttrNumber	attnum;			/* column to convert */
+	Oid			collation;		/* input collation for the cast */
+	FmgrInfo	flinfo;			/* cast function */
+} SchemaVersionCast;
+
+/* How to read tuples stamped with one particular old version */
+typedef struct SchemaVersion
+{
+	TupleDesc	tupdesc;		/* physical layout of such tuples */
+	int			ncasts;			/* number of cast steps */
+	SchemaVersionCast *casts;	/* cast steps, to be applied in order */
+} SchemaVersion;
+
+typedef struct SchemaVersionInfo
+{
+	MemoryContext context;		/* holds everything reachable from here */
+	int			current;		/* version of tuples laid out as tupdesc */
+	TupleDesc	tupdesc;		/* row type old tuples are converted to */
+	SchemaVersion versions[MaxSchemaVersion];	/* valid below current */
+	Bitmapset  *lazydefaults;	/* columns whose default is filled lazily */
+} SchemaVersionInfo;
+
+extern SchemaVersionInfo *BuildSchemaVersionInfo(Oid relid, TupleDesc tupdesc,
+					   MemoryContext parent);
+extern void FreeSchemaVersionInfo(SchemaVersionInfo *info);
+extern SchemaVersionInfo *RelationGetSchemaVersionInfo(Relation relation);
+extern int	RelationGetSchemaVersion(Relation relation);
+extern TupleDesc RelationGetTupleVersionDescr(Relation relation,
+							 HeapTupleHeader tup);
+extern bool RelationHasLazyDefaults(Relation relation);
+extern bool RelationIdHasLazyDefaults(Oid relid);
+
+extern HeapTuple heap_upgrade_tuple(HeapTuple tuple, SchemaVersionInfo *info);
+extern void heap_copy_tuple_identity(HeapTuple newtup, HeapTuple tuple);
+extern void heap_tuple_upgrade(Relation relation, HeapTuple tuple);
+extern void heap_scan_upgrade_tuple(HeapScanDesc scan);
+extern void index_scan_upgrade_tuple(IndexScanDesc scan);
+
+#endif							/* HEAPVERSION_H */
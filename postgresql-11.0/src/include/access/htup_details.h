@@ -273,7 +273,10 @@ struct HeapTupleHeaderData
  * information stored in t_infomask2:
  */
 #define HEAP_NATTS_MASK			0x07FF	/* 11 bits for number of attributes */
-/* bits 0x1800 are available */
+#define HEAP_SCHEMA_VERSION_MASK	0x1800	/* schema version the tuple was
+											 * written under, see
+											 * access/heapversion.h */
+#define HEAP_SCHEMA_VERSION_SHIFT	11
 #define HEAP_KEYS_UPDATED		0x2000	/* tuple was updated and key cols
 										 * modified, or tuple deleted */
 #define HEAP_HOT_UPDATED		0x4000	/* tuple was HOT-updated */
@@ -549,6 +552,15 @@ do { \
 	(tup)->t_infomask2 = ((tup)->t_infomask2 & ~HEAP_NATTS_MASK) | (natts) \
 )
 
+#define HeapTupleHeaderGetSchemaVersion(tup) \
+	(((tup)->t_infomask2 & HEAP_SCHEMA_VERSION_MASK) >> HEAP_SCHEMA_VERSION_SHIFT)
+
+#define HeapTupleHeaderSetSchemaVersion(tup, version) \
+( \
+	(tup)->t_infomask2 = ((tup)->t_infomask2 & ~HEAP_SCHEMA_VERSION_MASK) | \
+		(((version) << HEAP_SCHEMA_VERSION_SHIFT) & HEAP_SCHEMA_VERSION_MASK) \
+)
+
 #define HeapTupleHeaderHasExternal(tup) \
 		(((tup)->t_infomask & HEAP_HASEXTERNAL) != 0)
 
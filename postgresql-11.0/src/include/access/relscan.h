@@ -64,6 +64,8 @@ typedef struct HeapScanDescData
 	/* rs_numblocks is usually InvalidBlockNumber, meaning "scan whole rel" */
 	BufferAccessStrategy rs_strategy;	/* access strategy for reads */
 	bool		rs_syncscan;	/* report location to syncscan logic? */
+	bool		rs_migrate;		/* feeding a migration? see heap_setmigratescan */
+	BlockNumber rs_prefetch_next;	/* next block to consider prefetching */
 
 	/* scan current state */
 	bool		rs_inited;		/* false = scan not init'd yet */
@@ -73,6 +75,10 @@ typedef struct HeapScanDescData
 	/* NB: if rs_cbuf is not InvalidBuffer, we hold a pin on that buffer */
 	ParallelHeapScanDesc rs_parallel;	/* parallel scan information */
 
+	/* conversion of tuples written under older schema versions */
+	struct SchemaVersionInfo *rs_versions;	/* NULL if all are current */
+	MemoryContext rs_versioncxt;	/* holds the converted rs_ctup, if any */
+
 	/* these fields only used in page-at-a-time mode and for bitmap scans */
 	int			rs_cindex;		/* current tuple's index in vistuples */
 	int			rs_ntuples;		/* number of visible tuples on page */
@@ -137,8 +143,19 @@ typedef struct IndexScanDescData
 	/* state data for traversing HOT chains in index_getnext */
 	bool		xs_continue_hot;	/* T if must keep walking HOT chain */
 
+	/* TIDs read ahead for a migration; see index_setmigratescan */
+	int			xs_migrate_max;	/* queue size, or 0 if not reading ahead */
+	int			xs_migrate_ntids;	/* number of TIDs queued */
+	int			xs_migrate_next;	/* index of next TID to return */
+	ItemPointerData *xs_migrate_tids;	/* the queued TIDs */
+	bool	   *xs_migrate_recheck;	/* their xs_recheck flags */
+
 	/* parallel index scan information, in shared memory */
 	ParallelIndexScanDesc parallel_scan;
+
+	/* conversion of heap tuples written under older schema versions */
+	struct SchemaVersionInfo *xs_versions;	/* NULL if all are current */
+	MemoryContext xs_versioncxt;	/* holds the converted xs_ctup, if any */
 }			IndexScanDescData;
 
 /* Generic structure for parallel scans */
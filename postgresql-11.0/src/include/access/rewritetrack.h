@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * rewritetrack.h
+ *	  Tracking of heap blocks changed during an online table rewrite.
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/access/rewritetrack.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef REWRITETRACK_H
+#define REWRITETRACK_H
+
+#include "storage/block.h"
+#include "utils/relcache.h"
+
+/* Number of online rewrites that may be in progress at once */
+#define MAX_ONLINE_REWRITES		4
+
+typedef struct RewriteTrackSlot RewriteTrackSlot;
+
+/* GUC variable */
+extern int	online_rewrite_tracked_blocks;
+
+extern Size RewriteTrackShmemSize(void);
+extern void RewriteTrackShmemInit(void);
+
+extern RewriteTrackSlot *RewriteTrackStart(Relation rel);
+extern void RewriteTrackStop(RewriteTrackSlot *slot);
+extern BlockNumber RewriteTrackCapacity(void);
+extern bool RewriteTrackTestAndClear(RewriteTrackSlot *slot,
+						 BlockNumber blkno);
+extern void RewriteTrackSetDirty(RewriteTrackSlot *slot, BlockNumber blkno);
+
+extern void RewriteTrackNoteChange(Relation rel, BlockNumber blkno);
+
+#endif							/* REWRITETRACK_H */
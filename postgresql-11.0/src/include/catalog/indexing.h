@@ -92,6 +92,9 @@ DECLARE_UNIQUE_INDEX(pg_attribute_relid_attnam_index, 2658, on pg_attribute usin
 DECLARE_UNIQUE_INDEX(pg_attribute_relid_attnum_index, 2659, on pg_attribute using btree(attrelid oid_ops, attnum int2_ops));
 #define AttributeRelidNumIndexId  2659
 
+DECLARE_UNIQUE_INDEX(pg_attribute_version_relid_version_attnum_index, 4143, on pg_attribute_version using btree(avrelid oid_ops, avversion int2_ops, avattnum int2_ops));
+#define AttributeVersionIndexId  4143
+
 DECLARE_UNIQUE_INDEX(pg_authid_rolname_index, 2676, on pg_authid using btree(rolname name_ops));
 #define AuthIdRolnameIndexId	2676
 DECLARE_UNIQUE_INDEX(pg_authid_oid_index, 2677, on pg_authid using btree(oid oid_ops));
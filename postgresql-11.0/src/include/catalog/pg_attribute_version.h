@@ -0,0 +1,65 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_attribute_version.h
+ *	  definition of the "attribute version" system catalog
+ *	  (pg_attribute_version)
+ *
+ * A row in this catalog records that a lazy ALTER COLUMN TYPE changed the
+ * type of column avattnum of relation avrelid when the relation's schema
+ * version was advanced to avversion.  Heap tuples stamped with an older
+ * schema version still store that column as avtypid, and are converted to
+ * the current row type with avcastfunc when they are read.
+ *
+ * A row with avtypid = 0 instead records that column avattnum was added by
+ * a lazy ADD COLUMN with a volatile default: tuples written before that do
+ * not contain the column, and the default is filled in when they are first
+ * read.
+ *
+ *
+ * Portions Copyright (c) 1996-2018, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/catalog/pg_attribute_version.h
+ *
+ * NOTES
+ *	  The Catalog.pm module reads this file and derives schema
+ *	  information.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PG_ATTRIBUTE_VERSION_H
+#define PG_ATTRIBUTE_VERSION_H
+
+#include "catalog/genbki.h"
+#include "catalog/pg_attribute_version_d.h"
+
+/* ----------------
+ *		pg_attribute_version definition.  cpp turns this into
+ *		typedef struct FormData_pg_attribute_version
+ * ----------------
+ */
+CATALOG(pg_attribute_version,4142,AttributeVersionRelationId) BKI_WITHOUT_OIDS
+{
+	Oid			avrelid;		/* OID of the altered relation */
+	int16		avversion;		/* schema version introduced by the change */
+	int16		avattnum;		/* column whose type was changed */
+	Oid			avtypid;		/* type stored by older tuples, or 0 */
+	int32		avtypmod;		/* typmod stored by older tuples */
+	Oid			avcollation;	/* collation of the older type */
+	regproc		avcastfunc;		/* cast from avtypid to the next type */
+} FormData_pg_attribute_version;
+
+/* ----------------
+ *		Form_pg_attribute_version corresponds to a pointer to a tuple with
+ *		the format of pg_attribute_version relation.
+ * ----------------
+ */
+typedef FormData_pg_attribute_version *Form_pg_attribute_version;
+
+extern int16 GetRelationSchemaVersion(Oid relid);
+extern void StoreAttributeVersion(Oid relid, int16 version, AttrNumber attnum,
+					  Oid typid, int32 typmod, Oid collation,
+					  Oid castfunc);
+extern void RemoveAttributeVersions(Oid relid);
+
+#endif							/* PG_ATTRIBUTE_VERSION_H */
@@ -22,6 +22,10 @@
 #include "utils/relcache.h"
 
 
+/* GUC variables */
+extern bool lazy_alter_column_type;
+extern bool lazy_add_column;
+
 extern ObjectAddress DefineRelation(CreateStmt *stmt, char relkind, Oid ownerId,
 			   ObjectAddress *typaddress, const char *queryString);
 
@@ -26,6 +26,10 @@ struct ArrayRefState;
 #define EEO_FLAG_INTERPRETER_INITIALIZED	(1 << 1)
 /* jump-threading is in use */
 #define EEO_FLAG_DIRECT_THREADED			(1 << 2)
+/* ExecQualBatch has looked at the qual */
+#define EEO_FLAG_BATCH_CHECKED				(1 << 3)
+/* ... and found it compares a scan column with a constant */
+#define EEO_FLAG_BATCH_VAR_CONST			(1 << 4)
 
 /* Typical API for out-of-line evaluation subroutines */
 typedef void (*ExecEvalSubroutine) (ExprState *state,
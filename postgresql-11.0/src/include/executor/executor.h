@@ -136,6 +136,8 @@ extern TupleHashEntry FindTupleHashEntry(TupleHashTable hashtable,
 				   TupleTableSlot *slot,
 				   ExprState *eqcomp,
 				   FmgrInfo *hashfunctions);
+extern uint32 TupleHashTableHashSlot(TupleHashTable hashtable,
+					   TupleTableSlot *slot);
 
 /*
  * prototypes from functions in execJunk.c
@@ -220,6 +222,19 @@ extern void ExecEndNode(PlanState *node);
 extern bool ExecShutdownNode(PlanState *node);
 extern void ExecSetTupleBound(int64 tuples_needed, PlanState *child_node);
 
+/*
+ * functions in execBatch.c
+ */
+extern int	executor_batch_size;
+
+extern int	ExecProcNodeBatch(PlanState *node, TupleTableSlot **slots,
+				  int maxslots);
+extern TupleTableSlot **ExecInitBatchSlots(EState *estate, TupleDesc tupdesc,
+				   int nslots);
+extern TupleBatch *ExecInitTupleBatch(PlanState *outerPlan);
+extern TupleTableSlot *ExecProjectInto(ProjectionInfo *projInfo,
+				TupleTableSlot *slot);
+
 
 /* ----------------------------------------------------------------
  *		ExecProcNode
@@ -236,6 +251,38 @@ ExecProcNode(PlanState *node)
 
 	return node->ExecProcNode(node);
 }
+
+/* ----------------------------------------------------------------
+ *		ExecBatchNext
+ *
+ *		Return the next tuple of outerPlan, fetching a new batch of them
+ *		once the previous one has been consumed, or NULL at the end.
+ * ----------------------------------------------------------------
+ */
+static inline TupleTableSlot *
+ExecBatchNext(PlanState *outerPlan, TupleBatch *batch)
+{
+	if (batch->next >= batch->ntuples)
+	{
+		batch->ntuples = ExecProcNodeBatch(outerPlan, batch->tuples,
+										   batch->maxtuples);
+		batch->next = 0;
+		if (batch->ntuples == 0)
+			return NULL;
+	}
+
+	return batch->tuples[batch->next++];
+}
+
+/*
+ * Forget the tuples left in a batch, as when the outer plan is rescanned.
+ */
+static inline void
+ExecResetTupleBatch(TupleBatch *batch)
+{
+	batch->ntuples = 0;
+	batch->next = 0;
+}
 #endif
 
 /*
@@ -396,6 +443,12 @@ ExecQualAndReset(ExprState *state, ExprContext *econtext)
 
 extern bool ExecCheck(ExprState *state, ExprContext *context);
 
+/*
+ * prototypes from functions in execExprInterp.c
+ */
+extern int	ExecQualBatch(ExprState *state, ExprContext *econtext,
+			  TupleTableSlot **slots, int nslots, int *sel);
+
 /*
  * prototypes from functions in execSRF.c
  */
@@ -420,11 +473,22 @@ extern Datum ExecMakeFunctionResultSet(SetExprState *fcache,
 typedef TupleTableSlot *(*ExecScanAccessMtd) (ScanState *node);
 typedef bool (*ExecScanRecheckMtd) (ScanState *node, TupleTableSlot *slot);
 
+typedef TupleTableSlot *(*ExecScanBatchAccessMtd) (ScanState *node,
+													TupleTableSlot *slot,
+													HeapTuple tuple);
+
 extern TupleTableSlot *ExecScan(ScanState *node, ExecScanAccessMtd accessMtd,
 		 ExecScanRecheckMtd recheckMtd);
+extern bool ExecInitScanBatch(ScanState *node);
+extern int ExecScanBatch(ScanState *node, ExecScanAccessMtd accessMtd,
+			  ExecScanRecheckMtd recheckMtd,
+			  ExecScanBatchAccessMtd batchAccessMtd,
+			  TupleTableSlot **slots, int maxslots);
+extern void ExecEndScanBatch(ScanState *node);
 extern void ExecAssignScanProjectionInfo(ScanState *node);
 extern void ExecAssignScanProjectionInfoWithVarno(ScanState *node, Index varno);
 extern void ExecScanReScan(ScanState *node);
+extern bool MigrateTuple(TupleTableSlot *slot);
 
 /*
  * prototypes from functions in execTuples.c
@@ -550,6 +614,19 @@ extern void check_exclusion_constraint(Relation heap, Relation index,
 						   Datum *values, bool *isnull,
 						   EState *estate, bool newIndex);
 
+/*
+ * prototypes from functions in execLazyDefault.c
+ */
+extern LazyDefaultState *ExecInitLazyDefaults(Relation rel, TupleDesc tupdesc,
+					 EState *estate, bool writeback);
+extern bool ExecLazyDefaultsCanStore(Relation rel, EState *estate);
+extern HeapTuple ExecFillLazyDefaults(LazyDefaultState *ldstate,
+					 HeapTuple tuple, ExprContext *econtext);
+extern void ExecEndLazyDefaults(LazyDefaultState *ldstate);
+extern void ExecScanFillLazyDefaults(ScanState *node, TupleTableSlot *slot);
+extern HeapTuple ExecResultRelFillLazyDefaults(ResultRelInfo *resultRelInfo,
+							  HeapTuple tuple, EState *estate);
+
 /*
  * prototypes from functions in execReplication.c
  */
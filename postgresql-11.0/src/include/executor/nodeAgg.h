@@ -14,7 +14,12 @@
 #ifndef NODEAGG_H
 #define NODEAGG_H
 
+#include "access/parallel.h"
+#include "lib/dshash.h"
 #include "nodes/execnodes.h"
+#include "port/atomics.h"
+#include "storage/barrier.h"
+#include "utils/logtape.h"
 
 
 /*
@@ -85,6 +90,12 @@ typedef struct AggStatePerTransData
 	/* fmgr lookup data for deserialization function */
 	FmgrInfo	deserialfn;
 
+	/*
+	 * fmgr lookup data for the combine function, used to merge groups into
+	 * the shared hash table of a Parallel HashAggregate; unused otherwise.
+	 */
+	FmgrInfo	combinefn;
+
 	/* Input collation derived for aggregate */
 	Oid			aggCollation;
 
@@ -164,6 +175,9 @@ typedef struct AggStatePerTransData
 	FunctionCallInfoData serialfn_fcinfo;
 
 	FunctionCallInfoData deserialfn_fcinfo;
+
+	/* Likewise for the combine function, when it is used */
+	FunctionCallInfoData combinefn_fcinfo;
 }			AggStatePerTransData;
 
 /*
@@ -304,11 +318,67 @@ typedef struct AggStatePerHashData
 	Agg		   *aggnode;		/* original Agg node, for numGroups etc. */
 }			AggStatePerHashData;
 
+/*
+ * HashAggSpillData - input tuples spilled by one pass of hashed aggregation
+ *
+ * Once the hash table has used up work_mem, a pass stops creating groups and
+ * writes each input tuple that doesn't belong to a group already in the table
+ * to one of npartitions tapes, chosen by the next bits of its hash value.
+ * Each tape that receives tuples is read back later as a HashAggBatchData.
+ */
+typedef struct HashAggSpillData
+{
+	LogicalTapeSet *tapeset;	/* one tape per partition, or NULL once
+								 * every partition has been read back */
+	int			npartitions;	/* number of partitions, a power of 2 */
+	int			partition_bits; /* log2(npartitions) */
+	int			used_bits;		/* hash bits used by earlier passes */
+	int64	   *ntuples;		/* number of tuples written to each tape */
+	int			nunread;		/* partitions not yet read back */
+}			HashAggSpillData;
+
+/*
+ * HashAggBatchData - a spilled partition waiting to be aggregated
+ */
+typedef struct HashAggBatchData
+{
+	HashAggSpill spill;			/* spill the partition belongs to */
+	int			tapenum;		/* its tape in spill->tapeset */
+	int			used_bits;		/* hash bits shared by all its tuples */
+	int64		ntuples;		/* number of tuples in it */
+}			HashAggBatchData;
+
+/*
+ * ParallelAggState - shared state of a Parallel HashAggregate
+ *
+ * Each participant aggregates its share of the input into a local hash table,
+ * and merges that into a dshash table shared by all of them whenever it
+ * outgrows work_mem, and once more at the end of its input.  After all have
+ * done so, as build_barrier tells, they claim the shared table's partitions
+ * one at a time to finalize and return the groups they hold.
+ */
+typedef struct ParallelAggState
+{
+	dshash_table_handle hashtable_handle;	/* the shared hash table */
+	Barrier		build_barrier;	/* synchronizes the end of merging */
+	pg_atomic_uint32 next_partition;	/* next partition to return */
+} ParallelAggState;
+
+/* The phases of build_barrier. */
+#define PAGG_BUILD_MERGING			0
+#define PAGG_BUILD_DONE				1
+
 
 extern AggState *ExecInitAgg(Agg *node, EState *estate, int eflags);
 extern void ExecEndAgg(AggState *node);
 extern void ExecReScanAgg(AggState *node);
 
+extern void ExecAggEstimate(AggState *node, ParallelContext *pcxt);
+extern void ExecAggInitializeDSM(AggState *node, ParallelContext *pcxt);
+extern void ExecAggReInitializeDSM(AggState *node, ParallelContext *pcxt);
+extern void ExecAggInitializeWorker(AggState *node,
+						ParallelWorkerContext *pwcxt);
+
 extern Size hash_agg_entry_size(int numAggs);
 
 extern Datum aggregate_dummy(PG_FUNCTION_ARGS);
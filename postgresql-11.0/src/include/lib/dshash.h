@@ -26,6 +26,15 @@ typedef dsa_pointer dshash_table_handle;
 /* The type for hash values. */
 typedef uint32 dshash_hash;
 
+/*
+ * The number of partitions for locking purposes.  This is set to match
+ * NUM_BUFFER_PARTITIONS for now, on the basis that whatever's good enough for
+ * the buffer pool must be good enough for any other purpose.  This could
+ * become a runtime parameter in future.
+ */
+#define DSHASH_NUM_PARTITIONS_LOG2 7
+#define DSHASH_NUM_PARTITIONS (1 << DSHASH_NUM_PARTITIONS_LOG2)
+
 /* A function type for comparing keys. */
 typedef int (*dshash_compare_function) (const void *a, const void *b,
 										size_t size, void *arg);
@@ -59,6 +68,18 @@ typedef struct dshash_parameters
 struct dshash_table_item;
 typedef struct dshash_table_item dshash_table_item;
 
+/*
+ * The state of a scan through the entries of one partition.  Callers may
+ * allocate this, but its members are private to dshash.c.
+ */
+typedef struct dshash_seq_status
+{
+	dshash_table *hash_table;	/* table being scanned */
+	size_t		curbucket;		/* next bucket to scan */
+	size_t		endbucket;		/* first bucket past the partition */
+	dsa_pointer nextitem;		/* next item in the current bucket */
+} dshash_seq_status;
+
 /* Creating, sharing and destroying from hash tables. */
 extern dshash_table *dshash_create(dsa_area *area,
 			  const dshash_parameters *params,
@@ -80,6 +101,11 @@ extern bool dshash_delete_key(dshash_table *hash_table, const void *key);
 extern void dshash_delete_entry(dshash_table *hash_table, void *entry);
 extern void dshash_release_lock(dshash_table *hash_table, void *entry);
 
+/* Scanning the entries of a table that is no longer being modified. */
+extern void dshash_seq_init(dshash_seq_status *status,
+				dshash_table *hash_table, int partition);
+extern void *dshash_seq_next(dshash_seq_status *status);
+
 /* Convenience hash and compare functions wrapping memcmp and tag_hash. */
 extern int	dshash_memcmp(const void *a, const void *b, size_t size, void *arg);
 extern dshash_hash dshash_memhash(const void *v, size_t size, void *arg);
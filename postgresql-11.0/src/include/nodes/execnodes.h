@@ -462,8 +462,35 @@ typedef struct ResultRelInfo
 
 	/* true if ready for tuple routing */
 	bool		ri_PartitionReadyForRouting;
+
+	/* for filling in lazy column defaults of rows read back, or NULL */
+	struct LazyDefaultState *ri_LazyDefaults;
 } ResultRelInfo;
 
+/* ----------------
+ *	  LazyDefaultState information
+ *
+ *		State for filling in the columns that ADD COLUMN gave a volatile
+ *		default without rewriting the table, in rows that predate them
+ *		(see execLazyDefault.c).  If ld_writeback is set, the values are
+ *		stored back in the heap, so that every reader sees the same ones;
+ *		that takes a result relation of our own for index upkeep.
+ * ----------------
+ */
+typedef struct LazyDefaultState
+{
+	Relation	ld_relation;	/* relation the rows belong to */
+	TupleDesc	ld_tupdesc;		/* row type to fill the rows in to */
+	int			ld_ncolumns;	/* number of columns with a lazy default */
+	AttrNumber *ld_attnums;		/* those columns, in ascending order */
+	ExprState **ld_defaults;	/* their default expressions, or NULLs */
+	Snapshot	ld_snapshot;	/* snapshot the rows were read with */
+	bool		ld_writeback;	/* store the values back? */
+	struct EState *ld_estate;	/* private executor state for writing */
+	ResultRelInfo *ld_resultRelInfo;	/* ... its result relation */
+	TupleTableSlot *ld_slot;	/* ... and slot for index insertion */
+} LazyDefaultState;
+
 /* ----------------
  *	  EState information
  *
@@ -904,6 +931,34 @@ typedef struct DomainConstraintState
  */
 typedef TupleTableSlot *(*ExecProcNodeMtd) (struct PlanState *pstate);
 
+/* ----------------
+ *	 ExecProcNodeBatchMtd
+ *
+ * This is the method called by ExecProcNodeBatch to return up to maxslots
+ * tuples at once from an executor node that supports it.  It stores them
+ * in slots and returns how many it stored; zero means no more tuples are
+ * available.  The slots belong to the node and remain valid until it is
+ * called again or rescanned.
+ * ----------------
+ */
+typedef int (*ExecProcNodeBatchMtd) (struct PlanState *pstate,
+									 TupleTableSlot **slots, int maxslots);
+
+/* ----------------
+ *	 TupleBatch
+ *
+ * Input a node fetches from its outer plan a batch at a time; see
+ * ExecBatchNext.
+ * ----------------
+ */
+typedef struct TupleBatch
+{
+	int			maxtuples;		/* size of tuples[] */
+	int			ntuples;		/* number of tuples fetched */
+	int			next;			/* index of next tuple to return */
+	TupleTableSlot **tuples;	/* the outer plan's slots */
+} TupleBatch;
+
 /* ----------------
  *		PlanState node
  *
@@ -924,6 +979,8 @@ typedef struct PlanState
 	ExecProcNodeMtd ExecProcNode;	/* function to return next tuple */
 	ExecProcNodeMtd ExecProcNodeReal;	/* actual function, if above is a
 										 * wrapper */
+	ExecProcNodeBatchMtd ExecProcNodeBatch; /* function to return a batch
+											 * of tuples, or NULL */
 
 	Instrumentation *instrument;	/* Optional runtime stats for this node */
 	WorkerInstrumentation *worker_instrument;	/* per-worker instrumentation */
@@ -1017,6 +1074,8 @@ typedef struct ResultState
 	ExprState  *resconstantqual;
 	bool		rs_done;		/* are we done? */
 	bool		rs_checkqual;	/* do we need to check the qual? */
+	TupleBatch *rs_batch;		/* outer tuples, if fetched in batches */
+	TupleTableSlot **rs_BatchSlots; /* their projections */
 } ResultState;
 
 /* ----------------
@@ -1202,6 +1261,14 @@ typedef struct ScanState
 	Relation	ss_currentRelation;
 	HeapScanDesc ss_currentScanDesc;
 	TupleTableSlot *ss_ScanTupleSlot;
+	LazyDefaultState *ss_LazyDefaults;	/* set up on first short row */
+	/* these fields are used when returning batches; see ExecScanBatch */
+	int			ss_BatchSize;	/* number of batch slots, or 0 */
+	TupleTableSlot **ss_BatchScanSlots; /* scan tuples of a batch */
+	HeapTupleData *ss_BatchTuples;	/* headers of the tuples in those slots */
+	TupleTableSlot **ss_BatchResultSlots;	/* their projections, if any */
+	int		   *ss_BatchSel;	/* positions of those passing the qual */
+	bool		ss_BatchDone;	/* has the scan been exhausted? */
 } ScanState;
 
 /* ----------------
@@ -1278,6 +1345,7 @@ typedef struct
  *		OrderByTypByVals   is the datatype of order by expression pass-by-value?
  *		OrderByTypLens	   typlens of the datatypes of order by expressions
  *		pscan_len		   size of parallel index scan descriptor
+ *		MigrateReadAhead   may the scan read ahead for a migration?
  * ----------------
  */
 typedef struct IndexScanState
@@ -1305,6 +1373,7 @@ typedef struct IndexScanState
 	bool	   *iss_OrderByTypByVals;
 	int16	   *iss_OrderByTypLens;
 	Size		iss_PscanLen;
+	bool		iss_MigrateReadAhead;
 } IndexScanState;
 
 /* ----------------
@@ -1867,6 +1936,32 @@ typedef struct SortState
 	SharedSortInfo *shared_info;	/* one entry per worker */
 } SortState;
 
+/* ----------------
+ *	 IncrementalSortState information
+ *
+ *	 The input arrives sorted on the leading presorted keys, so it is sorted
+ *	 in batches, each ending at a change of those keys.  group_pivot holds a
+ *	 tuple of the batch being read, to detect that change; when the tuple
+ *	 that shows it has been read, it is kept there (pivot_pending) to begin
+ *	 the next batch.
+ * ----------------
+ */
+typedef struct IncrementalSortState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	bool		bounded;		/* is the result set bounded? */
+	int64		bound;			/* if bounded, how many tuples are needed */
+	int64		tuples_returned;	/* tuples returned since (re)scan */
+	int			nPresortedCols; /* number of presorted leading keys */
+	FmgrInfo   *presorted_eqfuncs;	/* equality functions for those keys */
+	bool		outerNodeDone;	/* have we read all of the input? */
+	bool		pivot_pending;	/* does group_pivot begin the next batch? */
+	TupleTableSlot *group_pivot;	/* tuple the current batch is compared to */
+	void	   *tuplesortstate; /* tuplesort.c state of the current batch */
+	int64		nbatches;		/* number of batches sorted, for EXPLAIN */
+	TuplesortInstrumentation peak_stats;	/* stats of the largest batch */
+} IncrementalSortState;
+
 /* ---------------------
  *	GroupState information
  * ---------------------
@@ -1896,6 +1991,8 @@ typedef struct AggStatePerTransData *AggStatePerTrans;
 typedef struct AggStatePerGroupData *AggStatePerGroup;
 typedef struct AggStatePerPhaseData *AggStatePerPhase;
 typedef struct AggStatePerHashData *AggStatePerHash;
+typedef struct HashAggSpillData *HashAggSpill;
+typedef struct HashAggBatchData *HashAggBatch;
 
 typedef struct AggState
 {
@@ -1947,6 +2044,30 @@ typedef struct AggState
 	AggStatePerGroup *all_pergroups;	/* array of first ->pergroups, than
 										 * ->hash_pergroup */
 	ProjectionInfo *combinedproj;	/* projection machinery */
+	TupleBatch *batch;			/* outer tuples, if fetched in batches */
+	/* these fields are used when AGG_HASHED spills groups to disk: */
+	bool		hash_can_spill; /* may groups beyond work_mem be spilled? */
+	bool		hash_spill_mode;	/* table is full, spill tuples of new
+									 * groups */
+	int			hash_used_bits; /* hash bits already used to partition the
+								 * current input */
+	HashAggSpill hash_spill;	/* partitions the current pass writes */
+	HashAggBatch hash_batch;	/* spilled partition being read, if any */
+	List	   *hash_batches;	/* spilled partitions not yet read */
+	List	   *hash_spills;	/* all spills made during this scan */
+	TupleTableSlot *hash_spill_slot;	/* slot for tuples read back */
+	Size		hash_mem_peak;	/* peak memory used by the hash table */
+	long		hash_disk_used; /* kB written to spill files */
+	int			hash_batches_used;	/* number of passes over the input */
+	/* these fields are used by a Parallel HashAggregate's shared table: */
+	struct ParallelAggState *parallel_state;	/* shared state in DSM */
+	struct dshash_table *shared_table;	/* groups of all participants */
+	struct dshash_seq_status *shared_scan;	/* scan of a claimed partition */
+	bool		shared_scan_active; /* is shared_scan in progress? */
+	bool		shared_merge_pending;	/* merge the local table into the
+										 * shared one before going on */
+	Size		shared_key_size;	/* size of the key of a shared entry */
+	FmgrInfo   *shared_eqfunctions; /* per-grouping-field equality fns */
 } AggState;
 
 /* ----------------
@@ -2144,6 +2265,8 @@ typedef struct HashState
 
 	/* Parallel hash state. */
 	struct ParallelHashJoinState *parallel_state;
+
+	TupleBatch *batch;			/* outer tuples, if fetched in batches */
 } HashState;
 
 /* ----------------
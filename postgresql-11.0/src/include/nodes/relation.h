@@ -1563,6 +1563,16 @@ typedef struct SortPath
 	Path	   *subpath;		/* path representing input source */
 } SortPath;
 
+/*
+ * IncrementalSortPath represents an explicit sort of input that is already
+ * sorted on a leading subset of the requested pathkeys
+ */
+typedef struct IncrementalSortPath
+{
+	SortPath	spath;
+	int			nPresortedCols; /* number of presorted leading pathkeys */
+} IncrementalSortPath;
+
 /*
  * GroupPath represents grouping (of presorted input)
  *
@@ -94,6 +94,11 @@ typedef void (*LogicalDecodeMessageCB) (struct LogicalDecodingContext *ctx,
 typedef bool (*LogicalDecodeFilterByOriginCB) (struct LogicalDecodingContext *ctx,
 											   RepOriginId origin_id);
 
+/*
+ * Filter the changes lazy migrations make.
+ */
+typedef bool (*LogicalDecodeFilterMigrationCB) (struct LogicalDecodingContext *ctx);
+
 /*
  * Called to shutdown an output plugin.
  */
@@ -112,6 +117,7 @@ typedef struct OutputPluginCallbacks
 	LogicalDecodeMessageCB message_cb;
 	LogicalDecodeFilterByOriginCB filter_by_origin_cb;
 	LogicalDecodeShutdownCB shutdown_cb;
+	LogicalDecodeFilterMigrationCB filter_migration_cb;
 } OutputPluginCallbacks;
 
 /* Functions in replication/logical/logical.c */
@@ -94,6 +94,9 @@ typedef struct ReorderBufferChange
 			/* no previously reassembled toast chunks are necessary anymore */
 			bool		clear_toast_afterwards;
 
+			/* written by a lazy migration rather than by the application */
+			bool		is_migration;
+
 			/* valid for DELETE || UPDATE */
 			ReorderBufferTupleBuf *oldtuple;
 			/* valid for INSERT || UPDATE */
@@ -112,7 +112,9 @@ extern PGDLLIMPORT int NamedLWLockTrancheRequests;
 /* Number of partitions of the shared buffer mapping hashtable */
 #define NUM_BUFFER_PARTITIONS  128
 
+/* Number of partitions of each migration bitmap (see migrate_schema.h) */
 #define NUM_MIGRATE_BITMAP_LOCKS 256
+#define NUM_MIGRATE_BITMAP_LOCK_SETS 16
 
 /* Number of partitions the shared lock tables are divided into */
 #define LOG2_NUM_LOCK_PARTITIONS  4
@@ -131,7 +133,8 @@ extern PGDLLIMPORT int NamedLWLockTrancheRequests;
 #define MIGRATE_BITMAP_OFFSET \
 	(PREDICATELOCK_MANAGER_LWLOCK_OFFSET + NUM_PREDICATELOCK_PARTITIONS)
 #define NUM_FIXED_LWLOCKS	\
-	(MIGRATE_BITMAP_OFFSET + NUM_MIGRATE_BITMAP_LOCKS * 2)
+	(MIGRATE_BITMAP_OFFSET + \
+	 NUM_MIGRATE_BITMAP_LOCKS * NUM_MIGRATE_BITMAP_LOCK_SETS)
 
 typedef enum LWLockMode
 {
@@ -224,6 +227,7 @@ typedef enum BuiltinTrancheIds
 	LWTRANCHE_SHARED_TUPLESTORE,
 	LWTRANCHE_TBM,
 	LWTRANCHE_PARALLEL_APPEND,
+	LWTRANCHE_PARALLEL_HASH_AGG,
 	LWTRANCHE_FIRST_USER_DEFINED
 }			BuiltinTrancheIds;
 
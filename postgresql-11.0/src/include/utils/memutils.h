@@ -82,6 +82,7 @@ extern void MemoryContextSetParent(MemoryContext context,
 extern Size GetMemoryChunkSpace(void *pointer);
 extern MemoryContext MemoryContextGetParent(MemoryContext context);
 extern bool MemoryContextIsEmpty(MemoryContext context);
+extern Size MemoryContextMemAllocated(MemoryContext context, bool recurse);
 extern void MemoryContextStats(MemoryContext context);
 extern void MemoryContextStatsDetail(MemoryContext context, int max_children);
 extern void MemoryContextAllowInCriticalSection(MemoryContext context,
@@ -154,6 +155,7 @@ extern MemoryContext AllocSetContextCreateExtended(MemoryContext parent,
 							  Size minContextSize,
 							  Size initBlockSize,
 							  Size maxBlockSize);
+extern Size AllocSetMemAllocated(MemoryContext context);
 
 /*
  * This wrapper macro exists to check for non-constant strings used as context
@@ -16,8 +16,13 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "access/htup.h"
+#include "storage/buf.h"
+#include "storage/itemptr.h"
 #include "storage/lwlock.h"
+#include "nodes/params.h"
 #include "nodes/pg_list.h"
+#include "utils/relcache.h"
 
 
 #define LOCKBITPOS      0
@@ -63,44 +68,278 @@ tpcc=# select pid, num_tuples from (select (ctid::text::point)[0]::bigint as pid
 #define NUMTUPLESLASTPAGE   4
 #define NUMTUPLES           2000000
 #define ACTUALTUPLES        2000000
-#define BITMAPSIZE          (((NUMTUPLES * 2) + (SIZEOFWORD - 1)) / (SIZEOFWORD))
-
-extern inline uint32 getwordid      (uint32 eid);
-extern inline uint32 getlockbitid   (uint32 eid);
-extern inline uint32 getmigratebitid(uint32 eid);
-
-extern inline bool getkthbit        (uint64 word, uint32 k);
-extern inline bool getlockbit       (uint64 *bitmap, uint32 eid);
-extern inline void setlockbit       (uint64 *bitmap, uint32 eid);
-extern inline void resetlockbit     (uint64 *bitmap, uint32 eid);
-extern inline bool getmigratebit    (uint64 *bitmap, uint32 eid);
-extern inline void setmigratebit    (uint64 *bitmap, uint32 eid);
-extern inline bool getinprogbit     (uint64 *bitmap, uint32 eid);
-extern inline void setinprogbit     (uint64 *bitmap, uint32 eid);
-extern inline void resetinprogbit   (uint64 *bitmap, uint32 eid);
+
+/*
+ * A bitmap holds a lock bit and a migrate bit per element, and is laid out
+ * according to migrate_bitmap_layout:
+ *
+ * interleaved: the two bits of an element are adjacent, so a word covers
+ * ELEMCOUNTINWORD elements.
+ *
+ * split: the lock bits of all elements come first and the migrate bits
+ * follow in a region of their own, each region starting on a cache line.
+ * Claims then keep dirtying lines that scans testing migrate bits don't
+ * read, and a word covers SIZEOFWORD elements of either kind.
+ *
+ * Both layouts take BITMAPSIZE words, a whole number of cache lines, so
+ * every bitmap starts on a cache line.
+ */
+#define MIGRATE_WORDS_PER_LINE (PG_CACHE_LINE_SIZE / sizeof(uint64))
+#define MIGRATE_REGIONSIZE \
+	TYPEALIGN(MIGRATE_WORDS_PER_LINE, (NUMTUPLES + SIZEOFWORD - 1) / SIZEOFWORD)
+#define BITMAPSIZE          (MIGRATE_REGIONSIZE * 2)
+
+typedef enum MigrateBitmapLayout
+{
+	MIGRATE_LAYOUT_INTERLEAVED,
+	MIGRATE_LAYOUT_SPLIT
+}			MigrateBitmapLayout;
+
+/* element id of a tuple the bitmap can't represent */
+#define InvalidMigrateEid   PG_UINT32_MAX
+
+/* number of migrations (one per migration target) that can be under way */
+#define NUM_MIGRATIONS      2
+
+/*
+ * Each migration has a bitmap over its source.  A two-way migration also
+ * uses the bitmap MigrateReverseBitmap(b), over its target, to move rows back
+ * if it is rolled back.  The remaining bitmaps are handed out to migrations
+ * that read more than one relation, such as the leaves of a partitioned
+ * source, one per relation.  lwlock.h reserves a set of partition locks for
+ * each bitmap.
+ */
+#define NUM_MIGRATE_PARTITION_BITMAPS 12
+#define NUM_MIGRATE_BITMAPS (NUM_MIGRATIONS * 2 + NUM_MIGRATE_PARTITION_BITMAPS)
+#define MigrateReverseBitmap(b) ((b) + NUM_MIGRATIONS)
+#define MigrateIsReverseBitmap(b) \
+	((b) >= NUM_MIGRATIONS && (b) < NUM_MIGRATIONS * 2)
+#define MIGRATE_FIRST_PARTITION_BITMAP (NUM_MIGRATIONS * 2)
+
+/* entries of InProgLocalList1 carry their bitmap above the element id */
+#define MIGRATE_INPROG_EID_BITS 24
+#define MigrateInProgEntry(bitmapno, eid) \
+	((int) (((uint32) (bitmapno) << MIGRATE_INPROG_EID_BITS) | (eid)))
+#define MigrateInProgBitmap(entry) \
+	((uint32) (entry) >> MIGRATE_INPROG_EID_BITS)
+#define MigrateInProgEid(entry) \
+	((uint32) (entry) & ((1U << MIGRATE_INPROG_EID_BITS) - 1))
+
+/* room for the query text prefix that identifies a reverse statement */
+#define MIGRATE_PREFIX_LEN  128
 
 extern bool migrateflag;
 
 extern uint64 tuplemigratecount;
 extern uint32 count_inprogress;
+extern bool migratebatchfull;
 
 extern uint64 *GlobalBitmap;
 extern uint64 *PartialBitmap;
 extern uint8 BitmapNum;
 
-extern List *InProgLocalList0;
 extern List *InProgLocalList1;
 
+/* GUC variables */
+extern int	max_migrate_claims_per_xact;
+extern int	migrate_batch_size;
+extern int	migrate_bitmap_layout;
+
+/*
+ * Bitmap accessors.  Callers changing a shared bitmap hold the element's
+ * partition lock (see MigrateBitmapPartition).
+ *
+ * getwordid gives the group of elements sharing a snapshot stamp in
+ * wordSeq; in the interleaved layout, also the word holding both of their
+ * bits.
+ */
+static inline uint32
+getwordid(uint32 eid)
+{
+	return (eid / ELEMCOUNTINWORD);
+}
+
+static inline uint32
+getlockwordid(uint32 eid)
+{
+	if (migrate_bitmap_layout == MIGRATE_LAYOUT_SPLIT)
+		return (eid / SIZEOFWORD);
+	return getwordid(eid);
+}
+
+static inline uint32
+getlockbitid(uint32 eid)
+{
+	uint32		posinbyte;
+
+	if (migrate_bitmap_layout == MIGRATE_LAYOUT_SPLIT)
+		return (eid % SIZEOFWORD);
+	posinbyte = eid % ELEMCOUNTINWORD;
+	return (posinbyte * 2 + LOCKBITPOS);
+}
+
+static inline uint32
+getmigratewordid(uint32 eid)
+{
+	if (migrate_bitmap_layout == MIGRATE_LAYOUT_SPLIT)
+		return (MIGRATE_REGIONSIZE + eid / SIZEOFWORD);
+	return getwordid(eid);
+}
+
+static inline uint32
+getmigratebitid(uint32 eid)
+{
+	uint32		posinbyte;
+
+	if (migrate_bitmap_layout == MIGRATE_LAYOUT_SPLIT)
+		return (eid % SIZEOFWORD);
+	posinbyte = eid % ELEMCOUNTINWORD;
+	return (posinbyte * 2 + MIGRATEBITPOS);
+}
+
+static inline bool
+getkthbit(uint64 word, uint32 k)
+{
+	return ((word & ((uint64) 1 << k)) != 0);
+}
+
+static inline bool
+getlockbit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = getlockwordid(eid);
+	uint32		lockbitid = getlockbitid(eid);
+
+	return getkthbit(bitmap[wordid], lockbitid);
+}
+
+static inline void
+setlockbit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = getlockwordid(eid);
+	uint32		lockbitid = getlockbitid(eid);
+
+	bitmap[wordid] |= ((uint64) 1 << lockbitid);
+}
+
+static inline void
+resetlockbit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = getlockwordid(eid);
+	uint32		lockbitid = getlockbitid(eid);
+
+	bitmap[wordid] &= ~((uint64) 1 << lockbitid);
+}
+
+static inline void
+setmigratebit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = getmigratewordid(eid);
+	uint32		migratebitid = getmigratebitid(eid);
+
+	bitmap[wordid] |= ((uint64) 1 << migratebitid);
+}
+
+static inline void
+resetmigratebit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = getmigratewordid(eid);
+	uint32		migratebitid = getmigratebitid(eid);
+
+	bitmap[wordid] &= ~((uint64) 1 << migratebitid);
+}
+
+static inline bool
+getmigratebit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = getmigratewordid(eid);
+	uint32		migratebitid = getmigratebitid(eid);
+
+	return getkthbit(bitmap[wordid], migratebitid);
+}
+
+static inline bool
+getinprogbit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = eid / SIZEOFWORD;
+	uint32		bitid = eid % SIZEOFWORD;
+
+	return getkthbit(bitmap[wordid], bitid);
+}
+
+static inline void
+setinprogbit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = eid / SIZEOFWORD;
+	uint32		bitid = eid % SIZEOFWORD;
+
+	bitmap[wordid] |= ((uint64) 1 << bitid);
+}
+
+static inline void
+resetinprogbit(uint64 *bitmap, uint32 eid)
+{
+	uint32		wordid = eid / SIZEOFWORD;
+	uint32		bitid = eid % SIZEOFWORD;
+
+	bitmap[wordid] &= ~((uint64) 1 << bitid);
+}
+
+extern Size MigrateShmemSize(void);
 extern void InitGlobalBitmap(void);
 
-#define MigrateBitmapPartition(hashcode) \
-    ((hashcode) % NUM_MIGRATE_BITMAP_LOCKS)
+extern uint32 MigrateTupleEid(ItemPointer tid);
+extern int	MigrateScanBitmap(Oid relid);
+extern bool MigrateScanFinished(Oid relid);
+extern bool MigrateBatchIsFull(void);
+extern bool MigrateBlockHasUnmigrated(Relation rel, BlockNumber blkno);
+extern void MigrateRegisterClaim(uint8 bitmapno, uint32 eid,
+					 TransactionId owner);
+extern void MigrateCheckSnapshotConflict(uint8 bitmapno, uint32 eid);
+extern void MigrateCoalesceStatement(const char *query_string,
+						 ParamListInfo params);
+extern void MigrateWaitForInProgress(void);
 
-#define MigrateBitmapPartitionLock(hashcode, i) \
+extern void MigrateClaimOldVersion(Relation rel, ItemPointer tid);
+extern bool MigrateNewVersionFits(Relation rel, Buffer buffer);
+extern void MigrateCheckNewVersion(Relation rel, Buffer buffer);
+extern void MigrateClaimNewVersion(Relation rel, ItemPointer tid);
+extern bool MigrateRelationIsSource(Oid relid);
+extern bool MigrateTupleIsMigrated(Relation rel, ItemPointer tid);
+extern bool MigrateBitmapFinished(uint8 bitmapno);
+extern Oid	MigrateBitmapRelation(uint8 bitmapno);
+extern uint32 MigratePublishSeq(void);
+extern bool MigrateElementMigratedBefore(uint8 bitmapno, uint32 eid,
+							 uint32 seq);
+extern bool MigrateElementClaimant(uint8 bitmapno, uint32 eid,
+					   TransactionId *owner);
+extern bool MigrateBitmapMoves(uint8 bitmapno);
+extern void MigrateRemoveSourceTuple(HeapTuple tuple);
+extern int	MigrateReverseStatement(const char *query_string);
+
+extern void MigrateNoteXactSnapshot(void);
+extern void AtPrepare_MigrateSchema(void);
+extern void AtEOXact_MigrateSchema(bool isCommit);
+extern void AtEOSubXact_MigrateSchema(bool isCommit, int nestDepth);
+
+/*
+ * The bitmap locks are partitioned by groups of SIZEOFWORD elements rather
+ * than by element.  Such a group covers whole bitmap words in both layouts
+ * (two interleaved words, or one lock word and one migrate word when split)
+ * and whole wordSeq stamps, so everything that shares a word with an element
+ * is guarded by that element's partition lock.
+ */
+#define MigrateBitmapPartition(eid) \
+    (((eid) / SIZEOFWORD) % NUM_MIGRATE_BITMAP_LOCKS)
+
+#define MigrateBitmapPartitionLock(eid, i) \
     (&MainLWLockArray[MIGRATE_BITMAP_OFFSET + \
-    MigrateBitmapPartition(hashcode) + i*NUM_MIGRATE_BITMAP_LOCKS].lock)
+    MigrateBitmapPartition(eid) + (i)*NUM_MIGRATE_BITMAP_LOCKS].lock)
 
 #define MigrateBitmapLockByIndex(i) \
 	  (&MainLWLockArray[MIGRATE_BITMAP_OFFSET + (i)].lock)
 
+/* index of the claim-hash partition guarded by MigrateBitmapPartitionLock */
+#define MigrateClaimPartitionIndex(eid, i) \
+    (MigrateBitmapPartition(eid) + (i)*NUM_MIGRATE_BITMAP_LOCKS)
+
 #endif /* MIGRATE_SCHEMA_H */
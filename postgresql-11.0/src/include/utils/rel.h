@@ -186,6 +186,15 @@ typedef struct RelationData
 	 */
 	Oid			rd_toastoid;	/* Real TOAST table's OID, or InvalidOid */
 
+	/*
+	 * Schema version history left by lazy ALTER COLUMN TYPE, loaded on
+	 * demand by RelationGetSchemaVersionInfo.  rd_versions is NULL if all
+	 * tuples are current.
+	 */
+	bool		rd_versionsvalid;	/* rd_versions has been loaded */
+	/* use "struct" here to avoid needing to include heapversion.h: */
+	struct SchemaVersionInfo *rd_versions;	/* conversion info, or NULL */
+
 	/* use "struct" here to avoid needing to include pgstat.h: */
 	struct PgStat_TableStatus *pgstat_info; /* statistics collection area */
 } RelationData;
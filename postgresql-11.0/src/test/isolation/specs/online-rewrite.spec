@@ -0,0 +1,59 @@
+# Online table rewrite
+#
+# pg_rewrite_table_online() copies the table while other sessions go on
+# inserting, updating and deleting.  Rows changed by a transaction that is
+# still open while the copy is made are gone over again, and whatever that
+# transaction does while the rewrite waits for its exclusive lock is picked
+# up once it has it.  Afterwards a sequential scan and each index must agree
+# on the rows.
+
+setup
+{
+  CREATE TABLE ort (id int PRIMARY KEY, val text, pad char(1000) DEFAULT 'x');
+  CREATE INDEX ort_val ON ort (val);
+  INSERT INTO ort (id, val) SELECT g, 'v' || g FROM generate_series(1, 10) g;
+  CREATE TABLE ort_filenode AS SELECT pg_relation_filenode('ort') AS filenode;
+}
+
+teardown
+{
+  DROP TABLE ort, ort_filenode;
+}
+
+session "s1"
+setup		{ BEGIN; }
+step "s1i"	{ INSERT INTO ort (id, val) VALUES (11, 'v11'), (12, 'v12'); }
+step "s1u"	{ UPDATE ort SET val = val || 'u' WHERE id IN (2, 11); }
+step "s1d"	{ DELETE FROM ort WHERE id IN (3, 12); }
+step "s1i2"	{ INSERT INTO ort (id, val) VALUES (13, 'v13'); }
+step "s1u2"	{ UPDATE ort SET val = val || 'w' WHERE id IN (4, 13); }
+step "s1d2"	{ DELETE FROM ort WHERE id = 5; }
+step "s1c"	{ COMMIT; }
+step "s1a"	{ ROLLBACK; }
+
+session "s2"
+step "s2r"	{ SELECT pg_rewrite_table_online('ort', NULL, 1); }
+
+session "s3"
+step "s3c"
+{
+  SELECT pg_relation_filenode('ort') <> filenode AS rewritten FROM ort_filenode;
+  SET enable_indexscan = off;
+  SET enable_indexonlyscan = off;
+  SET enable_bitmapscan = off;
+  SELECT string_agg(id || '=' || val, ' ' ORDER BY id) AS heap FROM ort;
+  RESET enable_indexscan;
+  RESET enable_indexonlyscan;
+  SET enable_seqscan = off;
+  SELECT string_agg(id::text, ' ' ORDER BY id) AS pkey FROM ort WHERE id > 0;
+  SELECT string_agg(val, ' ' ORDER BY val COLLATE "C") AS val FROM ort WHERE val > '';
+  RESET enable_seqscan;
+  RESET enable_bitmapscan;
+}
+
+# the rewrite copies around an open transaction, then waits for it
+permutation "s1i" "s1u" "s1d" "s2r" "s1i2" "s1u2" "s1d2" "s1c" "s3c"
+permutation "s1i" "s1u" "s1d" "s2r" "s1i2" "s1u2" "s1d2" "s1a" "s3c"
+
+# changes made after the swap go to the new heap and indexes
+permutation "s2r" "s1i" "s1u" "s1d" "s1c" "s3c"
@@ -0,0 +1,28 @@
+# A migration statement that another transaction is already running waits
+# for that transaction before it starts.  If it committed, there is nothing
+# left to migrate; if it rolled back, the waiter migrates the tuples itself
+# instead of failing.
+
+setup
+{
+  SET client_min_messages = warning;
+  CREATE EXTENSION IF NOT EXISTS test_migrate;
+  CREATE TABLE IF NOT EXISTS mig_src (id int, pad char(600));
+  CREATE TABLE IF NOT EXISTS mig_dst (id int, pad char(600));
+  SELECT test_migrate_reset('mig_src', 0);
+  TRUNCATE mig_src, mig_dst;
+  INSERT INTO mig_src SELECT g, 'x' FROM generate_series(1, 10) g;
+}
+
+session "s1"
+setup		{ BEGIN; }
+step "s1m"	{ SELECT test_migrate_run(0, 'INSERT INTO mig_dst SELECT * FROM mig_src', coalesce => true) AS migrated; }
+step "s1c"	{ COMMIT; }
+step "s1a"	{ ROLLBACK; }
+
+session "s2"
+step "s2m"	{ SELECT test_migrate_run(0, 'INSERT INTO mig_dst SELECT * FROM mig_src', coalesce => true) AS migrated; }
+step "s2s"	{ SELECT count(*), count(DISTINCT id) FROM mig_dst; }
+
+permutation "s1m" "s2m" "s1c" "s2s"
+permutation "s1m" "s2m" "s1a" "s2s"
@@ -0,0 +1,37 @@
+# A migration that fails part way, or whose subtransaction is rolled back,
+# gives up its claims at once, and another migration moves the tuples.  So
+# does one whose tuples are changed under it.
+
+setup
+{
+  SET client_min_messages = warning;
+  CREATE EXTENSION IF NOT EXISTS test_migrate;
+  CREATE TABLE IF NOT EXISTS mig_src (id int, pad char(600));
+  CREATE TABLE IF NOT EXISTS mig_dst (id int, pad char(600));
+  SELECT test_migrate_reset('mig_src', 0);
+  TRUNCATE mig_src, mig_dst;
+  INSERT INTO mig_src SELECT g, 'x' FROM generate_series(1, 10) g;
+}
+
+session "s1"
+setup		{ BEGIN; }
+step "s1f"	{ SELECT test_migrate_run(0, 'INSERT INTO mig_dst SELECT id, test_migrate_fault(pad) FROM mig_src', 4) AS migrated; }
+step "s1m"	{ SELECT test_migrate_run(0, 'INSERT INTO mig_dst SELECT * FROM mig_src') AS migrated; }
+step "s1u"	{ UPDATE mig_src SET pad = 'y' WHERE id = 3; }
+step "s1s"	{ SAVEPOINT s; }
+step "s1rs"	{ ROLLBACK TO s; }
+step "s1c"	{ COMMIT; }
+step "s1a"	{ ROLLBACK; }
+
+session "s2"
+step "s2m"	{ SELECT test_migrate_run(0, 'INSERT INTO mig_dst SELECT * FROM mig_src') AS migrated; }
+step "s2s"	{ SELECT count(*), count(DISTINCT id) FROM mig_dst; }
+
+# cancelled after four tuples
+permutation "s1f" "s2m" "s1a" "s2s"
+
+# rolled back to a savepoint
+permutation "s1s" "s1m" "s1rs" "s2m" "s1c" "s2s"
+
+# a tuple updated by a transaction in progress
+permutation "s1u" "s2m" "s1c" "s2m" "s2s"
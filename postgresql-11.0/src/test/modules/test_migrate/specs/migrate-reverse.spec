@@ -0,0 +1,36 @@
+# A two-way migration moves rows to the target, deleting them from the
+# source.  Rolling it back waits for the writers of the target, and from
+# then on the forward statement does nothing while the reverse statement
+# moves the target's rows back, including those written there since.
+#
+# A migration can be made two-way and rolled back only once until the
+# server restarts, so this takes over migration 1 and has one permutation.
+
+setup
+{
+  SET client_min_messages = warning;
+  CREATE EXTENSION IF NOT EXISTS test_migrate;
+  CREATE TABLE rev_src (id int, pad char(600));
+  CREATE TABLE rev_dst (id int, pad char(600));
+  SELECT pg_migrate_enable_reverse(1, 'rev_dst', 'INSERT INTO rev_src');
+  INSERT INTO rev_src SELECT g, 'x' FROM generate_series(1, 10) g;
+}
+
+teardown
+{
+  DROP TABLE rev_src, rev_dst;
+}
+
+session "s1"
+step "s1m"	{ SELECT test_migrate_run(1, 'INSERT INTO rev_dst SELECT * FROM rev_src WHERE id <= 6') AS migrated; }
+step "s1r"	{ SELECT pg_migrate_rollback(1); }
+step "s1b"	{ SELECT test_migrate_run(3, 'INSERT INTO rev_src SELECT * FROM rev_dst') AS moved_back; }
+step "s1f"	{ SELECT pg_migrate_finalize(3); }
+step "s1s"	{ SELECT (SELECT count(*) FROM rev_src) AS source, (SELECT count(*) FROM rev_dst) AS target, (SELECT pad = 'y' FROM rev_src WHERE id = 2) AS updated; }
+
+session "s2"
+setup		{ BEGIN; }
+step "s2u"	{ UPDATE rev_dst SET pad = 'y' WHERE id = 2; }
+step "s2c"	{ COMMIT; }
+
+permutation "s1m" "s2u" "s1r" "s2c" "s1m" "s1r" "s1b" "s1f" "s1s"
@@ -0,0 +1,256 @@
+CREATE EXTENSION test_migrate;
+
+CREATE TABLE stress_src (id int, pad char(600));
+CREATE TABLE stress_dst (id int, pad char(600));
+INSERT INTO stress_src SELECT g, 'x' FROM generate_series(1, 1500) g;
+
+-- concurrent migrations, a fifth of them rolled back and a fifth cancelled
+SELECT commits + aborts + cancels + retries AS runs,
+       tuples_per_sec > 0 AS progressed
+  FROM test_migrate_stress(0,
+         'INSERT INTO stress_dst SELECT id, test_migrate_fault(pad) FROM stress_src',
+         workers => 4, runs => 20, abort_percent => 20,
+         cancel_percent => 20, seed => 42);
+
+-- whatever the workers left behind
+SELECT test_migrate_run(0, 'INSERT INTO stress_dst SELECT * FROM stress_src') >= 0 AS swept;
+
+-- every tuple moved exactly once
+SELECT count(*) = 1500 AS complete, count(DISTINCT id) = count(*) AS no_duplicates
+  FROM stress_dst;
+SELECT problem, count(*)
+  FROM pg_migrate_verify((SELECT bitmap FROM pg_migrate_bitmaps()
+                          WHERE relid = 'stress_src'::regclass),
+                         'stress_dst', '{id}')
+  GROUP BY problem;
+
+-- a migration can't be nested in another, or use a partition's bitmap
+SELECT test_migrate_run(0, 'SELECT test_migrate_run(0, ''SELECT 1'')');
+SELECT test_migrate_run(4, 'SELECT 1');
+
+DROP TABLE stress_src, stress_dst;
+
+-- the empty target of a migration gets the indexes of its source
+CREATE TABLE idx_src (id int PRIMARY KEY, name text, extra int);
+CREATE INDEX idx_src_lower ON idx_src (lower(name));
+CREATE INDEX idx_src_extra ON idx_src (extra);
+CREATE TABLE idx_dst (id int, name text);
+SELECT pg_migrate_clone_indexes('idx_src', 'idx_dst');
+SELECT indexdef FROM pg_indexes WHERE tablename = 'idx_dst' ORDER BY indexname;
+SELECT pg_migrate_clone_indexes('idx_src', 'idx_dst');
+INSERT INTO idx_dst VALUES (1, 'one');
+SELECT pg_migrate_clone_indexes('idx_src', 'idx_dst');
+
+DROP TABLE idx_src, idx_dst;
+
+-- the rows a migration left behind are moved in bulk
+CREATE TABLE copy_src (id int, pad char(600), note text);
+CREATE TABLE copy_dst (id int PRIMARY KEY, pad char(600));
+INSERT INTO copy_src SELECT g, 'x', 'n' FROM generate_series(1, 1500) g;
+SELECT test_migrate_run(1, 'INSERT INTO copy_dst SELECT id, pad FROM copy_src WHERE id <= 100');
+SELECT pg_migrate_copy(1, 'copy_src', 'copy_dst');
+SELECT pg_migrate_copy(1, 'copy_src', 'copy_dst');
+SELECT count(*) = 1500 AS complete, count(DISTINCT id) = count(*) AS no_duplicates
+  FROM copy_dst;
+SELECT problem, count(*)
+  FROM pg_migrate_verify((SELECT bitmap FROM pg_migrate_bitmaps()
+                          WHERE relid = 'copy_src'::regclass),
+                         'copy_dst', '{id}')
+  GROUP BY problem;
+
+-- every column of the target has to come from the source
+CREATE TABLE copy_bad (id int, missing int);
+SELECT pg_migrate_copy(1, 'copy_src', 'copy_bad');
+
+DROP TABLE copy_src, copy_dst, copy_bad;
+
+-- EXPLAIN shows the work a migration statement did for the migration
+CREATE TABLE explain_src (id int, pad char(600));
+CREATE TABLE explain_dst (id int, pad char(600));
+INSERT INTO explain_src SELECT g, 'x' FROM generate_series(1, 30) g;
+\set VERBOSITY terse
+SELECT test_migrate_run(1, $q$
+DO $$
+DECLARE
+  line text;
+BEGIN
+  FOR line IN EXPLAIN (ANALYZE, MIGRATION, COSTS OFF, TIMING OFF, SUMMARY OFF)
+      INSERT INTO explain_dst SELECT * FROM explain_src WHERE id <= 10
+  LOOP
+    RAISE NOTICE '%', line;
+  END LOOP;
+END
+$$
+$q$);
+\set VERBOSITY default
+EXPLAIN (MIGRATION) SELECT 1;
+
+DROP TABLE explain_src, explain_dst;
+
+-- an index scan feeding a migration reads ahead of it
+CREATE TABLE ahead_src (id int PRIMARY KEY, pad char(600));
+CREATE TABLE ahead_dst (id int, pad char(600));
+INSERT INTO ahead_src SELECT g, 'x' FROM generate_series(1, 300) g;
+ANALYZE ahead_src;
+SET effective_io_concurrency = 4;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SELECT test_migrate_run(1, 'INSERT INTO ahead_dst SELECT * FROM ahead_src WHERE id BETWEEN 50 AND 120');
+SELECT test_migrate_run(1, 'INSERT INTO ahead_dst SELECT * FROM ahead_src WHERE id BETWEEN 100 AND 150');
+SELECT count(*) = 101 AS complete, count(DISTINCT id) = count(*) AS no_duplicates
+  FROM ahead_dst;
+RESET effective_io_concurrency;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+
+DROP TABLE ahead_src, ahead_dst;
+
+-- the pages a running migration has drained are reclaimed
+CREATE TABLE reclaim_src (id int, pad char(600));
+CREATE TABLE reclaim_dst (id int, pad char(600));
+INSERT INTO reclaim_src SELECT g, 'x' FROM generate_series(1, 30) g;
+SELECT pg_migrate_reclaim('reclaim_src');
+SELECT test_migrate_run(1, 'INSERT INTO reclaim_dst SELECT * FROM reclaim_src WHERE id <= 18');
+SELECT pg_migrate_reclaim('reclaim_src');
+SELECT count(*), min(id), max(id) FROM reclaim_src;
+-- a row written since was never migrated, so its page stays
+INSERT INTO reclaim_src VALUES (31, 'x');
+SELECT test_migrate_run(1, 'INSERT INTO reclaim_dst SELECT * FROM reclaim_src WHERE id <= 30');
+SELECT pg_migrate_reclaim('reclaim_src');
+SELECT count(*), min(id), max(id) FROM reclaim_src;
+SELECT pg_migrate_reclaim('reclaim_src');
+SELECT count(*) FROM reclaim_dst;
+DELETE FROM reclaim_src WHERE id = 31;
+SELECT bitmap AS reclaim_bitmap FROM pg_migrate_bitmaps()
+  WHERE relid = 'reclaim_src'::regclass \gset
+SELECT pg_migrate_finalize(:reclaim_bitmap);
+DROP TABLE reclaim_src, reclaim_dst;
+
+-- a bitmap is finalized once every row of its source has moved
+CREATE TABLE fin_src (id int, pad char(600));
+CREATE TABLE fin_dst (id int, pad char(600));
+INSERT INTO fin_src SELECT g, 'x' FROM generate_series(1, 30) g;
+SELECT test_migrate_run(1, 'INSERT INTO fin_dst SELECT * FROM fin_src WHERE id <= 20');
+SELECT bitmap AS fin_bitmap FROM pg_migrate_bitmaps()
+  WHERE relid = 'fin_src'::regclass \gset
+SELECT pg_migrate_finalize(:fin_bitmap);
+UPDATE fin_src SET pad = 'y' WHERE id = 1;
+SELECT test_migrate_run(1, 'INSERT INTO fin_dst SELECT * FROM fin_src');
+SELECT pg_migrate_finalize(:fin_bitmap);
+SELECT pg_migrate_finalize(:fin_bitmap);
+SELECT parent, finished FROM pg_migrate_bitmaps()
+  WHERE relid = 'fin_src'::regclass;
+-- writers no longer claim the rows, and there is nothing left to migrate
+UPDATE fin_src SET pad = 'y' WHERE id = 1;
+SELECT test_migrate_run(1, 'INSERT INTO fin_dst SELECT * FROM fin_src');
+
+-- only the owner of the source may finalize it
+CREATE ROLE regress_migrate_user;
+SET ROLE regress_migrate_user;
+SELECT pg_migrate_finalize(:fin_bitmap);
+RESET ROLE;
+DROP ROLE regress_migrate_user;
+
+SELECT pg_migrate_finalize(16);
+-- a reverse bitmap is only in use once its migration is rolled back
+SELECT pg_migrate_finalize(3);
+
+DROP TABLE fin_src, fin_dst;
+
+-- each leaf of a partitioned source gets a bitmap of its own
+CREATE TABLE part_src (id int, pad char(600)) PARTITION BY RANGE (id);
+CREATE TABLE part_src_1 PARTITION OF part_src FOR VALUES FROM (1) TO (16);
+CREATE TABLE part_src_2 PARTITION OF part_src FOR VALUES FROM (16) TO (31);
+CREATE TABLE part_dst (id int, pad char(600));
+INSERT INTO part_src SELECT g, 'x' FROM generate_series(1, 30) g;
+SELECT test_migrate_run(1, 'INSERT INTO part_dst SELECT * FROM part_src WHERE id % 2 = 0');
+SELECT relid::regclass, parent, finished FROM pg_migrate_bitmaps()
+  WHERE relid::regclass::text LIKE 'part_src%' ORDER BY bitmap;
+SELECT bitmap AS part1_bitmap FROM pg_migrate_bitmaps()
+  WHERE relid = 'part_src_1'::regclass \gset
+SELECT bitmap AS part2_bitmap FROM pg_migrate_bitmaps()
+  WHERE relid = 'part_src_2'::regclass \gset
+SELECT test_migrate_run(1, 'INSERT INTO part_dst SELECT * FROM part_src WHERE id < 16');
+-- and is finalized on its own
+SELECT pg_migrate_finalize(:part1_bitmap) AS part1,
+       pg_migrate_finalize(:part2_bitmap) AS part2;
+SELECT test_migrate_run(1, 'INSERT INTO part_dst SELECT * FROM part_src');
+SELECT pg_migrate_finalize(:part2_bitmap) AS part2;
+SELECT relid::regclass, finished FROM pg_migrate_bitmaps()
+  WHERE relid::regclass::text LIKE 'part_src%' ORDER BY bitmap;
+SELECT count(*) = 30 AS complete, count(DISTINCT id) = count(*) AS no_duplicates
+  FROM part_dst;
+SELECT b.relid::regclass, v.problem
+  FROM pg_migrate_bitmaps() b, pg_migrate_verify(b.bitmap, 'part_dst', '{id}') v
+  WHERE b.relid::regclass::text LIKE 'part_src%';
+
+DROP TABLE part_src, part_dst;
+
+-- a sequential scan feeding a migration reads ahead of it through a ring,
+-- past the blocks drained so far; fifteen rows fill a block, so every other
+-- stretch of five blocks is drained first
+CREATE TABLE ring_src (id int, pad char(490));
+CREATE TABLE ring_dst (id int, pad char(490));
+INSERT INTO ring_src SELECT g, 'x' FROM generate_series(1, 1200) g;
+SET effective_io_concurrency = 8;
+SELECT test_migrate_run(1, 'INSERT INTO ring_dst SELECT * FROM ring_src WHERE (id - 1) / 75 % 2 = 0');
+SELECT test_migrate_run(1, 'INSERT INTO ring_dst SELECT * FROM ring_src');
+SELECT count(*) = 1200 AS complete, count(DISTINCT id) = count(*) AS no_duplicates
+  FROM ring_dst;
+RESET effective_io_concurrency;
+
+DROP TABLE ring_src, ring_dst;
+
+-- outside a transaction block, a migration statement stops once it has
+-- migrated migrate_batch_size tuples, and the next run passes over the
+-- blocks drained so far but the first
+CREATE TABLE batch_src (id int, pad char(490));
+CREATE TABLE batch_dst (id int, pad char(490));
+INSERT INTO batch_src SELECT g, 'x' FROM generate_series(1, 150) g;
+SET migrate_batch_size = 30;
+SELECT test_migrate_run(1, 'INSERT INTO batch_dst SELECT * FROM batch_src');
+SELECT test_migrate_run(1, 'INSERT INTO batch_dst SELECT * FROM batch_src');
+\set VERBOSITY terse
+SELECT test_migrate_run(1, $q$
+DO $$
+DECLARE
+  line text;
+BEGIN
+  FOR line IN EXPLAIN (ANALYZE, MIGRATION, COSTS OFF, TIMING OFF, SUMMARY OFF)
+      INSERT INTO batch_dst SELECT * FROM batch_src
+  LOOP
+    RAISE NOTICE '%', line;
+  END LOOP;
+END
+$$
+$q$);
+\set VERBOSITY default
+-- inside one, it runs to the end
+BEGIN;
+SELECT test_migrate_run(1, 'INSERT INTO batch_dst SELECT * FROM batch_src');
+COMMIT;
+SELECT count(*) = 150 AS complete, count(DISTINCT id) = count(*) AS no_duplicates
+  FROM batch_dst;
+RESET migrate_batch_size;
+
+DROP TABLE batch_src, batch_dst;
+
+-- pg_migrate_verify reports rows migrated twice or lost on the way
+CREATE TABLE verify_src (id int, pad char(600));
+CREATE TABLE verify_dst (id int, pad char(600));
+INSERT INTO verify_src SELECT g, 'x' FROM generate_series(1, 30) g;
+SELECT test_migrate_run(1, 'INSERT INTO verify_dst SELECT * FROM verify_src WHERE id <= 20');
+SELECT bitmap AS verify_bitmap FROM pg_migrate_bitmaps()
+  WHERE relid = 'verify_src'::regclass \gset
+SELECT * FROM pg_migrate_verify(:verify_bitmap, 'verify_dst', '{id}');
+INSERT INTO verify_dst VALUES (5, 'x');
+DELETE FROM verify_dst WHERE id = 12;
+-- rows not migrated yet are nobody's business
+INSERT INTO verify_dst VALUES (25, 'x');
+SELECT problem, relid::regclass, tid, key
+  FROM pg_migrate_verify(:verify_bitmap, 'verify_dst', '{id}')
+  ORDER BY problem, tid;
+SELECT pg_migrate_verify(:verify_bitmap, 'verify_dst', '{}');
+SELECT pg_migrate_verify(15, 'verify_dst', '{id}');
+
+DROP TABLE verify_src, verify_dst;
@@ -0,0 +1,54 @@
+# Migration statements sent over the extended query protocol outside a
+# transaction block commit every migrate_batch_size tuples and run again for
+# the rest.  Each row of the targets records the transaction that migrated it.
+
+use strict;
+use warnings;
+
+use PostgresNode;
+use TestLib;
+use Test::More tests => 4;
+
+my $node = get_new_node('main');
+$node->init;
+$node->append_conf('postgresql.conf', 'migrate_batch_size = 300');
+$node->start;
+
+$node->safe_psql(
+	'postgres', q{
+	CREATE TABLE customer (c_id int, c_pad char(600));
+	CREATE TABLE customer_proj1 (c_id int, c_pad char(600),
+		c_xid bigint DEFAULT txid_current());
+	CREATE TABLE customer_proj2 (c_id int, c_pad char(600),
+		c_xid bigint DEFAULT txid_current());
+	INSERT INTO customer SELECT g, 'x' FROM generate_series(1, 1000) g;
+});
+
+my $script = $node->basedir . '/batches.sql';
+append_to_file($script,
+	"insert into customer_proj1 (c_id, c_pad) select c_id, c_pad from customer;\n");
+
+$node->command_ok(
+	[ 'pgbench', '-n', '-M', 'extended', '-t', '1', '-f', $script, 'postgres' ],
+	'migration statement outside a transaction block');
+is( $node->safe_psql(
+		'postgres',
+		'SELECT count(*), count(DISTINCT c_id), count(DISTINCT c_xid) FROM customer_proj1'),
+	'1000|1000|4',
+	'migrated in batches of migrate_batch_size');
+
+# In a transaction block, the statement can't commit part way.
+$script = $node->basedir . '/block.sql';
+append_to_file($script,
+	"begin;\ninsert into customer_proj2 (c_id, c_pad) select c_id, c_pad from customer;\ncommit;\n");
+
+$node->command_ok(
+	[ 'pgbench', '-n', '-M', 'extended', '-t', '1', '-f', $script, 'postgres' ],
+	'migration statement in a transaction block');
+is( $node->safe_psql(
+		'postgres',
+		'SELECT count(*), count(DISTINCT c_id), count(DISTINCT c_xid) FROM customer_proj2'),
+	'1000|1000|1',
+	'migrated at once in a transaction block');
+
+$node->stop;
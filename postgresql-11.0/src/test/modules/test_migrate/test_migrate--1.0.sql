@@ -0,0 +1,37 @@
+/* src/test/modules/test_migrate/test_migrate--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION test_migrate" to load this file. \quit
+
+CREATE FUNCTION test_migrate_run(bitmap integer,
+    query text,
+    fault_after integer DEFAULT 0,
+    coalesce boolean DEFAULT false)
+RETURNS pg_catalog.int8 STRICT
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_migrate_fault(anyelement)
+RETURNS anyelement STRICT VOLATILE
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_migrate_reset(rel regclass,
+    bitmap integer DEFAULT 0)
+RETURNS pg_catalog.int4 STRICT
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_migrate_stress(bitmap integer,
+    query text,
+    workers integer DEFAULT 4,
+    runs integer DEFAULT 100,
+    abort_percent integer DEFAULT 10,
+    cancel_percent integer DEFAULT 10,
+    seed integer DEFAULT 0,
+    OUT commits bigint,
+    OUT aborts bigint,
+    OUT cancels bigint,
+    OUT retries bigint,
+    OUT tuples bigint,
+    OUT elapsed_ms float8,
+    OUT tuples_per_sec float8)
+RETURNS record STRICT
+AS 'MODULE_PATHNAME' LANGUAGE C;
@@ -0,0 +1,498 @@
+/*--------------------------------------------------------------------------
+ *
+ * test_migrate.c
+ *		Stress tests for the lazy migration claim protocol.
+ *
+ * Migration statements are normally recognized by their text when they are
+ * bound (see exec_bind_message), which test drivers such as the isolation
+ * tester can't arrange.  test_migrate_run() runs any statement as a
+ * migration instead, doing what the protocol code does around it, and
+ * test_migrate_fault() lets a statement be cancelled after a given number
+ * of the tuples it migrates.  test_migrate_stress() starts background
+ * workers that run a migration statement over and over, rolling back or
+ * cancelling a share of the runs, and reports how they ended.
+ *
+ * Copyright (c) 2020, UMD Database Group
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_migrate/test_migrate.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/migrate_schema.h"
+#include "utils/resowner.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(test_migrate_run);
+PG_FUNCTION_INFO_V1(test_migrate_fault);
+PG_FUNCTION_INFO_V1(test_migrate_reset);
+PG_FUNCTION_INFO_V1(test_migrate_stress);
+
+extern PGDLLEXPORT void test_migrate_worker_main(Datum main_arg);
+
+/* a cancelled stress run migrates at most this many tuples first */
+#define TEST_MIGRATE_MAX_FAULT_DELAY	100
+
+#define TEST_MIGRATE_STRESS_COLS	7
+
+/*
+ * Control segment of a stress test, shared by the backend running it and
+ * its workers.
+ */
+typedef struct
+{
+	Oid			dbid;
+	Oid			userid;
+	int32		bitmap;
+	int32		runs;
+	int32		abort_percent;
+	int32		cancel_percent;
+	int32		seed;
+	pg_atomic_uint64 commits;
+	pg_atomic_uint64 aborts;
+	pg_atomic_uint64 cancels;
+	pg_atomic_uint64 retries;
+	pg_atomic_uint64 tuples;
+	pg_atomic_uint32 finished;	/* workers that did all their runs */
+	char		query[FLEXIBLE_ARRAY_MEMBER];
+} test_migrate_stress_shared;
+
+/* calls of test_migrate_fault() left until it cancels the statement */
+static int	fault_countdown = 0;
+
+
+/*
+ * Run a statement as a migration of the given bitmap, the way
+ * exec_bind_message, exec_execute_message and post_query_tasks do for a real
+ * one.  Returns the number of rows it processed.
+ */
+static uint64
+test_migrate_execute(int bitmap, const char *query, int fault_after,
+					 bool coalesce)
+{
+	uint64		processed;
+	int			ret;
+
+	if (bitmap < 0 || bitmap >= MIGRATE_FIRST_PARTITION_BITMAP)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("%d is not the bitmap of a migration", bitmap)));
+	if (migrateflag)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("a migration statement is already running")));
+
+	migrateflag = true;
+	InProgLocalList1 = NIL;
+	BitmapNum = bitmap;
+	PartialBitmap = GlobalBitmap + bitmap * BITMAPSIZE;
+	fault_countdown = fault_after;
+
+	if (coalesce)
+		MigrateCoalesceStatement(query, NULL);
+
+	SPI_connect();
+	ret = SPI_execute(query, false, 0);
+	if (ret < 0)
+		elog(ERROR, "SPI_execute returned %s", SPI_result_code_string(ret));
+	processed = SPI_processed;
+	SPI_finish();
+
+	fault_countdown = 0;
+
+	MigrateWaitForInProgress();
+	tuplemigratecount = 0;
+	migrateflag = false;
+
+	return processed;
+}
+
+/*
+ * test_migrate_run(bitmap, query, fault_after, coalesce)
+ *
+ * Run query as a migration statement.  If fault_after is positive, the
+ * statement is cancelled on the fault_after'th call of test_migrate_fault().
+ * With coalesce, the statement first waits for any transaction running the
+ * same one, as it would if a client had sent it.
+ */
+Datum
+test_migrate_run(PG_FUNCTION_ARGS)
+{
+	int32		bitmap = PG_GETARG_INT32(0);
+	char	   *query = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	int32		fault_after = PG_GETARG_INT32(2);
+	bool		coalesce = PG_GETARG_BOOL(3);
+
+	PG_RETURN_INT64((int64) test_migrate_execute(bitmap, query, fault_after,
+												 coalesce));
+}
+
+/*
+ * test_migrate_fault(value)
+ *
+ * Return value, unless a fault is due, in which case the statement is
+ * cancelled just as if the client had asked for it.  Called in the target
+ * list of a migration statement, it runs after the tuple is claimed.
+ */
+Datum
+test_migrate_fault(PG_FUNCTION_ARGS)
+{
+	if (fault_countdown > 0 && --fault_countdown == 0)
+	{
+		QueryCancelPending = true;
+		InterruptPending = true;
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+}
+
+/*
+ * test_migrate_reset(rel, bitmap)
+ *
+ * Make every tuple of rel unmigrated again, so that tests can migrate the
+ * same relation many times.  Bitmaps are never taken back from a relation,
+ * so this saves tests from running out of them.  The relation is assigned a
+ * bitmap under the given migration if it has none yet.  Returns the bitmap.
+ */
+Datum
+test_migrate_reset(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		migration = PG_GETARG_INT32(1);
+	uint8		save_bitmapnum = BitmapNum;
+	uint64	   *bitmap;
+	int			b;
+	uint32		eid;
+
+	if (migration < 0 || migration >= MIGRATE_FIRST_PARTITION_BITMAP)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("%d is not the bitmap of a migration", migration)));
+
+	BitmapNum = migration;
+	PG_TRY();
+	{
+		b = MigrateScanBitmap(relid);
+	}
+	PG_CATCH();
+	{
+		BitmapNum = save_bitmapnum;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	BitmapNum = save_bitmapnum;
+
+	if (b < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration %d has been rolled back", migration)));
+	if (MigrateBitmapFinished(b))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("migration bitmap %d is finished", b)));
+
+	bitmap = GlobalBitmap + b * BITMAPSIZE;
+	for (eid = 0; eid < NUMTUPLES; eid++)
+	{
+		LWLock	   *bitmapLock;
+		bool		locked;
+
+		if (!getlockbit(bitmap, eid) && !getmigratebit(bitmap, eid))
+			continue;
+
+		bitmapLock = MigrateBitmapPartitionLock(eid, b);
+		LWLockAcquire(bitmapLock, LW_EXCLUSIVE);
+		locked = getlockbit(bitmap, eid);
+		if (!locked)
+			resetmigratebit(bitmap, eid);
+		LWLockRelease(bitmapLock);
+
+		if (locked)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_IN_USE),
+					 errmsg("migration bitmap %d has claims in progress",
+							b)));
+	}
+
+	PG_RETURN_INT32(b);
+}
+
+/*
+ * test_migrate_stress(bitmap, query, workers, runs, abort_percent,
+ *					   cancel_percent, seed)
+ *
+ * Start the given number of workers, each of which runs query as a
+ * migration statement runs times, each time in a transaction of its own.
+ * A run is rolled back at the end with probability abort_percent, or
+ * cancelled somewhere in the middle with probability cancel_percent.  Which
+ * runs those are, and where they are cancelled, follows from seed and the
+ * worker number alone.  Runs that fail because of a concurrent migration,
+ * whether by a serialization failure or a deadlock, count as retries.
+ *
+ * Returns how many runs ended each way, the number of tuples committed
+ * runs migrated, and the time taken.
+ */
+Datum
+test_migrate_stress(PG_FUNCTION_ARGS)
+{
+	int32		bitmap = PG_GETARG_INT32(0);
+	char	   *query = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	int32		nworkers = PG_GETARG_INT32(2);
+	int32		runs = PG_GETARG_INT32(3);
+	int32		abort_percent = PG_GETARG_INT32(4);
+	int32		cancel_percent = PG_GETARG_INT32(5);
+	int32		seed = PG_GETARG_INT32(6);
+	dsm_segment *seg;
+	test_migrate_stress_shared *shared;
+	BackgroundWorker worker;
+	BackgroundWorkerHandle **handles;
+	TimestampTz start;
+	long		secs;
+	int			usecs;
+	double		elapsed;
+	uint64		tuples;
+	uint32		finished;
+	TupleDesc	tupdesc;
+	Datum		values[TEST_MIGRATE_STRESS_COLS];
+	bool		nulls[TEST_MIGRATE_STRESS_COLS];
+	int			i;
+
+	if (bitmap < 0 || bitmap >= MIGRATE_FIRST_PARTITION_BITMAP)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("%d is not the bitmap of a migration", bitmap)));
+	if (nworkers < 1 || runs < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("workers must be positive and runs not negative")));
+	if (abort_percent < 0 || cancel_percent < 0 ||
+		abort_percent + cancel_percent > 100)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("abort_percent and cancel_percent must not be negative or add up to more than 100")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	seg = dsm_create(offsetof(test_migrate_stress_shared, query) +
+					 strlen(query) + 1, 0);
+	shared = dsm_segment_address(seg);
+	shared->dbid = MyDatabaseId;
+	shared->userid = GetUserId();
+	shared->bitmap = bitmap;
+	shared->runs = runs;
+	shared->abort_percent = abort_percent;
+	shared->cancel_percent = cancel_percent;
+	shared->seed = seed;
+	pg_atomic_init_u64(&shared->commits, 0);
+	pg_atomic_init_u64(&shared->aborts, 0);
+	pg_atomic_init_u64(&shared->cancels, 0);
+	pg_atomic_init_u64(&shared->retries, 0);
+	pg_atomic_init_u64(&shared->tuples, 0);
+	pg_atomic_init_u32(&shared->finished, 0);
+	strcpy(shared->query, query);
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	sprintf(worker.bgw_library_name, "test_migrate");
+	sprintf(worker.bgw_function_name, "test_migrate_worker_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "test_migrate worker");
+	snprintf(worker.bgw_type, BGW_MAXLEN, "test_migrate");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+	/* set bgw_notify_pid, so we can wait for the workers to stop */
+	worker.bgw_notify_pid = MyProcPid;
+
+	handles = palloc0(sizeof(BackgroundWorkerHandle *) * nworkers);
+	start = GetCurrentTimestamp();
+
+	PG_TRY();
+	{
+		for (i = 0; i < nworkers; i++)
+		{
+			memcpy(worker.bgw_extra, &i, sizeof(i));
+			if (!RegisterDynamicBackgroundWorker(&worker, &handles[i]))
+				ereport(ERROR,
+						(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+						 errmsg("could not register background process"),
+						 errhint("You may need to increase max_worker_processes.")));
+		}
+
+		for (i = 0; i < nworkers; i++)
+		{
+			if (WaitForBackgroundWorkerShutdown(handles[i]) ==
+				BGWH_POSTMASTER_DIED)
+				ereport(FATAL,
+						(errcode(ERRCODE_ADMIN_SHUTDOWN),
+						 errmsg("postmaster exited during a stress test")));
+		}
+	}
+	PG_CATCH();
+	{
+		for (i = 0; i < nworkers; i++)
+		{
+			if (handles[i] != NULL)
+				TerminateBackgroundWorker(handles[i]);
+		}
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+	elapsed = secs + usecs / 1000000.0;
+
+	finished = pg_atomic_read_u32(&shared->finished);
+	if (finished < nworkers)
+		ereport(ERROR,
+				(errmsg("%d of %d stress test workers failed",
+						nworkers - finished, nworkers),
+				 errhint("See the server log for their errors.")));
+
+	tuples = pg_atomic_read_u64(&shared->tuples);
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum((int64) pg_atomic_read_u64(&shared->commits));
+	values[1] = Int64GetDatum((int64) pg_atomic_read_u64(&shared->aborts));
+	values[2] = Int64GetDatum((int64) pg_atomic_read_u64(&shared->cancels));
+	values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&shared->retries));
+	values[4] = Int64GetDatum((int64) tuples);
+	values[5] = Float8GetDatum(elapsed * 1000.0);
+	values[6] = Float8GetDatum(elapsed > 0 ? tuples / elapsed : 0);
+
+	dsm_detach(seg);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Background worker entrypoint of test_migrate_stress().
+ */
+void
+test_migrate_worker_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	test_migrate_stress_shared *shared;
+	MemoryContext workcxt;
+	unsigned short xseed[3];
+	int			workerno;
+	int			run;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "test_migrate worker");
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("unable to map dynamic shared memory segment")));
+	dsm_pin_mapping(seg);
+	shared = dsm_segment_address(seg);
+	memcpy(&workerno, MyBgworkerEntry->bgw_extra, sizeof(workerno));
+
+	BackgroundWorkerInitializeConnectionByOid(shared->dbid, shared->userid, 0);
+
+	/* concurrent migrations deadlock routinely; don't dawdle over it */
+	SetConfigOption("deadlock_timeout", "10ms", PGC_SUSET, PGC_S_OVERRIDE);
+
+	workcxt = AllocSetContextCreate(TopMemoryContext,
+									"test_migrate worker",
+									ALLOCSET_DEFAULT_SIZES);
+
+	xseed[0] = 0x330e;
+	xseed[1] = (unsigned short) shared->seed;
+	xseed[2] = (unsigned short) workerno;
+
+	for (run = 0; run < shared->runs; run++)
+	{
+		double		r = pg_erand48(xseed) * 100.0;
+		bool		abort = r < shared->abort_percent;
+		int			fault_after = 0;
+
+		if (!abort && r < shared->abort_percent + shared->cancel_percent)
+			fault_after = 1 + (int) (pg_erand48(xseed) *
+									 TEST_MIGRATE_MAX_FAULT_DELAY);
+
+		CHECK_FOR_INTERRUPTS();
+
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pgstat_report_activity(STATE_RUNNING, shared->query);
+
+		PG_TRY();
+		{
+			uint64		processed;
+
+			processed = test_migrate_execute(shared->bitmap, shared->query,
+											 fault_after, false);
+			PopActiveSnapshot();
+
+			if (abort)
+			{
+				AbortCurrentTransaction();
+				pg_atomic_fetch_add_u64(&shared->aborts, 1);
+			}
+			else
+			{
+				CommitTransactionCommand();
+				pg_atomic_fetch_add_u64(&shared->commits, 1);
+				pg_atomic_fetch_add_u64(&shared->tuples, processed);
+			}
+		}
+		PG_CATCH();
+		{
+			ErrorData  *edata;
+
+			MemoryContextSwitchTo(workcxt);
+			edata = CopyErrorData();
+			FlushErrorState();
+			AbortCurrentTransaction();
+
+			switch (edata->sqlerrcode)
+			{
+				case ERRCODE_QUERY_CANCELED:
+					pg_atomic_fetch_add_u64(&shared->cancels, 1);
+					break;
+				case ERRCODE_T_R_SERIALIZATION_FAILURE:
+				case ERRCODE_T_R_DEADLOCK_DETECTED:
+					pg_atomic_fetch_add_u64(&shared->retries, 1);
+					break;
+				default:
+					ReThrowError(edata);
+			}
+			FreeErrorData(edata);
+		}
+		PG_END_TRY();
+
+		pgstat_report_activity(STATE_IDLE, NULL);
+		MemoryContextReset(workcxt);
+	}
+
+	pg_atomic_fetch_add_u32(&shared->finished, 1);
+
+	dsm_detach(seg);
+	proc_exit(0);
+}
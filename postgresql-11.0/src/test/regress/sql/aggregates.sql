@@ -928,3 +928,48 @@ ROLLBACK;
 
 -- test coverage for dense_rank
 SELECT dense_rank(x) WITHIN GROUP (ORDER BY x) FROM (VALUES (1),(1),(2),(2),(3),(3)) v(x) GROUP BY (x) ORDER BY 1;
+
+-- aggregation and hashing of batches of tuples
+SET executor_batch_size = 7;
+SELECT count(*), sum(unique1), max(ten) FROM tenk1 WHERE two = 0;
+SELECT ten, count(*) FROM tenk1 GROUP BY ten ORDER BY ten;
+SELECT count(*) FROM tenk1 a JOIN tenk1 b ON a.unique1 = b.unique2 WHERE b.ten = 3;
+-- each tuple of a batch must keep its own contents even when no qual or
+-- projection has read them before the next tuple is fetched
+SELECT sum(ten), sum(unique1) FROM tenk1;
+CREATE TEMP TABLE batch_keys AS SELECT g AS k FROM generate_series(1, 1000) g;
+SELECT count(*), sum(k.k) FROM tenk1 t JOIN batch_keys k ON t.unique1 = k.k;
+DROP TABLE batch_keys;
+-- the scan's qual is tested over each batch at once; most batches of the
+-- first query fail it entirely
+CREATE TEMP TABLE batch_vals AS
+  SELECT g, CASE WHEN g % 3 <> 0 THEN g END AS v FROM generate_series(1, 1000) g;
+SELECT count(*), sum(v) FROM batch_vals WHERE v > 990;
+SELECT count(*), sum(v) FROM batch_vals WHERE 50 >= v;
+SELECT count(*), sum(g) FROM batch_vals WHERE v IS NULL AND g < 100;
+DROP TABLE batch_vals;
+RESET executor_batch_size;
+
+-- hash aggregation spilling groups to disk once its table outgrows work_mem;
+-- lacking statistics, the planner expects far fewer groups than there are
+CREATE TEMP TABLE agg_spill AS
+  SELECT g % 5000 AS k, g FROM generate_series(0, 19999) g;
+CREATE FUNCTION hashagg_batches(query text) RETURNS int
+LANGUAGE plpgsql AS $$
+DECLARE
+  whole_plan json;
+BEGIN
+  EXECUTE 'EXPLAIN (ANALYZE, FORMAT JSON) ' || query INTO whole_plan;
+  RETURN (whole_plan->0->'Plan'->>'HashAgg Batches')::int;
+END;
+$$;
+SET work_mem = '64kB';
+SELECT hashagg_batches('SELECT k, count(*) FROM agg_spill GROUP BY k') > 1 AS spilled;
+SELECT count(*), sum(cnt), sum(s) FROM
+  (SELECT k, count(*) AS cnt, sum(g) AS s FROM agg_spill GROUP BY k) ss;
+SELECT count(*) FROM
+  (SELECT k, min(g) AS lo, max(g) AS hi, avg(g) AS a FROM agg_spill GROUP BY k) ss
+  WHERE lo <> k OR hi <> k + 15000 OR a <> k + 7500;
+RESET work_mem;
+DROP FUNCTION hashagg_batches(text);
+DROP TABLE agg_spill;
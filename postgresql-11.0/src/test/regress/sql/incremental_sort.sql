@@ -0,0 +1,37 @@
+--
+-- Incremental sort: sorting input already sorted on leading sort keys
+--
+
+create table incsort_tab (a int, b int);
+insert into incsort_tab select i / 100, (i * 7919) % 100
+  from generate_series(1, 10000) i;
+create index on incsort_tab (a);
+analyze incsort_tab;
+
+set enable_incremental_sort = on;
+
+-- the index provides order on a, so only rows with equal a need sorting,
+-- and the limit stops the scan after the groups it needs
+explain (costs off)
+select * from incsort_tab order by a, b limit 5 offset 97;
+select * from incsort_tab order by a, b limit 5 offset 97;
+
+-- small groups are sorted together in batches; check NULLs in either key
+create table incsort_small (a int, b int);
+insert into incsort_small select i / 10, nullif((i * 7) % 13, 3)
+  from generate_series(0, 49) i;
+insert into incsort_small values (null, 5), (null, 1);
+create index on incsort_small (a);
+analyze incsort_small;
+
+set enable_sort = off;
+explain (costs off)
+select a, b from incsort_small order by a, b;
+select a, array_agg(b)
+  from (select a, b from incsort_small order by a, b) s
+  group by a order by a;
+reset enable_sort;
+
+reset enable_incremental_sort;
+drop table incsort_tab;
+drop table incsort_small;
@@ -0,0 +1,47 @@
+--
+-- Lazy ADD COLUMN with a volatile default
+--
+
+CREATE SCHEMA lazy_add_column;
+SET search_path = lazy_add_column;
+SET lazy_add_column = on;
+
+CREATE SEQUENCE seq;
+CREATE TABLE t (id int, pad text);
+INSERT INTO t SELECT g, 'row ' || g FROM generate_series(1, 5) g;
+
+-- rows that predate the column get a value of their own when first read,
+-- and keep it
+ALTER TABLE t ADD COLUMN n int DEFAULT nextval('seq');
+SELECT id, pad, n FROM t ORDER BY id;
+SELECT id, pad, n FROM t ORDER BY id;
+SELECT last_value FROM seq;
+
+-- reading the same row twice in one query gives the same value both times
+ALTER TABLE t ADD COLUMN m float8 DEFAULT random();
+SELECT count(*), count(*) FILTER (WHERE a.m = b.m) AS same FROM t a JOIN t b ON a.id = b.id;
+CREATE TEMP TABLE m_seen AS SELECT id, m FROM t;
+SELECT count(*) FROM t JOIN m_seen s ON t.id = s.id AND t.m = s.m;
+
+-- an UPDATE stores the value it read
+ALTER TABLE t ADD COLUMN k int DEFAULT nextval('seq');
+UPDATE t SET pad = pad || '!' RETURNING id, pad, k;
+SELECT id, pad, k FROM t ORDER BY id;
+
+-- so does COPY TO
+ALTER TABLE t ADD COLUMN c int DEFAULT nextval('seq');
+COPY t (id, c) TO stdout;
+SELECT id, c FROM t ORDER BY id;
+
+-- and a rewrite of the table, for rows not read before
+ALTER TABLE t ADD COLUMN d int DEFAULT nextval('seq');
+CREATE INDEX t_id ON t (id);
+CLUSTER t USING t_id;
+SELECT id, n, k, c, d FROM t ORDER BY id;
+SELECT last_value FROM seq;
+
+-- cleanup; pg_upgrade refuses tables with lazy changes pending, so leave none
+RESET lazy_add_column;
+DROP TABLE t, m_seen;
+DROP SEQUENCE seq;
+DROP SCHEMA lazy_add_column;
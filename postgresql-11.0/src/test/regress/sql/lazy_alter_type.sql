@@ -0,0 +1,96 @@
+--
+-- Lazy ALTER COLUMN TYPE
+--
+
+SET search_path = lazy_alter_type;
+CREATE SCHEMA lazy_alter_type;
+
+CREATE FUNCTION log_rewrite() RETURNS event_trigger
+LANGUAGE plpgsql as
+$func$
+
+declare
+   this_schema text;
+begin
+    select into this_schema relnamespace::regnamespace::text
+    from pg_class
+    where oid = pg_event_trigger_table_rewrite_oid();
+    if this_schema = 'lazy_alter_type'
+    then
+        RAISE NOTICE 'rewriting table % for reason %',
+          pg_event_trigger_table_rewrite_oid()::regclass,
+          pg_event_trigger_table_rewrite_reason();
+    end if;
+end;
+$func$;
+
+CREATE EVENT TRIGGER lazy_alter_type_rewrite
+                  ON table_rewrite
+   EXECUTE PROCEDURE log_rewrite();
+
+CREATE TABLE t (id int PRIMARY KEY, a int4, b int2, c text);
+INSERT INTO t SELECT g, g * 10, g, 'row ' || g FROM generate_series(1, 5) g;
+
+SET lazy_alter_column_type = on;
+
+-- implicit casts through immutable functions don't rewrite
+ALTER TABLE t ALTER COLUMN a TYPE int8;
+ALTER TABLE t ALTER COLUMN b TYPE int4;
+SELECT avversion, avattnum, avtypid::regtype, avcastfunc::regprocedure
+  FROM pg_attribute_version WHERE avrelid = 't'::regclass ORDER BY 1, 2;
+
+-- old rows read as the new types, whatever the scan
+SELECT id, a, pg_typeof(a), b, pg_typeof(b), c FROM t ORDER BY id;
+SET enable_seqscan = off;
+SELECT id, a, b FROM t WHERE id = 4;
+RESET enable_seqscan;
+COPY t TO stdout;
+
+-- old rows can be updated and deleted, including values only the new types hold
+UPDATE t SET a = a * 1000000000, b = b * 100000 WHERE id = 2;
+UPDATE t SET c = c || '!' WHERE id = 3 RETURNING *;
+DELETE FROM t WHERE id = 5 RETURNING a, b;
+
+-- a third change leaves rows of three older versions behind
+ALTER TABLE t ALTER COLUMN b TYPE int8;
+SELECT avversion, avattnum, avtypid::regtype, avcastfunc::regprocedure
+  FROM pg_attribute_version WHERE avrelid = 't'::regclass ORDER BY 1, 2;
+SELECT id, a, b, pg_typeof(b), c FROM t ORDER BY id;
+
+-- convert them in batches
+SELECT pg_upgrade_tuple_versions('t', 1);
+SELECT pg_upgrade_tuple_versions('t', 0);
+SELECT pg_upgrade_tuple_versions('t', 0);
+SELECT * FROM t ORDER BY id;
+
+-- there are no spare versions for a fourth change, so it rewrites
+ALTER TABLE t ALTER COLUMN a TYPE numeric;
+SELECT count(*) FROM pg_attribute_version WHERE avrelid = 't'::regclass;
+
+-- casts that can fail, and USING, rewrite too
+ALTER TABLE t ALTER COLUMN c TYPE varchar(10);
+ALTER TABLE t ALTER COLUMN b TYPE int8 USING b + 1;
+
+-- a rewrite by VACUUM FULL forgets the history
+ALTER TABLE t ALTER COLUMN b TYPE numeric;
+SELECT count(*) FROM pg_attribute_version WHERE avrelid = 't'::regclass;
+VACUUM FULL t;
+SELECT count(*) FROM pg_attribute_version WHERE avrelid = 't'::regclass;
+SELECT id, a, b, pg_typeof(b), c FROM t ORDER BY id;
+
+-- a batch of scanned tuples keeps its own copy of each converted tuple
+CREATE TABLE bt (id int, v int4);
+INSERT INTO bt SELECT g, g FROM generate_series(1, 100) g;
+ALTER TABLE bt ALTER COLUMN v TYPE int8;
+SET executor_batch_size = 16;
+SELECT count(*), sum(v), min(v), max(v) FROM bt;
+SELECT count(*), sum(v) FROM bt WHERE id % 2 = 0;
+RESET executor_batch_size;
+DROP TABLE bt;
+
+-- cleanup; pg_upgrade refuses tables with lazy changes pending, so leave none
+RESET lazy_alter_column_type;
+DROP TABLE t;
+DROP EVENT TRIGGER lazy_alter_type_rewrite;
+DROP FUNCTION log_rewrite;
+DROP SCHEMA lazy_alter_type;
@@ -91,6 +91,13 @@ explain (costs off)
 	select length(stringu1) from tenk1 group by length(stringu1);
 select length(stringu1) from tenk1 group by length(stringu1);
 
+-- test parallel hashed aggregation into a shared hash table
+set enable_parallel_hashagg to on;
+explain (costs off)
+	select ten, count(*), sum(unique1), max(four) from tenk1 group by ten order by ten;
+select ten, count(*), sum(unique1), max(four) from tenk1 group by ten order by ten;
+reset enable_parallel_hashagg;
+
 explain (costs off)
 	select stringu1, count(*) from tenk1 group by stringu1 order by stringu1;
 